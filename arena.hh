@@ -0,0 +1,220 @@
+#ifndef HIREDIS11_ARENA_H_
+#define HIREDIS11_ARENA_H_
+#include <hiredis/hiredis.h>
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <algorithm>
+
+namespace hiredis
+{
+namespace reply
+{
+
+/*
+ Bump allocator for reply trees.
+ Every node, element table and string payload of the replies read into
+ an arena is carved out of a few large blocks. Nothing is released
+ individually; reset() or destruction releases the whole batch at once.
+ e.g.
+ reply::arena a;
+ pipeline p(c);
+ ...
+ auto replies = p.execute(a);
+*/
+class arena
+{
+private:
+	struct block
+	{
+		std::unique_ptr<char[]> data;
+		std::size_t size;
+		std::size_t used;
+	};
+	std::vector<block> blocks;
+	std::size_t current;
+	std::size_t block_size;
+	redisReplyObjectFunctions fn;
+
+	static auto node(const redisReadTask* task) -> redisReply*
+	{
+		auto a = static_cast<arena*>(task->privdata);
+		auto r = new (a->allocate(sizeof(redisReply), alignof(redisReply))) redisReply();
+		r->type = task->type;
+		if(task->parent)
+		{
+			auto parent = static_cast<redisReply*>(task->parent->obj);
+			parent->element[task->idx] = r;
+		}
+		return r;
+	}
+	static void* create_string(const redisReadTask* task, char* str, size_t len)
+	{
+		auto a = static_cast<arena*>(task->privdata);
+		auto data = static_cast<char*>(a->allocate(len + 1, 1));
+		std::memcpy(data, str, len);
+		data[len] = 0;
+
+		auto r = node(task);
+		r->str = data;
+		r->len = len;
+		return r;
+	}
+	static void* create_array(const redisReadTask* task, int elements)
+	{
+		auto a = static_cast<arena*>(task->privdata);
+		auto r = node(task);
+		r->elements = elements;
+		if(elements > 0)
+			r->element = static_cast<redisReply**>(a->allocate(elements * sizeof(redisReply*), alignof(redisReply*)));
+		return r;
+	}
+	static void* create_integer(const redisReadTask* task, long long value)
+	{
+		auto r = node(task);
+		r->integer = value;
+		return r;
+	}
+	static void* create_nil(const redisReadTask* task)
+	{
+		return node(task);
+	}
+	static void free_object(void*)
+	{
+		// Storage is owned by the arena.
+	}
+
+	auto grow(std::size_t size) -> block&
+	{
+		for(++current; current < blocks.size(); ++current)
+		{
+			if(blocks[current].size >= size)
+				return blocks[current];
+		}
+		auto n = std::max(size, block_size);
+		blocks.push_back({std::unique_ptr<char[]>(new char[n]), n, 0});
+		current = blocks.size() - 1;
+		return blocks.back();
+	}
+public:
+	explicit arena(std::size_t block_size = 64 * 1024)
+	 : current(0), block_size(block_size), fn()
+	{
+		fn.createString = create_string;
+		fn.createArray = create_array;
+		fn.createInteger = create_integer;
+		fn.createNil = create_nil;
+		fn.freeObject = free_object;
+
+		blocks.push_back({std::unique_ptr<char[]>(new char[block_size]), block_size, 0});
+	}
+
+	arena(const arena&) = delete;
+	arena& operator=(const arena&) = delete;
+
+	arena(arena&&) = default;
+	arena& operator=(arena&&) = default;
+
+	auto allocate(std::size_t size, std::size_t align) -> void*
+	{
+		auto b = &blocks[current];
+		auto offset = (b->used + align - 1) & ~(align - 1);
+		if(offset + size > b->size)
+		{
+			b = &grow(size + align);
+			offset = (b->used + align - 1) & ~(align - 1);
+		}
+		b->used = offset + size;
+		return b->data.get() + offset;
+	}
+
+	/*
+	 Release every reply read into the arena.
+	 Blocks are kept for reuse by the next batch.
+	*/
+	void reset()
+	{
+		for(auto& b : blocks)
+			b.used = 0;
+		current = 0;
+	}
+
+	// Total bytes reserved by the arena.
+	auto capacity() const -> std::size_t
+	{
+		std::size_t n = 0;
+		for(auto& b : blocks)
+			n += b.size;
+		return n;
+	}
+
+	// Reader callbacks; the reader's privdata must point at this arena.
+	auto functions() -> redisReplyObjectFunctions*
+	{
+		return &fn;
+	}
+};
+
+/*
+ Non-owning handle to a reply node.
+ Copying is free (no reference count); the handle is valid for as long
+ as the storage that owns the node, typically an arena.
+*/
+class ref
+{
+private:
+	const redisReply* r;
+public:
+	ref(const redisReply* r = nullptr)
+	 : r(r)
+	{
+	}
+
+	auto type() const -> int
+	{
+		return r->type;
+	}
+	auto is_nill() const -> bool
+	{
+		return r->type == REDIS_REPLY_NIL;
+	}
+	auto integer() const -> long long
+	{
+		return r->integer;
+	}
+	auto data() const -> const char*
+	{
+		return r->str;
+	}
+
+	// String length, or element count for arrays.
+	auto size() const -> std::size_t
+	{
+		return r->type == REDIS_REPLY_ARRAY ? r->elements : static_cast<std::size_t>(r->len);
+	}
+
+	auto operator[](std::size_t i) const -> ref
+	{
+		return r->element[i];
+	}
+	auto begin() const -> const redisReply* const*
+	{
+		return r->element;
+	}
+	auto end() const -> const redisReply* const*
+	{
+		return r->element + r->elements;
+	}
+
+	operator const redisReply*() const
+	{
+		return r;
+	}
+};
+
+}
+}
+
+#endif /* HIREDIS11_ARENA_H_ */
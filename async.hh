@@ -0,0 +1,763 @@
+#ifndef HIREDIS11_ASYNC_H_
+#define HIREDIS11_ASYNC_H_
+#include <hiredis/hiredis.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <exception>
+#include <functional>
+#include <vector>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include "reply.hh"
+#include "error.hh"
+
+namespace hiredis
+{
+
+class async_context;
+
+namespace coro
+{
+class batch_awaiter;
+template <typename T>
+class awaitable;
+}
+
+/*
+ Single threaded loop driving any number of async_contexts.
+ All callbacks, timers and posted functions run on the thread calling run().
+ I/O uses poll() unless built with HIREDIS11_IO_URING, in which case
+ io_uring is used where the kernel supports it and epoll otherwise
+ (see uring.hh).
+*/
+class event_loop
+{
+public:
+	typedef std::chrono::steady_clock clock;
+	static const std::size_t npos = static_cast<std::size_t>(-1);
+
+	enum class backend
+	{
+		// Best available.
+		automatic,
+		poll,
+		epoll,
+		io_uring
+	};
+
+	/*
+	 Intrusive timer; expire() is called on the loop thread.
+	 A scheduled timer must be cancelled before it is destroyed.
+	*/
+	struct timer
+	{
+		clock::time_point when;
+		std::size_t index;
+
+		timer()
+		 : index(npos)
+		{
+		}
+		virtual void expire() = 0;
+	protected:
+		~timer()
+		{
+		}
+	};
+
+	/*
+	 Moves bytes for the loop's contexts in place of poll().
+	 Transports may keep per-context state in async_context::io.
+	*/
+	struct transport
+	{
+		virtual ~transport()
+		{
+		}
+		virtual auto name() const -> const char* = 0;
+		// Context is being destroyed; release its state.
+		virtual void remove(async_context& ac) = 0;
+		// Service the contexts, waiting at most timeout ms (-1 for no limit).
+		virtual void wait(event_loop& ev, int timeout) = 0;
+	};
+private:
+	friend class async_context;
+	friend class epoll_transport;
+	friend class uring_transport;
+
+	std::vector<async_context*> contexts;
+	std::vector<timer*> timers;
+	std::vector<std::function<void()>> posted;
+	std::mutex posted_mutex;
+	int wake[2];
+	bool stopped;
+	std::unique_ptr<transport> io;
+
+	static auto make_transport(backend b) -> std::unique_ptr<transport>;
+
+	void add(async_context& ac)
+	{
+		contexts.push_back(&ac);
+	}
+	void remove(async_context& ac);
+	void drain_wake()
+	{
+		char buf[64];
+		while(read(wake[0], buf, sizeof(buf)) > 0)
+		{
+		}
+	}
+
+	// Indexed binary min-heap on timer::when.
+	void place(std::size_t i, timer* t)
+	{
+		timers[i] = t;
+		t->index = i;
+	}
+	void sift_up(std::size_t i)
+	{
+		auto t = timers[i];
+		while(i > 0)
+		{
+			auto parent = (i - 1) / 2;
+			if(!(t->when < timers[parent]->when))
+				break;
+			place(i, timers[parent]);
+			i = parent;
+		}
+		place(i, t);
+	}
+	void sift_down(std::size_t i)
+	{
+		auto t = timers[i];
+		auto n = timers.size();
+		while(true)
+		{
+			auto child = 2 * i + 1;
+			if(child >= n)
+				break;
+			if(child + 1 < n && timers[child + 1]->when < timers[child]->when)
+				++child;
+			if(!(timers[child]->when < t->when))
+				break;
+			place(i, timers[child]);
+			i = child;
+		}
+		place(i, t);
+	}
+
+	void run_posted()
+	{
+		std::vector<std::function<void()>> work;
+		{
+			std::lock_guard<std::mutex> lock(posted_mutex);
+			work.swap(posted);
+		}
+		for(auto& fn : work)
+			fn();
+	}
+	void expire_timers()
+	{
+		auto now = clock::now();
+		while(!timers.empty() && !(now < timers.front()->when))
+		{
+			auto t = timers.front();
+			cancel(*t);
+			t->expire();
+		}
+	}
+	void poll_once();
+public:
+	explicit event_loop(backend b = backend::automatic)
+	 : stopped(false), io(make_transport(b))
+	{
+		if(pipe(wake) != 0)
+			throw std::runtime_error("Unable to create event loop wake pipe");
+		fcntl(wake[0], F_SETFL, O_NONBLOCK);
+		fcntl(wake[1], F_SETFL, O_NONBLOCK);
+	}
+	~event_loop()
+	{
+		close(wake[0]);
+		close(wake[1]);
+	}
+
+	event_loop(const event_loop&) = delete;
+	event_loop& operator=(const event_loop&) = delete;
+
+	// e.g. "poll", "epoll" or "io_uring".
+	auto transport_name() const -> const char*
+	{
+		return io ? io->name() : "poll";
+	}
+
+	void schedule(timer& t, clock::time_point when)
+	{
+		if(t.index != npos)
+			cancel(t);
+		t.when = when;
+		timers.push_back(&t);
+		sift_up(timers.size() - 1);
+	}
+	void cancel(timer& t)
+	{
+		if(t.index == npos)
+			return;
+		auto i = t.index;
+		auto last = timers.back();
+		timers.pop_back();
+		t.index = npos;
+		if(last != &t)
+		{
+			place(i, last);
+			sift_up(i);
+			sift_down(last->index);
+		}
+	}
+
+	// Queue a function to run on the loop thread. Safe to call from any thread.
+	void post(std::function<void()> fn)
+	{
+		{
+			std::lock_guard<std::mutex> lock(posted_mutex);
+			posted.push_back(std::move(fn));
+		}
+		char b = 0;
+		ssize_t res = write(wake[1], &b, 1);
+		(void)res;
+	}
+
+	/*
+	 Run until done() returns true or stop() is called.
+	 done() is checked after every batch of events.
+	*/
+	void run_until(const std::function<bool()>& done)
+	{
+		stopped = false;
+		while(true)
+		{
+			run_posted();
+			expire_timers();
+			if(stopped || done())
+				break;
+			poll_once();
+		}
+	}
+	void run()
+	{
+		run_until([]{ return false; });
+	}
+	void stop()
+	{
+		post([this]{ stopped = true; });
+	}
+};
+
+/*
+ Cooperative cancellation.
+ cancel() fails every command or await registered against the source
+ with cancelled_error; the abandoned replies are read and discarded.
+ Must be used from the loop thread of the registered commands.
+*/
+class cancellation_source
+{
+public:
+	struct registration
+	{
+		registration* prev = nullptr;
+		registration* next = nullptr;
+		virtual void cancelled() = 0;
+	protected:
+		~registration()
+		{
+		}
+	};
+private:
+	registration* head = nullptr;
+	bool flag = false;
+public:
+	cancellation_source() = default;
+	cancellation_source(const cancellation_source&) = delete;
+	cancellation_source& operator=(const cancellation_source&) = delete;
+
+	bool cancelled() const
+	{
+		return flag;
+	}
+	void add(registration& r)
+	{
+		r.prev = nullptr;
+		r.next = head;
+		if(head)
+			head->prev = &r;
+		head = &r;
+	}
+	void remove(registration& r)
+	{
+		if(r.prev)
+			r.prev->next = r.next;
+		else if(head == &r)
+			head = r.next;
+		if(r.next)
+			r.next->prev = r.prev;
+		r.prev = r.next = nullptr;
+	}
+	void cancel()
+	{
+		flag = true;
+		while(head)
+		{
+			auto r = head;
+			remove(*r);
+			r->cancelled();
+		}
+	}
+};
+
+/*
+ Non-blocking connection driven by an event_loop.
+ Commands are queued with a completion handler and written out in
+ batches by the loop; replies complete the handlers in order.
+ e.g.
+ event_loop loop;
+ async_context ac(loop, "localhost", 6379);
+ ac.command({"GET", "foo"}, [](reply::reply_t reply, std::exception_ptr error) { ... });
+ loop.run_until(...);
+*/
+class async_context
+{
+public:
+	struct error : std::runtime_error
+	{
+		error(const std::string& what)
+		 : std::runtime_error(what)
+		{
+		}
+	};
+
+	/*
+	 Completion for a queued command.
+	 Intrusive, so callers that own their completion state (e.g. coroutine
+	 awaiters) queue commands without allocating.
+	 On connection failure reply is null and error is set.
+	*/
+	struct handler
+	{
+		virtual void complete(reply::reply_t reply, std::exception_ptr error) = 0;
+	protected:
+		~handler()
+		{
+		}
+	};
+
+	typedef std::function<void(reply::reply_t, std::exception_ptr)> callback;
+private:
+	friend class event_loop;
+	friend class epoll_transport;
+	friend class uring_transport;
+	friend class coro::batch_awaiter;
+	template <typename T>
+	friend class coro::awaitable;
+
+	struct discard_handler : handler
+	{
+		void complete(reply::reply_t, std::exception_ptr) override
+		{
+		}
+	};
+	struct callback_handler : handler
+	{
+		callback fn;
+
+		callback_handler(callback fn)
+		 : fn(std::move(fn))
+		{
+		}
+		void complete(reply::reply_t reply, std::exception_ptr error) override
+		{
+			std::unique_ptr<callback_handler> self(this);
+			fn(reply, error);
+		}
+	};
+
+	/*
+	 Callback with a deadline and a cancellation token; the first of the
+	 reply, the deadline and the token completes it.
+	*/
+	struct bounded_handler : handler, event_loop::timer, cancellation_source::registration
+	{
+		async_context& ac;
+		callback fn;
+		cancellation_source* token;
+
+		bounded_handler(async_context& ac, callback fn, cancellation_source* token)
+		 : ac(ac), fn(std::move(fn)), token(token)
+		{
+		}
+		void finish(reply::reply_t reply, std::exception_ptr error)
+		{
+			std::unique_ptr<bounded_handler> self(this);
+			ac.ev.cancel(*this);
+			if(token)
+				token->remove(*this);
+			fn(reply, error);
+		}
+		void complete(reply::reply_t reply, std::exception_ptr error) override
+		{
+			finish(reply, error);
+		}
+		void expire() override
+		{
+			ac.cancel(*this);
+			++ac.timeouts;
+			finish({}, std::make_exception_ptr(timeout_error("Command deadline exceeded.")));
+		}
+		void cancelled() override
+		{
+			ac.cancel(*this);
+			finish({}, std::make_exception_ptr(cancelled_error("Command cancelled.")));
+		}
+	};
+
+	event_loop& ev;
+	std::shared_ptr<redisContext> c;
+	std::deque<handler*> pending;
+	// Encoded commands not yet handed to the socket.
+	std::string out;
+	// Transport state, see event_loop::transport.
+	void* io;
+	unsigned long long timeouts;
+
+	static auto discard() -> handler&
+	{
+		static discard_handler h;
+		return h;
+	}
+
+	void fail(const std::string& what)
+	{
+		auto err = std::make_exception_ptr(error(what));
+		// Context is not reusable.
+		c.reset();
+		out.clear();
+		std::deque<handler*> failed;
+		failed.swap(pending);
+		for(auto h : failed)
+			h->complete({}, err);
+	}
+	void critical_error()
+	{
+		fail(c->errstr);
+	}
+
+	bool wants_read() const
+	{
+		return c && !pending.empty();
+	}
+	bool wants_write() const
+	{
+		return c && !out.empty();
+	}
+	void on_writable()
+	{
+		auto n = send(c->fd, out.data(), out.size(), MSG_NOSIGNAL);
+		if(n < 0)
+		{
+			if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return;
+			return fail(std::strerror(errno));
+		}
+		out.erase(0, n);
+	}
+	void on_readable()
+	{
+		if(redisBufferRead(c.get()) == REDIS_ERR)
+			return critical_error();
+		read_replies();
+	}
+	// Bytes received by a transport that reads the socket itself.
+	void on_data(const char* buf, std::size_t len)
+	{
+		if(redisReaderFeed(c->reader, buf, len) != REDIS_OK)
+			return fail("Unable to buffer reply.");
+		read_replies();
+	}
+	void read_replies()
+	{
+		while(c)
+		{
+			void* r;
+			if(redisGetReplyFromReader(c.get(), &r) == REDIS_ERR)
+				return critical_error();
+			if(!r)
+				break;
+
+			reply::reply_t reply(static_cast<redisReply*>(r), freeReplyObject);
+			if(pending.empty())
+				return fail("Unexpected reply with no pending command.");
+			auto h = pending.front();
+			pending.pop_front();
+			h->complete(reply, {});
+		}
+	}
+public:
+	async_context(event_loop& ev, const std::string& ip, int port)
+	 : ev(ev), c(redisConnectNonBlock(ip.c_str(), port), redisFree), io(nullptr), timeouts(0)
+	{
+		if(!c)
+			throw error("Unable to create context");
+		if(c->err)
+			throw error(c->errstr);
+		ev.add(*this);
+	}
+	~async_context()
+	{
+		ev.remove(*this);
+		if(c)
+			fail("Context destroyed with pending commands.");
+	}
+
+	async_context(const async_context&) = delete;
+	async_context& operator=(const async_context&) = delete;
+
+	auto loop() -> event_loop&
+	{
+		return ev;
+	}
+	bool connected() const
+	{
+		return c != nullptr;
+	}
+	auto pending_count() const -> std::size_t
+	{
+		return pending.size();
+	}
+	// Commands that missed their deadline on this context.
+	auto timeout_count() const -> unsigned long long
+	{
+		return timeouts;
+	}
+
+	/*
+	 Queue a command; h is completed on the loop thread.
+	 h must stay alive until it is completed or cancelled.
+	*/
+	void command(const std::vector<std::string>& args, handler& h)
+	{
+		if(!c)
+			throw error("Context is not connected.");
+
+		// Encoded straight into the output buffer.
+		out += '*';
+		out += std::to_string(args.size());
+		out += "\r\n";
+		for(auto& a : args)
+		{
+			out += '$';
+			out += std::to_string(a.size());
+			out += "\r\n";
+			out += a;
+			out += "\r\n";
+		}
+		pending.push_back(&h);
+	}
+	void command(const std::vector<std::string>& args, callback fn)
+	{
+		std::unique_ptr<callback_handler> h(new callback_handler(std::move(fn)));
+		command(args, *h);
+		h.release();
+	}
+	/*
+	 Queue a command whose fn gets timeout_error if no reply has arrived by
+	 deadline, or cancelled_error once token is cancelled. The late reply is
+	 still read, keeping the stream in order, and discarded. If token is
+	 already cancelled fn is called at once and nothing is sent.
+	 e.g.
+	 cancellation_source stop;
+	 ac.command({"GET", "foo"}, fn, event_loop::clock::now() + std::chrono::milliseconds(20), &stop);
+	*/
+	void command(const std::vector<std::string>& args, callback fn, event_loop::clock::time_point deadline, cancellation_source* token = nullptr)
+	{
+		if(token && token->cancelled())
+			return fn({}, std::make_exception_ptr(cancelled_error("Command cancelled.")));
+
+		std::unique_ptr<bounded_handler> h(new bounded_handler(*this, std::move(fn), token));
+		command(args, *h);
+		if(deadline != event_loop::clock::time_point::max())
+			ev.schedule(*h, deadline);
+		if(token)
+			token->add(*h);
+		h.release();
+	}
+	void command(const std::vector<std::string>& args, callback fn, cancellation_source& token)
+	{
+		command(args, std::move(fn), event_loop::clock::time_point::max(), &token);
+	}
+
+	// Queue a command already encoded as RESP, e.g. by prepared_command.
+	void append_formatted(const char* cmd, std::size_t len, handler& h)
+	{
+		if(!c)
+			throw error("Context is not connected.");
+
+		out.append(cmd, len);
+		pending.push_back(&h);
+	}
+	void append_formatted(const char* cmd, std::size_t len, callback fn)
+	{
+		std::unique_ptr<callback_handler> h(new callback_handler(std::move(fn)));
+		append_formatted(cmd, len, *h);
+		h.release();
+	}
+
+	/*
+	 Detach h from its queued commands.
+	 The replies are still read, keeping the stream in order, and discarded.
+	*/
+	void cancel(handler& h)
+	{
+		std::replace(begin(pending), end(pending), &h, &discard());
+	}
+};
+
+inline void event_loop::remove(async_context& ac)
+{
+	if(io)
+		io->remove(ac);
+	std::replace(begin(contexts), end(contexts), &ac, static_cast<async_context*>(nullptr));
+}
+
+#ifndef HIREDIS11_IO_URING
+inline auto event_loop::make_transport(backend b) -> std::unique_ptr<transport>
+{
+	if(b != backend::automatic && b != backend::poll)
+		throw std::runtime_error("Event loop backend not available; build with HIREDIS11_IO_URING.");
+	return {};
+}
+#endif
+
+inline void event_loop::poll_once()
+{
+	contexts.erase(std::remove(begin(contexts), end(contexts), static_cast<async_context*>(nullptr)), end(contexts));
+
+	int timeout = -1;
+	if(!timers.empty())
+	{
+		auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(timers.front()->when - clock::now());
+		timeout = static_cast<int>(std::max<long long>(0, wait.count() + 1));
+	}
+	if(io)
+		return io->wait(*this, timeout);
+
+	std::vector<pollfd> fds;
+	std::vector<std::size_t> active;
+	fds.push_back({wake[0], POLLIN, 0});
+	for(std::size_t i = 0; i < contexts.size(); ++i)
+	{
+		auto ac = contexts[i];
+		short events = 0;
+		if(ac->wants_read())
+			events |= POLLIN;
+		if(ac->wants_write())
+			events |= POLLOUT;
+		if(!events)
+			continue;
+		fds.push_back({ac->c->fd, events, 0});
+		active.push_back(i);
+	}
+
+	if(poll(fds.data(), fds.size(), timeout) <= 0)
+		return;
+
+	if(fds[0].revents)
+		drain_wake();
+	for(std::size_t i = 0; i < active.size(); ++i)
+	{
+		// Contexts may be destroyed while dispatching; removal only nulls the slot.
+		auto ac = contexts[active[i]];
+		auto revents = fds[i + 1].revents;
+		if(!ac)
+			continue;
+		if((revents & POLLOUT) && ac->wants_write())
+			ac->on_writable();
+		if((revents & (POLLIN | POLLERR | POLLHUP)) && ac->c)
+			ac->on_readable();
+	}
+}
+
+/*
+ A fixed set of event loops, each on its own thread.
+ Contexts are bound to one loop; spread them with next() and create and
+ use them from that loop's thread, e.g. inside a function given to post().
+*/
+class executor
+{
+private:
+	std::vector<std::unique_ptr<event_loop>> loops;
+	std::vector<std::thread> threads;
+	std::atomic<std::size_t> counter;
+public:
+	explicit executor(std::size_t n = std::thread::hardware_concurrency())
+	 : counter(0)
+	{
+		n = std::max<std::size_t>(n, 1);
+		for(std::size_t i = 0; i < n; ++i)
+			loops.emplace_back(new event_loop());
+		for(auto& l : loops)
+		{
+			auto loop = l.get();
+			threads.emplace_back([loop]{ loop->run(); });
+		}
+	}
+	~executor()
+	{
+		stop();
+	}
+
+	executor(const executor&) = delete;
+	executor& operator=(const executor&) = delete;
+
+	auto size() const -> std::size_t
+	{
+		return loops.size();
+	}
+	auto operator[](std::size_t i) -> event_loop&
+	{
+		return *loops[i];
+	}
+	// Round-robin loop selection.
+	auto next() -> event_loop&
+	{
+		return *loops[counter++ % loops.size()];
+	}
+
+	void stop()
+	{
+		for(auto& l : loops)
+			l->stop();
+		for(auto& t : threads)
+		{
+			if(t.joinable())
+				t.join();
+		}
+	}
+};
+
+}
+
+#ifdef HIREDIS11_IO_URING
+#include "uring.hh"
+#endif
+
+#endif /* HIREDIS11_ASYNC_H_ */
@@ -0,0 +1,363 @@
+#ifndef HIREDIS11_CAPTURE_H_
+#define HIREDIS11_CAPTURE_H_
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "context.hh"
+#include "command_info.hh"
+#include "error.hh"
+
+namespace hiredis
+{
+namespace capture
+{
+
+/*
+ File layout; varints are LEB128:
+ header  "H11CAP01", u64 little endian unix time of the start in us
+ record* varint ns since the previous record (the first: since the start),
+         varint stream, varint argc, argc times varint length and bytes
+ A stream is the sending thread, so each stream is in the order its
+ commands were sent. A truncated last record is ignored.
+*/
+namespace detail
+{
+const char header[] = "H11CAP01";
+const std::size_t magic_size = 8;
+const std::size_t header_size = 16;
+
+inline void put_varint(std::string& buf, std::uint64_t v)
+{
+	while(v >= 0x80)
+	{
+		buf.push_back(static_cast<char>(v | 0x80));
+		v >>= 7;
+	}
+	buf.push_back(static_cast<char>(v));
+}
+// False if the varint runs past end.
+inline bool get_varint(const char*& p, const char* end, std::uint64_t& v)
+{
+	v = 0;
+	for(int shift = 0; p < end && shift < 64; shift += 7)
+	{
+		auto b = static_cast<unsigned char>(*p++);
+		v |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+		if(!(b & 0x80))
+			return true;
+	}
+	return false;
+}
+
+inline auto fnv1a(std::uint64_t seed, const char* s, std::size_t len) -> std::uint64_t
+{
+	std::uint64_t h = 0xcbf29ce484222325ull ^ seed;
+	for(std::size_t i = 0; i < len; ++i)
+	{
+		h ^= static_cast<unsigned char>(s[i]);
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+// Small per-thread id, stable for the thread's life.
+inline auto stream_id() -> std::uint64_t
+{
+	static std::atomic<std::uint64_t> next(0);
+	static thread_local std::uint64_t id = next++;
+	return id;
+}
+}
+
+/*
+ Records the commands sent by the observed contexts (and so by their
+ pipelines) with timestamps, for replay by hiredis11-replay.
+ Senders only encode the command into a shared buffer under a short lock;
+ a background thread writes it out once it fills or every second. If the
+ writer falls a full buffer behind, commands are dropped and counted
+ rather than stalling the senders.
+ With anonymize, key arguments (positions from command_info) become a
+ salted hash, e.g. "k:9f86d081884c7d65", so a log keeps its key
+ distribution and hot keys without their names. Values are kept.
+ e.g.
+ capture::writer log("traffic.cap", {true, 42});
+ c.observe(&log);
+*/
+class writer : public command_observer
+{
+public:
+	typedef std::chrono::steady_clock clock;
+
+	struct options
+	{
+		bool anonymize;
+		std::uint64_t salt;
+		// Bytes buffered before a write.
+		std::size_t buffer;
+
+		options(bool anonymize = false, std::uint64_t salt = 0, std::size_t buffer = 1 << 20)
+		 : anonymize(anonymize), salt(salt), buffer(buffer)
+		{
+		}
+	};
+private:
+	int fd;
+	options o;
+	std::mutex m;
+	std::condition_variable wake;
+	std::string active;
+	clock::time_point last;
+	bool stopping;
+	bool broken;
+	std::atomic<std::uint64_t> recorded;
+	std::atomic<std::uint64_t> lost;
+	std::thread worker;
+
+	bool write_out(const std::string& buf)
+	{
+		std::size_t done = 0;
+		while(done < buf.size())
+		{
+			auto n = ::write(fd, buf.data() + done, buf.size() - done);
+			if(n < 0)
+			{
+				if(errno == EINTR)
+					continue;
+				return false;
+			}
+			done += n;
+		}
+		return true;
+	}
+	void run()
+	{
+		std::string writing;
+		std::unique_lock<std::mutex> lock(m);
+		while(true)
+		{
+			wake.wait_for(lock, std::chrono::seconds(1), [this]{ return stopping || active.size() >= o.buffer; });
+			writing.swap(active);
+			auto stop = stopping;
+			lock.unlock();
+			auto ok = write_out(writing);
+			writing.clear();
+			lock.lock();
+			// Nothing to report to; the rest of the log is dropped.
+			if(!ok)
+				broken = true;
+			if(stop && active.empty())
+				return;
+		}
+	}
+public:
+	explicit writer(const std::string& path, const options& o = options())
+	 : fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)), o(o), last(clock::now()), stopping(false), broken(false), recorded(0), lost(0)
+	{
+		if(fd < 0)
+			throw error("Unable to create " + path + ": " + std::strerror(errno));
+		std::string head(detail::header, detail::magic_size);
+		auto start = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+		for(int i = 0; i < 8; ++i)
+			head.push_back(static_cast<char>(static_cast<std::uint64_t>(start) >> (8 * i)));
+		if(!write_out(head))
+		{
+			::close(fd);
+			throw error("Unable to write " + path + ": " + std::strerror(errno));
+		}
+		active.reserve(this->o.buffer);
+		worker = std::thread([this]{ run(); });
+	}
+	// Contexts must stop observing first.
+	~writer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m);
+			stopping = true;
+		}
+		wake.notify_one();
+		worker.join();
+		::close(fd);
+	}
+
+	writer(const writer&) = delete;
+	writer& operator=(const writer&) = delete;
+
+	void sent(std::size_t argc, const char* const* argv, const std::size_t* argvlen) override
+	{
+		// Encoded outside the lock.
+		static thread_local std::string encoded;
+		static thread_local std::vector<std::uint64_t> hashed;
+		encoded.clear();
+		hashed.assign(argc, 0);
+		if(o.anonymize && argc)
+		{
+			auto spec = command_info::lookup({argv[0], argvlen[0]});
+			if(spec)
+				command_info::for_each_key(*spec, argc, argv, argvlen, [&](std::size_t i)
+				{
+					hashed[i] = detail::fnv1a(o.salt, argv[i], argvlen[i]) | 1;
+				});
+		}
+		detail::put_varint(encoded, detail::stream_id());
+		detail::put_varint(encoded, argc);
+		for(std::size_t i = 0; i < argc; ++i)
+		{
+			if(!hashed[i])
+			{
+				detail::put_varint(encoded, argvlen[i]);
+				encoded.append(argv[i], argvlen[i]);
+				continue;
+			}
+			static const char hex[] = "0123456789abcdef";
+			char key[18] = {'k', ':'};
+			for(int d = 0; d < 16; ++d)
+				key[2 + d] = hex[(hashed[i] >> (60 - 4 * d)) & 0xf];
+			detail::put_varint(encoded, sizeof(key));
+			encoded.append(key, sizeof(key));
+		}
+
+		bool full;
+		{
+			std::lock_guard<std::mutex> lock(m);
+			if(broken || active.size() >= 2 * o.buffer)
+			{
+				++lost;
+				return;
+			}
+			// Taken under the lock so records are in time order.
+			auto now = clock::now();
+			detail::put_varint(active, std::chrono::duration_cast<std::chrono::nanoseconds>(now - last).count());
+			last = now;
+			active += encoded;
+			full = active.size() >= o.buffer;
+		}
+		++recorded;
+		if(full)
+			wake.notify_one();
+	}
+
+	auto records() const -> std::uint64_t
+	{
+		return recorded;
+	}
+	// Commands not recorded because the writer fell behind or failed.
+	auto dropped() const -> std::uint64_t
+	{
+		return lost;
+	}
+};
+
+struct record
+{
+	// Since the start of the capture.
+	std::chrono::nanoseconds offset;
+	std::uint64_t stream;
+	std::vector<std::string> args;
+};
+
+/*
+ Reads a capture file in record order.
+ e.g.
+ capture::reader log("traffic.cap");
+ capture::record r;
+ while(log.next(r))
+	 ...
+*/
+class reader
+{
+private:
+	int fd;
+	const char* data;
+	std::size_t size;
+	const char* pos;
+	std::chrono::nanoseconds elapsed;
+public:
+	explicit reader(const std::string& path)
+	 : fd(::open(path.c_str(), O_RDONLY)), data(nullptr), size(0), pos(nullptr), elapsed(0)
+	{
+		if(fd < 0)
+			throw error("Unable to open " + path + ": " + std::strerror(errno));
+		struct stat st;
+		if(::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(detail::header_size))
+		{
+			::close(fd);
+			throw error("Not a capture: " + path);
+		}
+		size = st.st_size;
+		auto m = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		if(m == MAP_FAILED)
+		{
+			::close(fd);
+			throw error("Unable to map " + path);
+		}
+		data = static_cast<const char*>(m);
+		::madvise(m, size, MADV_SEQUENTIAL);
+		if(std::memcmp(data, detail::header, detail::magic_size) != 0)
+		{
+			::munmap(m, size);
+			::close(fd);
+			throw error("Not a capture: " + path);
+		}
+		pos = data + detail::header_size;
+	}
+	~reader()
+	{
+		::munmap(const_cast<char*>(data), size);
+		::close(fd);
+	}
+
+	reader(const reader&) = delete;
+	reader& operator=(const reader&) = delete;
+
+	// Wall clock time the capture started.
+	auto started() const -> std::chrono::system_clock::time_point
+	{
+		std::uint64_t us = 0;
+		for(int i = 0; i < 8; ++i)
+			us |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[detail::magic_size + i])) << (8 * i);
+		return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::microseconds(us)));
+	}
+
+	// False at the end of the log.
+	bool next(record& r)
+	{
+		auto end = data + size;
+		auto p = pos;
+		std::uint64_t delta, stream, argc;
+		if(!detail::get_varint(p, end, delta) || !detail::get_varint(p, end, stream) || !detail::get_varint(p, end, argc))
+			return false;
+		if(argc > static_cast<std::uint64_t>(end - p))
+			return false;
+		r.args.resize(argc);
+		for(auto& a : r.args)
+		{
+			std::uint64_t len;
+			if(!detail::get_varint(p, end, len) || len > static_cast<std::uint64_t>(end - p))
+				return false;
+			a.assign(p, len);
+			p += len;
+		}
+		elapsed += std::chrono::nanoseconds(delta);
+		r.offset = elapsed;
+		r.stream = stream;
+		pos = p;
+		return true;
+	}
+};
+
+}
+}
+
+#endif /* HIREDIS11_CAPTURE_H_ */
@@ -0,0 +1,450 @@
+#ifndef HIREDIS11_CODEC_H_
+#define HIREDIS11_CODEC_H_
+#include <hiredis/hiredis.h>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include "reply.hh"
+#include "error.hh"
+
+namespace hiredis
+{
+
+/*
+ Value compression with an LZ4 block format compressor.
+ Values of at least threshold bytes are compressed and prefixed with a
+ header (4 byte magic, 4 byte little endian raw size); values that do not
+ shrink and values below the threshold are stored as is, so values
+ written without the codec read back unchanged. A raw value that itself
+ begins with a magic is stored behind the literal magic "\xfeLZ0", so it
+ is never taken for a compressed one.
+ Not thread-safe: encoding reuses one hash table and both directions
+ update the statistics, so threads (and the compressed_contexts sharing
+ a codec) need a codec each or a lock around it.
+*/
+class codec
+{
+public:
+	static const std::size_t header_size = 8;
+
+	struct statistics
+	{
+		unsigned long long compressed;
+		unsigned long long decompressed;
+		// Raw and stored size of compressed values.
+		unsigned long long raw_bytes;
+		unsigned long long stored_bytes;
+		std::chrono::nanoseconds compress_time;
+		std::chrono::nanoseconds decompress_time;
+
+		statistics()
+		 : compressed(0), decompressed(0), raw_bytes(0), stored_bytes(0), compress_time(0), decompress_time(0)
+		{
+		}
+
+		auto bytes_saved() const -> long long
+		{
+			return static_cast<long long>(raw_bytes) - static_cast<long long>(stored_bytes);
+		}
+	};
+private:
+	static const int hash_log = 14;
+	static const int min_hash_log = 8;
+	static const std::size_t min_match = 4;
+	// The format requires the last literals and the last match start to keep clear of the end.
+	static const std::size_t last_literals = 5;
+	static const std::size_t match_margin = 12;
+	static const std::size_t max_offset = 65535;
+
+	std::size_t threshold;
+	statistics s;
+	std::vector<std::uint32_t> table;
+
+	static auto magic() -> const char*
+	{
+		return "\xfeLZ4";
+	}
+	// Marks a raw value stored with a prefix because it begins with a magic.
+	static auto literal_magic() -> const char*
+	{
+		return "\xfeLZ0";
+	}
+	static bool literal(const char* data, std::size_t len)
+	{
+		return len >= 4 && std::memcmp(data, literal_magic(), 4) == 0;
+	}
+	static bool reserved(const std::string& value)
+	{
+		return compressed(value.data(), value.size()) || literal(value.data(), value.size());
+	}
+	static auto escape(const std::string& value) -> std::string
+	{
+		return reserved(value) ? literal_magic() + value : value;
+	}
+	static auto read32(const unsigned char* p) -> std::uint32_t
+	{
+		std::uint32_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+	static void put_length(unsigned char*& op, std::size_t n)
+	{
+		for(; n >= 255; n -= 255)
+			*op++ = 255;
+		*op++ = static_cast<unsigned char>(n);
+	}
+
+	// Compress into out, which must hold bound(len) bytes. Returns the compressed size.
+	auto compress_block(const unsigned char* in, std::size_t len, unsigned char* out) -> std::size_t
+	{
+		// A table no larger than the input, so short values do not clear 64 KiB.
+		int bits = min_hash_log;
+		while(bits < hash_log && (std::size_t(1) << bits) < len)
+			++bits;
+		table.assign(std::size_t(1) << bits, 0);
+		auto op = out;
+		std::size_t anchor = 0;
+		std::size_t ip = 0;
+
+		auto emit = [&op, in](std::size_t literals_begin, std::size_t literals, std::size_t offset, std::size_t match)
+		{
+			auto token = op++;
+			*token = static_cast<unsigned char>(std::min<std::size_t>(literals, 15) << 4);
+			if(literals >= 15)
+				put_length(op, literals - 15);
+			std::memcpy(op, in + literals_begin, literals);
+			op += literals;
+			if(!match)
+				return;
+			*op++ = static_cast<unsigned char>(offset);
+			*op++ = static_cast<unsigned char>(offset >> 8);
+			auto extra = match - min_match;
+			*token |= static_cast<unsigned char>(std::min<std::size_t>(extra, 15));
+			if(extra >= 15)
+				put_length(op, extra - 15);
+		};
+
+		if(len > match_margin)
+		{
+			auto limit = len - match_margin;
+			auto match_limit = len - last_literals;
+			while(ip < limit)
+			{
+				auto seq = read32(in + ip);
+				auto h = (seq * 2654435761u) >> (32 - bits);
+				std::size_t ref = table[h];
+				table[h] = static_cast<std::uint32_t>(ip);
+				if(ip == 0 || ref >= ip || ip - ref > max_offset || read32(in + ref) != seq)
+				{
+					++ip;
+					continue;
+				}
+
+				auto match = min_match;
+				while(ip + match < match_limit && in[ref + match] == in[ip + match])
+					++match;
+				emit(anchor, ip - anchor, ip - ref, match);
+				ip += match;
+				anchor = ip;
+			}
+		}
+		emit(anchor, len - anchor, 0, 0);
+		return op - out;
+	}
+
+	static void decompress_block(const unsigned char* in, std::size_t len, unsigned char* out, std::size_t size)
+	{
+		auto ip = in;
+		auto end = in + len;
+		auto op = out;
+		auto out_end = out + size;
+		auto corrupt = []{ throw error("Corrupt compressed value."); };
+		auto length = [&](std::size_t n) -> std::size_t
+		{
+			if(n != 15)
+				return n;
+			unsigned char b;
+			do
+			{
+				if(ip >= end)
+					corrupt();
+				b = *ip++;
+				n += b;
+			} while(b == 255);
+			return n;
+		};
+
+		while(true)
+		{
+			if(ip >= end)
+				corrupt();
+			auto token = *ip++;
+			auto literals = length(token >> 4);
+			if(literals > static_cast<std::size_t>(end - ip) || literals > static_cast<std::size_t>(out_end - op))
+				corrupt();
+			std::memcpy(op, ip, literals);
+			ip += literals;
+			op += literals;
+			if(ip == end)
+				break;
+
+			if(end - ip < 2)
+				corrupt();
+			std::size_t offset = ip[0] | (ip[1] << 8);
+			ip += 2;
+			auto match = length(token & 15) + min_match;
+			if(!offset || offset > static_cast<std::size_t>(op - out) || match > static_cast<std::size_t>(out_end - op))
+				corrupt();
+			// Overlapping copies repeat the pattern, so copy bytewise.
+			auto ref = op - offset;
+			for(std::size_t i = 0; i < match; ++i)
+				*op++ = *ref++;
+		}
+		if(op != out_end)
+			corrupt();
+	}
+public:
+	explicit codec(std::size_t threshold = 1024)
+	 : threshold(threshold)
+	{
+	}
+
+	static auto bound(std::size_t len) -> std::size_t
+	{
+		return len + len / 255 + 16;
+	}
+
+	// True if the stored value carries the compression header.
+	static bool compressed(const char* data, std::size_t len)
+	{
+		return len >= header_size && std::memcmp(data, magic(), 4) == 0;
+	}
+	/*
+	 Size of the value once decoded. Throws if a compressed value claims more
+	 than its block could expand to, so a corrupt header cannot trigger a
+	 huge allocation.
+	*/
+	static auto decoded_size(const char* data, std::size_t len) -> std::size_t
+	{
+		if(literal(data, len))
+			return len - 4;
+		if(!compressed(data, len))
+			return len;
+		auto p = reinterpret_cast<const unsigned char*>(data) + 4;
+		std::size_t size = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::size_t>(p[3]) << 24);
+		// Each byte of a block expands to at most 255 bytes.
+		if(size > (len - header_size) * 255)
+			throw error("Corrupt compressed value.");
+		return size;
+	}
+
+	// Value as it should be stored.
+	auto encode(const std::string& value) -> std::string
+	{
+		if(value.size() < threshold || value.size() > 0xffffffffu)
+			return escape(value);
+
+		auto start = std::chrono::steady_clock::now();
+		std::string stored(header_size + bound(value.size()), '\0');
+		auto out = reinterpret_cast<unsigned char*>(&stored[0]);
+		std::memcpy(out, magic(), 4);
+		for(int i = 0; i < 4; ++i)
+			out[4 + i] = static_cast<unsigned char>(value.size() >> (8 * i));
+		auto n = compress_block(reinterpret_cast<const unsigned char*>(value.data()), value.size(), out + header_size);
+		s.compress_time += std::chrono::steady_clock::now() - start;
+
+		if(header_size + n >= value.size())
+			return escape(value);
+		stored.resize(header_size + n);
+		++s.compressed;
+		s.raw_bytes += value.size();
+		s.stored_bytes += stored.size();
+		return stored;
+	}
+
+	/*
+	 Decode a stored value into out, which must hold decoded_size() bytes.
+	 Returns the decoded size.
+	*/
+	auto decode(const char* data, std::size_t len, char* out) -> std::size_t
+	{
+		if(literal(data, len))
+		{
+			std::memcpy(out, data + 4, len - 4);
+			return len - 4;
+		}
+		if(!compressed(data, len))
+		{
+			std::memcpy(out, data, len);
+			return len;
+		}
+		auto start = std::chrono::steady_clock::now();
+		auto size = decoded_size(data, len);
+		decompress_block(reinterpret_cast<const unsigned char*>(data) + header_size, len - header_size, reinterpret_cast<unsigned char*>(out), size);
+		s.decompress_time += std::chrono::steady_clock::now() - start;
+		++s.decompressed;
+		return size;
+	}
+	auto decode(const std::string& stored) -> std::string
+	{
+		if(literal(stored.data(), stored.size()))
+			return stored.substr(4);
+		if(!compressed(stored.data(), stored.size()))
+			return stored;
+		std::string value(decoded_size(stored.data(), stored.size()), '\0');
+		decode(stored.data(), stored.size(), &value[0]);
+		return value;
+	}
+
+	/*
+	 Decode every compressed string in a reply in place.
+	 Each node's buffer is replaced by one the value is decompressed into
+	 directly; the reply must have been allocated by hiredis.
+	*/
+	void decode(redisReply* r)
+	{
+		if(r->type == REDIS_REPLY_ARRAY)
+		{
+			for(std::size_t i = 0; i < r->elements; ++i)
+				decode(r->element[i]);
+			return;
+		}
+		if(r->type != REDIS_REPLY_STRING)
+			return;
+		if(literal(r->str, r->len))
+		{
+			r->len -= 4;
+			std::memmove(r->str, r->str + 4, r->len + 1);
+			return;
+		}
+		if(!compressed(r->str, r->len))
+			return;
+
+		auto size = decoded_size(r->str, r->len);
+		auto buf = static_cast<char*>(std::malloc(size + 1));
+		if(!buf)
+			throw std::bad_alloc();
+		try
+		{
+			decode(r->str, r->len, buf);
+		}
+		catch(...)
+		{
+			std::free(buf);
+			throw;
+		}
+		buf[size] = 0;
+		std::free(r->str);
+		r->str = buf;
+		r->len = size;
+	}
+
+	auto stats() const -> const statistics&
+	{
+		return s;
+	}
+	void reset_stats()
+	{
+		s = statistics();
+	}
+};
+
+/*
+ Context adapter compressing values written and decompressing values
+ read, so the wrapped commands and types work unchanged:
+ codec z;
+ compressed_context<context> db(c, z);
+ commands::string::set(db, "doc", json);
+ auto doc = commands::string::get(db, "doc");
+ Handles string (SET, SETEX, PSETEX, SETNX, GETSET, MSET, MSETNX) and hash
+ (HSET, HMSET, HSETNX) values; other commands pass through.
+*/
+template <typename Context>
+class compressed_context
+{
+private:
+	Context& c;
+	codec& z;
+	std::deque<bool> decoding;
+
+	static auto upper(std::string s) -> std::string
+	{
+		std::transform(begin(s), end(s), begin(s), ::toupper);
+		return s;
+	}
+
+	auto encode(const std::vector<std::string>& args) -> std::vector<std::string>
+	{
+		if(args.empty())
+			return args;
+
+		auto name = upper(args[0]);
+		std::size_t first = 0;
+		std::size_t step = 1;
+		if(name == "SET" || name == "SETNX" || name == "GETSET")
+			first = 2;
+		else if(name == "SETEX" || name == "PSETEX" || name == "HSETNX")
+			first = 3;
+		else if(name == "MSET" || name == "MSETNX")
+			first = 2, step = 2;
+		else if(name == "HSET" || name == "HMSET")
+			first = 3, step = 2;
+		else
+			return args;
+
+		auto encoded = args;
+		for(std::size_t i = first; i < encoded.size(); i += step)
+		{
+			encoded[i] = z.encode(encoded[i]);
+			if(step == 1)
+				break;
+		}
+		return encoded;
+	}
+	static bool decodes(const std::vector<std::string>& args)
+	{
+		if(args.empty())
+			return false;
+		auto name = upper(args[0]);
+		return name == "GET" || name == "GETSET" || name == "MGET" || name == "HGET" || name == "HMGET" || name == "HGETALL" || name == "HVALS";
+	}
+public:
+	compressed_context(Context& c, codec& z)
+	 : c(c), z(z)
+	{
+	}
+
+	auto command(const std::vector<std::string>& args) -> reply::reply_t
+	{
+		auto r = c.command(encode(args));
+		if(decodes(args))
+			z.decode(r.get());
+		return r;
+	}
+
+	void append_command(const std::vector<std::string>& args)
+	{
+		c.append_command(encode(args));
+		decoding.push_back(decodes(args));
+	}
+	auto get_reply() -> reply::reply_t
+	{
+		auto r = c.get_reply();
+		bool decode = !decoding.empty() && decoding.front();
+		if(!decoding.empty())
+			decoding.pop_front();
+		if(decode)
+			z.decode(r.get());
+		return r;
+	}
+};
+
+}
+
+#endif /* HIREDIS11_CODEC_H_ */
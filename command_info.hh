@@ -0,0 +1,249 @@
+#ifndef HIREDIS11_COMMAND_INFO_H_
+#define HIREDIS11_COMMAND_INFO_H_
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+
+namespace hiredis
+{
+namespace command_info
+{
+
+/*
+ Key positions of a command, as reported by COMMAND INFO.
+ first/last/step index into the argument vector (0 is the command name);
+ a negative last counts back from the end.
+ numkeys, when non-zero, is the position of a key count argument and the
+ keys follow it (EVAL, ZUNIONSTORE...).
+readonly commands never modify data and may be served by a replica.
+*/
+struct spec
+{
+	const char* name;
+	int first;
+	int last;
+	int step;
+	int numkeys;
+	bool readonly;
+};
+
+inline auto compare(const char* a, const char* b) -> int
+{
+	for(; *a && *b; ++a, ++b)
+	{
+		int d = std::toupper(static_cast<unsigned char>(*a)) - std::toupper(static_cast<unsigned char>(*b));
+		if(d)
+			return d;
+	}
+	return std::toupper(static_cast<unsigned char>(*a)) - std::toupper(static_cast<unsigned char>(*b));
+}
+
+// Sorted by name.
+inline auto table() -> const std::vector<spec>&
+{
+	static const std::vector<spec> specs{
+		{"APPEND", 1, 1, 1, 0, false},
+		{"BITCOUNT", 1, 1, 1, 0, true},
+		{"BITFIELD", 1, 1, 1, 0, false},
+		{"BITFIELD_RO", 1, 1, 1, 0, true},
+		{"BITOP", 2, -1, 1, 0, false},
+		{"BITPOS", 1, 1, 1, 0, true},
+		{"BLPOP", 1, -2, 1, 0, false},
+		{"BRPOP", 1, -2, 1, 0, false},
+		{"BRPOPLPUSH", 1, 2, 1, 0, false},
+		{"DBSIZE", 0, 0, 0, 0, true},
+		{"DECR", 1, 1, 1, 0, false},
+		{"DECRBY", 1, 1, 1, 0, false},
+		{"DEL", 1, -1, 1, 0, false},
+		{"DUMP", 1, 1, 1, 0, true},
+		{"EVAL", 0, 0, 1, 2, false},
+		{"EVALSHA", 0, 0, 1, 2, false},
+		{"EXISTS", 1, -1, 1, 0, true},
+		{"EXPIRE", 1, 1, 1, 0, false},
+		{"EXPIREAT", 1, 1, 1, 0, false},
+		{"GET", 1, 1, 1, 0, true},
+		{"GETBIT", 1, 1, 1, 0, true},
+		{"GETRANGE", 1, 1, 1, 0, true},
+		{"GETSET", 1, 1, 1, 0, false},
+		{"HDEL", 1, 1, 1, 0, false},
+		{"HEXISTS", 1, 1, 1, 0, true},
+		{"HGET", 1, 1, 1, 0, true},
+		{"HGETALL", 1, 1, 1, 0, true},
+		{"HINCRBY", 1, 1, 1, 0, false},
+		{"HINCRBYFLOAT", 1, 1, 1, 0, false},
+		{"HKEYS", 1, 1, 1, 0, true},
+		{"HLEN", 1, 1, 1, 0, true},
+		{"HMGET", 1, 1, 1, 0, true},
+		{"HMSET", 1, 1, 1, 0, false},
+		{"HSCAN", 1, 1, 1, 0, true},
+		{"HSET", 1, 1, 1, 0, false},
+		{"HSETNX", 1, 1, 1, 0, false},
+		{"HVALS", 1, 1, 1, 0, true},
+		{"INCR", 1, 1, 1, 0, false},
+		{"INCRBY", 1, 1, 1, 0, false},
+		{"INCRBYFLOAT", 1, 1, 1, 0, false},
+		{"KEYS", 0, 0, 0, 0, true},
+		{"LINDEX", 1, 1, 1, 0, true},
+		{"LINSERT", 1, 1, 1, 0, false},
+		{"LLEN", 1, 1, 1, 0, true},
+		{"LPOP", 1, 1, 1, 0, false},
+		{"LPUSH", 1, 1, 1, 0, false},
+		{"LPUSHX", 1, 1, 1, 0, false},
+		{"LRANGE", 1, 1, 1, 0, true},
+		{"LREM", 1, 1, 1, 0, false},
+		{"LSET", 1, 1, 1, 0, false},
+		{"LTRIM", 1, 1, 1, 0, false},
+		{"MGET", 1, -1, 1, 0, true},
+		{"MOVE", 1, 1, 1, 0, false},
+		{"MSET", 1, -1, 2, 0, false},
+		{"MSETNX", 1, -1, 2, 0, false},
+		{"OBJECT", 2, 2, 1, 0, true},
+		{"PERSIST", 1, 1, 1, 0, false},
+		{"PEXPIRE", 1, 1, 1, 0, false},
+		{"PEXPIREAT", 1, 1, 1, 0, false},
+		{"PFADD", 1, 1, 1, 0, false},
+		{"PFCOUNT", 1, -1, 1, 0, true},
+		{"PSETEX", 1, 1, 1, 0, false},
+		{"PTTL", 1, 1, 1, 0, true},
+		{"RANDOMKEY", 0, 0, 0, 0, true},
+		{"RENAME", 1, 2, 1, 0, false},
+		{"RENAMENX", 1, 2, 1, 0, false},
+		{"RESTORE", 1, 1, 1, 0, false},
+		{"RPOP", 1, 1, 1, 0, false},
+		{"RPOPLPUSH", 1, 2, 1, 0, false},
+		{"RPUSH", 1, 1, 1, 0, false},
+		{"RPUSHX", 1, 1, 1, 0, false},
+		{"SADD", 1, 1, 1, 0, false},
+		{"SCAN", 0, 0, 0, 0, true},
+		{"SCARD", 1, 1, 1, 0, true},
+		{"SDIFF", 1, -1, 1, 0, true},
+		{"SDIFFSTORE", 1, -1, 1, 0, false},
+		{"SET", 1, 1, 1, 0, false},
+		{"SETBIT", 1, 1, 1, 0, false},
+		{"SETEX", 1, 1, 1, 0, false},
+		{"SETNX", 1, 1, 1, 0, false},
+		{"SETRANGE", 1, 1, 1, 0, false},
+		{"SINTER", 1, -1, 1, 0, true},
+		{"SINTERSTORE", 1, -1, 1, 0, false},
+		{"SISMEMBER", 1, 1, 1, 0, true},
+		{"SMEMBERS", 1, 1, 1, 0, true},
+		{"SMOVE", 1, 2, 1, 0, false},
+		{"SORT", 1, 1, 1, 0, false},
+		{"SPOP", 1, 1, 1, 0, false},
+		{"SRANDMEMBER", 1, 1, 1, 0, true},
+		{"SREM", 1, 1, 1, 0, false},
+		{"SSCAN", 1, 1, 1, 0, true},
+		{"STRLEN", 1, 1, 1, 0, true},
+		{"SUNION", 1, -1, 1, 0, true},
+		{"SUNIONSTORE", 1, -1, 1, 0, false},
+		{"TOUCH", 1, -1, 1, 0, true},
+		{"TTL", 1, 1, 1, 0, true},
+		{"TYPE", 1, 1, 1, 0, true},
+		{"UNLINK", 1, -1, 1, 0, false},
+		{"WATCH", 1, -1, 1, 0, false},
+		{"ZADD", 1, 1, 1, 0, false},
+		{"ZCARD", 1, 1, 1, 0, true},
+		{"ZCOUNT", 1, 1, 1, 0, true},
+		{"ZINCRBY", 1, 1, 1, 0, false},
+		{"ZINTERSTORE", 1, 1, 1, 2, false},
+		{"ZRANGE", 1, 1, 1, 0, true},
+		{"ZRANGEBYLEX", 1, 1, 1, 0, true},
+		{"ZRANGEBYSCORE", 1, 1, 1, 0, true},
+		{"ZRANK", 1, 1, 1, 0, true},
+		{"ZREM", 1, 1, 1, 0, false},
+		{"ZREMRANGEBYRANK", 1, 1, 1, 0, false},
+		{"ZREMRANGEBYSCORE", 1, 1, 1, 0, false},
+		{"ZREVRANGE", 1, 1, 1, 0, true},
+		{"ZREVRANGEBYSCORE", 1, 1, 1, 0, true},
+		{"ZREVRANK", 1, 1, 1, 0, true},
+		{"ZSCAN", 1, 1, 1, 0, true},
+		{"ZSCORE", 1, 1, 1, 0, true},
+		{"ZUNIONSTORE", 1, 1, 1, 2, false},
+	};
+	return specs;
+}
+
+// Spec for the named command, or null if it is unknown.
+inline auto lookup(const std::string& name) -> const spec*
+{
+	auto& specs = table();
+	auto it = std::lower_bound(begin(specs), end(specs), name, [](const spec& s, const std::string& n) { return compare(s.name, n.c_str()) < 0; });
+	if(it == end(specs) || compare(it->name, name.c_str()) != 0)
+		return nullptr;
+	return &*it;
+}
+
+/*
+ Call fn(position) for each key argument of a command, in order.
+ Unknown commands have no keys.
+*/
+template <typename Fn>
+inline void for_each_key(const std::vector<std::string>& args, Fn fn)
+{
+	if(args.empty())
+		return;
+	auto s = lookup(args[0]);
+	if(!s)
+		return;
+
+	int argc = args.size();
+	if(s->first)
+	{
+		int last = s->last < 0 ? argc + s->last : s->last;
+		for(int i = s->first; i <= last && i < argc; i += s->step)
+			fn(static_cast<std::size_t>(i));
+	}
+	if(s->numkeys && s->numkeys < argc)
+	{
+		int n = std::atoi(args[s->numkeys].c_str());
+		for(int i = s->numkeys + 1; i <= s->numkeys + n && i < argc; ++i)
+			fn(static_cast<std::size_t>(i));
+	}
+}
+
+/*
+ As above, for a command in raw argument buffers whose spec is known,
+ e.g. as seen by a command_observer.
+*/
+template <typename Fn>
+inline void for_each_key(const spec& s, std::size_t argc, const char* const* argv, const std::size_t* argvlen, Fn fn)
+{
+	int n = argc;
+	if(s.first)
+	{
+		int last = s.last < 0 ? n + s.last : s.last;
+		for(int i = s.first; i <= last && i < n; i += s.step)
+			fn(static_cast<std::size_t>(i));
+	}
+	if(s.numkeys && s.numkeys < n)
+	{
+		int keys = std::atoi(std::string(argv[s.numkeys], argvlen[s.numkeys]).c_str());
+		for(int i = s.numkeys + 1; i <= s.numkeys + keys && i < n; ++i)
+			fn(static_cast<std::size_t>(i));
+	}
+}
+
+// True if the command is known not to write.
+inline bool readonly(const std::vector<std::string>& args)
+{
+	if(args.empty())
+		return false;
+	auto s = lookup(args[0]);
+	return s && s->readonly;
+}
+
+// Position of the first key argument, or 0 if the command has none.
+inline auto first_key(const std::vector<std::string>& args) -> std::size_t
+{
+	std::size_t first = 0;
+	for_each_key(args, [&first](std::size_t i) { if(!first) first = i; });
+	return first;
+}
+
+}
+}
+
+#endif /* HIREDIS11_COMMAND_INFO_H_ */
@@ -2,11 +2,16 @@
 #define HIREDIS11_COMMANDS_H_
 #include "context.hh"
 #include "reply.hh"
+#include "schema.hh"
 #include <string>
 #include <ctime>
 #include <chrono>
 #include <vector>
 #include <map>
+#include <deque>
+#include <iterator>
+#include <exception>
+#include <stdexcept>
 #include <boost/optional.hpp>
 
 namespace hiredis
@@ -14,6 +19,97 @@ namespace hiredis
 namespace commands
 {
 
+/*
+ Size limits for the *_many batch commands.
+ Input is split into commands of at most max_keys keys and roughly
+ max_bytes of arguments, so one huge request does not stall the server;
+ up to depth of those commands are pipelined before reading replies.
+ max_keys and max_bytes must be non-zero; the batch commands throw
+ std::invalid_argument otherwise.
+*/
+struct batch_limits
+{
+	std::size_t max_keys;
+	std::size_t max_bytes;
+	std::size_t depth;
+	
+	batch_limits(std::size_t max_keys = 512, std::size_t max_bytes = 512 * 1024, std::size_t depth = 16)
+	 : max_keys(max_keys), max_bytes(max_bytes), depth(depth)
+	{
+	}
+};
+
+namespace detail
+{
+/*
+ Send [first, last) as a pipeline of commands starting with prefix.
+ add(args, item) appends an item's arguments and returns their size;
+ read(reply, offset, count) is called for each command's reply in order.
+ Every reply is read even if one fails, so the context stays usable.
+*/
+template<typename Context, typename Iterator, typename Add, typename Read>
+inline void chunked(Context& c, const std::vector<std::string>& prefix, Iterator first, Iterator last, const batch_limits& limits, Add add, Read read)
+{
+	// A zero limit would never take a key and loop sending empty commands.
+	if(limits.max_keys == 0 || limits.max_bytes == 0)
+		throw std::invalid_argument("batch_limits max_keys and max_bytes must be non-zero.");
+	
+	std::deque<std::pair<std::size_t, std::size_t>> in_flight;
+	std::exception_ptr failure;
+	auto collect = [&]
+	{
+		auto chunk = in_flight.front();
+		in_flight.pop_front();
+		auto reply = c.get_reply();
+		try
+		{
+			if(reply->type == REDIS_REPLY_ERROR)
+				throw error({reply->str, static_cast<size_t>(reply->len)});
+			read(reply, chunk.first, chunk.second);
+		}
+		catch(...)
+		{
+			if(!failure)
+				failure = std::current_exception();
+		}
+	};
+	
+	std::size_t offset = 0;
+	while(first != last)
+	{
+		auto args = prefix;
+		std::size_t n = 0;
+		std::size_t bytes = 0;
+		for(; first != last && n < limits.max_keys && (n == 0 || bytes < limits.max_bytes); ++first, ++n)
+			bytes += add(args, *first);
+		
+		if(in_flight.size() >= std::max<std::size_t>(limits.depth, 1))
+			collect();
+		c.append_command(args);
+		in_flight.emplace_back(offset, n);
+		offset += n;
+	}
+	while(!in_flight.empty())
+		collect();
+	
+	if(failure)
+		std::rethrow_exception(failure);
+}
+
+// Decode an array of bulk strings / nils into out[offset, offset + count).
+inline void optional_strings(const redisReply* r, std::vector<boost::optional<std::string>>& out, std::size_t offset, std::size_t count)
+{
+	if(r->type != REDIS_REPLY_ARRAY || r->elements != count)
+		throw error("multi-key result not equal to key count");
+	for(std::size_t i = 0; i < count; ++i)
+	{
+		auto e = r->element[i];
+		if(!reply::is_nill(e))
+			out[offset + i] = std::string{e->str, static_cast<size_t>(e->len)};
+	}
+}
+}
+
 // #    #  ######   #   #
 // #   #   #         # #
 // ####    #####      #
@@ -23,42 +119,43 @@ namespace commands
 namespace key
 {
 // Delete a key
-template<typename Key, typename... Keys>
-inline auto del(context& c, Key key, Keys... keys) -> long long
+template<typename Context, typename Key, typename... Keys>
+inline auto del(Context& c, Key key, Keys... keys) -> long long
 {
 	return reply::integer{c.command({"DEL", key, keys...})};
 }
 
 // Return a serialized version of the value stored at the specified key.
-template<typename Key>
-inline auto dump(context& c, Key key) -> std::string
+template<typename Context, typename Key>
+inline auto dump(Context& c, Key key) -> std::string
 {
 	return reply::string{c.command({"DUMP", key})};
 }
 
 // Determine if a key exists
-template<typename Key>
-inline auto exists(context& c, Key key) -> bool
+template<typename Context, typename Key>
+inline auto exists(Context& c, Key key) -> bool
 {
 	return reply::integer{c.command({"EXISTS", key})};
 }
 
 // Set a key's time to live in seconds
-template<typename Key>
-inline auto expire(context& c, Key key, std::chrono::seconds ttl) -> bool
+template<typename Context, typename Key>
+inline auto expire(Context& c, Key key, std::chrono::seconds ttl) -> bool
 {
 	return reply::integer{c.command({"EXPIRE", key, std::to_string(ttl.count())})};
 }
 
 // Set the expiration for a key as a UNIX timestamp
-template<typename Key>
-inline auto expire_at(context& c, Key key, std::time_t timestamp) -> bool
+template<typename Context, typename Key>
+inline auto expire_at(Context& c, Key key, std::time_t timestamp) -> bool
 {
 	return reply::integer{c.command({"EXPIREAT", key, std::to_string(timestamp)})};
 }
 
 // Find all keys matching the given pattern
-inline auto keys(context& c, const std::string& pattern) -> std::vector<std::string>
+template<typename Context>
+inline auto keys(Context& c, const std::string& pattern) -> std::vector<std::string>
 {
 	auto array = reply::array{c.command({"KEYS", pattern})};
 	std::vector<std::string> keys;
@@ -72,83 +169,120 @@ inline auto keys(context& c, const std::string& pattern) -> std::vector<std::str
 //Atomically transfer a key from a Redis instance to another one.
 
 // Move a key to another database
-template<typename Key>
-inline auto move(context& c, Key key, int db) -> bool
+template<typename Context, typename Key>
+inline auto move(Context& c, Key key, int db) -> bool
 {
 	return reply::integer{c.command({"MOVE", key, std::to_string(db)})};
 }
 
-//OBJECT subcommand [arguments [arguments ...]]
-//Inspect the internals of Redis objects
+// Get the internal encoding of the value stored at key
+template<typename Context, typename Key>
+inline auto object_encoding(Context& c, Key key) -> boost::optional<std::string>
+{
+	auto value = c.command({"OBJECT", "ENCODING", key});
+	if(reply::is_nill(value))
+		return {};
+	return {true, reply::string{value}};
+}
+
+// Get the number of bytes a key and its value use in RAM
+template<typename Context, typename Key>
+inline auto memory_usage(Context& c, Key key) -> boost::optional<long long>
+{
+	auto value = c.command({"MEMORY", "USAGE", key});
+	if(reply::is_nill(value))
+		return {};
+	return {true, reply::integer{value}.value};
+}
 
 // Remove the expiration from a key
-template<typename Key>
-inline auto persist(context& c, Key key) -> bool
+template<typename Context, typename Key>
+inline auto persist(Context& c, Key key) -> bool
 {
 	return reply::integer{c.command({"PERSIST", key})};
 }
 
 // Set a key's time to live in milliseconds
-template<typename Key>
-inline auto expire(context& c, Key key, std::chrono::milliseconds ttl) -> bool
+template<typename Context, typename Key>
+inline auto expire(Context& c, Key key, std::chrono::milliseconds ttl) -> bool
 {
 	return reply::integer{c.command({"PEXPIRE", key, std::to_string(ttl.count())})};
 }
 
 // Set the expiration for a key as a UNIX timestamp specified in milliseconds
-template<typename Key>
-inline auto expire_at_ms(context& c, Key key, uint64_t timestamp) -> bool
+template<typename Context, typename Key>
+inline auto expire_at_ms(Context& c, Key key, uint64_t timestamp) -> bool
 {
 	return reply::integer{c.command({"PEXPIREAT", key, std::to_string(timestamp)})};
 }
 
 // Get the time to live for a key in milliseconds
-template<typename Key>
-inline auto ttl_ms(context& c, Key key) -> std::chrono::milliseconds
+template<typename Context, typename Key>
+inline auto ttl_ms(Context& c, Key key) -> std::chrono::milliseconds
 {
-	return reply::integer{c.command({"PTTL", key})};
+	return std::chrono::milliseconds{reply::integer{c.command({"PTTL", key})}.value};
 }
 
 // Return a random key from the keyspace
-inline auto random(context& c) -> std::string
+template<typename Context>
+inline auto random(Context& c) -> std::string
 {
 	return reply::string{c.command({"RANDOMKEY"})};
 }
 
 // Rename a key
-template<typename Key>
-inline auto rename(context& c, Key key, Key newkey) -> std::string
+template<typename Context, typename Key>
+inline auto rename(Context& c, Key key, Key newkey) -> std::string
 {
 	return reply::status{c.command({"RENAME", key, newkey})};
 }
 
 // Rename a key, only if the new key does not exist
-template<typename Key>
-inline auto renamenx(context& c, Key key, Key newkey) -> bool
+template<typename Context, typename Key>
+inline auto renamenx(Context& c, Key key, Key newkey) -> bool
 {
 	return reply::integer{c.command({"RENAMENX", key, newkey})};
 }
 
 // Create a key using the provided serialized value, previously obtained using DUMP.
-template<typename Key>
-inline auto restore(context& c, Key key, int ttl, const std::string& dump) -> std::string
+template<typename Context, typename Key>
+inline auto restore(Context& c, Key key, int ttl, const std::string& dump) -> std::string
 {
 	return reply::status{c.command({"RESTORE", key, std::to_string(ttl), dump})};
 }
 
+/*
+ Incrementally iterate the keyspace.
+ Returns the next cursor ("0" when done) and a batch of keys.
+*/
+template<typename Context>
+inline auto scan(Context& c, const std::string& cursor, const std::string& pattern = {}, long long count = 0) -> std::pair<std::string, std::vector<std::string>>
+{
+	std::vector<std::string> args{"SCAN", cursor};
+	if(!pattern.empty())
+		args.insert(args.end(), {"MATCH", pattern});
+	if(count > 0)
+		args.insert(args.end(), {"COUNT", std::to_string(count)});
+	
+	auto value = c.command(args);
+	if(value->type != REDIS_REPLY_ARRAY || value->elements != 2)
+		throw error("SCAN result not 2 elements");
+	return {reply::string{value->element[0]}, reply::string_array{value->element[1]}};
+}
+
 //SORT key [BY pattern] [LIMIT offset count] [GET pattern [GET pattern ...]] [ASC|DESC] [ALPHA] [STORE destination]
 //Sort the elements in a list, set or sorted set
 
 // Get the time to live for a key
-template<typename Key>
-inline auto ttl(context& c, Key key) -> std::chrono::seconds
+template<typename Context, typename Key>
+inline auto ttl(Context& c, Key key) -> std::chrono::seconds
 {
-	return reply::integer{c.command({"TTL", key})};
+	return std::chrono::seconds{reply::integer{c.command({"TTL", key})}.value};
 }
 
 // Determine the type stored at key
-template<typename Key>
-inline auto type(context& c, Key key) -> std::string
+template<typename Context, typename Key>
+inline auto type(Context& c, Key key) -> std::string
 {
 	return reply::status{c.command({"TYPE", key})};
 }
@@ -163,35 +297,65 @@ inline auto type(context& c, Key key) -> std::string
 namespace string
 {
 // Append a value to a key
-template<typename Key, typename Value>
-inline auto append(context& c, Key key, Value value) -> std::string
+template<typename Context, typename Key, typename Value>
+inline auto append(Context& c, Key key, Value value) -> std::string
 {
 	return reply::status{c.command({"APPEND", key, value})};
 }
 
-//BITCOUNT key [start] [end]
-//Count set bits in a string
+// Count set bits in a string
+template<typename Context, typename Key>
+inline auto bit_count(Context& c, Key key) -> long long
+{
+	return reply::integer{c.command({"BITCOUNT", key})};
+}
+// Count set bits in the bytes [start, end] of a string
+template<typename Context, typename Key>
+inline auto bit_count(Context& c, Key key, long long start, long long end) -> long long
+{
+	return reply::integer{c.command({"BITCOUNT", key, std::to_string(start), std::to_string(end)})};
+}
+
+/*
+ Perform bitwise operations between strings
+ operation is one of AND, OR, XOR, NOT; returns the length of destkey.
+*/
+template<typename Context, typename Key, typename... Keys>
+inline auto bit_op(Context& c, const std::string& operation, Key destkey, Key key, Keys... keys) -> long long
+{
+	return reply::integer{c.command({"BITOP", operation, destkey, key, keys...})};
+}
 
-//BITOP operation destkey key [key ...]
-//Perform bitwise operations between strings
+// Find first bit set or clear in a string
+template<typename Context, typename Key>
+inline auto bit_pos(Context& c, Key key, bool bit) -> long long
+{
+	return reply::integer{c.command({"BITPOS", key, bit ? "1" : "0"})};
+}
+// Find first bit set or clear in the bytes [start, end] of a string
+template<typename Context, typename Key>
+inline auto bit_pos(Context& c, Key key, bool bit, long long start, long long end = -1) -> long long
+{
+	return reply::integer{c.command({"BITPOS", key, bit ? "1" : "0", std::to_string(start), std::to_string(end)})};
+}
 
 // Decrement the integer value of a key by one
-template<typename Key>
-inline auto decr(context& c, Key key) -> long long
+template<typename Context, typename Key>
+inline auto decr(Context& c, Key key) -> long long
 {
 	return reply::integer{c.command({"DECR", key})};
 }
 
 // Decrement the integer value of a key by the given number
-template<typename Key>
-inline auto decr_by(context& c, Key key, long long decrement) -> long long
+template<typename Context, typename Key>
+inline auto decr_by(Context& c, Key key, long long decrement) -> long long
 {
 	return reply::integer{c.command({"DECRBY", key, std::to_string(decrement)})};
 }
 
 // Get the value of a key
-template<typename Key>
-inline auto get(context& c, Key key) -> boost::optional<std::string>
+template<typename Context, typename Key>
+inline auto get(Context& c, Key key) -> boost::optional<std::string>
 {
 	auto value = c.command({"GET", key});
 	if(reply::is_nill(value))
@@ -199,12 +363,42 @@ inline auto get(context& c, Key key) -> boost::optional<std::string>
 	return {true, reply::string{value}};
 }
 
-//GETBIT key offset
-//Returns the bit value at offset in the string value stored at key
+// Returns the bit value at offset in the string value stored at key
+template<typename Context, typename Key>
+inline auto get_bit(Context& c, Key key, uint64_t offset) -> bool
+{
+	return reply::integer{c.command({"GETBIT", key, std::to_string(offset)})};
+}
+
+/*
+ Returns the bits at each offset, read with pipelined BITFIELD_RO
+ commands of up to limits.max_keys offsets each.
+*/
+template<typename Context, typename Key, typename Offsets>
+inline auto get_bits(Context& c, Key key, const Offsets& offsets, const batch_limits& limits = {}) -> std::vector<bool>
+{
+	std::vector<bool> res(offsets.size());
+	detail::chunked(c, {"BITFIELD_RO", key}, begin(offsets), end(offsets), limits,
+		[](std::vector<std::string>& args, uint64_t offset) -> std::size_t
+		{
+			args.push_back("GET");
+			args.push_back("u1");
+			args.push_back(std::to_string(offset));
+			return args.back().size() + 5;
+		},
+		[&res](const reply::reply_t& r, std::size_t offset, std::size_t count)
+		{
+			if(r->type != REDIS_REPLY_ARRAY || r->elements != count)
+				throw error("BITFIELD result not equal to offset count");
+			for(std::size_t i = 0; i < count; ++i)
+				res[offset + i] = r->element[i]->integer != 0;
+		});
+	return res;
+}
 
 // Get a substring of the string stored at a key
-template<typename Key>
-inline auto get_range(context& c, Key key, long long start, long long end) -> boost::optional<std::string>
+template<typename Context, typename Key>
+inline auto get_range(Context& c, Key key, long long start, long long end) -> boost::optional<std::string>
 {
 	auto value = c.command({"GETRANGE", key, start, end});
 	if(reply::is_nill(value))
@@ -213,8 +407,8 @@ inline auto get_range(context& c, Key key, long long start, long long end) -> bo
 }
 
 // Set the string value of a key and return its old value
-template<typename Key, typename Value>
-inline auto get_set(context& c, Key key, Value value) -> boost::optional<std::string>
+template<typename Context, typename Key, typename Value>
+inline auto get_set(Context& c, Key key, Value value) -> boost::optional<std::string>
 {
 	auto old_value = c.command({"GETSET", key, value});
 	if(reply::is_nill(old_value))
@@ -223,98 +417,200 @@ inline auto get_set(context& c, Key key, Value value) -> boost::optional<std::st
 }
 
 // Increment the integer value of a key by one
-template<typename Key>
-inline auto incr(context& c, Key key) -> long long
+template<typename Context, typename Key>
+inline auto incr(Context& c, Key key) -> long long
 {
 	return reply::integer{c.command({"INCR", key})};
 }
 
 // Increment the integer value of a key by the given amount
-template<typename Key>
-inline auto incr_by(context& c, Key key, long long increment) -> long long
+template<typename Context, typename Key>
+inline auto incr_by(Context& c, Key key, long long increment) -> long long
 {
 	return reply::integer{c.command({"INCRBY", key, std::to_string(increment)})};
 }
 
 // Increment the float value of a key by the given amount
-template<typename Key>
-inline auto incr_by(context& c, Key key, double increment) -> long long
+template<typename Context, typename Key>
+inline auto incr_by(Context& c, Key key, double increment) -> long long
 {
 	return reply::integer{c.command({"INCRBYFLOAT", key, std::to_string(increment)})};
 }
 
-//MGET key [key ...]
-//Get the values of all the given keys
+// Get the values of all the given keys
+template<typename Context, typename Key, typename... Keys>
+inline auto get(Context& c, Key key, Key key2, Keys... keys) -> std::vector<boost::optional<std::string>>
+{
+	auto value = c.command({"MGET", key, key2, keys...});
+	std::vector<boost::optional<std::string>> res(2 + sizeof...(keys));
+	detail::optional_strings(value.get(), res, 0, res.size());
+	return res;
+}
 
-//MSET key value [key value ...]
-//Set multiple keys to multiple values
+/*
+ Get the values of a runtime sized range of keys.
+ Keys are fetched with pipelined MGETs bounded by limits; the result is
+ aligned with the input, with missing keys left empty.
+ Context must support append_command / get_reply.
+*/
+template<typename Context, typename Keys>
+inline auto get_many(Context& c, const Keys& keys, const batch_limits& limits = {}) -> std::vector<boost::optional<std::string>>
+{
+	std::vector<boost::optional<std::string>> res(std::distance(std::begin(keys), std::end(keys)));
+	detail::chunked(c, {"MGET"}, std::begin(keys), std::end(keys), limits,
+		[](std::vector<std::string>& args, const std::string& key) -> std::size_t
+		{
+			args.push_back(key);
+			return key.size();
+		},
+		[&res](const reply::reply_t& r, std::size_t offset, std::size_t count)
+		{
+			detail::optional_strings(r.get(), res, offset, count);
+		});
+	return res;
+}
 
-//MSETNX key value [key value ...]
-//Set multiple keys to multiple values, only if none of the keys exist
+// Set multiple keys to multiple values
+template<typename Context, typename Key, typename Value>
+inline auto set(Context& c, const std::map<Key, Value>& values) -> std::string
+{
+	std::vector<std::string> args{"MSET"};
+	for(auto& v : values)
+		args.insert(args.end(), {v.first, v.second});
+	return reply::status{c.command(args)};
+}
+
+/*
+ Set a runtime sized range of key / value pairs.
+ Sent as pipelined MSETs bounded by limits, so unlike a single MSET the
+ whole range is not set atomically.
+ Context must support append_command / get_reply.
+*/
+template<typename Context, typename Pairs>
+inline void set_many(Context& c, const Pairs& values, const batch_limits& limits = {})
+{
+	typedef typename std::iterator_traits<decltype(std::begin(values))>::value_type pair_type;
+	detail::chunked(c, {"MSET"}, std::begin(values), std::end(values), limits,
+		[](std::vector<std::string>& args, const pair_type& v) -> std::size_t
+		{
+			args.push_back(v.first);
+			args.push_back(v.second);
+			return args[args.size() - 2].size() + args.back().size();
+		},
+		[](const reply::reply_t& r, std::size_t, std::size_t)
+		{
+			reply::status{r};
+		});
+}
+
+// Set multiple keys to multiple values, only if none of the keys exist
+template<typename Context, typename Key, typename Value>
+inline auto setnx(Context& c, const std::map<Key, Value>& values) -> bool
+{
+	std::vector<std::string> args{"MSETNX"};
+	for(auto& v : values)
+		args.insert(args.end(), {v.first, v.second});
+	return reply::integer{c.command(args)};
+}
 
 //PSETEX key milliseconds value
 //Set the value and expiration in milliseconds of a key
 
 // Set the string value of a key
-template<typename Key, typename Value>
-inline auto set(context& c, Key key, Value value) -> std::string
+template<typename Context, typename Key, typename Value>
+inline auto set(Context& c, Key key, Value value) -> std::string
 {
 	return reply::status{c.command({"SET", key, value})};
 }
-template<typename Key, typename Value>
-inline auto set(context& c, Key key, Value value, std::chrono::seconds ttl) -> std::string
+template<typename Context, typename Key, typename Value>
+inline auto set(Context& c, Key key, Value value, std::chrono::seconds ttl) -> std::string
 {
 	return reply::status{c.command({"SET", key, value, "EX", std::to_string(ttl.count())})};
 }
-template<typename Key, typename Value>
-inline auto set(context& c, Key key, Value value, std::chrono::milliseconds ttl) -> std::string
+template<typename Context, typename Key, typename Value>
+inline auto set(Context& c, Key key, Value value, std::chrono::milliseconds ttl) -> std::string
 {
 	return reply::status{c.command({"SET", key, value, "PX", std::to_string(ttl.count())})};
 }
 
 // Set the value of a key, only if the key already exists
-template<typename Key, typename Value>
-inline auto setxx(context& c, Key key, Value value) -> std::string
+template<typename Context, typename Key, typename Value>
+inline auto setxx(Context& c, Key key, Value value) -> std::string
 {
 	return reply::status{c.command({"SET", key, value, "XX"})};
 }
-template<typename Key, typename Value>
-inline auto setxx(context& c, Key key, Value value, std::chrono::seconds ttl) -> std::string
+template<typename Context, typename Key, typename Value>
+inline auto setxx(Context& c, Key key, Value value, std::chrono::seconds ttl) -> std::string
 {
 	return reply::status{c.command({"SET", key, value, "EX", std::to_string(ttl.count()), "XX"})};
 }
-template<typename Key, typename Value>
-inline auto setxx(context& c, Key key, Value value, std::chrono::milliseconds ttl) -> std::string
+template<typename Context, typename Key, typename Value>
+inline auto setxx(Context& c, Key key, Value value, std::chrono::milliseconds ttl) -> std::string
 {
 	return reply::status{c.command({"SET", key, value, "PX", std::to_string(ttl.count()), "XX"})};
 }
 
-//SETBIT key offset value
-//Sets or clears the bit at offset in the string value stored at key
+// Sets or clears the bit at offset in the string value stored at key; returns the previous bit
+template<typename Context, typename Key>
+inline auto set_bit(Context& c, Key key, uint64_t offset, bool value) -> bool
+{
+	return reply::integer{c.command({"SETBIT", key, std::to_string(offset), value ? "1" : "0"})};
+}
+
+/*
+ Sets or clears the bits at each offset, with pipelined BITFIELD commands
+ of up to limits.max_keys offsets each; returns the previous bits.
+*/
+template<typename Context, typename Key, typename Offsets>
+inline auto set_bits(Context& c, Key key, const Offsets& offsets, bool value, const batch_limits& limits = {}) -> std::vector<bool>
+{
+	std::vector<bool> res(offsets.size());
+	detail::chunked(c, {"BITFIELD", key}, begin(offsets), end(offsets), limits,
+		[value](std::vector<std::string>& args, uint64_t offset) -> std::size_t
+		{
+			args.push_back("SET");
+			args.push_back("u1");
+			args.push_back(std::to_string(offset));
+			args.push_back(value ? "1" : "0");
+			return args[args.size() - 2].size() + 9;
+		},
+		[&res](const reply::reply_t& r, std::size_t offset, std::size_t count)
+		{
+			if(r->type != REDIS_REPLY_ARRAY || r->elements != count)
+				throw error("BITFIELD result not equal to offset count");
+			for(std::size_t i = 0; i < count; ++i)
+				res[offset + i] = r->element[i]->integer != 0;
+		});
+	return res;
+}
 
 // Set the value of a key, only if the key does not exist
-template<typename Key, typename Value>
-inline auto setnx(context& c, Key key, Value value) -> std::string
+template<typename Context, typename Key, typename Value>
+inline auto setnx(Context& c, Key key, Value value) -> std::string
 {
 	return reply::status{c.command({"SET", key, value, "NX"})};
 }
-template<typename Key, typename Value>
-inline auto setnx(context& c, Key key, Value value, std::chrono::seconds ttl) -> std::string
+template<typename Context, typename Key, typename Value>
+inline auto setnx(Context& c, Key key, Value value, std::chrono::seconds ttl) -> std::string
 {
 	return reply::status{c.command({"SET", key, value, "EX", std::to_string(ttl.count()), "NX"})};
 }
-template<typename Key, typename Value>
-inline auto setnx(context& c, Key key, Value value, std::chrono::milliseconds ttl) -> std::string
+template<typename Context, typename Key, typename Value>
+inline auto setnx(Context& c, Key key, Value value, std::chrono::milliseconds ttl) -> std::string
 {
 	return reply::status{c.command({"SET", key, value, "PX", std::to_string(ttl.count()), "NX"})};
 }
 
-//SETRANGE key offset value
-//Overwrite part of a string at key starting at the specified offset
+// Overwrite part of a string at key starting at the specified offset; returns the new length
+template<typename Context, typename Key, typename Value>
+inline auto set_range(Context& c, Key key, uint64_t offset, Value value) -> long long
+{
+	return reply::integer{c.command({"SETRANGE", key, std::to_string(offset), value})};
+}
 
 // Get the length of the value stored in a key
-template<typename Key>
-inline auto strlen(context& c, Key key) -> long long
+template<typename Context, typename Key>
+inline auto strlen(Context& c, Key key) -> long long
 {
 	return reply::integer{c.command({"STRLEN", key})};
 }
@@ -329,22 +625,22 @@ inline auto strlen(context& c, Key key) -> long long
 namespace hash
 {
 // Delete one or more hash fields
-template<typename Key, typename Field, typename... Fields>
-inline auto del(context& c, Key key, Field field, Fields... fields) -> long long
+template<typename Context, typename Key, typename Field, typename... Fields>
+inline auto del(Context& c, Key key, Field field, Fields... fields) -> long long
 {
 	return reply::integer{c.command({"HDEL", key, field, fields...})};
 }
 
 // Determine if a hash field exists
-template<typename Key, typename Field>
-inline auto exists(context& c, Key key, Field field) -> bool
+template<typename Context, typename Key, typename Field>
+inline auto exists(Context& c, Key key, Field field) -> bool
 {
 	return reply::integer{c.command({"HEXISTS", key, field})};
 }
 
 // Get the value of a hash field
-template<typename Key, typename Field>
-inline auto get(context& c, Key key, Field field) -> boost::optional<std::string>
+template<typename Context, typename Key, typename Field>
+inline auto get(Context& c, Key key, Field field) -> boost::optional<std::string>
 {
 	auto value = c.command({"HGET", key, field});
 	if(reply::is_nill(value))
@@ -353,8 +649,8 @@ inline auto get(context& c, Key key, Field field) -> boost::optional<std::string
 }
 
 // Get all the fields and values in a hash
-template<typename Key>
-inline auto get(context& c, Key key) -> std::map<std::string, std::string>
+template<typename Context, typename Key>
+inline auto get(Context& c, Key key) -> std::map<std::string, std::string>
 {
 	auto value = c.command({"HGETALL", key});
 	std::vector<std::string> data = reply::string_array{value};
@@ -367,36 +663,36 @@ inline auto get(context& c, Key key) -> std::map<std::string, std::string>
 }
 
 // Increment the integer value of a hash field by the given number
-template<typename Key, typename Field>
-inline auto incr_by(context& c, Key key, Field field, long long increment) -> long long
+template<typename Context, typename Key, typename Field>
+inline auto incr_by(Context& c, Key key, Field field, long long increment) -> long long
 {
 	return reply::integer{c.command({"HINCRBY", key, field, std::to_string(increment)})};
 }
 
 // Increment the float value of a hash field by the given amount
-template<typename Key, typename Field>
-inline auto incr_by(context& c, Key key, Field field, double increment) -> long long
+template<typename Context, typename Key, typename Field>
+inline auto incr_by(Context& c, Key key, Field field, double increment) -> long long
 {
 	return reply::integer{c.command({"HINCRBYFLOAT", key, field, std::to_string(increment)})};
 }
 
 // Get all the fields in a hash
-template<typename Key>
-inline auto keys(context& c, Key key) -> std::vector<std::string>
+template<typename Context, typename Key>
+inline auto keys(Context& c, Key key) -> std::vector<std::string>
 {
 	return reply::string_array{c.command({"HKEYS", key})};
 }
 
 // Get the number of fields in a hash
-template<typename Key>
-inline auto len(context& c, Key key) -> long long
+template<typename Context, typename Key>
+inline auto len(Context& c, Key key) -> long long
 {
 	return reply::integer{c.command({"HLEN", key})};
 }
 
 // Get the values of all the given hash fields
-template<typename Key, typename Field, typename... Fields>
-inline auto get(context& c, Key key, Field field, Fields... fields) -> std::map<std::string, std::string>
+template<typename Context, typename Key, typename Field, typename... Fields>
+inline auto get(Context& c, Key key, Field field, Fields... fields) -> std::map<std::string, std::string>
 {
 	auto value = c.command({"HMGET", key, field, fields...});
 	std::vector<std::string> keys{field, fields...};
@@ -414,9 +710,32 @@ inline auto get(context& c, Key key, Field field, Fields... fields) -> std::map<
 	return res;
 }
 
+/*
+ Get the values of a runtime sized range of hash fields.
+ Fields are fetched with pipelined HMGETs bounded by limits; the result
+ is aligned with the input, with missing fields left empty.
+ Context must support append_command / get_reply.
+*/
+template<typename Context, typename Key, typename Fields>
+inline auto get_many(Context& c, Key key, const Fields& fields, const batch_limits& limits = {}) -> std::vector<boost::optional<std::string>>
+{
+	std::vector<boost::optional<std::string>> res(std::distance(std::begin(fields), std::end(fields)));
+	detail::chunked(c, {"HMGET", key}, std::begin(fields), std::end(fields), limits,
+		[](std::vector<std::string>& args, const std::string& field) -> std::size_t
+		{
+			args.push_back(field);
+			return field.size();
+		},
+		[&res](const reply::reply_t& r, std::size_t offset, std::size_t count)
+		{
+			detail::optional_strings(r.get(), res, offset, count);
+		});
+	return res;
+}
+
 // Set multiple hash fields to multiple values
-template<typename Key, typename Field, typename Value>
-inline auto set(context& c, Key key, const std::map<Field, Value> h) -> std::string
+template<typename Context, typename Key, typename Field, typename Value>
+inline auto set(Context& c, Key key, const std::map<Field, Value> h) -> std::string
 {
 	std::vector<std::string> args{"HMSET", key};
 	for(auto& v : h)
@@ -425,22 +744,22 @@ inline auto set(context& c, Key key, const std::map<Field, Value> h) -> std::str
 }
 
 // Set the string value of a hash field
-template<typename Key, typename Field, typename Value>
-inline auto set(context& c, Key key, Field field, Value value) -> bool
+template<typename Context, typename Key, typename Field, typename Value>
+inline auto set(Context& c, Key key, Field field, Value value) -> bool
 {
 	return reply::integer{c.command({"HSET", key, field, value})};
 }
 
 // Set the value of a hash field, only if the field does not exist
-template<typename Key, typename Field, typename Value>
-inline auto setnx(context& c, Key key, Field field, Value value) -> bool
+template<typename Context, typename Key, typename Field, typename Value>
+inline auto setnx(Context& c, Key key, Field field, Value value) -> bool
 {
 	return reply::integer{c.command({"HSETNX", key, field, value})};
 }
 
 //Get all the values in a hash
-template<typename Key>
-inline auto values(context& c, Key key) -> std::vector<std::string>
+template<typename Context, typename Key>
+inline auto values(Context& c, Key key) -> std::vector<std::string>
 {
 	return reply::string_array{c.command({"HVALS", key})};
 }
@@ -463,47 +782,118 @@ namespace list
 //BRPOPLPUSH source destination timeout
 //Pop a value from a list, push it to another list and return it; or block until one is available
 
-//LINDEX key index
-//Get an element from a list by its index
+// Get an element from a list by its index
+template<typename Context, typename Key>
+inline auto index(Context& c, Key key, long long index) -> boost::optional<std::string>
+{
+	auto value = c.command({"LINDEX", key, std::to_string(index)});
+	if(reply::is_nill(value))
+		return {};
+	return {true, reply::string{value}};
+}
 
-//LINSERT key BEFORE|AFTER pivot value
-//Insert an element before or after another element in a list
+/*
+ Insert an element before or after another element in a list
+ Returns the new length, or -1 if pivot was not found.
+*/
+template<typename Context, typename Key, typename Value>
+inline auto insert(Context& c, Key key, bool before, Value pivot, Value value) -> long long
+{
+	return reply::integer{c.command({"LINSERT", key, before ? "BEFORE" : "AFTER", pivot, value})};
+}
 
-//LLEN key
-//Get the length of a list
+// Get the length of a list
+template<typename Context, typename Key>
+inline auto len(Context& c, Key key) -> long long
+{
+	return reply::integer{c.command({"LLEN", key})};
+}
 
-//LPOP key
-//Remove and get the first element in a list
+// Remove and get the first element in a list
+template<typename Context, typename Key>
+inline auto lpop(Context& c, Key key) -> boost::optional<std::string>
+{
+	auto value = c.command({"LPOP", key});
+	if(reply::is_nill(value))
+		return {};
+	return {true, reply::string{value}};
+}
 
-//LPUSH key value [value ...]
-//Prepend one or multiple values to a list
+// Prepend one or multiple values to a list
+template<typename Context, typename Key, typename Value, typename... Values>
+inline auto lpush(Context& c, Key key, Value value, Values... values) -> long long
+{
+	return reply::integer{c.command({"LPUSH", key, value, values...})};
+}
 
-//LPUSHX key value
-//Prepend a value to a list, only if the list exists
+// Prepend a value to a list, only if the list exists
+template<typename Context, typename Key, typename Value>
+inline auto lpushx(Context& c, Key key, Value value) -> long long
+{
+	return reply::integer{c.command({"LPUSHX", key, value})};
+}
 
-//LRANGE key start stop
-//Get a range of elements from a list
+// Get a range of elements from a list
+template<typename Context, typename Key>
+inline auto range(Context& c, Key key, long long start, long long stop) -> std::vector<std::string>
+{
+	return reply::string_array{c.command({"LRANGE", key, std::to_string(start), std::to_string(stop)})};
+}
 
-//LREM key count value
-//Remove elements from a list
+// Remove elements from a list
+template<typename Context, typename Key, typename Value>
+inline auto rem(Context& c, Key key, long long count, Value value) -> long long
+{
+	return reply::integer{c.command({"LREM", key, std::to_string(count), value})};
+}
 
-//LSET key index value
-//Set the value of an element in a list by its index
+// Set the value of an element in a list by its index
+template<typename Context, typename Key, typename Value>
+inline auto set(Context& c, Key key, long long index, Value value) -> std::string
+{
+	return reply::status{c.command({"LSET", key, std::to_string(index), value})};
+}
 
-//LTRIM key start stop
-//Trim a list to the specified range
+// Trim a list to the specified range
+template<typename Context, typename Key>
+inline auto trim(Context& c, Key key, long long start, long long stop) -> std::string
+{
+	return reply::status{c.command({"LTRIM", key, std::to_string(start), std::to_string(stop)})};
+}
 
-//RPOP key
-//Remove and get the last element in a list
+// Remove and get the last element in a list
+template<typename Context, typename Key>
+inline auto rpop(Context& c, Key key) -> boost::optional<std::string>
+{
+	auto value = c.command({"RPOP", key});
+	if(reply::is_nill(value))
+		return {};
+	return {true, reply::string{value}};
+}
 
-//RPOPLPUSH source destination
-//Remove the last element in a list, append it to another list and return it
+// Remove the last element in a list, append it to another list and return it
+template<typename Context, typename Key>
+inline auto rpoplpush(Context& c, Key source, Key destination) -> boost::optional<std::string>
+{
+	auto value = c.command({"RPOPLPUSH", source, destination});
+	if(reply::is_nill(value))
+		return {};
+	return {true, reply::string{value}};
+}
 
-//RPUSH key value [value ...]
-//Append one or multiple values to a list
+// Append one or multiple values to a list
+template<typename Context, typename Key, typename Value, typename... Values>
+inline auto rpush(Context& c, Key key, Value value, Values... values) -> long long
+{
+	return reply::integer{c.command({"RPUSH", key, value, values...})};
+}
 
-//RPUSHX key value
-//Append a value to a list, only if the list exists
+// Append a value to a list, only if the list exists
+template<typename Context, typename Key, typename Value>
+inline auto rpushx(Context& c, Key key, Value value) -> long long
+{
+	return reply::integer{c.command({"RPUSHX", key, value})};
+}
 }
 
 //  ####   ######   #####
@@ -515,15 +905,15 @@ namespace list
 namespace set
 {
 // Add one or more members to a set
-template<typename Key, typename Member, typename... Members>
-inline auto add(context& c, Key key, Member member, Members... members) -> long long
+template<typename Context, typename Key, typename Member, typename... Members>
+inline auto add(Context& c, Key key, Member member, Members... members) -> long long
 {
 	return reply::integer{c.command({"SADD", key, member, members...})};
 }
 
 // Get the number of members in a set
-template<typename Key>
-inline auto card(context& c, Key key) -> long long
+template<typename Context, typename Key>
+inline auto card(Context& c, Key key) -> long long
 {
 	return reply::integer{c.command({"SCARD", key})};
 }
@@ -541,15 +931,15 @@ inline auto card(context& c, Key key) -> long long
 //Intersect multiple sets and store the resulting set in a key
 
 // Determine if a given value is a member of a set
-template<typename Key, typename Member>
-inline auto is_member(context& c, Key key, Member member) -> bool
+template<typename Context, typename Key, typename Member>
+inline auto is_member(Context& c, Key key, Member member) -> bool
 {
 	return reply::integer{c.command({"SISMEMBER", key, member})};
 }
 
 // Get all the members in a set
-template<typename Key>
-inline auto members(context& c, Key key) -> std::vector<std::string>
+template<typename Context, typename Key>
+inline auto members(Context& c, Key key) -> std::vector<std::string>
 {
 	return reply::string_array{c.command({"SMEMBERS", key})};
 }
@@ -558,8 +948,8 @@ inline auto members(context& c, Key key) -> std::vector<std::string>
 //Move a member from one set to another
 
 // Remove and return a random member from a set
-template<typename Key>
-inline auto pop(context& c, Key key) -> std::string
+template<typename Context, typename Key>
+inline auto pop(Context& c, Key key) -> std::string
 {
 	return reply::string{c.command({"SPOP", key})};
 }
@@ -568,8 +958,8 @@ inline auto pop(context& c, Key key) -> std::string
 //Get one or multiple random members from a set
 
 // Remove one or more members from a set
-template<typename Key, typename Member, typename... Members>
-inline auto rem(context& c, Key key, Member member, Members... members) -> long long
+template<typename Context, typename Key, typename Member, typename... Members>
+inline auto rem(Context& c, Key key, Member member, Members... members) -> long long
 {
 	return reply::integer{c.command({"SREM", key, member, members...})};
 }
@@ -589,11 +979,32 @@ inline auto rem(context& c, Key key, Member member, Members... members) -> long
 //  ####    ####   #    #     #    ######  #####            ####   ######     #
 namespace sorted_set
 {
-//ZADD key score member [score member ...]
-//Add one or more members to a sorted set, or update its score if it already exists
+// Add a member to a sorted set, or update its score if it already exists
+template<typename Context, typename Key, typename Member>
+inline auto add(Context& c, Key key, double score, Member member) -> long long
+{
+	return reply::integer{c.command({"ZADD", key, schema::field_codec<double>::encode(score), member})};
+}
+// Add several (score, member) pairs in one command
+template<typename Context, typename Key>
+inline auto add(Context& c, Key key, const std::vector<std::pair<double, std::string>>& members) -> long long
+{
+	std::vector<std::string> args{"ZADD", key};
+	args.reserve(2 + 2 * members.size());
+	for(auto& m : members)
+	{
+		args.push_back(schema::field_codec<double>::encode(m.first));
+		args.push_back(m.second);
+	}
+	return reply::integer{c.command(args)};
+}
 
-//ZCARD key
-//Get the number of members in a sorted set
+// Get the number of members in a sorted set
+template<typename Context, typename Key>
+inline auto card(Context& c, Key key) -> long long
+{
+	return reply::integer{c.command({"ZCARD", key})};
+}
 
 //ZCOUNT key min max
 //Count the members in a sorted set with scores within the given values
@@ -604,8 +1015,19 @@ namespace sorted_set
 //ZINTERSTORE destination numkeys key [key ...] [WEIGHTS weight [weight ...]] [AGGREGATE SUM|MIN|MAX]
 //Intersect multiple sorted sets and store the resulting sorted set in a new key
 
-//ZRANGE key start stop [WITHSCORES]
-//Return a range of members in a sorted set, by index
+// Return a range of members in a sorted set, by index
+template<typename Context, typename Key>
+inline auto range(Context& c, Key key, long long start, long long stop) -> std::vector<std::string>
+{
+	return reply::string_array{c.command({"ZRANGE", key, std::to_string(start), std::to_string(stop)})};
+}
+
+// Return a range of members of equal score, by member, e.g. range_by_lex(c, key, "[a", "(b")
+template<typename Context, typename Key>
+inline auto range_by_lex(Context& c, Key key, const std::string& min, const std::string& max) -> std::vector<std::string>
+{
+	return reply::string_array{c.command({"ZRANGEBYLEX", key, min, max})};
+}
 
 //ZRANGEBYSCORE key min max [WITHSCORES] [LIMIT offset count]
 //Return a range of members in a sorted set, by score
@@ -613,8 +1035,12 @@ namespace sorted_set
 //ZRANK key member
 //Determine the index of a member in a sorted set
 
-//ZREM key member [member ...]
-//Remove one or more members from a sorted set
+// Remove one or more members from a sorted set
+template<typename Context, typename Key, typename Member, typename... Members>
+inline auto rem(Context& c, Key key, Member member, Members... members) -> long long
+{
+	return reply::integer{c.command({"ZREM", key, member, members...})};
+}
 
 //ZREMRANGEBYRANK key start stop
 //Remove all members in a sorted set within the given indexes
@@ -631,8 +1057,15 @@ namespace sorted_set
 //ZREVRANK key member
 //Determine the index of a member in a sorted set, with scores ordered from high to low
 
-//ZSCORE key member
-//Get the score associated with the given member in a sorted set
+// Get the score associated with the given member in a sorted set
+template<typename Context, typename Key, typename Member>
+inline auto score(Context& c, Key key, Member member) -> boost::optional<double>
+{
+	auto value = c.command({"ZSCORE", key, member});
+	if(reply::is_nill(value))
+		return {};
+	return {true, std::stod(reply::string{value})};
+}
 
 //ZUNIONSTORE destination numkeys key [key ...] [WEIGHTS weight [weight ...]] [AGGREGATE SUM|MIN|MAX]
 //Add multiple sorted sets and store the resulting sorted set in a new key
@@ -647,8 +1080,8 @@ namespace sorted_set
 namespace pubsub
 {
 // Listen for messages published to channels matching the given patterns
-template<typename Pattern, typename... Patterns>
-inline void psubscribe(context& c, Pattern pattern, Patterns... patterns)
+template<typename Context, typename Pattern, typename... Patterns>
+inline void psubscribe(Context& c, Pattern pattern, Patterns... patterns)
 {
 	c.command({"PSUBSCRIBE", pattern, patterns...});
 }
@@ -657,29 +1090,29 @@ inline void psubscribe(context& c, Pattern pattern, Patterns... patterns)
 //Inspect the state of the Pub/Sub subsystem
 
 // Post a message to a channel
-template<typename Channel, typename Message>
-inline auto publish(context& c, Channel channel, Message message) -> long long
+template<typename Context, typename Channel, typename Message>
+inline auto publish(Context& c, Channel channel, Message message) -> long long
 {
 	return reply::integer{c.command({"PUBLISH", channel, message})};
 }
 
 // Stop listening for messages posted to channels matching the given patterns
-template<typename... Patterns>
-inline void punsubscribe(context& c, Patterns... patterns)
+template<typename Context, typename... Patterns>
+inline void punsubscribe(Context& c, Patterns... patterns)
 {
 	c.command({"PUNSUBSCRIBE", patterns...});
 }
 
 // Listen for messages published to the given channels
-template<typename Channel, typename... Channels>
-inline void subscribe(context& c, Channel channel, Channels... channels)
+template<typename Context, typename Channel, typename... Channels>
+inline void subscribe(Context& c, Channel channel, Channels... channels)
 {
 	c.command({"SUBSCRIBE", channel, channels...});
 }
 
 // Stop listening for messages posted to the given channels
-template<typename... Channels>
-inline void unsubscribe(context& c, Channels... channels)
+template<typename Context, typename... Channels>
+inline void unsubscribe(Context& c, Channels... channels)
 {
 	c.command({"UNSUBSCRIBE", channels...});
 }
@@ -694,32 +1127,36 @@ inline void unsubscribe(context& c, Channels... channels)
 namespace transaction
 {
 // Discard all commands issued after MULTI
-inline auto discard(context& c) -> std::string
+template<typename Context>
+inline auto discard(Context& c) -> std::string
 {
 	return reply::status{c.command({"DISCARD"})};
 }
 
 // Execute all commands issued after MULTI
-inline auto exec(context& c) -> std::vector<reply::reply_t>
+template<typename Context>
+inline auto exec(Context& c) -> std::vector<reply::reply_t>
 {
 	return reply::array{c.command({"EXEC"})};
 }
 
 // Mark the start of a transaction block
-inline auto multi(context& c) -> std::string
+template<typename Context>
+inline auto multi(Context& c) -> std::string
 {
 	return reply::status{c.command({"MULTI"})};
 }
 
 // Forget about all watched keys
-inline auto unwatch(context& c) -> std::string
+template<typename Context>
+inline auto unwatch(Context& c) -> std::string
 {
 	return reply::status{c.command({"UNWATCH"})};
 }
 
 // Watch the given keys to determine execution of the MULTI/EXEC block
-template<typename Key, typename... Keys>
-inline auto watch(context& c, Key key, Keys... keys) -> std::string
+template<typename Context, typename Key, typename... Keys>
+inline auto watch(Context& c, Key key, Keys... keys) -> std::string
 {
 	return reply::status{c.command({"WATCH", key, keys...})};
 }
@@ -761,31 +1198,36 @@ namespace script
 namespace connection
 {
 // Authenticate to the server
-inline auto auth(context& c, const std::string& password) -> std::string
+template<typename Context>
+inline auto auth(Context& c, const std::string& password) -> std::string
 {
 	return reply::status{c.command({"AUTH", password})};
 }
 
 // Echo the given string
-inline auto echo(context& c, const std::string& message) -> std::string
+template<typename Context>
+inline auto echo(Context& c, const std::string& message) -> std::string
 {
 	return reply::string{c.command({"ECHO", message})};
 }
 
 // Ping the server
-inline auto ping(context& c) -> std::string
+template<typename Context>
+inline auto ping(Context& c) -> std::string
 {
 	return reply::status{c.command({"PING"})};
 }
 
 // Close the connection
-inline auto quit(context& c) -> std::string
+template<typename Context>
+inline auto quit(Context& c) -> std::string
 {
 	return reply::status{c.command({"QUIT"})};
 }
 
 // Change the selected database for the current connection
-inline auto select(context& c, int index) -> std::string
+template<typename Context>
+inline auto select(Context& c, int index) -> std::string
 {
 	return reply::status{c.command({"SELECT", std::to_string(index)})};
 }
@@ -800,13 +1242,15 @@ inline auto select(context& c, int index) -> std::string
 namespace server
 {
 // Asynchronously rewrite the append-only file
-inline auto bg_rewrite_aof(context& c) -> std::string
+template<typename Context>
+inline auto bg_rewrite_aof(Context& c) -> std::string
 {
 	return reply::status{c.command({"BGREWRITEAOF"})};
 }
 
 // Asynchronously save the dataset to disk
-inline auto bg_save(context& c) -> std::string
+template<typename Context>
+inline auto bg_save(Context& c) -> std::string
 {
 	return reply::status{c.command({"BGSAVE"})};
 }
@@ -814,19 +1258,22 @@ inline auto bg_save(context& c) -> std::string
 namespace client
 {
 // Kill the connection of a client
-inline auto kill(context& c, const std::string& address) -> std::string
+template<typename Context>
+inline auto kill(Context& c, const std::string& address) -> std::string
 {
 	return reply::status{c.command({"CLIENT", "KILL", address})};
 }
 
 // Get the list of client connections
-inline auto list(context& c) -> std::string
+template<typename Context>
+inline auto list(Context& c) -> std::string
 {
 	return reply::string{c.command({"CLIENT", "LIST"})};
 }
 
 // Get the current connection name
-inline auto get_name(context& c) -> boost::optional<std::string>
+template<typename Context>
+inline auto get_name(Context& c) -> boost::optional<std::string>
 {
 	auto value = c.command({"CLIENT", "GETNAME"});
 	if(reply::is_nill(value))
@@ -835,7 +1282,8 @@ inline auto get_name(context& c) -> boost::optional<std::string>
 }
 
 // Set the current connection name
-inline auto set_name(context& c, const std::string& name) -> std::string
+template<typename Context>
+inline auto set_name(Context& c, const std::string& name) -> std::string
 {
 	return reply::status{c.command({"CLIENT", "SETNAME", name})};
 }
@@ -843,21 +1291,44 @@ inline auto set_name(context& c, const std::string& name) -> std::string
 
 namespace config
 {
-//CONFIG GET parameter
-//Get the value of a configuration parameter
+// Get the value of configuration parameters matching a pattern
+template<typename Context>
+inline auto get(Context& c, const std::string& parameter) -> std::map<std::string, std::string>
+{
+	std::vector<std::string> data = reply::string_array{c.command({"CONFIG", "GET", parameter})};
+	if(data.size() % 2)
+		throw error("CONFIG GET result not multiple of 2");
+	std::map<std::string, std::string> res;
+	for(auto it = begin(data); it != end(data); it += 2)
+		res.insert(std::make_pair(*it, *(it+1)));
+	return res;
+}
 
-//CONFIG REWRITE
-//Rewrite the configuration file with the in memory configuration
+// Rewrite the configuration file with the in memory configuration
+template<typename Context>
+inline auto rewrite(Context& c) -> std::string
+{
+	return reply::status{c.command({"CONFIG", "REWRITE"})};
+}
 
-//CONFIG SET parameter value
-//Set a configuration parameter to the given value
+// Set a configuration parameter to the given value
+template<typename Context>
+inline auto set(Context& c, const std::string& parameter, const std::string& value) -> std::string
+{
+	return reply::status{c.command({"CONFIG", "SET", parameter, value})};
+}
 
-//CONFIG RESETSTAT
-//Reset the stats returned by INFO
+// Reset the stats returned by INFO
+template<typename Context>
+inline auto reset_stat(Context& c) -> std::string
+{
+	return reply::status{c.command({"CONFIG", "RESETSTAT"})};
+}
 }
 
 // Return the number of keys in the selected database
-inline auto dbsize(context& c) -> long long
+template<typename Context>
+inline auto dbsize(Context& c) -> long long
 {
 	return reply::integer{c.command({"DBSIZE"})};
 }
@@ -869,29 +1340,34 @@ inline auto dbsize(context& c) -> long long
 //Make the server crash
 
 // Remove all keys from all databases
-inline auto flush_all(context& c) -> std::string
+template<typename Context>
+inline auto flush_all(Context& c) -> std::string
 {
 	return reply::status{c.command({"FLUSHALL"})};
 }
 
 // Remove all keys from the current database
-inline auto flush_db(context& c) -> std::string
+template<typename Context>
+inline auto flush_db(Context& c) -> std::string
 {
 	return reply::status{c.command({"FLUSHDB"})};
 }
 
 // Get information and statistics about the server
-inline auto info(context& c) -> std::string
+template<typename Context>
+inline auto info(Context& c) -> std::string
 {
 	return reply::string{c.command({"INFO"})};
 }
-inline auto info(context& c, const std::string& section) -> std::string
+template<typename Context>
+inline auto info(Context& c, const std::string& section) -> std::string
 {
 	return reply::string{c.command({"INFO", section})};
 }
 
 // Get the UNIX time stamp of the last successful save to disk
-inline auto last_save(context& c, const std::string& section) -> time_t
+template<typename Context>
+inline auto last_save(Context& c, const std::string& section) -> time_t
 {
 	return reply::integer{c.command({"LASTSAVE", section})};
 }
@@ -900,7 +1376,8 @@ inline auto last_save(context& c, const std::string& section) -> time_t
 //Listen for all requests received by the server in real time
 
 // Synchronously save the dataset to disk
-inline auto save(context& c) -> std::string
+template<typename Context>
+inline auto save(Context& c) -> std::string
 {
 	return reply::status{c.command({"SAVE"})};
 }
@@ -911,14 +1388,67 @@ inline auto save(context& c) -> std::string
 //SLAVEOF host port
 //Make the server a slave of another instance, or promote it as master
 
-//SLOWLOG subcommand [argument]
-//Manages the Redis slow queries log
+namespace slowlog
+{
+struct entry
+{
+	long long id;
+	std::time_t time;
+	std::chrono::microseconds duration;
+	std::vector<std::string> args;
+};
+
+// Get the most recent entries of the slow queries log
+template<typename Context>
+inline auto get(Context& c, long long count = 10) -> std::vector<entry>
+{
+	auto value = c.command({"SLOWLOG", "GET", std::to_string(count)});
+	if(value->type != REDIS_REPLY_ARRAY)
+		throw std::invalid_argument("reply type not array.");
+	
+	std::vector<entry> entries;
+	for(std::size_t i = 0; i < value->elements; ++i)
+	{
+		auto e = value->element[i];
+		if(e->type != REDIS_REPLY_ARRAY || e->elements < 4)
+			throw error("SLOWLOG entry has too few fields");
+		
+		entry res{reply::integer{e->element[0]}, static_cast<std::time_t>(reply::integer{e->element[1]}.value), std::chrono::microseconds{reply::integer{e->element[2]}.value}, {}};
+		auto args = e->element[3];
+		for(std::size_t j = 0; j < args->elements; ++j)
+			res.args.push_back(reply::string{args->element[j]});
+		entries.push_back(std::move(res));
+	}
+	return entries;
+}
+
+// Get the length of the slow queries log
+template<typename Context>
+inline auto len(Context& c) -> long long
+{
+	return reply::integer{c.command({"SLOWLOG", "LEN"})};
+}
+
+// Clear the slow queries log
+template<typename Context>
+inline auto reset(Context& c) -> std::string
+{
+	return reply::status{c.command({"SLOWLOG", "RESET"})};
+}
+}
 
 //SYNC
 //Internal command used for replication
 
-//TIME
-//Return the current server time
+// Return the current server time
+template<typename Context>
+inline auto time(Context& c) -> std::chrono::system_clock::time_point
+{
+	std::vector<std::string> t = reply::string_array{c.command({"TIME"})};
+	if(t.size() != 2)
+		throw error("TIME result not 2 elements");
+	return std::chrono::system_clock::time_point{std::chrono::seconds{std::stoll(t[0])} + std::chrono::microseconds{std::stoll(t[1])}};
+}
 }
 
 }
@@ -6,15 +6,80 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <chrono>
+#include <sys/time.h>
+#include <poll.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
 #include "reply.hh"
+#include "arena.hh"
+#include "result.hh"
 
 namespace hiredis
 {
 
+/*
+ Sees the arguments of every command a context sends, on the sending
+ thread, e.g. telemetry::hot_keys. Commands appended already encoded
+ (append_formatted) are not seen.
+*/
+struct command_observer
+{
+	virtual ~command_observer() = default;
+	virtual void sent(std::size_t argc, const char* const* argv, const std::size_t* argvlen) = 0;
+};
+
 class context
 {
+public:
+	typedef std::chrono::steady_clock clock;
+
+	/*
+	 What a command that misses its deadline leaves behind.
+	 resync keeps the connection and skips the late reply when it arrives,
+	 so later commands wait for it first; invalidate closes the connection.
+	 Either way the command may still execute on the server.
+	*/
+	enum class timeout_policy
+	{
+		resync,
+		invalidate
+	};
+
+	/*
+	 Socket I/O for blocking contexts in place of hiredis' own read() and
+	 write() calls, e.g. uring_context_transport (io_ring.hh). One serves
+	 the contexts of one thread.
+	*/
+	class transport
+	{
+	public:
+		virtual ~transport() = default;
+		virtual auto name() const -> const char* = 0;
+		/*
+		 Send all len bytes of out (possibly none), then receive what has
+		 arrived, blocking for at least a byte. Returns the bytes received,
+		 at in until the next call; 0 once the server closed the
+		 connection, or -errno.
+		*/
+		virtual auto exchange(int fd, const char* out, std::size_t len, const char*& in) -> long = 0;
+	};
+
+	/*
+	 Transport of the calling thread, or null for hiredis' own I/O.
+	 Builds with HIREDIS11_IO_URING set up an io_uring per thread where the
+	 kernel supports it; other builds have none.
+	*/
+	static auto thread_transport() -> transport*;
 private:
 	std::shared_ptr<redisContext> c;
+	command_observer* observer;
+	timeout_policy policy;
+	// Replies owed to commands whose callers gave up on them.
+	std::size_t abandoned;
+	unsigned long long timeouts;
+	bool transported;
 	
 	void critical_error()
 	{
@@ -27,6 +92,122 @@ private:
 		}
 		throw std::logic_error("critical_error called with no active hiredis error.");
 	}
+	// As critical_error, for callers that do not throw.
+	auto lost() -> error_code
+	{
+		errc code = errc::io;
+		if(c->err == REDIS_ERR_EOF)
+			code = errc::eof;
+		else if(c->err == REDIS_ERR_PROTOCOL)
+			code = errc::protocol;
+#ifdef REDIS_ERR_TIMEOUT
+		else if(c->err == REDIS_ERR_TIMEOUT)
+			code = errc::timeout;
+#endif
+		else if(c->err == REDIS_ERR_IO && (errno == EAGAIN || errno == EWOULDBLOCK))
+			code = errc::timeout;
+		error_code e(code, c->errstr);
+		c.reset();
+		return e;
+	}
+	
+	// Wait for the socket to be ready for events; false once deadline passes.
+	bool ready(short events, clock::time_point deadline)
+	{
+		while(true)
+		{
+			auto now = clock::now();
+			if(!(now < deadline))
+				return false;
+			// Rounded up so the wait does not end just short of the deadline.
+			auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now + std::chrono::microseconds(999));
+			pollfd fd{c->fd, events, 0};
+			auto res = poll(&fd, 1, static_cast<int>(std::min<long long>(wait.count(), 1 << 30)));
+			if(res > 0)
+				return true;
+			if(res < 0 && errno != EINTR)
+			{
+				auto err = error(std::strerror(errno));
+				c.reset();
+				throw err;
+			}
+		}
+	}
+	// Write out pending commands and read the next reply; null once deadline passes.
+	auto read_reply(clock::time_point deadline) -> redisReply*
+	{
+		void* reply = nullptr;
+		if(redisGetReplyFromReader(c.get(), &reply) == REDIS_ERR)
+			critical_error();
+		if(reply)
+			return static_cast<redisReply*>(reply);
+		
+		int done = 0;
+		while(!done)
+		{
+			if(!ready(POLLOUT, deadline))
+				return nullptr;
+			if(redisBufferWrite(c.get(), &done) == REDIS_ERR)
+				critical_error();
+		}
+		while(!reply)
+		{
+			if(!ready(POLLIN, deadline))
+				return nullptr;
+			if(redisBufferRead(c.get()) == REDIS_ERR)
+				critical_error();
+			if(redisGetReplyFromReader(c.get(), &reply) == REDIS_ERR)
+				critical_error();
+		}
+		return static_cast<redisReply*>(reply);
+	}
+	/*
+	 As redisGetReply, but through the thread's transport if there is one,
+	 resolved per call as a pooled context may move between threads.
+	*/
+	auto receive(void** reply) -> int
+	{
+		auto io = transported ? thread_transport() : nullptr;
+		if(!io)
+			return redisGetReply(c.get(), reply);
+		if(redisGetReplyFromReader(c.get(), reply) == REDIS_ERR)
+			return REDIS_ERR;
+		while(!*reply)
+		{
+			const char* in = nullptr;
+			auto n = io->exchange(c->fd, c->obuf, sdslen(c->obuf), in);
+			if(n <= 0)
+			{
+				c->err = n == 0 ? REDIS_ERR_EOF : REDIS_ERR_IO;
+				std::snprintf(c->errstr, sizeof(c->errstr), "%s", n == 0 ? "Server closed the connection" : std::strerror(-n));
+				return REDIS_ERR;
+			}
+			sdsclear(c->obuf);
+			if(redisReaderFeed(c->reader, in, n) != REDIS_OK)
+			{
+				c->err = c->reader->err;
+				std::snprintf(c->errstr, sizeof(c->errstr), "%s", c->reader->errstr);
+				return REDIS_ERR;
+			}
+			if(redisGetReplyFromReader(c.get(), reply) == REDIS_ERR)
+				return REDIS_ERR;
+		}
+		return REDIS_OK;
+	}
+	// Skip the replies of abandoned commands, blocking as get_reply().
+	void drain()
+	{
+		if(!c)
+			throw error("Context is not connected");
+		while(abandoned)
+		{
+			void* reply;
+			if(receive(&reply) == REDIS_ERR)
+				critical_error();
+			freeReplyObject(reply);
+			--abandoned;
+		}
+	}
 public:
 	struct error : std::runtime_error
 	{
@@ -37,7 +218,16 @@ public:
 	};
 
 	context(const std::string& ip, int port)
-	 : c(redisConnect(ip.c_str(), port), redisFree)
+	 : c(redisConnect(ip.c_str(), port), redisFree), observer(nullptr), policy(timeout_policy::resync), abandoned(0), timeouts(0), transported(true)
+	{
+		if(!c)
+			throw error("Unable to create context");
+		if(c->err)
+			throw error(c->errstr);
+	}
+	// Fail if the connection is not established within timeout.
+	context(const std::string& ip, int port, std::chrono::microseconds timeout)
+	 : c(redisConnectWithTimeout(ip.c_str(), port, {static_cast<time_t>(timeout.count() / 1000000), static_cast<suseconds_t>(timeout.count() % 1000000)}), redisFree), observer(nullptr), policy(timeout_policy::resync), abandoned(0), timeouts(0), transported(true)
 	{
 		if(!c)
 			throw error("Unable to create context");
@@ -51,6 +241,60 @@ public:
 	context(context&&) = default;
 	context& operator=(context&&) = default;
 	
+	// Report commands to o, which must outlive the context; null stops reporting.
+	void observe(command_observer* o)
+	{
+		observer = o;
+	}
+	
+	/*
+	 With a thread transport (see thread_transport()), blocking reads and
+	 writes go through it unless turned off here, e.g. to compare against
+	 hiredis' own I/O. Commands with a deadline always poll.
+	*/
+	void use_transport(bool on)
+	{
+		transported = on;
+	}
+	
+	// False once a connection error has made the context unusable.
+	bool connected() const
+	{
+		return c != nullptr;
+	}
+	
+	void on_timeout(timeout_policy p)
+	{
+		policy = p;
+	}
+	// Commands that missed their deadline on this context.
+	auto timeout_count() const -> unsigned long long
+	{
+		return timeouts;
+	}
+	// Late replies still to be skipped before the next one is returned.
+	auto abandoned_count() const -> std::size_t
+	{
+		return abandoned;
+	}
+	
+	/*
+	 Give up on the replies of n commands already sent, e.g. the rest of a
+	 pipeline after a timeout. Applies the timeout policy.
+	*/
+	void abandon(std::size_t n)
+	{
+		if(!c || !n)
+			return;
+		if(policy == timeout_policy::invalidate)
+		{
+			c.reset();
+			abandoned = 0;
+		}
+		else
+			abandoned += n;
+	}
+	
 	/*
 	 Send a command and get a reply.
 	 e.g.
@@ -59,44 +303,244 @@ public:
 	*/
 	auto command(const std::vector<std::string>& args) -> reply::reply_t
 	{
+		if(!c)
+			throw error("Context is not connected");
 		auto argc = args.size();
 		std::vector<const char*> argv(argc);
 		std::vector<size_t> argvlen(argc);
 		std::transform(begin(args), end(args), begin(argv), [](const std::string& s) -> const char* { return s.c_str(); });
 		std::transform(begin(args), end(args), begin(argvlen), [](const std::string& s) -> size_t { return s.size(); });
 	
-		auto res = redisCommandArgv(c.get(), argc, argv.data(), argvlen.data());
-		if(!res)
+		if(observer)
+			observer->sent(argc, argv.data(), argvlen.data());
+		drain();
+		void* res;
+		if(redisAppendCommandArgv(c.get(), argc, argv.data(), argvlen.data()) != REDIS_OK || receive(&res) == REDIS_ERR)
 			critical_error();
 	
 		return { static_cast<redisReply*>(res), freeReplyObject };
 	}
 	
+	/*
+	 Send a command without throwing.
+	 Error replies and connection failures are returned as an error_code;
+	 after a connection failure the context is unusable as with command().
+	 e.g.
+	 auto r = c.try_command({"INCR", "foo"});
+	 if(!r && r.error().code == errc::wrong_type)
+		 ...
+	*/
+	auto try_command(const std::vector<std::string>& args) -> result<reply::reply_t>
+	{
+		if(!c)
+			return error_code{errc::io, "Context is not connected"};
+		
+		auto argc = args.size();
+		std::vector<const char*> argv(argc);
+		std::vector<size_t> argvlen(argc);
+		std::transform(begin(args), end(args), begin(argv), [](const std::string& s) -> const char* { return s.c_str(); });
+		std::transform(begin(args), end(args), begin(argvlen), [](const std::string& s) -> size_t { return s.size(); });
+		
+		if(observer)
+			observer->sent(argc, argv.data(), argvlen.data());
+		if(redisAppendCommandArgv(c.get(), argc, argv.data(), argvlen.data()) != REDIS_OK)
+			return lost();
+		return try_get_reply();
+	}
+	
+	/*
+	 Get the next reply without throwing, as try_command(), e.g. for a
+	 pipeline queued with append_command().
+	*/
+	auto try_get_reply() -> result<reply::reply_t>
+	{
+		if(!c)
+			return error_code{errc::io, "Context is not connected"};
+		for(; abandoned; --abandoned)
+		{
+			void* late;
+			if(receive(&late) == REDIS_ERR)
+				return lost();
+			freeReplyObject(late);
+		}
+		void* res;
+		if(receive(&res) == REDIS_ERR)
+			return lost();
+		
+		reply::reply_t reply{ static_cast<redisReply*>(res), freeReplyObject };
+		if(reply->type == REDIS_REPLY_ERROR)
+			return error_code::from_reply(reply.get());
+		return reply;
+	}
+	
 	void append_command(const std::vector<std::string>& args)
 	{
+		if(!c)
+			throw error("Context is not connected");
 		auto argc = args.size();
 		std::vector<const char*> argv(argc);
 		std::vector<size_t> argvlen(argc);
 		std::transform(begin(args), end(args), begin(argv), [](const std::string& s) -> const char* { return s.c_str(); });
 		std::transform(begin(args), end(args), begin(argvlen), [](const std::string& s) -> size_t { return s.size(); });
 	
+		if(observer)
+			observer->sent(argc, argv.data(), argvlen.data());
 		redisAppendCommandArgv(c.get(), argc, argv.data(), argvlen.data());
 		if(c->err)
 			critical_error();
 	}
 	
+	/*
+	 Append a command from raw argument buffers.
+	 The arguments are copied once, straight into the output buffer, so
+	 large payloads (e.g. a mapped file) need no intermediate string.
+	*/
+	void append_command(std::size_t argc, const char* const* argv, const size_t* argvlen)
+	{
+		if(!c)
+			throw error("Context is not connected");
+		if(observer)
+			observer->sent(argc, argv, argvlen);
+		redisAppendCommandArgv(c.get(), argc, const_cast<const char**>(argv), argvlen);
+		if(c->err)
+			critical_error();
+	}
+	
+	/*
+	 Append a command already encoded as RESP, e.g. by prepared_command.
+	 The text is copied as is into the output buffer.
+	*/
+	void append_formatted(const char* cmd, std::size_t len)
+	{
+		if(!c)
+			throw error("Context is not connected");
+		redisAppendFormattedCommand(c.get(), cmd, len);
+		if(c->err)
+			critical_error();
+	}
+	
+	/*
+	 Write appended commands without waiting for their replies, e.g. to
+	 put several connections' pipelines in flight before reading any.
+	*/
+	void flush()
+	{
+		if(!c)
+			throw error("Context is not connected");
+		int done = 0;
+		while(!done)
+		{
+			if(redisBufferWrite(c.get(), &done) == REDIS_ERR)
+				critical_error();
+		}
+	}
+	
 	auto get_reply() -> reply::reply_t
 	{
+		if(!c)
+			throw error("Context is not connected");
 		void* reply;
 		
-		int res = redisGetReply(c.get(), &reply);
+		drain();
+		int res = receive(&reply);
 		if(res == REDIS_ERR)
 			critical_error();
 		
 		return { static_cast<redisReply*>(reply), freeReplyObject };
 	}
+	
+	/*
+	 Get a reply whose nodes are allocated from the given arena.
+	 The reply is valid until the arena is reset or destroyed.
+	*/
+	auto get_reply(reply::arena& a) -> reply::ref
+	{
+		if(!c)
+			throw error("Context is not connected");
+		void* reply;
+		
+		drain();
+		auto reader = c->reader;
+		auto fn = reader->fn;
+		auto privdata = reader->privdata;
+		reader->fn = a.functions();
+		reader->privdata = &a;
+		int res = receive(&reply);
+		// A reply cut short by an error is in the arena; redisFree must not free it.
+		if(res == REDIS_ERR)
+			reader->reply = nullptr;
+		reader->fn = fn;
+		reader->privdata = privdata;
+		if(res == REDIS_ERR)
+			critical_error();
+		
+		return static_cast<const redisReply*>(reply);
+	}
+	
+	/*
+	 Send a command and get a reply allocated from the given arena.
+	 e.g.
+	 reply::arena a;
+	 reply::string foo = c.command({"GET", "foo"}, a);
+	*/
+	auto command(const std::vector<std::string>& args, reply::arena& a) -> reply::ref
+	{
+		append_command(args);
+		return get_reply(a);
+	}
+	
+	/*
+	 Get the next reply, or throw timeout_error if it has not arrived by
+	 deadline. The reply is then abandoned per the timeout policy.
+	*/
+	auto get_reply(clock::time_point deadline) -> reply::reply_t
+	{
+		if(!c)
+			throw error("Context is not connected");
+		while(true)
+		{
+			auto reply = read_reply(deadline);
+			if(!reply)
+			{
+				++timeouts;
+				abandon(1);
+				throw timeout_error("Command deadline exceeded.");
+			}
+			if(!abandoned)
+				return { reply, freeReplyObject };
+			freeReplyObject(reply);
+			--abandoned;
+		}
+	}
+	
+	/*
+	 Send a command and get a reply, or throw timeout_error at deadline.
+	 e.g.
+	 auto reply = c.command({"GET", "foo"}, context::clock::now() + std::chrono::milliseconds(20));
+	*/
+	auto command(const std::vector<std::string>& args, clock::time_point deadline) -> reply::reply_t
+	{
+		append_command(args);
+		return get_reply(deadline);
+	}
+	template <typename Rep, typename Period>
+	auto command(const std::vector<std::string>& args, std::chrono::duration<Rep, Period> timeout) -> reply::reply_t
+	{
+		return command(args, clock::now() + timeout);
+	}
 };
 
+#ifndef HIREDIS11_IO_URING
+inline auto context::thread_transport() -> transport*
+{
+	return nullptr;
 }
+#endif
+
+}
+
+#ifdef HIREDIS11_IO_URING
+#include "io_ring.hh"
+#endif
 
 #endif /* HIREDIS11_CONTEXT_H_ */
@@ -0,0 +1,1004 @@
+#ifndef HIREDIS11_COROUTINE_H_
+#define HIREDIS11_COROUTINE_H_
+#if defined(__cpp_impl_coroutine) && __cplusplus >= 202002L
+#include <coroutine>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <cstddef>
+#include <new>
+#include <map>
+#include <boost/optional.hpp>
+#include "async.hh"
+
+namespace hiredis
+{
+namespace coro
+{
+
+/*
+ Recycling allocator for coroutine frames.
+ Freed frames are kept on per-thread free lists by size class, so steady
+ state awaits do not touch the global heap.
+*/
+class frame_allocator
+{
+private:
+	static constexpr std::size_t granularity = 64;
+	static constexpr std::size_t classes = 32;
+	static constexpr std::size_t max_cached = 1024;
+	static constexpr std::size_t header = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+
+	struct node
+	{
+		node* next;
+	};
+	struct cache
+	{
+		node* free[classes];
+		std::size_t count[classes];
+
+		cache()
+		 : free(), count()
+		{
+		}
+
+		~cache()
+		{
+			for(auto head : free)
+			{
+				while(head)
+				{
+					auto next = head->next;
+					::operator delete(head);
+					head = next;
+				}
+			}
+		}
+	};
+	static auto local() -> cache&
+	{
+		thread_local cache c;
+		return c;
+	}
+public:
+	static auto allocate(std::size_t n) -> void*
+	{
+		auto cls = (n + header + granularity - 1) / granularity;
+		void* p = nullptr;
+		if(cls < classes)
+		{
+			auto& c = local();
+			if(auto head = c.free[cls])
+			{
+				c.free[cls] = head->next;
+				--c.count[cls];
+				p = head;
+			}
+			else
+			{
+				p = ::operator new(cls * granularity);
+			}
+		}
+		else
+		{
+			p = ::operator new(n + header);
+		}
+		*static_cast<std::size_t*>(p) = cls;
+		return static_cast<char*>(p) + header;
+	}
+	static void deallocate(void* frame)
+	{
+		auto p = static_cast<char*>(frame) - header;
+		auto cls = *reinterpret_cast<std::size_t*>(p);
+		auto& c = local();
+		if(cls < classes && c.count[cls] < max_cached)
+		{
+			auto n = reinterpret_cast<node*>(p);
+			n->next = c.free[cls];
+			c.free[cls] = n;
+			++c.count[cls];
+			return;
+		}
+		::operator delete(p);
+	}
+};
+
+using hiredis::cancellation_source;
+
+/*
+ State shared by every task promise.
+ The deadline and cancellation source propagate from an awaiting task to
+ the tasks and commands it awaits.
+*/
+struct promise_base
+{
+	std::coroutine_handle<> continuation;
+	std::exception_ptr exception;
+	event_loop::clock::time_point deadline = event_loop::clock::time_point::max();
+	cancellation_source* token = nullptr;
+
+	static void* operator new(std::size_t n)
+	{
+		return frame_allocator::allocate(n);
+	}
+	static void operator delete(void* p)
+	{
+		frame_allocator::deallocate(p);
+	}
+
+	struct final_awaiter
+	{
+		bool await_ready() noexcept
+		{
+			return false;
+		}
+		template <typename Promise>
+		auto await_suspend(std::coroutine_handle<Promise> h) noexcept -> std::coroutine_handle<>
+		{
+			auto next = h.promise().continuation;
+			return next ? next : std::noop_coroutine();
+		}
+		void await_resume() noexcept
+		{
+		}
+	};
+
+	auto initial_suspend() noexcept -> std::suspend_always
+	{
+		return {};
+	}
+	auto final_suspend() noexcept -> final_awaiter
+	{
+		return {};
+	}
+	void unhandled_exception()
+	{
+		exception = std::current_exception();
+	}
+
+	void inherit(const promise_base& parent)
+	{
+		deadline = std::min(deadline, parent.deadline);
+		if(!token)
+			token = parent.token;
+	}
+};
+
+// Apply the awaiting coroutine's deadline and cancellation, if it has any.
+template <typename Promise>
+inline void inherit(promise_base& child, std::coroutine_handle<Promise> parent)
+{
+	if constexpr(std::is_base_of<promise_base, Promise>::value)
+		child.inherit(parent.promise());
+}
+
+template <typename T>
+class task;
+
+template <typename T>
+struct promise : promise_base
+{
+	std::optional<T> value;
+
+	auto get_return_object() -> task<T>;
+	template <typename U>
+	void return_value(U&& v)
+	{
+		value.emplace(std::forward<U>(v));
+	}
+	auto result() -> T
+	{
+		if(exception)
+			std::rethrow_exception(exception);
+		return std::move(*value);
+	}
+};
+
+template <>
+struct promise<void> : promise_base
+{
+	auto get_return_object() -> task<void>;
+	void return_void()
+	{
+	}
+	void result()
+	{
+		if(exception)
+			std::rethrow_exception(exception);
+	}
+};
+
+/*
+ Lazily started coroutine returning T.
+ e.g.
+ auto value = co_await string::get(ac, "foo").with_timeout(std::chrono::milliseconds(5));
+*/
+template <typename T>
+class task
+{
+public:
+	typedef coro::promise<T> promise_type;
+private:
+	std::coroutine_handle<promise_type> h;
+public:
+	explicit task(std::coroutine_handle<promise_type> h)
+	 : h(h)
+	{
+	}
+	task(task&& o) noexcept
+	 : h(std::exchange(o.h, {}))
+	{
+	}
+	task& operator=(task&& o) noexcept
+	{
+		if(this != &o)
+		{
+			if(h)
+				h.destroy();
+			h = std::exchange(o.h, {});
+		}
+		return *this;
+	}
+	~task()
+	{
+		if(h)
+			h.destroy();
+	}
+
+	task(const task&) = delete;
+	task& operator=(const task&) = delete;
+
+	// Every command awaited by this task must complete before the deadline.
+	auto with_deadline(event_loop::clock::time_point deadline) && -> task&&
+	{
+		h.promise().deadline = std::min(h.promise().deadline, deadline);
+		return std::move(*this);
+	}
+	template <typename Rep, typename Period>
+	auto with_timeout(std::chrono::duration<Rep, Period> timeout) && -> task&&
+	{
+		return std::move(*this).with_deadline(event_loop::clock::now() + timeout);
+	}
+	auto with_cancellation(cancellation_source& source) && -> task&&
+	{
+		h.promise().token = &source;
+		return std::move(*this);
+	}
+
+	auto handle() const -> std::coroutine_handle<promise_type>
+	{
+		return h;
+	}
+
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+	template <typename Promise>
+	auto await_suspend(std::coroutine_handle<Promise> parent) noexcept -> std::coroutine_handle<>
+	{
+		h.promise().continuation = parent;
+		inherit(h.promise(), parent);
+		return h;
+	}
+	auto await_resume() -> T
+	{
+		return h.promise().result();
+	}
+};
+
+template <typename T>
+inline auto promise<T>::get_return_object() -> task<T>
+{
+	return task<T>{std::coroutine_handle<promise<T>>::from_promise(*this)};
+}
+inline auto promise<void>::get_return_object() -> task<void>
+{
+	return task<void>{std::coroutine_handle<promise<void>>::from_promise(*this)};
+}
+
+namespace detail
+{
+// Self-destroying coroutine used to start a task from non-coroutine code.
+struct detached
+{
+	struct promise_type : promise_base
+	{
+		auto get_return_object() -> detached
+		{
+			return {};
+		}
+		auto initial_suspend() noexcept -> std::suspend_never
+		{
+			return {};
+		}
+		auto final_suspend() noexcept -> std::suspend_never
+		{
+			return {};
+		}
+		void return_void()
+		{
+		}
+		void unhandled_exception()
+		{
+			std::terminate();
+		}
+	};
+};
+
+template <typename T, typename F>
+inline auto run(task<T> t, F done) -> detached
+{
+	if constexpr(std::is_void<T>::value)
+	{
+		co_await t;
+		done();
+	}
+	else
+	{
+		done(co_await t);
+	}
+}
+}
+
+/*
+ Start a task on the calling thread; it runs until its first suspension.
+ Exceptions escaping a spawned task terminate the program.
+*/
+inline void spawn(task<void> t)
+{
+	detail::run(std::move(t), []{});
+}
+
+// Spawn on a loop, from any thread.
+inline void spawn(event_loop& loop, task<void> t)
+{
+	auto holder = std::make_shared<task<void>>(std::move(t));
+	loop.post([holder]{ spawn(std::move(*holder)); });
+}
+
+/*
+ Run the loop until the task completes and return its result.
+ e.g.
+ auto value = coro::sync_wait(loop, string::get(ac, "foo"));
+*/
+template <typename T>
+inline auto sync_wait(event_loop& loop, task<T> t) -> T
+{
+	bool done = false;
+	std::exception_ptr error;
+	std::optional<typename std::conditional<std::is_void<T>::value, bool, T>::type> result;
+
+	auto wrapper = [&]() -> task<void>
+	{
+		try
+		{
+			if constexpr(std::is_void<T>::value)
+				co_await std::move(t);
+			else
+				result.emplace(co_await std::move(t));
+		}
+		catch(...)
+		{
+			error = std::current_exception();
+		}
+	};
+	detail::run(wrapper(), [&]{ done = true; });
+	loop.run_until([&]{ return done; });
+
+	if(error)
+		std::rethrow_exception(error);
+	if constexpr(!std::is_void<T>::value)
+		return std::move(*result);
+}
+
+/*
+ Awaitable batch of commands on one async_context.
+ Completes when the last reply arrives, the deadline passes or the
+ awaiting task is cancelled. Abandoned replies are read and discarded.
+*/
+class batch_awaiter : private async_context::handler, private event_loop::timer, private cancellation_source::registration
+{
+private:
+	async_context& ac;
+	std::vector<std::vector<std::string>> commands;
+	std::vector<reply::reply_t> replies;
+	std::exception_ptr error;
+	std::coroutine_handle<> waiter;
+	event_loop::clock::time_point deadline;
+	cancellation_source* token;
+	bool transaction;
+
+	void finish()
+	{
+		ac.loop().cancel(*this);
+		if(token)
+			token->remove(*this);
+		waiter.resume();
+	}
+	void complete(reply::reply_t reply, std::exception_ptr e) override
+	{
+		replies.push_back(reply);
+		if(e && !error)
+			error = e;
+		if(replies.size() == commands.size())
+			finish();
+	}
+	void expire() override
+	{
+		ac.cancel(*this);
+		++ac.timeouts;
+		error = std::make_exception_ptr(timeout_error("Command deadline exceeded."));
+		finish();
+	}
+	void cancelled() override
+	{
+		ac.cancel(*this);
+		error = std::make_exception_ptr(cancelled_error("Command cancelled."));
+		finish();
+	}
+public:
+	batch_awaiter(async_context& ac, std::vector<std::vector<std::string>> commands, bool transaction = false)
+	 : ac(ac), commands(std::move(commands)), deadline(event_loop::clock::time_point::max()), token(nullptr), transaction(transaction)
+	{
+	}
+
+	auto with_deadline(event_loop::clock::time_point when) && -> batch_awaiter&&
+	{
+		deadline = std::min(deadline, when);
+		return std::move(*this);
+	}
+	template <typename Rep, typename Period>
+	auto with_timeout(std::chrono::duration<Rep, Period> timeout) && -> batch_awaiter&&
+	{
+		return std::move(*this).with_deadline(event_loop::clock::now() + timeout);
+	}
+	auto with_cancellation(cancellation_source& source) && -> batch_awaiter&&
+	{
+		token = &source;
+		return std::move(*this);
+	}
+
+	bool await_ready() const noexcept
+	{
+		return commands.empty();
+	}
+	template <typename Promise>
+	bool await_suspend(std::coroutine_handle<Promise> h)
+	{
+		if constexpr(std::is_base_of<promise_base, Promise>::value)
+		{
+			deadline = std::min(deadline, h.promise().deadline);
+			if(!token)
+				token = h.promise().token;
+		}
+		if(token && token->cancelled())
+		{
+			error = std::make_exception_ptr(cancelled_error("Command cancelled."));
+			return false;
+		}
+
+		waiter = h;
+		replies.reserve(commands.size());
+		for(auto& args : commands)
+			ac.command(args, *this);
+		if(deadline != event_loop::clock::time_point::max())
+			ac.loop().schedule(*this, deadline);
+		if(token)
+			token->add(*this);
+		return true;
+	}
+	auto await_resume() -> std::vector<reply::reply_t>
+	{
+		if(error)
+			std::rethrow_exception(error);
+		if(!transaction)
+			return std::move(replies);
+
+		// MULTI and QUEUED statuses carry any queueing errors.
+		for(std::size_t i = 0; i + 1 < replies.size(); ++i)
+			reply::status{replies[i]};
+		return reply::array{replies.back()};
+	}
+};
+
+/*
+ Single command awaiter that decodes its reply.
+ Not a coroutine itself, so awaiting a wrapped command needs no frame,
+ and it keeps its one reply inline rather than in a batch.
+*/
+template <typename T>
+class awaitable : private async_context::handler, private event_loop::timer, private cancellation_source::registration
+{
+public:
+	typedef T (*decoder)(reply::reply_t);
+private:
+	async_context& ac;
+	std::vector<std::string> args;
+	reply::reply_t reply;
+	std::exception_ptr error;
+	std::coroutine_handle<> waiter;
+	event_loop::clock::time_point deadline;
+	cancellation_source* token;
+	decoder decode;
+
+	void finish()
+	{
+		ac.loop().cancel(*this);
+		if(token)
+			token->remove(*this);
+		waiter.resume();
+	}
+	void complete(reply::reply_t r, std::exception_ptr e) override
+	{
+		reply = r;
+		error = e;
+		finish();
+	}
+	void expire() override
+	{
+		ac.cancel(*this);
+		++ac.timeouts;
+		error = std::make_exception_ptr(timeout_error("Command deadline exceeded."));
+		finish();
+	}
+	void cancelled() override
+	{
+		ac.cancel(*this);
+		error = std::make_exception_ptr(cancelled_error("Command cancelled."));
+		finish();
+	}
+public:
+	awaitable(async_context& ac, std::vector<std::string> args, decoder decode)
+	 : ac(ac), args(std::move(args)), deadline(event_loop::clock::time_point::max()), token(nullptr), decode(decode)
+	{
+	}
+
+	auto with_deadline(event_loop::clock::time_point when) && -> awaitable&&
+	{
+		deadline = std::min(deadline, when);
+		return std::move(*this);
+	}
+	template <typename Rep, typename Period>
+	auto with_timeout(std::chrono::duration<Rep, Period> timeout) && -> awaitable&&
+	{
+		return std::move(*this).with_deadline(event_loop::clock::now() + timeout);
+	}
+	auto with_cancellation(cancellation_source& source) && -> awaitable&&
+	{
+		token = &source;
+		return std::move(*this);
+	}
+
+	bool await_ready() const noexcept
+	{
+		return false;
+	}
+	template <typename Promise>
+	bool await_suspend(std::coroutine_handle<Promise> h)
+	{
+		if constexpr(std::is_base_of<promise_base, Promise>::value)
+		{
+			deadline = std::min(deadline, h.promise().deadline);
+			if(!token)
+				token = h.promise().token;
+		}
+		if(token && token->cancelled())
+		{
+			error = std::make_exception_ptr(cancelled_error("Command cancelled."));
+			return false;
+		}
+
+		waiter = h;
+		ac.command(args, *this);
+		if(deadline != event_loop::clock::time_point::max())
+			ac.loop().schedule(*this, deadline);
+		if(token)
+			token->add(*this);
+		return true;
+	}
+	auto await_resume() -> T
+	{
+		if(error)
+			std::rethrow_exception(error);
+		return decode(std::move(reply));
+	}
+};
+
+/*
+ Send a command and await its reply.
+ e.g.
+ reply::string foo = co_await coro::command(ac, {"GET", "foo"});
+*/
+inline auto command(async_context& ac, std::vector<std::string> args) -> awaitable<reply::reply_t>
+{
+	return {ac, std::move(args), [](reply::reply_t reply) { return reply; }};
+}
+
+/*
+ Commands queued locally and sent together when awaited.
+ e.g.
+ coro::pipeline p(ac);
+ p.command({"SET", "a", "1"});
+ p.command({"GET", "a"});
+ auto replies = co_await p.execute();
+*/
+class pipeline
+{
+private:
+	async_context& ac;
+	std::vector<std::vector<std::string>> commands;
+public:
+	pipeline(async_context& ac)
+	 : ac(ac)
+	{
+	}
+
+	void command(std::vector<std::string> args)
+	{
+		commands.push_back(std::move(args));
+	}
+	auto execute() -> batch_awaiter
+	{
+		std::vector<std::vector<std::string>> batch;
+		batch.swap(commands);
+		return {ac, std::move(batch)};
+	}
+};
+
+/*
+ MULTI/EXEC block sent as one batch.
+ Awaiting execute() yields the EXEC replies.
+*/
+class transaction
+{
+private:
+	async_context& ac;
+	std::vector<std::vector<std::string>> commands;
+public:
+	transaction(async_context& ac)
+	 : ac(ac)
+	{
+	}
+
+	void command(std::vector<std::string> args)
+	{
+		commands.push_back(std::move(args));
+	}
+	auto execute() -> batch_awaiter
+	{
+		std::vector<std::vector<std::string>> batch;
+		batch.reserve(commands.size() + 2);
+		batch.push_back({"MULTI"});
+		for(auto& args : commands)
+			batch.push_back(std::move(args));
+		batch.push_back({"EXEC"});
+		commands.clear();
+		return {ac, std::move(batch), true};
+	}
+};
+
+/*
+ Awaitable counterparts of the commands.hh key, string, hash, set and
+ connection wrappers. Other commands are awaited through coro::command.
+ e.g.
+ using namespace hiredis::coro::commands;
+ auto foo = co_await string::get(ac, "foo");
+*/
+namespace commands
+{
+
+namespace detail
+{
+inline auto integer(reply::reply_t reply) -> long long
+{
+	return reply::integer{reply}.value;
+}
+inline auto boolean(reply::reply_t reply) -> bool
+{
+	return reply::integer{reply}.value != 0;
+}
+inline auto status(reply::reply_t reply) -> std::string
+{
+	return reply::status{reply}.value;
+}
+inline auto string(reply::reply_t reply) -> std::string
+{
+	return reply::string{reply}.value;
+}
+inline auto optional_string(reply::reply_t reply) -> boost::optional<std::string>
+{
+	if(reply::is_nill(reply))
+		return {};
+	return {true, reply::string{reply}};
+}
+inline auto string_array(reply::reply_t reply) -> std::vector<std::string>
+{
+	return reply::string_array{reply};
+}
+}
+
+namespace key
+{
+// Delete a key
+template<typename Key, typename... Keys>
+inline auto del(async_context& c, Key key, Keys... keys) -> awaitable<long long>
+{
+	return {c, {"DEL", key, keys...}, detail::integer};
+}
+
+// Determine if a key exists
+template<typename Key>
+inline auto exists(async_context& c, Key key) -> awaitable<bool>
+{
+	return {c, {"EXISTS", key}, detail::boolean};
+}
+
+// Set a key's time to live in seconds
+template<typename Key>
+inline auto expire(async_context& c, Key key, std::chrono::seconds ttl) -> awaitable<bool>
+{
+	return {c, {"EXPIRE", key, std::to_string(ttl.count())}, detail::boolean};
+}
+
+// Set a key's time to live in milliseconds
+template<typename Key>
+inline auto expire(async_context& c, Key key, std::chrono::milliseconds ttl) -> awaitable<bool>
+{
+	return {c, {"PEXPIRE", key, std::to_string(ttl.count())}, detail::boolean};
+}
+
+// Remove the expiration from a key
+template<typename Key>
+inline auto persist(async_context& c, Key key) -> awaitable<bool>
+{
+	return {c, {"PERSIST", key}, detail::boolean};
+}
+
+// Get the time to live for a key
+template<typename Key>
+inline auto ttl(async_context& c, Key key) -> awaitable<std::chrono::seconds>
+{
+	return {c, {"TTL", key}, [](reply::reply_t reply) { return std::chrono::seconds{reply::integer{reply}.value}; }};
+}
+
+// Get the time to live for a key in milliseconds
+template<typename Key>
+inline auto ttl_ms(async_context& c, Key key) -> awaitable<std::chrono::milliseconds>
+{
+	return {c, {"PTTL", key}, [](reply::reply_t reply) { return std::chrono::milliseconds{reply::integer{reply}.value}; }};
+}
+
+// Determine the type stored at key
+template<typename Key>
+inline auto type(async_context& c, Key key) -> awaitable<std::string>
+{
+	return {c, {"TYPE", key}, detail::status};
+}
+}
+
+namespace string
+{
+// Decrement the integer value of a key by one
+template<typename Key>
+inline auto decr(async_context& c, Key key) -> awaitable<long long>
+{
+	return {c, {"DECR", key}, detail::integer};
+}
+
+// Decrement the integer value of a key by the given number
+template<typename Key>
+inline auto decr_by(async_context& c, Key key, long long decrement) -> awaitable<long long>
+{
+	return {c, {"DECRBY", key, std::to_string(decrement)}, detail::integer};
+}
+
+// Get the value of a key
+template<typename Key>
+inline auto get(async_context& c, Key key) -> awaitable<boost::optional<std::string>>
+{
+	return {c, {"GET", key}, detail::optional_string};
+}
+
+// Set the string value of a key and return its old value
+template<typename Key, typename Value>
+inline auto get_set(async_context& c, Key key, Value value) -> awaitable<boost::optional<std::string>>
+{
+	return {c, {"GETSET", key, value}, detail::optional_string};
+}
+
+// Increment the integer value of a key by one
+template<typename Key>
+inline auto incr(async_context& c, Key key) -> awaitable<long long>
+{
+	return {c, {"INCR", key}, detail::integer};
+}
+
+// Increment the integer value of a key by the given amount
+template<typename Key>
+inline auto incr_by(async_context& c, Key key, long long increment) -> awaitable<long long>
+{
+	return {c, {"INCRBY", key, std::to_string(increment)}, detail::integer};
+}
+
+// Set the string value of a key
+template<typename Key, typename Value>
+inline auto set(async_context& c, Key key, Value value) -> awaitable<std::string>
+{
+	return {c, {"SET", key, value}, detail::status};
+}
+template<typename Key, typename Value>
+inline auto set(async_context& c, Key key, Value value, std::chrono::seconds ttl) -> awaitable<std::string>
+{
+	return {c, {"SET", key, value, "EX", std::to_string(ttl.count())}, detail::status};
+}
+template<typename Key, typename Value>
+inline auto set(async_context& c, Key key, Value value, std::chrono::milliseconds ttl) -> awaitable<std::string>
+{
+	return {c, {"SET", key, value, "PX", std::to_string(ttl.count())}, detail::status};
+}
+
+// Set the value of a key, only if the key does not exist
+template<typename Key, typename Value>
+inline auto setnx(async_context& c, Key key, Value value) -> awaitable<bool>
+{
+	return {c, {"SET", key, value, "NX"}, [](reply::reply_t reply) { return !reply::is_nill(reply); }};
+}
+
+// Get the length of the value stored in a key
+template<typename Key>
+inline auto strlen(async_context& c, Key key) -> awaitable<long long>
+{
+	return {c, {"STRLEN", key}, detail::integer};
+}
+}
+
+namespace hash
+{
+// Delete one or more hash fields
+template<typename Key, typename Field, typename... Fields>
+inline auto del(async_context& c, Key key, Field field, Fields... fields) -> awaitable<long long>
+{
+	return {c, {"HDEL", key, field, fields...}, detail::integer};
+}
+
+// Determine if a hash field exists
+template<typename Key, typename Field>
+inline auto exists(async_context& c, Key key, Field field) -> awaitable<bool>
+{
+	return {c, {"HEXISTS", key, field}, detail::boolean};
+}
+
+// Get the value of a hash field
+template<typename Key, typename Field>
+inline auto get(async_context& c, Key key, Field field) -> awaitable<boost::optional<std::string>>
+{
+	return {c, {"HGET", key, field}, detail::optional_string};
+}
+
+// Get all the fields and values in a hash
+template<typename Key>
+inline auto get(async_context& c, Key key) -> awaitable<std::map<std::string, std::string>>
+{
+	return {c, {"HGETALL", key}, [](reply::reply_t reply)
+	{
+		std::vector<std::string> data = reply::string_array{reply};
+		if(data.size() % 2)
+			throw error("HGETALL result not multiple of 2");
+		std::map<std::string, std::string> res;
+		for(auto it = begin(data); it != end(data); it += 2)
+			res.insert(std::make_pair(*it, *(it+1)));
+		return res;
+	}};
+}
+
+// Increment the integer value of a hash field by the given number
+template<typename Key, typename Field>
+inline auto incr_by(async_context& c, Key key, Field field, long long increment) -> awaitable<long long>
+{
+	return {c, {"HINCRBY", key, field, std::to_string(increment)}, detail::integer};
+}
+
+// Get all the fields in a hash
+template<typename Key>
+inline auto keys(async_context& c, Key key) -> awaitable<std::vector<std::string>>
+{
+	return {c, {"HKEYS", key}, detail::string_array};
+}
+
+// Get the number of fields in a hash
+template<typename Key>
+inline auto len(async_context& c, Key key) -> awaitable<long long>
+{
+	return {c, {"HLEN", key}, detail::integer};
+}
+
+// Set the string value of a hash field
+template<typename Key, typename Field, typename Value>
+inline auto set(async_context& c, Key key, Field field, Value value) -> awaitable<bool>
+{
+	return {c, {"HSET", key, field, value}, detail::boolean};
+}
+
+// Set the value of a hash field, only if the field does not exist
+template<typename Key, typename Field, typename Value>
+inline auto setnx(async_context& c, Key key, Field field, Value value) -> awaitable<bool>
+{
+	return {c, {"HSETNX", key, field, value}, detail::boolean};
+}
+
+// Get all the values in a hash
+template<typename Key>
+inline auto values(async_context& c, Key key) -> awaitable<std::vector<std::string>>
+{
+	return {c, {"HVALS", key}, detail::string_array};
+}
+}
+
+namespace set
+{
+// Add one or more members to a set
+template<typename Key, typename Member, typename... Members>
+inline auto add(async_context& c, Key key, Member member, Members... members) -> awaitable<long long>
+{
+	return {c, {"SADD", key, member, members...}, detail::integer};
+}
+
+// Get the number of members in a set
+template<typename Key>
+inline auto card(async_context& c, Key key) -> awaitable<long long>
+{
+	return {c, {"SCARD", key}, detail::integer};
+}
+
+// Determine if a given value is a member of a set
+template<typename Key, typename Member>
+inline auto is_member(async_context& c, Key key, Member member) -> awaitable<bool>
+{
+	return {c, {"SISMEMBER", key, member}, detail::boolean};
+}
+
+// Get all the members in a set
+template<typename Key>
+inline auto members(async_context& c, Key key) -> awaitable<std::vector<std::string>>
+{
+	return {c, {"SMEMBERS", key}, detail::string_array};
+}
+
+// Remove one or more members from a set
+template<typename Key, typename Member, typename... Members>
+inline auto rem(async_context& c, Key key, Member member, Members... members) -> awaitable<long long>
+{
+	return {c, {"SREM", key, member, members...}, detail::integer};
+}
+}
+
+namespace connection
+{
+// Echo the given string
+inline auto echo(async_context& c, const std::string& message) -> awaitable<std::string>
+{
+	return {c, {"ECHO", message}, detail::string};
+}
+
+// Ping the server
+inline auto ping(async_context& c) -> awaitable<std::string>
+{
+	return {c, {"PING"}, detail::status};
+}
+
+// Change the selected database for the current connection
+inline auto select(async_context& c, int index) -> awaitable<std::string>
+{
+	return {c, {"SELECT", std::to_string(index)}, detail::status};
+}
+}
+
+}
+
+}
+}
+
+#endif
+#endif /* HIREDIS11_COROUTINE_H_ */
@@ -0,0 +1,349 @@
+#ifndef HIREDIS11_COUNTERS_H_
+#define HIREDIS11_COUNTERS_H_
+#include <hiredis/hiredis.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <sstream>
+#include <iomanip>
+#include <limits>
+#include <type_traits>
+#include "context.hh"
+#include "reply.hh"
+#include "error.hh"
+
+namespace hiredis
+{
+
+/*
+ Write-behind aggregation of increments.
+ incr() sums locally; a background thread sends the totals as pipelined
+ INCRBY / HINCRBY / HINCRBYFLOAT at least every interval, sooner once
+ max_pending distinct counters are waiting, and on destruction. Updates
+ are striped over per-thread shards so concurrent callers rarely meet.
+ Totals not acknowledged because the connection failed are kept for the
+ next flush; a batch cut off mid-way may therefore be applied twice.
+ e.g.
+ counter_buffer counters("localhost", 6379);
+ counters.incr("hits", 1);
+ counters.incr("hits:by_page", "/index", 1);
+*/
+class counter_buffer
+{
+public:
+	struct options
+	{
+		// Upper bound on how long an increment stays local.
+		std::chrono::milliseconds interval;
+		// Distinct pending counters that trigger an early flush.
+		std::size_t max_pending;
+		// Commands per pipelined batch.
+		std::size_t batch;
+
+		options(std::chrono::milliseconds interval = std::chrono::milliseconds{1000}, std::size_t max_pending = 10000, std::size_t batch = 1000)
+		 : interval(interval), max_pending(max_pending), batch(batch)
+		{
+		}
+	};
+
+	struct statistics
+	{
+		unsigned long long increments;
+		unsigned long long commands;
+		unsigned long long flushes;
+		unsigned long long failures;
+	};
+private:
+	typedef std::pair<std::string, std::string> field;
+
+	struct totals
+	{
+		std::unordered_map<std::string, long long> keys;
+		std::map<field, long long> fields;
+		std::map<field, double> float_fields;
+
+		auto size() const -> std::size_t
+		{
+			return keys.size() + fields.size() + float_fields.size();
+		}
+		// Zero totals (already sent) are skipped.
+		void merge(totals& o)
+		{
+			for(auto& k : o.keys)
+			{
+				if(k.second)
+					keys[k.first] += k.second;
+			}
+			for(auto& f : o.fields)
+			{
+				if(f.second)
+					fields[f.first] += f.second;
+			}
+			for(auto& f : o.float_fields)
+			{
+				if(f.second)
+					float_fields[f.first] += f.second;
+			}
+		}
+	};
+
+	struct shard
+	{
+		std::mutex m;
+		totals pending;
+	};
+
+	std::string host;
+	int port;
+	options o;
+	std::vector<std::unique_ptr<shard>> shards;
+	std::unique_ptr<context> c;
+
+	std::atomic<std::size_t> pending;
+	std::atomic<unsigned long long> increments;
+	std::atomic<unsigned long long> commands;
+	std::atomic<unsigned long long> flushes;
+	std::atomic<unsigned long long> failures;
+
+	// Serialises flushes; the connection is only used with it held.
+	std::mutex flush_mutex;
+	std::mutex wake_mutex;
+	std::condition_variable wake;
+	bool stopping;
+	std::thread worker;
+
+	auto local() -> shard&
+	{
+		auto h = std::hash<std::thread::id>()(std::this_thread::get_id());
+		return *shards[h % shards.size()];
+	}
+	void added(bool created)
+	{
+		++increments;
+		if(created && ++pending >= o.max_pending)
+			wake.notify_one();
+	}
+
+	static auto format(double value) -> std::string
+	{
+		std::ostringstream s;
+		s << std::setprecision(std::numeric_limits<double>::max_digits10) << value;
+		return s.str();
+	}
+
+	/*
+	 Send the non-zero totals of t, zeroing each one as its reply arrives.
+	 Totals rejected by the server (e.g. WRONGTYPE) are dropped and
+	 reported; after a connection error the unacknowledged ones remain.
+	*/
+	void send(totals& t)
+	{
+		if(!c || !c->connected())
+			c.reset(new context(host, port));
+
+		struct command
+		{
+			std::vector<std::string> args;
+			long long* integer;
+			double* real;
+		};
+		std::vector<command> batch;
+		std::string failure;
+		auto run = [this, &batch, &failure]
+		{
+			for(auto& cmd : batch)
+				c->append_command(cmd.args);
+			for(auto& cmd : batch)
+			{
+				auto r = c->get_reply();
+				if(r->type == REDIS_REPLY_ERROR && failure.empty())
+					failure = r->str;
+				if(cmd.integer)
+					*cmd.integer = 0;
+				else
+					*cmd.real = 0;
+				++commands;
+			}
+			batch.clear();
+		};
+
+		for(auto& k : t.keys)
+		{
+			if(k.second)
+				batch.push_back({{"INCRBY", k.first, std::to_string(k.second)}, &k.second, nullptr});
+			if(batch.size() >= o.batch)
+				run();
+		}
+		for(auto& f : t.fields)
+		{
+			if(f.second)
+				batch.push_back({{"HINCRBY", f.first.first, f.first.second, std::to_string(f.second)}, &f.second, nullptr});
+			if(batch.size() >= o.batch)
+				run();
+		}
+		for(auto& f : t.float_fields)
+		{
+			if(f.second)
+				batch.push_back({{"HINCRBYFLOAT", f.first.first, f.first.second, format(f.second)}, nullptr, &f.second});
+			if(batch.size() >= o.batch)
+				run();
+		}
+		run();
+		if(!failure.empty())
+			throw error(failure);
+	}
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(wake_mutex);
+		while(!stopping)
+		{
+			wake.wait_for(lock, o.interval, [this]{ return stopping || pending >= o.max_pending; });
+			if(stopping)
+				break;
+			lock.unlock();
+			try
+			{
+				flush();
+			}
+			catch(const std::exception&)
+			{
+				// Counted in failures; retried on the next flush.
+			}
+			lock.lock();
+		}
+	}
+public:
+	counter_buffer(const std::string& host, int port, const options& o = options())
+	 : host(host), port(port), o(o), pending(0), increments(0), commands(0), flushes(0), failures(0), stopping(false)
+	{
+		auto n = std::max(1u, std::thread::hardware_concurrency()) * 2;
+		for(unsigned i = 0; i < n; ++i)
+			shards.emplace_back(new shard());
+		worker = std::thread([this]{ run(); });
+	}
+	// Stops the flush thread and sends whatever is pending.
+	~counter_buffer()
+	{
+		{
+			std::lock_guard<std::mutex> lock(wake_mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		worker.join();
+		try
+		{
+			flush();
+		}
+		catch(...)
+		{
+		}
+	}
+
+	counter_buffer(const counter_buffer&) = delete;
+	counter_buffer& operator=(const counter_buffer&) = delete;
+
+	// INCRBY key increment
+	void incr(const std::string& key, long long increment)
+	{
+		auto& s = local();
+		bool created;
+		{
+			std::lock_guard<std::mutex> lock(s.m);
+			auto res = s.pending.keys.emplace(key, increment);
+			created = res.second;
+			if(!created)
+				res.first->second += increment;
+		}
+		added(created);
+	}
+	// HINCRBY key field increment
+	template <typename Integer>
+	auto incr(const std::string& key, const std::string& field, Integer increment) -> typename std::enable_if<std::is_integral<Integer>::value>::type
+	{
+		auto& s = local();
+		bool created;
+		{
+			std::lock_guard<std::mutex> lock(s.m);
+			auto res = s.pending.fields.emplace(counter_buffer::field(key, field), static_cast<long long>(increment));
+			created = res.second;
+			if(!created)
+				res.first->second += increment;
+		}
+		added(created);
+	}
+	// HINCRBYFLOAT key field increment
+	void incr(const std::string& key, const std::string& field, double increment)
+	{
+		auto& s = local();
+		bool created;
+		{
+			std::lock_guard<std::mutex> lock(s.m);
+			auto res = s.pending.float_fields.emplace(counter_buffer::field(key, field), increment);
+			created = res.second;
+			if(!created)
+				res.first->second += increment;
+		}
+		added(created);
+	}
+
+	/*
+	 Send everything pending now.
+	 On failure unsent totals are kept for the next flush and the error is
+	 rethrown.
+	*/
+	void flush()
+	{
+		std::lock_guard<std::mutex> lock(flush_mutex);
+		totals t;
+		for(auto& s : shards)
+		{
+			totals taken;
+			{
+				std::lock_guard<std::mutex> shard_lock(s->m);
+				std::swap(taken, s->pending);
+			}
+			t.merge(taken);
+		}
+		pending = 0;
+		if(!t.size())
+			return;
+
+		try
+		{
+			send(t);
+			++flushes;
+		}
+		catch(...)
+		{
+			++failures;
+			if(c && !c->connected())
+				c.reset();
+			// Whatever was not acknowledged goes back for the next attempt.
+			auto& s = local();
+			{
+				std::lock_guard<std::mutex> shard_lock(s.m);
+				s.pending.merge(t);
+				pending += s.pending.size();
+			}
+			throw;
+		}
+	}
+
+	auto stats() const -> statistics
+	{
+		return {increments, commands, flushes, failures};
+	}
+};
+
+}
+
+#endif /* HIREDIS11_COUNTERS_H_ */
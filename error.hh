@@ -14,6 +14,24 @@ struct error : std::runtime_error
 	}
 };
 
+// A command did not complete before its deadline.
+struct timeout_error : std::runtime_error
+{
+	timeout_error(const std::string& what)
+	 : std::runtime_error(what)
+	{
+	}
+};
+
+// A command was abandoned by its caller before completing.
+struct cancelled_error : std::runtime_error
+{
+	cancelled_error(const std::string& what)
+	 : std::runtime_error(what)
+	{
+	}
+};
+
 }
 
 #endif /* HIREDIS11_ERROR_H_ */
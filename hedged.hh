@@ -0,0 +1,279 @@
+#ifndef HIREDIS11_HEDGED_H_
+#define HIREDIS11_HEDGED_H_
+#include <memory>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+#include <exception>
+#include "async.hh"
+#include "command_info.hh"
+#include "reply.hh"
+
+namespace hiredis
+{
+
+/*
+ Hedged reads over several connections, e.g. two to the same instance or
+ a primary and its replicas.
+ Every command goes to the first endpoint. Read-only commands (per
+ command_info) that have no reply within a delay derived from recent read
+ latency are sent again to another endpoint; the first reply wins. The
+ other attempt's handler is detached, so its reply is still read in order
+ on its connection and dropped. Hedges are limited to a fraction of reads
+ by a budget.
+ Runs on an event_loop; the blocking command() runs the loop until the
+ reply arrives, so wrapped commands work from the loop's thread.
+ e.g.
+ event_loop loop;
+ hedged_context db(loop, {{"10.0.0.1", 6379}, {"10.0.0.2", 6379}});
+ auto value = commands::string::get(db, "foo");
+ auto hedge_rate = db.stats().hedge_rate();
+*/
+class hedged_context
+{
+public:
+	typedef event_loop::clock clock;
+	typedef async_context::callback callback;
+
+	struct endpoint
+	{
+		std::string host;
+		int port;
+	};
+
+	struct options
+	{
+		// Hedge once a read has taken longer than this percentile of recent reads...
+		double percentile;
+		// ...but no sooner than min_delay and no later than max_delay.
+		std::chrono::microseconds min_delay;
+		std::chrono::microseconds max_delay;
+		// Hedges allowed per read, e.g. 0.05 for at most 5% extra reads.
+		double budget;
+
+		options(double percentile = 95, double budget = 0.05, std::chrono::microseconds min_delay = std::chrono::microseconds(500), std::chrono::microseconds max_delay = std::chrono::milliseconds(50))
+		 : percentile(percentile), min_delay(min_delay), max_delay(max_delay), budget(budget)
+		{
+		}
+	};
+
+	struct statistics
+	{
+		unsigned long long reads;
+		unsigned long long writes;
+		// Reads sent a second time.
+		unsigned long long hedges;
+		// Hedged reads answered first by the second attempt.
+		unsigned long long wins;
+		// Reads that were due a hedge the budget did not allow.
+		unsigned long long denied;
+		// Current hedge delay.
+		std::chrono::microseconds delay;
+
+		statistics()
+		 : reads(0), writes(0), hedges(0), wins(0), denied(0), delay(0)
+		{
+		}
+
+		auto hedge_rate() const -> double
+		{
+			return reads ? static_cast<double>(hedges) / reads : 0;
+		}
+		auto win_rate() const -> double
+		{
+			return hedges ? static_cast<double>(wins) / hedges : 0;
+		}
+	};
+private:
+	static const std::size_t window = 1024;
+	// Latency samples before the percentile is trusted over max_delay.
+	static const std::size_t warmup = 32;
+	static const int burst = 10;
+
+	struct request;
+	struct attempt : async_context::handler
+	{
+		request* r;
+		std::size_t target;
+		bool outstanding;
+
+		attempt()
+		 : r(nullptr), target(0), outstanding(false)
+		{
+		}
+		void complete(reply::reply_t reply, std::exception_ptr error) override;
+	};
+
+	struct request : event_loop::timer
+	{
+		hedged_context& owner;
+		std::vector<std::string> args;
+		callback fn;
+		clock::time_point start;
+		attempt attempts[2];
+
+		request(hedged_context& owner, std::vector<std::string> args, callback fn)
+		 : owner(owner), args(std::move(args)), fn(std::move(fn)), start(clock::now())
+		{
+			attempts[0].r = attempts[1].r = this;
+		}
+		void expire() override
+		{
+			owner.hedge(*this);
+		}
+	};
+
+	event_loop& ev;
+	std::vector<endpoint> endpoints;
+	std::vector<std::unique_ptr<async_context>> targets;
+	options o;
+	statistics s;
+	double credit;
+	std::size_t next;
+	std::vector<clock::rep> samples;
+	std::size_t recorded;
+
+	auto target(std::size_t i) -> async_context&
+	{
+		if(!targets[i]->connected())
+			targets[i].reset(new async_context(ev, endpoints[i].host, endpoints[i].port));
+		return *targets[i];
+	}
+
+	void record(clock::duration latency)
+	{
+		samples[recorded++ % window] = latency.count();
+		// Recomputed every 64 reads once warmed up.
+		if(recorded < warmup || (recorded != warmup && recorded % 64))
+			return;
+		auto n = recorded < window ? recorded : window;
+		std::vector<clock::rep> sorted(samples.begin(), samples.begin() + n);
+		auto k = std::min(n - 1, static_cast<std::size_t>(o.percentile / 100 * n));
+		std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+		auto d = std::chrono::duration_cast<std::chrono::microseconds>(clock::duration(sorted[k]));
+		s.delay = std::max(o.min_delay, std::min(o.max_delay, d));
+	}
+
+	void hedge(request& r)
+	{
+		if(credit < 1)
+		{
+			++s.denied;
+			return;
+		}
+		// Rotate over the endpoints other than the first.
+		for(std::size_t i = 0; i + 1 < targets.size(); ++i)
+		{
+			auto t = 1 + (next + i) % (targets.size() - 1);
+			try
+			{
+				target(t).command(r.args, r.attempts[1]);
+			}
+			catch(const async_context::error&)
+			{
+				continue;
+			}
+			next = t;
+			r.attempts[1].target = t;
+			r.attempts[1].outstanding = true;
+			credit -= 1;
+			++s.hedges;
+			return;
+		}
+	}
+
+	void completed(attempt& a, reply::reply_t reply, std::exception_ptr error)
+	{
+		auto& r = *a.r;
+		a.outstanding = false;
+		auto& other = r.attempts[&a == &r.attempts[0] ? 1 : 0];
+		if(other.outstanding)
+		{
+			// The other attempt may still succeed.
+			if(error)
+				return;
+			targets[other.target]->cancel(other);
+			if(&a == &r.attempts[1])
+				++s.wins;
+		}
+		ev.cancel(r);
+		if(!error)
+			record(clock::now() - r.start);
+		std::unique_ptr<request> done(&r);
+		done->fn(reply, error);
+	}
+public:
+	hedged_context(event_loop& ev, const std::vector<endpoint>& endpoints, const options& o = options())
+	 : ev(ev), endpoints(endpoints), o(o), credit(burst), next(0), samples(window), recorded(0)
+	{
+		if(endpoints.empty())
+			throw std::invalid_argument("hedged_context needs at least one endpoint");
+		for(auto& e : endpoints)
+			targets.emplace_back(new async_context(ev, e.host, e.port));
+		s.delay = o.max_delay;
+	}
+	~hedged_context()
+	{
+		// Pending requests fail as their connections close.
+		targets.clear();
+	}
+
+	hedged_context(const hedged_context&) = delete;
+	hedged_context& operator=(const hedged_context&) = delete;
+
+	auto loop() -> event_loop&
+	{
+		return ev;
+	}
+	auto stats() const -> const statistics&
+	{
+		return s;
+	}
+
+	// Queue a command; fn is called on the loop thread with the first reply.
+	void command(const std::vector<std::string>& args, callback fn)
+	{
+		if(targets.size() < 2 || !command_info::readonly(args))
+		{
+			++s.writes;
+			target(0).command(args, std::move(fn));
+			return;
+		}
+
+		++s.reads;
+		credit = std::min<double>(credit + o.budget, burst);
+		std::unique_ptr<request> r(new request(*this, args, std::move(fn)));
+		target(0).command(r->args, r->attempts[0]);
+		r->attempts[0].outstanding = true;
+		ev.schedule(*r, r->start + s.delay);
+		r.release();
+	}
+
+	// Send a command and wait for its reply, running the loop.
+	auto command(const std::vector<std::string>& args) -> reply::reply_t
+	{
+		reply::reply_t res;
+		std::exception_ptr err;
+		bool done = false;
+		command(args, [&](reply::reply_t reply, std::exception_ptr error)
+		{
+			res = reply;
+			err = error;
+			done = true;
+		});
+		ev.run_until([&done]{ return done; });
+		if(err)
+			std::rethrow_exception(err);
+		return res;
+	}
+};
+
+inline void hedged_context::attempt::complete(reply::reply_t reply, std::exception_ptr error)
+{
+	r->owner.completed(*this, reply, error);
+}
+
+}
+
+#endif /* HIREDIS11_HEDGED_H_ */
@@ -2,83 +2,417 @@
 #define HIREDIS11_H_
 #include <string>
 #include <memory>
+#include <vector>
+#include <algorithm>
 #include "context.hh"
 #include "commands.hh"
+#include "nothrow.hh"
+#include "schema.hh"
+#include "serialize.hh"
 
 #include "error.hh"
+#include "result.hh"
 #include "reply.hh"
 #include "pipeline.hh"
+#include "prepared.hh"
+#include "async.hh"
+#include "coroutine.hh"
+#include "command_info.hh"
+#include "sharded.hh"
+#include "replicated.hh"
+#include "hedged.hh"
+#include "resilient.hh"
+#include "codec.hh"
+#include "pool.hh"
+#include "multiplexed.hh"
+#include "single_flight.hh"
+#include "telemetry.hh"
+#include "hotkeys.hh"
+#include "capture.hh"
+#include "snapshot.hh"
+#include "counters.hh"
 
 namespace hiredis
 {
 namespace types
 {
 
-template <typename T>
-struct Serialize
-{
-	static auto encode(T value) -> std::string;
-};
-template <>
-struct Serialize<int>
+/*
+ A set of T stored in a set, encoded per Encoding (see serialize.hh).
+ e.g.
+ types::unordered_set<uint64_t, context, types::binary> ids(db, "ids");
+ ids.insert(17, 42);
+ for(auto id : ids.members())
+	 ...
+*/
+template <typename T, typename Context = context, typename Encoding = text>
+class unordered_set
 {
-	static auto encode(int value) -> std::string
+private:
+	std::shared_ptr<Context> c;
+	std::string name;
+public:
+	unordered_set(std::shared_ptr<Context> c, const std::string& name)
+	 : c(c), name(name)
 	{
-		return std::to_string(value);
 	}
-};
-template <>
-struct Serialize<uint64_t>
-{
-	static auto encode(uint64_t value) -> std::string
+	
+	bool empty()
 	{
-		return std::to_string(value);
+		return commands::set::card(*c, name) == 0;
 	}
-};
-template <>
-struct Serialize<double>
-{
-	static auto encode(double value) -> std::string
+	std::size_t size()
+	{
+		return commands::set::card(*c, name);
+	}
+	
+	template <typename... Keys>
+	bool insert(Keys... keys)
 	{
-		return std::to_string(value);
+		return commands::set::add(*c, name, Serialize<T, Encoding>::encode(keys)...) > 0;
+	}
+	
+	bool erase(const T& key)
+	{
+		return commands::set::rem(*c, name, Serialize<T, Encoding>::encode(key)) > 0;
+	}
+	
+	bool exists(const T& key)
+	{
+		return commands::set::is_member(*c, name, Serialize<T, Encoding>::encode(key));
+	}
+	
+	auto members() -> std::vector<T>
+	{
+		auto encoded = commands::set::members(*c, name);
+		std::vector<T> values;
+		values.reserve(encoded.size());
+		for(auto& e : encoded)
+			values.push_back(Deserialize<T, Encoding>::decode(e));
+		return values;
 	}
 };
 
-template <typename T>
-class unordered_set
+/*
+ A set of T kept in value order, stored as a sorted set whose members all
+ have score 0 so the server orders them by their encoding; with the
+ ordered encoding that is the order of the values.
+ e.g.
+ types::ordered_set<std::pair<int64_t, std::string>> events(db, "events");
+ events.insert(std::make_pair(now, std::string("login")));
+ auto today = events.range(std::make_pair(midnight, std::string()), std::make_pair(midnight + 86400, std::string()));
+*/
+template <typename T, typename Context = context, typename Encoding = ordered>
+class ordered_set
 {
 private:
-	std::shared_ptr<context> c;
+	std::shared_ptr<Context> c;
 	std::string name;
+
+	static auto decode(const std::vector<std::string>& encoded) -> std::vector<T>
+	{
+		std::vector<T> values;
+		values.reserve(encoded.size());
+		for(auto& e : encoded)
+			values.push_back(Deserialize<T, Encoding>::decode(e));
+		return values;
+	}
 public:
-	unordered_set(std::shared_ptr<context> c, const std::string& name)
+	ordered_set(std::shared_ptr<Context> c, const std::string& name)
 	 : c(c), name(name)
 	{
 	}
 	
 	bool empty()
 	{
-		return commands::set::card(*c, name) == 0;
+		return commands::sorted_set::card(*c, name) == 0;
 	}
 	std::size_t size()
 	{
-		return commands::set::card(*c, name);
+		return commands::sorted_set::card(*c, name);
 	}
 	
 	template <typename... Keys>
 	bool insert(Keys... keys)
 	{
-		return commands::set::add(*c, name, Serialize<T>::encode(keys)...) > 0;
+		return commands::sorted_set::add(*c, name, {{0, Serialize<T, Encoding>::encode(keys)}...}) > 0;
 	}
 	
 	bool erase(const T& key)
 	{
-		return commands::set::rem(*c, name, Serialize<T>::encode(key)) > 0;
+		return commands::sorted_set::rem(*c, name, Serialize<T, Encoding>::encode(key)) > 0;
 	}
 	
 	bool exists(const T& key)
 	{
-		return commands::set::is_member(*c, name, Serialize<T>::encode(key));
+		return bool(commands::sorted_set::score(*c, name, Serialize<T, Encoding>::encode(key)));
+	}
+	
+	// Values in [first, last).
+	auto range(const T& first, const T& last) -> std::vector<T>
+	{
+		return decode(commands::sorted_set::range_by_lex(*c, name, "[" + Serialize<T, Encoding>::encode(first), "(" + Serialize<T, Encoding>::encode(last)));
+	}
+	// Values from first on.
+	auto from(const T& first) -> std::vector<T>
+	{
+		return decode(commands::sorted_set::range_by_lex(*c, name, "[" + Serialize<T, Encoding>::encode(first), "+"));
+	}
+	// The n smallest values, or all.
+	auto front(std::size_t n = 0) -> std::vector<T>
+	{
+		return decode(commands::sorted_set::range(*c, name, 0, static_cast<long long>(n) - 1));
+	}
+};
+
+/*
+ A bitmap stored in a string, e.g. daily active users by user id.
+ Bits are read and written remotely, in batches of BITFIELD commands, or
+ the whole bitmap is loaded with one GET into a local word-aligned copy.
+ Counting and AND / OR / XOR with other loaded bitsets run over the copy
+ a word at a time, and store() writes back with SETRANGE only the 64 byte
+ blocks changed since load(); concurrent remote changes to those blocks
+ are overwritten.
+ Bit 0 is the most significant bit of the first byte, as for SETBIT.
+ e.g.
+ types::bitset<> today(db, "dau:2024-01-02");
+ today.set({17, 42, 1000000});
+ types::bitset<> yesterday(db, "dau:2024-01-01");
+ today.load();
+ yesterday.load();
+ today &= yesterday;
+ auto retained = today.local_count();
+*/
+template <typename Context = context>
+class bitset
+{
+private:
+	static const std::size_t block = 64;
+	static const std::size_t block_words = block / sizeof(uint64_t);
+
+	std::shared_ptr<Context> c;
+	std::string name;
+	// Bytes past the end of the bitmap are kept zero.
+	std::vector<uint64_t> words;
+	std::size_t bytes;
+	// Blocks of the local copy changed since load(), one byte each.
+	std::vector<unsigned char> dirty;
+
+	auto data() -> unsigned char*
+	{
+		return reinterpret_cast<unsigned char*>(words.data());
+	}
+	auto data() const -> const unsigned char*
+	{
+		return reinterpret_cast<const unsigned char*>(words.data());
+	}
+	void grow(std::size_t n)
+	{
+		if(n <= bytes)
+			return;
+		words.resize((n + 7) / 8);
+		dirty.resize((n + block - 1) / block);
+		bytes = n;
+	}
+	// Combine n words with x, or with zero if x is null; returns the bits changed.
+	template <typename Op>
+	static auto combine(uint64_t* w, const uint64_t* x, std::size_t n, Op op) -> uint64_t
+	{
+		uint64_t changed = 0;
+		if(x)
+		{
+			for(std::size_t i = 0; i < n; ++i)
+			{
+				auto v = op(w[i], x[i]);
+				changed |= v ^ w[i];
+				w[i] = v;
+			}
+		}
+		else
+		{
+			for(std::size_t i = 0; i < n; ++i)
+			{
+				auto v = op(w[i], uint64_t(0));
+				changed |= v ^ w[i];
+				w[i] = v;
+			}
+		}
+		return changed;
+	}
+	/*
+	 Run op a block at a time with no per word branch, so the loops
+	 vectorise, and mark a block dirty once if any of its words changed.
+	*/
+	template <typename Op>
+	auto apply(const bitset& o, Op op) -> bitset&
+	{
+		grow(o.bytes);
+		auto n = words.size();
+		auto m = o.words.size();
+		for(std::size_t first = 0; first < n; first += block_words)
+		{
+			auto count = n - first < block_words ? n - first : block_words;
+			auto with = first < m ? std::min(count, m - first) : 0;
+			auto changed = combine(&words[first], with ? &o.words[first] : nullptr, with, op);
+			changed |= combine(&words[first + with], nullptr, count - with, op);
+			dirty[first / block_words] |= changed != 0;
+		}
+		return *this;
+	}
+
+	static auto popcount(uint64_t w) -> std::size_t
+	{
+#if defined(__POPCNT__) || !(defined(__x86_64__) || defined(__i386__))
+		return __builtin_popcountll(w);
+#else
+		// Without -mpopcnt the builtin is a libgcc call; count in registers instead.
+		w -= (w >> 1) & 0x5555555555555555ull;
+		w = (w & 0x3333333333333333ull) + ((w >> 2) & 0x3333333333333333ull);
+		w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0full;
+		return (w * 0x0101010101010101ull) >> 56;
+#endif
+	}
+	static auto count_words(const uint64_t* w, std::size_t n) -> std::size_t
+	{
+		std::size_t count = 0;
+		for(std::size_t i = 0; i < n; ++i)
+			count += popcount(w[i]);
+		return count;
+	}
+#if !defined(__POPCNT__) && (defined(__x86_64__) || defined(__i386__))
+	// Built for POPCNT whatever the compiler flags; only called where the CPU has it.
+	__attribute__((target("popcnt")))
+	static auto count_words_popcnt(const uint64_t* w, std::size_t n) -> std::size_t
+	{
+		std::size_t count = 0;
+		for(std::size_t i = 0; i < n; ++i)
+			count += __builtin_popcountll(w[i]);
+		return count;
+	}
+#endif
+public:
+	bitset(std::shared_ptr<Context> c, const std::string& name)
+	 : c(c), name(name), bytes(0)
+	{
+	}
+
+	// Set or clear a bit remotely; returns the previous bit.
+	bool set(uint64_t offset, bool value = true)
+	{
+		return commands::string::set_bit(*c, name, offset, value);
+	}
+	auto set(const std::vector<uint64_t>& offsets, bool value = true) -> std::vector<bool>
+	{
+		return commands::string::set_bits(*c, name, offsets, value);
+	}
+	bool test(uint64_t offset)
+	{
+		return commands::string::get_bit(*c, name, offset);
+	}
+	auto test(const std::vector<uint64_t>& offsets) -> std::vector<bool>
+	{
+		return commands::string::get_bits(*c, name, offsets);
+	}
+	// Bits set remotely.
+	auto count() -> long long
+	{
+		return commands::string::bit_count(*c, name);
+	}
+
+	// Replace the local copy with the stored bitmap; returns its size in bytes.
+	auto load() -> std::size_t
+	{
+		auto value = commands::string::get(*c, name);
+		words.clear();
+		dirty.clear();
+		bytes = 0;
+		if(value)
+		{
+			grow(value->size());
+			std::copy(value->begin(), value->end(), data());
+			dirty.assign(dirty.size(), 0);
+		}
+		return bytes;
+	}
+	/*
+	 Write the blocks changed since load() back with pipelined SETRANGE.
+	 Returns the bytes written.
+	*/
+	auto store() -> std::size_t
+	{
+		std::vector<std::pair<std::size_t, std::size_t>> ranges;
+		for(std::size_t b = 0; b < dirty.size(); ++b)
+		{
+			if(!dirty[b])
+				continue;
+			auto first = b;
+			while(b < dirty.size() && dirty[b])
+				++b;
+			ranges.emplace_back(first * block, std::min(b * block, bytes));
+		}
+
+		std::size_t written = 0;
+		commands::batch_limits limits;
+		limits.max_keys = 1;
+		commands::detail::chunked(*c, {"SETRANGE", name}, ranges.begin(), ranges.end(), limits,
+			[this, &written](std::vector<std::string>& args, const std::pair<std::size_t, std::size_t>& range) -> std::size_t
+			{
+				args.push_back(std::to_string(range.first));
+				args.emplace_back(reinterpret_cast<const char*>(data()) + range.first, range.second - range.first);
+				written += range.second - range.first;
+				return range.second - range.first;
+			},
+			[](const reply::reply_t&, std::size_t, std::size_t)
+			{
+			});
+		dirty.assign(dirty.size(), 0);
+		return written;
+	}
+
+	// Size of the local copy in bits.
+	auto size() const -> std::size_t
+	{
+		return bytes * 8;
+	}
+	bool local_test(uint64_t offset) const
+	{
+		auto byte = offset / 8;
+		return byte < bytes && (data()[byte] & (0x80 >> (offset % 8)));
+	}
+	void local_set(uint64_t offset, bool value = true)
+	{
+		auto byte = offset / 8;
+		grow(byte + 1);
+		auto mask = 0x80 >> (offset % 8);
+		auto& b = data()[byte];
+		if(bool(b & mask) == value)
+			return;
+		b ^= mask;
+		dirty[byte / block] = 1;
+	}
+	// Bits set in the local copy.
+	auto local_count() const -> std::size_t
+	{
+#if !defined(__POPCNT__) && (defined(__x86_64__) || defined(__i386__))
+		static const bool hardware = __builtin_cpu_supports("popcnt");
+		if(hardware)
+			return count_words_popcnt(words.data(), words.size());
+#endif
+		return count_words(words.data(), words.size());
+	}
+
+	// Combine local copies; the shorter is treated as zero filled, as for BITOP.
+	bitset& operator&=(const bitset& o)
+	{
+		return apply(o, [](uint64_t a, uint64_t b) { return a & b; });
+	}
+	bitset& operator|=(const bitset& o)
+	{
+		return apply(o, [](uint64_t a, uint64_t b) { return a | b; });
+	}
+	bitset& operator^=(const bitset& o)
+	{
+		return apply(o, [](uint64_t a, uint64_t b) { return a ^ b; });
 	}
 };
 
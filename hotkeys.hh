@@ -0,0 +1,418 @@
+#ifndef HIREDIS11_HOTKEYS_H_
+#define HIREDIS11_HOTKEYS_H_
+#include <memory>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include "context.hh"
+#include "command_info.hh"
+
+namespace hiredis
+{
+namespace telemetry
+{
+
+/*
+ Client side hot key detection.
+ Samples a fraction of the commands sent by the observed contexts and
+ counts their key arguments (positions from command_info) in a
+ count-min sketch per command, tracking the keys with the highest
+ estimates as top-K candidates. Each thread writes only its own shard,
+ with no locks or shared writes; take() swaps every shard to a fresh
+ buffer, merges the sketches and candidates of the last period and
+ scales the estimates by the sampling rate. Byte volume is the request
+ size of the commands naming the key.
+ With no observer set a context pays one null check per command; with
+ one, unsampled commands cost a thread local lookup and a decrement.
+ e.g.
+ telemetry::hot_keys hot({0.01}, std::chrono::seconds{10}, [](const telemetry::hot_keys::report& r)
+ {
+	 for(auto& k : r.top)
+		 std::clog << k.key << " " << k.commands << " cmds " << k.bytes << " bytes\n";
+ });
+ c.observe(&hot);
+*/
+class hot_keys : public command_observer
+{
+public:
+	typedef std::chrono::steady_clock clock;
+
+	struct options
+	{
+		// Fraction of commands sampled.
+		double rate;
+		// Keys reported per command and overall.
+		std::size_t top;
+		// Sketch columns, rounded up to a power of two, and rows.
+		std::size_t width;
+		std::size_t depth;
+
+		options(double rate = 0.01, std::size_t top = 20, std::size_t width = 1024, std::size_t depth = 4)
+		 : rate(rate), top(top), width(width), depth(depth)
+		{
+		}
+	};
+
+	// Estimated totals over the report period.
+	struct hot_key
+	{
+		std::string key;
+		double commands;
+		double bytes;
+	};
+	struct command_keys
+	{
+		std::string command;
+		double commands;
+		std::vector<hot_key> top;
+	};
+	struct report
+	{
+		clock::time_point from;
+		clock::time_point to;
+		std::vector<command_keys> commands;
+		// Keys by commands over all command types.
+		std::vector<hot_key> top;
+	};
+private:
+	struct candidate
+	{
+		std::string key;
+		std::uint64_t hash;
+		std::uint32_t estimate;
+	};
+
+	struct sketch
+	{
+		std::size_t mask;
+		std::size_t depth;
+		std::vector<std::uint32_t> counts;
+		std::vector<std::uint64_t> bytes;
+		std::vector<candidate> candidates;
+		std::uint64_t sampled;
+
+		sketch(std::size_t width, std::size_t depth)
+		 : mask(width - 1), depth(depth), counts(width * depth), bytes(width * depth), sampled(0)
+		{
+		}
+
+		auto cell(std::uint64_t hash, std::size_t row) const -> std::size_t
+		{
+			auto step = (hash >> 32) | 1;
+			return row * (mask + 1) + ((hash + row * step) & mask);
+		}
+		auto estimate(std::uint64_t hash) const -> std::pair<std::uint32_t, std::uint64_t>
+		{
+			std::pair<std::uint32_t, std::uint64_t> e{UINT32_MAX, UINT64_MAX};
+			for(std::size_t row = 0; row < depth; ++row)
+			{
+				auto i = cell(hash, row);
+				e.first = std::min(e.first, counts[i]);
+				e.second = std::min(e.second, bytes[i]);
+			}
+			return e;
+		}
+		void add(const char* key, std::size_t len, std::size_t size, std::size_t limit)
+		{
+			auto hash = hot_keys::hash(key, len);
+			std::uint32_t est = UINT32_MAX;
+			for(std::size_t row = 0; row < depth; ++row)
+			{
+				auto i = cell(hash, row);
+				est = std::min(est, ++counts[i]);
+				bytes[i] += size;
+			}
+
+			auto lowest = candidates.end();
+			for(auto it = candidates.begin(); it != candidates.end(); ++it)
+			{
+				if(it->hash == hash && it->key.compare(0, std::string::npos, key, len) == 0)
+				{
+					it->estimate = est;
+					return;
+				}
+				if(lowest == candidates.end() || it->estimate < lowest->estimate)
+					lowest = it;
+			}
+			if(candidates.size() < limit)
+				candidates.push_back({{key, len}, hash, est});
+			else if(lowest != candidates.end() && est > lowest->estimate)
+				*lowest = {{key, len}, hash, est};
+		}
+		void clear()
+		{
+			std::fill(counts.begin(), counts.end(), 0);
+			std::fill(bytes.begin(), bytes.end(), 0);
+			candidates.clear();
+			sampled = 0;
+		}
+	};
+
+	/*
+	 Written only by its thread. seq is odd while the thread updates
+	 buffers[generation]; take() flips the generation and waits out an
+	 update in progress before reading the old buffer.
+	*/
+	struct shard
+	{
+		std::atomic<std::uint64_t> seq;
+		// By command_info::table() index.
+		std::vector<std::unique_ptr<sketch>> buffers[2];
+		std::uint64_t random;
+		long skip;
+
+		shard(std::uint64_t seed)
+		 : seq(0), random(seed | 1), skip(0)
+		{
+			buffers[0].resize(command_info::table().size());
+			buffers[1].resize(command_info::table().size());
+		}
+	};
+
+	struct update
+	{
+		shard& s;
+		std::uint64_t seq;
+
+		update(shard& s)
+		 : s(s), seq(s.seq.load(std::memory_order_relaxed))
+		{
+			s.seq.store(seq + 1, std::memory_order_seq_cst);
+		}
+		~update()
+		{
+			s.seq.store(seq + 2, std::memory_order_release);
+		}
+	};
+
+	const std::uint64_t id;
+	options o;
+	std::atomic<unsigned> generation;
+	std::mutex m;
+	std::vector<std::shared_ptr<shard>> shards;
+	clock::time_point since;
+
+	std::function<void(const report&)> on_report;
+	std::chrono::milliseconds interval;
+	std::condition_variable wake;
+	bool stopping;
+	std::thread worker;
+
+	static auto next_id() -> std::uint64_t
+	{
+		static std::atomic<std::uint64_t> ids(1);
+		return ids++;
+	}
+	static auto hash(const char* s, std::size_t len) -> std::uint64_t
+	{
+		// FNV-1a, then a final mix so both halves are usable.
+		std::uint64_t h = 14695981039346656037ull;
+		for(std::size_t i = 0; i < len; ++i)
+			h = (h ^ static_cast<unsigned char>(s[i])) * 1099511628211ull;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdull;
+		h ^= h >> 33;
+		return h;
+	}
+
+	auto local() -> shard&
+	{
+		static thread_local std::vector<std::pair<std::uint64_t, std::shared_ptr<shard>>> mine;
+		static thread_local std::pair<std::uint64_t, shard*> last(0, nullptr);
+		if(last.first == id)
+			return *last.second;
+
+		auto it = std::find_if(mine.begin(), mine.end(), [this](const std::pair<std::uint64_t, std::shared_ptr<shard>>& e) { return e.first == id; });
+		if(it == mine.end())
+		{
+			auto s = std::make_shared<shard>(std::hash<std::thread::id>()(std::this_thread::get_id()) * 0x9e3779b97f4a7c15ull ^ id);
+			s->skip = next_skip(*s);
+			{
+				std::lock_guard<std::mutex> lock(m);
+				shards.push_back(s);
+			}
+			mine.emplace_back(id, s);
+			it = mine.end() - 1;
+		}
+		last = {id, it->second.get()};
+		return *last.second;
+	}
+
+	// Commands until the next sample; geometric with mean 1 / rate.
+	auto next_skip(shard& s) const -> long
+	{
+		if(o.rate >= 1)
+			return 1;
+		s.random ^= s.random << 13;
+		s.random ^= s.random >> 7;
+		s.random ^= s.random << 17;
+		double u = (s.random >> 11) * (1.0 / 9007199254740992.0);
+		return 1 + static_cast<long>(std::log(1 - u) / std::log(1 - o.rate));
+	}
+
+	auto sorted(std::vector<hot_key> keys) const -> std::vector<hot_key>
+	{
+		auto n = std::min(o.top, keys.size());
+		std::partial_sort(keys.begin(), keys.begin() + n, keys.end(), [](const hot_key& a, const hot_key& b) { return a.commands > b.commands; });
+		keys.resize(n);
+		return keys;
+	}
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(m);
+		while(!stopping)
+		{
+			wake.wait_for(lock, interval, [this]{ return stopping; });
+			if(stopping)
+				break;
+			lock.unlock();
+			on_report(take());
+			lock.lock();
+		}
+	}
+public:
+	explicit hot_keys(options o = options())
+	 : id(next_id()), o(o), generation(0), since(clock::now()), interval(0), stopping(false)
+	{
+		std::size_t width = 1;
+		while(width < this->o.width)
+			width <<= 1;
+		this->o.width = width;
+		this->o.depth = std::max<std::size_t>(this->o.depth, 1);
+		this->o.rate = std::max(this->o.rate, 1e-9);
+	}
+	// Call fn with a report every interval, from a background thread.
+	hot_keys(options o, std::chrono::milliseconds interval, std::function<void(const report&)> fn)
+	 : hot_keys(o)
+	{
+		on_report = std::move(fn);
+		this->interval = interval;
+		worker = std::thread([this]{ run(); });
+	}
+	~hot_keys()
+	{
+		if(worker.joinable())
+		{
+			{
+				std::lock_guard<std::mutex> lock(m);
+				stopping = true;
+			}
+			wake.notify_all();
+			worker.join();
+		}
+	}
+
+	hot_keys(const hot_keys&) = delete;
+	hot_keys& operator=(const hot_keys&) = delete;
+
+	void sent(std::size_t argc, const char* const* argv, const std::size_t* argvlen) override
+	{
+		auto& s = local();
+		if(--s.skip > 0)
+			return;
+		s.skip = next_skip(s);
+		if(!argc)
+			return;
+		auto spec = command_info::lookup({argv[0], argvlen[0]});
+		if(!spec)
+			return;
+
+		std::size_t size = 0;
+		for(std::size_t i = 0; i < argc; ++i)
+			size += argvlen[i];
+
+		update u(s);
+		auto& sk = s.buffers[generation.load(std::memory_order_seq_cst)][spec - command_info::table().data()];
+		if(!sk)
+			sk.reset(new sketch(o.width, o.depth));
+		++sk->sampled;
+		command_info::for_each_key(*spec, argc, argv, argvlen, [&](std::size_t i)
+		{
+			sk->add(argv[i], argvlen[i], size, 4 * o.top);
+		});
+	}
+
+	/*
+	 Merge and reset what every thread sampled since the last report.
+	 Called by the background thread when constructed with a callback.
+	*/
+	auto take() -> report
+	{
+		std::lock_guard<std::mutex> lock(m);
+		auto old = generation.load(std::memory_order_relaxed);
+		generation.store(old ^ 1, std::memory_order_seq_cst);
+		for(auto& s : shards)
+		{
+			auto seq = s->seq.load(std::memory_order_seq_cst);
+			if(seq & 1)
+			{
+				while(s->seq.load(std::memory_order_acquire) == seq)
+					std::this_thread::yield();
+			}
+		}
+
+		report r;
+		r.from = since;
+		r.to = since = clock::now();
+		double scale = 1 / o.rate;
+		std::unordered_map<std::string, hot_key> overall;
+		auto& specs = command_info::table();
+		for(std::size_t c = 0; c < specs.size(); ++c)
+		{
+			std::unique_ptr<sketch> merged;
+			std::unordered_map<std::string, std::uint64_t> candidates;
+			for(auto& s : shards)
+			{
+				auto& sk = s->buffers[old][c];
+				if(!sk || !sk->sampled)
+					continue;
+				if(!merged)
+					merged.reset(new sketch(o.width, o.depth));
+				for(std::size_t i = 0; i < sk->counts.size(); ++i)
+				{
+					merged->counts[i] += sk->counts[i];
+					merged->bytes[i] += sk->bytes[i];
+				}
+				merged->sampled += sk->sampled;
+				for(auto& k : sk->candidates)
+					candidates.emplace(k.key, k.hash);
+				sk->clear();
+			}
+			if(!merged)
+				continue;
+
+			command_keys cmd{specs[c].name, merged->sampled * scale, {}};
+			for(auto& k : candidates)
+			{
+				auto e = merged->estimate(k.second);
+				cmd.top.push_back({k.first, e.first * scale, e.second * scale});
+				auto& total = overall[k.first];
+				total.key = k.first;
+				total.commands += e.first * scale;
+				total.bytes += e.second * scale;
+			}
+			cmd.top = sorted(std::move(cmd.top));
+			r.commands.push_back(std::move(cmd));
+		}
+		std::vector<hot_key> keys;
+		for(auto& k : overall)
+			keys.push_back(std::move(k.second));
+		r.top = sorted(std::move(keys));
+		return r;
+	}
+};
+
+}
+}
+
+#endif /* HIREDIS11_HOTKEYS_H_ */
@@ -0,0 +1,352 @@
+#ifndef HIREDIS11_IO_RING_H_
+#define HIREDIS11_IO_RING_H_
+#ifndef HIREDIS11_IO_URING
+#error "io_ring.hh is included by context.hh when built with HIREDIS11_IO_URING."
+#endif
+#include "context.hh"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+namespace hiredis
+{
+
+/*
+ An io_uring instance set up with raw system calls rather than liburing:
+ entries are queued with next() and handed to the kernel by submit(),
+ completions taken with pop(). Needs Linux 5.11 (IORING_FEAT_EXT_ARG);
+ the constructor throws on older kernels or where io_uring is disabled.
+*/
+class io_ring
+{
+private:
+	// Submission ring.
+	void* sq_ring;
+	std::size_t sq_ring_size;
+	unsigned* sq_head;
+	unsigned* sq_tail;
+	unsigned sq_mask;
+	unsigned sq_entries;
+	unsigned* sq_array;
+	io_uring_sqe* sqes;
+	std::size_t sqes_size;
+	unsigned tail;
+	unsigned queued;
+
+	// Completion ring; may share the submission mapping.
+	void* cq_ring;
+	std::size_t cq_ring_size;
+	unsigned* cq_head;
+	unsigned* cq_tail;
+	unsigned cq_mask;
+	io_uring_cqe* cqes;
+
+	unsigned supported;
+
+	auto enter(unsigned submit, unsigned wait, unsigned flags, const void* arg, std::size_t argsz) -> int
+	{
+		return syscall(__NR_io_uring_enter, fd, submit, wait, flags, arg, argsz);
+	}
+	void release()
+	{
+		if(sqes)
+			munmap(sqes, sqes_size);
+		if(cq_ring && cq_ring != sq_ring)
+			munmap(cq_ring, cq_ring_size);
+		if(sq_ring)
+			munmap(sq_ring, sq_ring_size);
+		if(fd >= 0)
+			close(fd);
+	}
+	void check(bool ok, const char* what)
+	{
+		if(ok)
+			return;
+		std::string msg = std::string(what) + ": " + std::strerror(errno);
+		release();
+		throw std::runtime_error(msg);
+	}
+public:
+	int fd;
+
+	explicit io_ring(unsigned entries)
+	 : sq_ring(nullptr), sqes(nullptr), tail(0), queued(0), cq_ring(nullptr), supported(0), fd(-1)
+	{
+		io_uring_params p = {};
+		p.flags = IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+		fd = syscall(__NR_io_uring_setup, entries, &p);
+		if(fd < 0 && errno == EINVAL)
+		{
+			p = {};
+			fd = syscall(__NR_io_uring_setup, entries, &p);
+		}
+		check(fd >= 0, "io_uring_setup");
+		supported = p.features;
+		errno = ENOSYS;
+		check((p.features & IORING_FEAT_EXT_ARG) && (p.features & IORING_FEAT_NODROP), "io_uring features");
+
+		sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+		cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+		if(p.features & IORING_FEAT_SINGLE_MMAP)
+			sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+		sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+		if(sq_ring == MAP_FAILED)
+			sq_ring = nullptr;
+		check(sq_ring, "io_uring mmap");
+		if(p.features & IORING_FEAT_SINGLE_MMAP)
+			cq_ring = sq_ring;
+		else
+		{
+			cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+			if(cq_ring == MAP_FAILED)
+				cq_ring = nullptr;
+			check(cq_ring, "io_uring mmap");
+		}
+		sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+		sqes = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+		if(sqes == MAP_FAILED)
+			sqes = nullptr;
+		check(sqes, "io_uring mmap");
+
+		auto sq = static_cast<char*>(sq_ring);
+		sq_head = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+		sq_tail = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+		sq_mask = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+		sq_entries = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_entries);
+		sq_array = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+		tail = *sq_tail;
+		auto cq = static_cast<char*>(cq_ring);
+		cq_head = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+		cq_tail = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+		cq_mask = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+		cqes = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+	}
+	// Closing the ring cancels whatever is still in flight.
+	~io_ring()
+	{
+		release();
+	}
+
+	io_ring(const io_ring&) = delete;
+	io_ring& operator=(const io_ring&) = delete;
+
+	// IORING_FEAT_* flags of the kernel.
+	auto features() const -> unsigned
+	{
+		return supported;
+	}
+	// Entries queued but not yet submitted.
+	auto pending() const -> unsigned
+	{
+		return queued;
+	}
+	// True if a completion is waiting.
+	bool ready() const
+	{
+		return *cq_head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+	}
+
+	/*
+	 Publish queued entries and hand them to the kernel, waiting for at
+	 least one completion if wait is set, for up to timeout ms (-1 for no
+	 limit).
+	*/
+	void submit(bool wait, int timeout)
+	{
+		__atomic_store_n(sq_tail, tail, __ATOMIC_RELEASE);
+		__kernel_timespec ts = {timeout / 1000, (timeout % 1000) * 1000000LL};
+		io_uring_getevents_arg arg = {};
+		arg.sigmask_sz = _NSIG / 8;
+		if(wait && timeout >= 0)
+			arg.ts = reinterpret_cast<std::uint64_t>(&ts);
+		unsigned flags = IORING_ENTER_EXT_ARG | (wait ? IORING_ENTER_GETEVENTS : 0);
+		auto res = enter(queued, wait ? 1 : 0, flags, &arg, sizeof(arg));
+		if(res >= 0)
+			queued -= std::min<unsigned>(queued, res);
+		else if(errno != EINTR && errno != ETIME && errno != EAGAIN && errno != EBUSY)
+			throw std::runtime_error(std::string("io_uring_enter: ") + std::strerror(errno));
+	}
+	// A cleared entry to fill in; submits first if the ring is full.
+	auto next() -> io_uring_sqe*
+	{
+		if(tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries)
+			submit(false, 0);
+		auto index = tail & sq_mask;
+		auto sqe = &sqes[index];
+		std::memset(sqe, 0, sizeof(*sqe));
+		sq_array[index] = index;
+		++tail;
+		++queued;
+		return sqe;
+	}
+	// Take the next completion; false if there is none.
+	bool pop(io_uring_cqe& cqe)
+	{
+		auto head = *cq_head;
+		if(head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE))
+			return false;
+		cqe = cqes[head & cq_mask];
+		__atomic_store_n(cq_head, head + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+	// Wait for the next completion.
+	auto wait() -> io_uring_cqe
+	{
+		io_uring_cqe cqe;
+		while(!pop(cqe))
+			submit(true, -1);
+		return cqe;
+	}
+};
+
+/*
+ io_uring transport for the blocking contexts of one thread.
+ A round trip queues the send of everything the context has buffered and
+ a receive into a buffer registered with the kernel, and submits both
+ with the wait, so it costs one system call where hiredis makes a write
+ and a read, and the receive needs no per-call page mapping.
+ Set up per thread by context::thread_transport().
+*/
+class uring_context_transport : public context::transport
+{
+private:
+	enum op : std::uint64_t
+	{
+		op_send = 1,
+		op_recv,
+		op_ignore
+	};
+
+	io_ring ring;
+	std::vector<char> buffer;
+
+	void cancel(op o)
+	{
+		auto sqe = ring.next();
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->fd = -1;
+		sqe->addr = o;
+		sqe->user_data = op_ignore;
+	}
+public:
+	explicit uring_context_transport(std::size_t buffer_size = 65536)
+	 : ring(8), buffer(buffer_size)
+	{
+		iovec v = {buffer.data(), buffer.size()};
+		if(syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS, &v, 1) != 0)
+			throw std::runtime_error(std::string("io_uring_register: ") + std::strerror(errno));
+	}
+
+	auto name() const -> const char* override
+	{
+		return "io_uring";
+	}
+
+	auto exchange(int fd, const char* out, std::size_t len, const char*& in) -> long override
+	{
+		std::size_t sent = 0;
+		long received = -1;
+		int err = 0;
+		bool sending = false;
+		bool receiving = false;
+		bool cancelled = false;
+		while(true)
+		{
+			if(!err && !sending && sent < len)
+			{
+				auto sqe = ring.next();
+				sqe->opcode = IORING_OP_SEND;
+				sqe->fd = fd;
+				sqe->addr = reinterpret_cast<std::uint64_t>(out + sent);
+				sqe->len = len - sent;
+				sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+				sqe->user_data = op_send;
+				sending = true;
+			}
+			if(!err && !receiving && received < 0)
+			{
+				auto sqe = ring.next();
+				sqe->opcode = IORING_OP_READ_FIXED;
+				sqe->fd = fd;
+				sqe->addr = reinterpret_cast<std::uint64_t>(buffer.data());
+				sqe->len = buffer.size();
+				sqe->buf_index = 0;
+				sqe->user_data = op_recv;
+				receiving = true;
+			}
+			if(!sending && !receiving)
+				break;
+			// After a failure, stop the other operation before returning.
+			if(err && !cancelled)
+			{
+				if(sending)
+					cancel(op_send);
+				if(receiving)
+					cancel(op_recv);
+				cancelled = true;
+			}
+
+			auto cqe = ring.wait();
+			if(cqe.user_data == op_send)
+			{
+				sending = false;
+				if(cqe.res < 0 && !err)
+					err = -cqe.res;
+				else if(cqe.res >= 0)
+					sent += cqe.res;
+			}
+			else if(cqe.user_data == op_recv)
+			{
+				receiving = false;
+				if(cqe.res < 0 && !err)
+					err = -cqe.res;
+				else if(cqe.res >= 0)
+					received = cqe.res;
+			}
+			// A closed connection fails the send, which may never complete otherwise.
+			if(received == 0 && !err)
+				err = ECONNRESET;
+		}
+		if(received == 0)
+			return 0;
+		if(err)
+			return -err;
+		in = buffer.data();
+		return received;
+	}
+};
+
+inline auto context::thread_transport() -> transport*
+{
+	// Set up on first use; where io_uring is unavailable the thread keeps hiredis' own I/O.
+	static thread_local std::unique_ptr<uring_context_transport> t;
+	static thread_local bool tried = false;
+	if(!tried)
+	{
+		tried = true;
+		try
+		{
+			t.reset(new uring_context_transport());
+		}
+		catch(const std::exception&)
+		{
+		}
+	}
+	return t.get();
+}
+
+}
+
+#endif /* HIREDIS11_IO_RING_H_ */
@@ -0,0 +1,288 @@
+#ifndef HIREDIS11_MULTIPLEXED_H_
+#define HIREDIS11_MULTIPLEXED_H_
+#include <memory>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include "async.hh"
+#include "context.hh"
+#include "pool.hh"
+#include "command_info.hh"
+#include "error.hh"
+#include "reply.hh"
+
+namespace hiredis
+{
+
+/*
+ Many logical clients over a few shared connections.
+ Each client is a blocking, context-like handle for one task. The commands
+ of all clients on a connection are encoded into its shared write buffer
+ and written together by one I/O thread; replies are matched back to
+ their clients in order.
+ Commands a shared connection cannot carry run on a dedicated one:
+ blocking commands (BLPOP, XREAD BLOCK, WAIT...) and transactions (MULTI
+ to EXEC, WATCH to EXEC or UNWATCH) borrow one from a pool for their
+ duration; subscriptions and connection state changes (SELECT, AUTH,
+ CLIENT...) give the client its own connection for the rest of its life.
+ A client is used by one thread at a time and must not outlive its
+ multiplexed_context.
+ e.g.
+ multiplexed_context mux("localhost", 6379, 4);
+ // per task
+ multiplexed_context::client c(mux);
+ commands::string::set(c, "foo", "bar");
+ auto job = c.command({"BLPOP", "jobs", "0"}); // on a dedicated connection
+*/
+class multiplexed_context
+{
+public:
+	class client;
+private:
+	enum class route
+	{
+		shared,
+		// For this command only.
+		blocking,
+		// Until the transaction ends.
+		transaction,
+		// For the rest of the client's life.
+		state
+	};
+
+	static auto classify(const std::vector<std::string>& args) -> route
+	{
+		static const char* const blocking[] = {"BLMOVE", "BLMPOP", "BLPOP", "BRPOP", "BRPOPLPUSH", "BZMPOP", "BZPOPMAX", "BZPOPMIN", "WAIT", "WAITAOF"};
+		static const char* const transaction[] = {"DISCARD", "EXEC", "MULTI", "UNWATCH", "WATCH"};
+		static const char* const state[] = {"AUTH", "CLIENT", "HELLO", "MONITOR", "PSUBSCRIBE", "READONLY", "READWRITE", "RESET", "SELECT", "SSUBSCRIBE", "SUBSCRIBE"};
+
+		if(args.empty())
+			return route::shared;
+		auto is = [&args](const char* name) { return command_info::compare(args[0].c_str(), name) == 0; };
+		if(std::any_of(std::begin(blocking), std::end(blocking), is))
+			return route::blocking;
+		if(is("XREAD") || is("XREADGROUP"))
+		{
+			auto block = std::any_of(args.begin() + 1, args.end(), [](const std::string& a) { return command_info::compare(a.c_str(), "BLOCK") == 0; });
+			return block ? route::blocking : route::shared;
+		}
+		if(std::any_of(std::begin(transaction), std::end(transaction), is))
+			return route::transaction;
+		if(std::any_of(std::begin(state), std::end(state), is))
+			return route::state;
+		return route::shared;
+	}
+
+	std::string host;
+	int port;
+	event_loop loop;
+	std::vector<std::unique_ptr<async_context>> connections;
+	context_pool dedicated;
+	std::atomic<std::size_t> next;
+	std::thread io;
+
+	// Loop thread only.
+	auto connection(std::size_t i) -> async_context&
+	{
+		if(!connections[i]->connected())
+			connections[i].reset(new async_context(loop, host, port));
+		return *connections[i];
+	}
+public:
+	multiplexed_context(const std::string& host, int port, std::size_t shared = 2, std::size_t max_dedicated = 64)
+	 : host(host), port(port), dedicated(host, port, max_dedicated), next(0)
+	{
+		for(std::size_t i = 0; i < std::max<std::size_t>(shared, 1); ++i)
+			connections.emplace_back(new async_context(loop, host, port));
+		io = std::thread([this]{ loop.run(); });
+	}
+	~multiplexed_context()
+	{
+		loop.stop();
+		io.join();
+	}
+
+	multiplexed_context(const multiplexed_context&) = delete;
+	multiplexed_context& operator=(const multiplexed_context&) = delete;
+
+	// Shared connections.
+	auto size() const -> std::size_t
+	{
+		return connections.size();
+	}
+	// Dedicated connections open for blocking commands and transactions.
+	auto dedicated_count() -> std::size_t
+	{
+		return dedicated.size();
+	}
+};
+
+class multiplexed_context::client : private async_context::handler
+{
+private:
+	multiplexed_context& mux;
+	// Shared connection; fixed, so the client's commands stay in order.
+	std::size_t index;
+
+	std::mutex m;
+	std::condition_variable replied;
+	bool done;
+	reply::reply_t result;
+	std::exception_ptr failure;
+
+	// Borrowed for a transaction.
+	std::unique_ptr<context_pool::lease> borrowed;
+	bool queuing;
+	bool watching;
+	// Owned after a subscription or connection state change.
+	std::unique_ptr<context> own;
+
+	// Loop thread.
+	void complete(reply::reply_t reply, std::exception_ptr error) override
+	{
+		{
+			std::lock_guard<std::mutex> lock(m);
+			result = reply;
+			failure = error;
+			done = true;
+		}
+		replied.notify_one();
+	}
+
+	auto shared(const std::vector<std::string>& args) -> reply::reply_t
+	{
+		done = false;
+		mux.loop.post([this, &args]
+		{
+			try
+			{
+				mux.connection(index).command(args, *this);
+			}
+			catch(...)
+			{
+				complete({}, std::current_exception());
+			}
+		});
+
+		std::unique_lock<std::mutex> lock(m);
+		replied.wait(lock, [this]{ return done; });
+		std::exception_ptr error;
+		std::swap(error, failure);
+		if(error)
+			std::rethrow_exception(error);
+		return std::move(result);
+	}
+
+	auto in_transaction(const std::vector<std::string>& args) -> reply::reply_t
+	{
+		auto& c = **borrowed;
+		reply::reply_t reply;
+		try
+		{
+			reply = c.command(args);
+		}
+		catch(...)
+		{
+			if(!c.connected())
+				borrowed.reset();
+			throw;
+		}
+
+		auto is = [&args](const char* name) { return command_info::compare(args[0].c_str(), name) == 0; };
+		if(reply->type != REDIS_REPLY_ERROR)
+		{
+			if(is("MULTI"))
+				queuing = true;
+			else if(is("WATCH"))
+				watching = true;
+			else if(is("UNWATCH") && !queuing)
+				watching = false;
+		}
+		// EXEC and DISCARD end the transaction even when they fail.
+		if(is("EXEC") || is("DISCARD"))
+			queuing = watching = false;
+		if(!queuing && !watching)
+			borrowed.reset();
+		return reply;
+	}
+public:
+	explicit client(multiplexed_context& mux)
+	 : mux(mux), index(mux.next++ % mux.connections.size()), done(false), queuing(false), watching(false)
+	{
+	}
+	~client()
+	{
+		// Return a clean connection to the pool.
+		if(!borrowed)
+			return;
+		try
+		{
+			(*borrowed)->command({queuing ? "DISCARD" : "UNWATCH"});
+		}
+		catch(...)
+		{
+		}
+	}
+
+	client(const client&) = delete;
+	client& operator=(const client&) = delete;
+
+	/*
+	 Send a command and get a reply, routed as described for
+	 multiplexed_context.
+	*/
+	auto command(const std::vector<std::string>& args) -> reply::reply_t
+	{
+		if(own)
+			return own->command(args);
+
+		auto r = classify(args);
+		if(r == route::state)
+		{
+			// Keep the transaction's connection, in the state it is in.
+			if(borrowed)
+				own = borrowed->detach();
+			else
+				own.reset(new context(mux.host, mux.port));
+			borrowed.reset();
+			queuing = watching = false;
+			return own->command(args);
+		}
+		if(borrowed)
+			return in_transaction(args);
+		if(r == route::transaction)
+		{
+			borrowed.reset(new context_pool::lease(mux.dedicated.acquire()));
+			return in_transaction(args);
+		}
+		if(r == route::blocking)
+			return mux.dedicated.acquire()->command(args);
+		return shared(args);
+	}
+
+	/*
+	 Get the next reply on the client's own connection, e.g. a message
+	 after SUBSCRIBE.
+	*/
+	auto get_reply() -> reply::reply_t
+	{
+		if(!own)
+			throw error("Client has no connection of its own to read from.");
+		return own->get_reply();
+	}
+
+	// True once the client has its own connection.
+	bool dedicated() const
+	{
+		return own != nullptr;
+	}
+};
+
+}
+
+#endif /* HIREDIS11_MULTIPLEXED_H_ */
@@ -0,0 +1,1221 @@
+#ifndef HIREDIS11_NOTHROW_H_
+#define HIREDIS11_NOTHROW_H_
+#include "context.hh"
+#include "reply.hh"
+#include "result.hh"
+#include "commands.hh"
+#include <string>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <deque>
+#include <cstdlib>
+#include <stdexcept>
+#include <boost/optional.hpp>
+
+namespace hiredis
+{
+namespace commands
+{
+
+/*
+ Wrappers for hot-path commands that report failure in a result rather
+ than by throwing, so e.g. a WRONGTYPE or a timeout in a tight loop costs
+ no stack unwinding. Signatures follow the throwing wrappers of the same
+ name. Need a context type with try_command(); the batch wrappers
+ (get_many, set_many, get_bits, set_bits) also need append_command(),
+ try_get_reply() and connected(). Zero batch limits are a programming
+ error and still throw std::invalid_argument.
+ SUBSCRIBE and the other subscription commands have no mirror: they put
+ the connection in subscriber mode, where replies are read as messages
+ rather than per command.
+ e.g.
+ auto n = commands::nothrow::string::incr(c, "counter");
+ if(!n)
+	 log(n.error().message);
+*/
+namespace nothrow
+{
+
+namespace detail
+{
+inline auto type_error(const char* expected) -> error_code
+{
+	return {errc::type, std::string("reply type not ") + expected + "."};
+}
+
+inline auto integer(const result<reply::reply_t>& r) -> result<long long>
+{
+	if(!r)
+		return r.error();
+	if((*r)->type != REDIS_REPLY_INTEGER)
+		return type_error("integer");
+	return (*r)->integer;
+}
+
+inline auto flag(const result<reply::reply_t>& r) -> result<bool>
+{
+	auto n = integer(r);
+	if(!n)
+		return n.error();
+	return *n != 0;
+}
+
+inline auto status(const result<reply::reply_t>& r) -> result<std::string>
+{
+	if(!r)
+		return r.error();
+	if((*r)->type != REDIS_REPLY_STATUS)
+		return type_error("status");
+	return std::string((*r)->str, (*r)->len);
+}
+
+inline auto string(const result<reply::reply_t>& r) -> result<std::string>
+{
+	if(!r)
+		return r.error();
+	if((*r)->type != REDIS_REPLY_STRING)
+		return type_error("string");
+	return std::string((*r)->str, (*r)->len);
+}
+
+inline auto optional_string(const result<reply::reply_t>& r) -> result<boost::optional<std::string>>
+{
+	if(!r)
+		return r.error();
+	if((*r)->type == REDIS_REPLY_NIL)
+		return boost::optional<std::string>();
+	if((*r)->type != REDIS_REPLY_STRING)
+		return type_error("string");
+	return boost::optional<std::string>(std::string((*r)->str, (*r)->len));
+}
+
+inline auto string_array(const result<reply::reply_t>& r) -> result<std::vector<std::string>>
+{
+	if(!r)
+		return r.error();
+	if((*r)->type != REDIS_REPLY_ARRAY)
+		return type_error("array");
+	std::vector<std::string> values;
+	values.reserve((*r)->elements);
+	for(std::size_t i = 0; i < (*r)->elements; ++i)
+	{
+		auto e = (*r)->element[i];
+		if(e->type != REDIS_REPLY_STRING)
+			return type_error("string");
+		values.emplace_back(e->str, e->len);
+	}
+	return values;
+}
+
+inline auto optional_integer(const result<reply::reply_t>& r) -> result<boost::optional<long long>>
+{
+	if(!r)
+		return r.error();
+	if((*r)->type == REDIS_REPLY_NIL)
+		return boost::optional<long long>();
+	if((*r)->type != REDIS_REPLY_INTEGER)
+		return type_error("integer");
+	return boost::optional<long long>((*r)->integer);
+}
+
+inline auto optional_double(const result<reply::reply_t>& r) -> result<boost::optional<double>>
+{
+	auto s = optional_string(r);
+	if(!s)
+		return s.error();
+	if(!*s)
+		return boost::optional<double>();
+	char* end;
+	auto v = std::strtod((*s)->c_str(), &end);
+	if(end == (*s)->c_str() || *end)
+		return type_error("double");
+	return boost::optional<double>(v);
+}
+
+// Flat field / value array, e.g. HGETALL.
+inline auto string_map(const result<reply::reply_t>& r) -> result<std::map<std::string, std::string>>
+{
+	auto data = string_array(r);
+	if(!data)
+		return data.error();
+	if(data->size() % 2)
+		return error_code{errc::type, "reply not field / value pairs."};
+	std::map<std::string, std::string> res;
+	for(auto it = data->begin(); it != data->end(); it += 2)
+		res.insert(std::make_pair(*it, *(it + 1)));
+	return res;
+}
+
+// Decode an array of bulk strings / nils into out[offset, offset + count).
+inline auto optional_strings(const redisReply* r, std::vector<boost::optional<std::string>>& out, std::size_t offset, std::size_t count) -> boost::optional<error_code>
+{
+	if(r->type != REDIS_REPLY_ARRAY || r->elements != count)
+		return error_code{errc::type, "multi-key result not equal to key count"};
+	for(std::size_t i = 0; i < count; ++i)
+	{
+		auto e = r->element[i];
+		if(e->type == REDIS_REPLY_STRING)
+			out[offset + i] = std::string{e->str, static_cast<size_t>(e->len)};
+		else if(e->type != REDIS_REPLY_NIL)
+			return type_error("string");
+	}
+	return {};
+}
+
+// Decode a BITFIELD reply of u1 values into out[offset, offset + count).
+inline auto bits(const redisReply* r, std::vector<bool>& out, std::size_t offset, std::size_t count) -> boost::optional<error_code>
+{
+	if(r->type != REDIS_REPLY_ARRAY || r->elements != count)
+		return error_code{errc::type, "BITFIELD result not equal to offset count"};
+	for(std::size_t i = 0; i < count; ++i)
+	{
+		if(r->element[i]->type != REDIS_REPLY_INTEGER)
+			return type_error("integer");
+		out[offset + i] = r->element[i]->integer != 0;
+	}
+	return {};
+}
+
+/*
+ As commands::detail::chunked, returning the first failure instead of
+ throwing it; read(reply, offset, count) returns its failure, if any.
+ Every reply is read even if one fails, so the context stays usable,
+ unless the connection itself is lost.
+*/
+template<typename Context, typename Iterator, typename Add, typename Read>
+inline auto chunked(Context& c, const std::vector<std::string>& prefix, Iterator first, Iterator last, const batch_limits& limits, Add add, Read read) -> boost::optional<error_code>
+{
+	if(limits.max_keys == 0 || limits.max_bytes == 0)
+		throw std::invalid_argument("batch_limits max_keys and max_bytes must be non-zero.");
+	
+	std::deque<std::pair<std::size_t, std::size_t>> in_flight;
+	boost::optional<error_code> failure;
+	auto collect = [&]
+	{
+		auto chunk = in_flight.front();
+		in_flight.pop_front();
+		auto reply = c.try_get_reply();
+		boost::optional<error_code> e;
+		if(!reply)
+			e = reply.error();
+		else
+			e = read(*reply, chunk.first, chunk.second);
+		if(e && !failure)
+			failure = std::move(e);
+	};
+	
+	std::size_t offset = 0;
+	while(first != last && c.connected())
+	{
+		auto args = prefix;
+		std::size_t n = 0;
+		std::size_t bytes = 0;
+		for(; first != last && n < limits.max_keys && (n == 0 || bytes < limits.max_bytes); ++first, ++n)
+			bytes += add(args, *first);
+		
+		if(in_flight.size() >= std::max<std::size_t>(limits.depth, 1))
+			collect();
+		if(!c.connected())
+			break;
+		c.append_command(args);
+		in_flight.emplace_back(offset, n);
+		offset += n;
+	}
+	while(!in_flight.empty())
+		collect();
+	
+	if(!failure && !c.connected())
+		failure = error_code{errc::io, "Context is not connected"};
+	return failure;
+}
+
+// Conditional SET: OK when applied, nil when the condition failed.
+inline auto applied(const result<reply::reply_t>& r) -> result<bool>
+{
+	if(!r)
+		return r.error();
+	if((*r)->type == REDIS_REPLY_NIL)
+		return false;
+	if((*r)->type != REDIS_REPLY_STATUS)
+		return type_error("status");
+	return true;
+}
+}
+
+namespace key
+{
+template<typename Context, typename Key, typename... Keys>
+inline auto del(Context& c, Key key, Keys... keys) -> result<long long>
+{
+	return detail::integer(c.try_command({"DEL", key, keys...}));
+}
+
+template<typename Context, typename Key>
+inline auto dump(Context& c, Key key) -> result<std::string>
+{
+	return detail::string(c.try_command({"DUMP", key}));
+}
+
+template<typename Context, typename Key>
+inline auto exists(Context& c, Key key) -> result<bool>
+{
+	return detail::flag(c.try_command({"EXISTS", key}));
+}
+
+template<typename Context, typename Key>
+inline auto expire(Context& c, Key key, std::chrono::seconds ttl) -> result<bool>
+{
+	return detail::flag(c.try_command({"EXPIRE", key, std::to_string(ttl.count())}));
+}
+template<typename Context, typename Key>
+inline auto expire(Context& c, Key key, std::chrono::milliseconds ttl) -> result<bool>
+{
+	return detail::flag(c.try_command({"PEXPIRE", key, std::to_string(ttl.count())}));
+}
+
+template<typename Context, typename Key>
+inline auto expire_at(Context& c, Key key, std::time_t timestamp) -> result<bool>
+{
+	return detail::flag(c.try_command({"EXPIREAT", key, std::to_string(timestamp)}));
+}
+template<typename Context, typename Key>
+inline auto expire_at_ms(Context& c, Key key, uint64_t timestamp) -> result<bool>
+{
+	return detail::flag(c.try_command({"PEXPIREAT", key, std::to_string(timestamp)}));
+}
+
+template<typename Context>
+inline auto keys(Context& c, const std::string& pattern) -> result<std::vector<std::string>>
+{
+	return detail::string_array(c.try_command({"KEYS", pattern}));
+}
+
+template<typename Context, typename Key>
+inline auto move(Context& c, Key key, int db) -> result<bool>
+{
+	return detail::flag(c.try_command({"MOVE", key, std::to_string(db)}));
+}
+
+template<typename Context, typename Key>
+inline auto object_encoding(Context& c, Key key) -> result<boost::optional<std::string>>
+{
+	return detail::optional_string(c.try_command({"OBJECT", "ENCODING", key}));
+}
+
+template<typename Context, typename Key>
+inline auto memory_usage(Context& c, Key key) -> result<boost::optional<long long>>
+{
+	return detail::optional_integer(c.try_command({"MEMORY", "USAGE", key}));
+}
+
+template<typename Context, typename Key>
+inline auto persist(Context& c, Key key) -> result<bool>
+{
+	return detail::flag(c.try_command({"PERSIST", key}));
+}
+
+// Empty if the keyspace is empty.
+template<typename Context>
+inline auto random(Context& c) -> result<boost::optional<std::string>>
+{
+	return detail::optional_string(c.try_command({"RANDOMKEY"}));
+}
+
+template<typename Context, typename Key>
+inline auto rename(Context& c, Key key, Key newkey) -> result<std::string>
+{
+	return detail::status(c.try_command({"RENAME", key, newkey}));
+}
+
+template<typename Context, typename Key>
+inline auto renamenx(Context& c, Key key, Key newkey) -> result<bool>
+{
+	return detail::flag(c.try_command({"RENAMENX", key, newkey}));
+}
+
+template<typename Context, typename Key>
+inline auto restore(Context& c, Key key, int ttl, const std::string& dump) -> result<std::string>
+{
+	return detail::status(c.try_command({"RESTORE", key, std::to_string(ttl), dump}));
+}
+
+template<typename Context>
+inline auto scan(Context& c, const std::string& cursor, const std::string& pattern = {}, long long count = 0) -> result<std::pair<std::string, std::vector<std::string>>>
+{
+	std::vector<std::string> args{"SCAN", cursor};
+	if(!pattern.empty())
+		args.insert(args.end(), {"MATCH", pattern});
+	if(count > 0)
+		args.insert(args.end(), {"COUNT", std::to_string(count)});
+	
+	auto r = c.try_command(args);
+	if(!r)
+		return r.error();
+	if((*r)->type != REDIS_REPLY_ARRAY || (*r)->elements != 2 || (*r)->element[0]->type != REDIS_REPLY_STRING)
+		return error_code{errc::type, "SCAN result not 2 elements"};
+	auto cursor_reply = (*r)->element[0];
+	std::vector<std::string> keys;
+	auto batch = (*r)->element[1];
+	if(batch->type != REDIS_REPLY_ARRAY)
+		return detail::type_error("array");
+	for(std::size_t i = 0; i < batch->elements; ++i)
+	{
+		if(batch->element[i]->type != REDIS_REPLY_STRING)
+			return detail::type_error("string");
+		keys.emplace_back(batch->element[i]->str, batch->element[i]->len);
+	}
+	return std::make_pair(std::string(cursor_reply->str, cursor_reply->len), std::move(keys));
+}
+
+template<typename Context, typename Key>
+inline auto ttl(Context& c, Key key) -> result<std::chrono::seconds>
+{
+	auto n = detail::integer(c.try_command({"TTL", key}));
+	if(!n)
+		return n.error();
+	return std::chrono::seconds(*n);
+}
+
+template<typename Context, typename Key>
+inline auto ttl_ms(Context& c, Key key) -> result<std::chrono::milliseconds>
+{
+	auto n = detail::integer(c.try_command({"PTTL", key}));
+	if(!n)
+		return n.error();
+	return std::chrono::milliseconds(*n);
+}
+
+template<typename Context, typename Key>
+inline auto type(Context& c, Key key) -> result<std::string>
+{
+	return detail::status(c.try_command({"TYPE", key}));
+}
+}
+
+namespace string
+{
+// Returns the new length.
+template<typename Context, typename Key, typename Value>
+inline auto append(Context& c, Key key, Value value) -> result<long long>
+{
+	return detail::integer(c.try_command({"APPEND", key, value}));
+}
+
+template<typename Context, typename Key>
+inline auto bit_count(Context& c, Key key) -> result<long long>
+{
+	return detail::integer(c.try_command({"BITCOUNT", key}));
+}
+template<typename Context, typename Key>
+inline auto bit_count(Context& c, Key key, long long start, long long end) -> result<long long>
+{
+	return detail::integer(c.try_command({"BITCOUNT", key, std::to_string(start), std::to_string(end)}));
+}
+
+template<typename Context, typename Key, typename... Keys>
+inline auto bit_op(Context& c, const std::string& operation, Key destkey, Key key, Keys... keys) -> result<long long>
+{
+	return detail::integer(c.try_command({"BITOP", operation, destkey, key, keys...}));
+}
+
+template<typename Context, typename Key>
+inline auto bit_pos(Context& c, Key key, bool bit) -> result<long long>
+{
+	return detail::integer(c.try_command({"BITPOS", key, bit ? "1" : "0"}));
+}
+template<typename Context, typename Key>
+inline auto bit_pos(Context& c, Key key, bool bit, long long start, long long end = -1) -> result<long long>
+{
+	return detail::integer(c.try_command({"BITPOS", key, bit ? "1" : "0", std::to_string(start), std::to_string(end)}));
+}
+
+template<typename Context, typename Key>
+inline auto decr(Context& c, Key key) -> result<long long>
+{
+	return detail::integer(c.try_command({"DECR", key}));
+}
+
+template<typename Context, typename Key>
+inline auto decr_by(Context& c, Key key, long long decrement) -> result<long long>
+{
+	return detail::integer(c.try_command({"DECRBY", key, std::to_string(decrement)}));
+}
+
+template<typename Context, typename Key>
+inline auto get(Context& c, Key key) -> result<boost::optional<std::string>>
+{
+	return detail::optional_string(c.try_command({"GET", key}));
+}
+
+template<typename Context, typename Key>
+inline auto get_bit(Context& c, Key key, uint64_t offset) -> result<bool>
+{
+	return detail::flag(c.try_command({"GETBIT", key, std::to_string(offset)}));
+}
+
+template<typename Context, typename Key, typename Offsets>
+inline auto get_bits(Context& c, Key key, const Offsets& offsets, const batch_limits& limits = {}) -> result<std::vector<bool>>
+{
+	std::vector<bool> res(offsets.size());
+	auto failure = detail::chunked(c, {"BITFIELD_RO", key}, begin(offsets), end(offsets), limits,
+		[](std::vector<std::string>& args, uint64_t offset) -> std::size_t
+		{
+			args.push_back("GET");
+			args.push_back("u1");
+			args.push_back(std::to_string(offset));
+			return args.back().size() + 5;
+		},
+		[&res](const reply::reply_t& r, std::size_t offset, std::size_t count)
+		{
+			return detail::bits(r.get(), res, offset, count);
+		});
+	if(failure)
+		return *failure;
+	return res;
+}
+
+template<typename Context, typename Key>
+inline auto get_range(Context& c, Key key, long long start, long long end) -> result<std::string>
+{
+	return detail::string(c.try_command({"GETRANGE", key, std::to_string(start), std::to_string(end)}));
+}
+
+template<typename Context, typename Key, typename Value>
+inline auto get_set(Context& c, Key key, Value value) -> result<boost::optional<std::string>>
+{
+	return detail::optional_string(c.try_command({"GETSET", key, value}));
+}
+
+template<typename Context, typename Key>
+inline auto incr(Context& c, Key key) -> result<long long>
+{
+	return detail::integer(c.try_command({"INCR", key}));
+}
+
+template<typename Context, typename Key>
+inline auto incr_by(Context& c, Key key, long long increment) -> result<long long>
+{
+	return detail::integer(c.try_command({"INCRBY", key, std::to_string(increment)}));
+}
+
+template<typename Context, typename Key, typename... Keys>
+inline auto get(Context& c, Key key, Key key2, Keys... keys) -> result<std::vector<boost::optional<std::string>>>
+{
+	auto r = c.try_command({"MGET", key, key2, keys...});
+	if(!r)
+		return r.error();
+	std::vector<boost::optional<std::string>> res(2 + sizeof...(keys));
+	auto failure = detail::optional_strings(r->get(), res, 0, res.size());
+	if(failure)
+		return *failure;
+	return res;
+}
+
+template<typename Context, typename Keys>
+inline auto get_many(Context& c, const Keys& keys, const batch_limits& limits = {}) -> result<std::vector<boost::optional<std::string>>>
+{
+	std::vector<boost::optional<std::string>> res(std::distance(std::begin(keys), std::end(keys)));
+	auto failure = detail::chunked(c, {"MGET"}, std::begin(keys), std::end(keys), limits,
+		[](std::vector<std::string>& args, const std::string& key) -> std::size_t
+		{
+			args.push_back(key);
+			return key.size();
+		},
+		[&res](const reply::reply_t& r, std::size_t offset, std::size_t count)
+		{
+			return detail::optional_strings(r.get(), res, offset, count);
+		});
+	if(failure)
+		return *failure;
+	return res;
+}
+
+template<typename Context, typename Key, typename Value>
+inline auto set(Context& c, const std::map<Key, Value>& values) -> result<std::string>
+{
+	std::vector<std::string> args{"MSET"};
+	for(auto& v : values)
+		args.insert(args.end(), {v.first, v.second});
+	return detail::status(c.try_command(args));
+}
+
+// Returns the number of pairs set; after a failure some chunks may have been applied.
+template<typename Context, typename Pairs>
+inline auto set_many(Context& c, const Pairs& values, const batch_limits& limits = {}) -> result<std::size_t>
+{
+	typedef typename std::iterator_traits<decltype(std::begin(values))>::value_type pair_type;
+	std::size_t n = 0;
+	auto failure = detail::chunked(c, {"MSET"}, std::begin(values), std::end(values), limits,
+		[](std::vector<std::string>& args, const pair_type& v) -> std::size_t
+		{
+			args.push_back(v.first);
+			args.push_back(v.second);
+			return args[args.size() - 2].size() + args.back().size();
+		},
+		[&n](const reply::reply_t& r, std::size_t, std::size_t count) -> boost::optional<error_code>
+		{
+			if(r->type != REDIS_REPLY_STATUS)
+				return detail::type_error("status");
+			n += count;
+			return {};
+		});
+	if(failure)
+		return *failure;
+	return n;
+}
+
+template<typename Context, typename Key, typename Value>
+inline auto setnx(Context& c, const std::map<Key, Value>& values) -> result<bool>
+{
+	std::vector<std::string> args{"MSETNX"};
+	for(auto& v : values)
+		args.insert(args.end(), {v.first, v.second});
+	return detail::flag(c.try_command(args));
+}
+
+template<typename Context, typename Key, typename Value>
+inline auto set(Context& c, Key key, Value value) -> result<std::string>
+{
+	return detail::status(c.try_command({"SET", key, value}));
+}
+template<typename Context, typename Key, typename Value>
+inline auto set(Context& c, Key key, Value value, std::chrono::seconds ttl) -> result<std::string>
+{
+	return detail::status(c.try_command({"SET", key, value, "EX", std::to_string(ttl.count())}));
+}
+template<typename Context, typename Key, typename Value>
+inline auto set(Context& c, Key key, Value value, std::chrono::milliseconds ttl) -> result<std::string>
+{
+	return detail::status(c.try_command({"SET", key, value, "PX", std::to_string(ttl.count())}));
+}
+
+// False if the key exists; not an error.
+template<typename Context, typename Key, typename Value>
+inline auto setnx(Context& c, Key key, Value value) -> result<bool>
+{
+	return detail::applied(c.try_command({"SET", key, value, "NX"}));
+}
+template<typename Context, typename Key, typename Value>
+inline auto setnx(Context& c, Key key, Value value, std::chrono::seconds ttl) -> result<bool>
+{
+	return detail::applied(c.try_command({"SET", key, value, "EX", std::to_string(ttl.count()), "NX"}));
+}
+template<typename Context, typename Key, typename Value>
+inline auto setnx(Context& c, Key key, Value value, std::chrono::milliseconds ttl) -> result<bool>
+{
+	return detail::applied(c.try_command({"SET", key, value, "PX", std::to_string(ttl.count()), "NX"}));
+}
+
+// False if the key does not exist; not an error.
+template<typename Context, typename Key, typename Value>
+inline auto setxx(Context& c, Key key, Value value) -> result<bool>
+{
+	return detail::applied(c.try_command({"SET", key, value, "XX"}));
+}
+template<typename Context, typename Key, typename Value>
+inline auto setxx(Context& c, Key key, Value value, std::chrono::seconds ttl) -> result<bool>
+{
+	return detail::applied(c.try_command({"SET", key, value, "EX", std::to_string(ttl.count()), "XX"}));
+}
+template<typename Context, typename Key, typename Value>
+inline auto setxx(Context& c, Key key, Value value, std::chrono::milliseconds ttl) -> result<bool>
+{
+	return detail::applied(c.try_command({"SET", key, value, "PX", std::to_string(ttl.count()), "XX"}));
+}
+
+template<typename Context, typename Key>
+inline auto set_bit(Context& c, Key key, uint64_t offset, bool value) -> result<bool>
+{
+	return detail::flag(c.try_command({"SETBIT", key, std::to_string(offset), value ? "1" : "0"}));
+}
+
+template<typename Context, typename Key, typename Offsets>
+inline auto set_bits(Context& c, Key key, const Offsets& offsets, bool value, const batch_limits& limits = {}) -> result<std::vector<bool>>
+{
+	std::vector<bool> res(offsets.size());
+	auto failure = detail::chunked(c, {"BITFIELD", key}, begin(offsets), end(offsets), limits,
+		[value](std::vector<std::string>& args, uint64_t offset) -> std::size_t
+		{
+			args.push_back("SET");
+			args.push_back("u1");
+			args.push_back(std::to_string(offset));
+			args.push_back(value ? "1" : "0");
+			return args[args.size() - 2].size() + 9;
+		},
+		[&res](const reply::reply_t& r, std::size_t offset, std::size_t count)
+		{
+			return detail::bits(r.get(), res, offset, count);
+		});
+	if(failure)
+		return *failure;
+	return res;
+}
+
+template<typename Context, typename Key, typename Value>
+inline auto set_range(Context& c, Key key, uint64_t offset, Value value) -> result<long long>
+{
+	return detail::integer(c.try_command({"SETRANGE", key, std::to_string(offset), value}));
+}
+
+template<typename Context, typename Key>
+inline auto strlen(Context& c, Key key) -> result<long long>
+{
+	return detail::integer(c.try_command({"STRLEN", key}));
+}
+}
+
+namespace hash
+{
+template<typename Context, typename Key, typename Field, typename... Fields>
+inline auto del(Context& c, Key key, Field field, Fields... fields) -> result<long long>
+{
+	return detail::integer(c.try_command({"HDEL", key, field, fields...}));
+}
+
+template<typename Context, typename Key, typename Field>
+inline auto exists(Context& c, Key key, Field field) -> result<bool>
+{
+	return detail::flag(c.try_command({"HEXISTS", key, field}));
+}
+
+template<typename Context, typename Key, typename Field>
+inline auto get(Context& c, Key key, Field field) -> result<boost::optional<std::string>>
+{
+	return detail::optional_string(c.try_command({"HGET", key, field}));
+}
+
+template<typename Context, typename Key>
+inline auto get(Context& c, Key key) -> result<std::map<std::string, std::string>>
+{
+	return detail::string_map(c.try_command({"HGETALL", key}));
+}
+
+template<typename Context, typename Key, typename Field, typename... Fields>
+inline auto get(Context& c, Key key, Field field, Fields... fields) -> result<std::map<std::string, std::string>>
+{
+	std::vector<std::string> names{field, fields...};
+	std::vector<boost::optional<std::string>> values(names.size());
+	auto r = c.try_command({"HMGET", key, field, fields...});
+	if(!r)
+		return r.error();
+	auto failure = detail::optional_strings(r->get(), values, 0, values.size());
+	if(failure)
+		return *failure;
+	std::map<std::string, std::string> res;
+	for(std::size_t i = 0; i < names.size(); ++i)
+	{
+		if(values[i])
+			res.insert(std::make_pair(names[i], std::move(*values[i])));
+	}
+	return res;
+}
+
+template<typename Context, typename Key, typename Fields>
+inline auto get_many(Context& c, Key key, const Fields& fields, const batch_limits& limits = {}) -> result<std::vector<boost::optional<std::string>>>
+{
+	std::vector<boost::optional<std::string>> res(std::distance(std::begin(fields), std::end(fields)));
+	auto failure = detail::chunked(c, {"HMGET", key}, std::begin(fields), std::end(fields), limits,
+		[](std::vector<std::string>& args, const std::string& field) -> std::size_t
+		{
+			args.push_back(field);
+			return field.size();
+		},
+		[&res](const reply::reply_t& r, std::size_t offset, std::size_t count)
+		{
+			return detail::optional_strings(r.get(), res, offset, count);
+		});
+	if(failure)
+		return *failure;
+	return res;
+}
+
+template<typename Context, typename Key, typename Field>
+inline auto incr_by(Context& c, Key key, Field field, long long increment) -> result<long long>
+{
+	return detail::integer(c.try_command({"HINCRBY", key, field, std::to_string(increment)}));
+}
+
+template<typename Context, typename Key>
+inline auto keys(Context& c, Key key) -> result<std::vector<std::string>>
+{
+	return detail::string_array(c.try_command({"HKEYS", key}));
+}
+
+template<typename Context, typename Key>
+inline auto len(Context& c, Key key) -> result<long long>
+{
+	return detail::integer(c.try_command({"HLEN", key}));
+}
+
+template<typename Context, typename Key, typename Field, typename Value>
+inline auto set(Context& c, Key key, const std::map<Field, Value> h) -> result<std::string>
+{
+	std::vector<std::string> args{"HMSET", key};
+	for(auto& v : h)
+		args.insert(args.end(), {v.first, v.second});
+	return detail::status(c.try_command(args));
+}
+
+template<typename Context, typename Key, typename Field, typename Value>
+inline auto set(Context& c, Key key, Field field, Value value) -> result<bool>
+{
+	return detail::flag(c.try_command({"HSET", key, field, value}));
+}
+
+template<typename Context, typename Key, typename Field, typename Value>
+inline auto setnx(Context& c, Key key, Field field, Value value) -> result<bool>
+{
+	return detail::flag(c.try_command({"HSETNX", key, field, value}));
+}
+
+template<typename Context, typename Key>
+inline auto values(Context& c, Key key) -> result<std::vector<std::string>>
+{
+	return detail::string_array(c.try_command({"HVALS", key}));
+}
+}
+
+namespace list
+{
+template<typename Context, typename Key>
+inline auto index(Context& c, Key key, long long index) -> result<boost::optional<std::string>>
+{
+	return detail::optional_string(c.try_command({"LINDEX", key, std::to_string(index)}));
+}
+
+template<typename Context, typename Key, typename Value>
+inline auto insert(Context& c, Key key, bool before, Value pivot, Value value) -> result<long long>
+{
+	return detail::integer(c.try_command({"LINSERT", key, before ? "BEFORE" : "AFTER", pivot, value}));
+}
+
+template<typename Context, typename Key>
+inline auto len(Context& c, Key key) -> result<long long>
+{
+	return detail::integer(c.try_command({"LLEN", key}));
+}
+
+template<typename Context, typename Key>
+inline auto lpop(Context& c, Key key) -> result<boost::optional<std::string>>
+{
+	return detail::optional_string(c.try_command({"LPOP", key}));
+}
+
+template<typename Context, typename Key, typename Value, typename... Values>
+inline auto lpush(Context& c, Key key, Value value, Values... values) -> result<long long>
+{
+	return detail::integer(c.try_command({"LPUSH", key, value, values...}));
+}
+
+template<typename Context, typename Key, typename Value>
+inline auto lpushx(Context& c, Key key, Value value) -> result<long long>
+{
+	return detail::integer(c.try_command({"LPUSHX", key, value}));
+}
+
+template<typename Context, typename Key>
+inline auto range(Context& c, Key key, long long start, long long stop) -> result<std::vector<std::string>>
+{
+	return detail::string_array(c.try_command({"LRANGE", key, std::to_string(start), std::to_string(stop)}));
+}
+
+template<typename Context, typename Key, typename Value>
+inline auto rem(Context& c, Key key, long long count, Value value) -> result<long long>
+{
+	return detail::integer(c.try_command({"LREM", key, std::to_string(count), value}));
+}
+
+template<typename Context, typename Key, typename Value>
+inline auto set(Context& c, Key key, long long index, Value value) -> result<std::string>
+{
+	return detail::status(c.try_command({"LSET", key, std::to_string(index), value}));
+}
+
+template<typename Context, typename Key>
+inline auto trim(Context& c, Key key, long long start, long long stop) -> result<std::string>
+{
+	return detail::status(c.try_command({"LTRIM", key, std::to_string(start), std::to_string(stop)}));
+}
+
+template<typename Context, typename Key>
+inline auto rpop(Context& c, Key key) -> result<boost::optional<std::string>>
+{
+	return detail::optional_string(c.try_command({"RPOP", key}));
+}
+
+template<typename Context, typename Key>
+inline auto rpoplpush(Context& c, Key source, Key destination) -> result<boost::optional<std::string>>
+{
+	return detail::optional_string(c.try_command({"RPOPLPUSH", source, destination}));
+}
+
+template<typename Context, typename Key, typename Value, typename... Values>
+inline auto rpush(Context& c, Key key, Value value, Values... values) -> result<long long>
+{
+	return detail::integer(c.try_command({"RPUSH", key, value, values...}));
+}
+
+template<typename Context, typename Key, typename Value>
+inline auto rpushx(Context& c, Key key, Value value) -> result<long long>
+{
+	return detail::integer(c.try_command({"RPUSHX", key, value}));
+}
+}
+
+namespace set
+{
+template<typename Context, typename Key, typename Member, typename... Members>
+inline auto add(Context& c, Key key, Member member, Members... members) -> result<long long>
+{
+	return detail::integer(c.try_command({"SADD", key, member, members...}));
+}
+
+template<typename Context, typename Key>
+inline auto card(Context& c, Key key) -> result<long long>
+{
+	return detail::integer(c.try_command({"SCARD", key}));
+}
+
+template<typename Context, typename Key, typename Member>
+inline auto is_member(Context& c, Key key, Member member) -> result<bool>
+{
+	return detail::flag(c.try_command({"SISMEMBER", key, member}));
+}
+
+template<typename Context, typename Key>
+inline auto members(Context& c, Key key) -> result<std::vector<std::string>>
+{
+	return detail::string_array(c.try_command({"SMEMBERS", key}));
+}
+
+// Empty if the set is empty.
+template<typename Context, typename Key>
+inline auto pop(Context& c, Key key) -> result<boost::optional<std::string>>
+{
+	return detail::optional_string(c.try_command({"SPOP", key}));
+}
+
+template<typename Context, typename Key, typename Member, typename... Members>
+inline auto rem(Context& c, Key key, Member member, Members... members) -> result<long long>
+{
+	return detail::integer(c.try_command({"SREM", key, member, members...}));
+}
+}
+
+namespace sorted_set
+{
+template<typename Context, typename Key, typename Member>
+inline auto add(Context& c, Key key, double score, Member member) -> result<long long>
+{
+	return detail::integer(c.try_command({"ZADD", key, schema::field_codec<double>::encode(score), member}));
+}
+template<typename Context, typename Key>
+inline auto add(Context& c, Key key, const std::vector<std::pair<double, std::string>>& members) -> result<long long>
+{
+	std::vector<std::string> args{"ZADD", key};
+	args.reserve(2 + 2 * members.size());
+	for(auto& m : members)
+	{
+		args.push_back(schema::field_codec<double>::encode(m.first));
+		args.push_back(m.second);
+	}
+	return detail::integer(c.try_command(args));
+}
+
+template<typename Context, typename Key>
+inline auto card(Context& c, Key key) -> result<long long>
+{
+	return detail::integer(c.try_command({"ZCARD", key}));
+}
+
+template<typename Context, typename Key>
+inline auto range(Context& c, Key key, long long start, long long stop) -> result<std::vector<std::string>>
+{
+	return detail::string_array(c.try_command({"ZRANGE", key, std::to_string(start), std::to_string(stop)}));
+}
+
+template<typename Context, typename Key>
+inline auto range_by_lex(Context& c, Key key, const std::string& min, const std::string& max) -> result<std::vector<std::string>>
+{
+	return detail::string_array(c.try_command({"ZRANGEBYLEX", key, min, max}));
+}
+
+template<typename Context, typename Key, typename Member, typename... Members>
+inline auto rem(Context& c, Key key, Member member, Members... members) -> result<long long>
+{
+	return detail::integer(c.try_command({"ZREM", key, member, members...}));
+}
+
+template<typename Context, typename Key, typename Member>
+inline auto score(Context& c, Key key, Member member) -> result<boost::optional<double>>
+{
+	return detail::optional_double(c.try_command({"ZSCORE", key, member}));
+}
+}
+
+namespace pubsub
+{
+// Returns the number of subscribers that received the message.
+template<typename Context, typename Channel, typename Message>
+inline auto publish(Context& c, Channel channel, Message message) -> result<long long>
+{
+	return detail::integer(c.try_command({"PUBLISH", channel, message}));
+}
+}
+
+namespace transaction
+{
+template<typename Context>
+inline auto discard(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"DISCARD"}));
+}
+
+/*
+ Replies of the queued commands, or empty if a watched key changed and
+ the transaction was not run. A transaction the server refused (e.g. a
+ queued command had a syntax error) fails with errc::exec_abort.
+*/
+template<typename Context>
+inline auto exec(Context& c) -> result<boost::optional<std::vector<reply::reply_t>>>
+{
+	auto r = c.try_command({"EXEC"});
+	if(!r)
+		return r.error();
+	if((*r)->type == REDIS_REPLY_NIL)
+		return boost::optional<std::vector<reply::reply_t>>();
+	if((*r)->type != REDIS_REPLY_ARRAY)
+		return detail::type_error("array");
+	return boost::optional<std::vector<reply::reply_t>>(reply::array{*r}.elements);
+}
+
+template<typename Context>
+inline auto multi(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"MULTI"}));
+}
+
+template<typename Context>
+inline auto unwatch(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"UNWATCH"}));
+}
+
+template<typename Context, typename Key, typename... Keys>
+inline auto watch(Context& c, Key key, Keys... keys) -> result<std::string>
+{
+	return detail::status(c.try_command({"WATCH", key, keys...}));
+}
+}
+
+namespace connection
+{
+template<typename Context>
+inline auto auth(Context& c, const std::string& password) -> result<std::string>
+{
+	return detail::status(c.try_command({"AUTH", password}));
+}
+
+template<typename Context>
+inline auto ping(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"PING"}));
+}
+
+template<typename Context>
+inline auto echo(Context& c, const std::string& message) -> result<std::string>
+{
+	return detail::string(c.try_command({"ECHO", message}));
+}
+
+template<typename Context>
+inline auto quit(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"QUIT"}));
+}
+
+template<typename Context>
+inline auto select(Context& c, int index) -> result<std::string>
+{
+	return detail::status(c.try_command({"SELECT", std::to_string(index)}));
+}
+}
+
+namespace server
+{
+template<typename Context>
+inline auto bg_rewrite_aof(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"BGREWRITEAOF"}));
+}
+
+template<typename Context>
+inline auto bg_save(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"BGSAVE"}));
+}
+
+namespace client
+{
+template<typename Context>
+inline auto kill(Context& c, const std::string& address) -> result<std::string>
+{
+	return detail::status(c.try_command({"CLIENT", "KILL", address}));
+}
+
+template<typename Context>
+inline auto list(Context& c) -> result<std::string>
+{
+	return detail::string(c.try_command({"CLIENT", "LIST"}));
+}
+
+template<typename Context>
+inline auto get_name(Context& c) -> result<boost::optional<std::string>>
+{
+	return detail::optional_string(c.try_command({"CLIENT", "GETNAME"}));
+}
+
+template<typename Context>
+inline auto set_name(Context& c, const std::string& name) -> result<std::string>
+{
+	return detail::status(c.try_command({"CLIENT", "SETNAME", name}));
+}
+}
+
+namespace config
+{
+template<typename Context>
+inline auto get(Context& c, const std::string& parameter) -> result<std::map<std::string, std::string>>
+{
+	return detail::string_map(c.try_command({"CONFIG", "GET", parameter}));
+}
+
+template<typename Context>
+inline auto rewrite(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"CONFIG", "REWRITE"}));
+}
+
+template<typename Context>
+inline auto set(Context& c, const std::string& parameter, const std::string& value) -> result<std::string>
+{
+	return detail::status(c.try_command({"CONFIG", "SET", parameter, value}));
+}
+
+template<typename Context>
+inline auto reset_stat(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"CONFIG", "RESETSTAT"}));
+}
+}
+
+template<typename Context>
+inline auto dbsize(Context& c) -> result<long long>
+{
+	return detail::integer(c.try_command({"DBSIZE"}));
+}
+
+template<typename Context>
+inline auto flush_all(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"FLUSHALL"}));
+}
+
+template<typename Context>
+inline auto flush_db(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"FLUSHDB"}));
+}
+
+template<typename Context>
+inline auto info(Context& c) -> result<std::string>
+{
+	return detail::string(c.try_command({"INFO"}));
+}
+template<typename Context>
+inline auto info(Context& c, const std::string& section) -> result<std::string>
+{
+	return detail::string(c.try_command({"INFO", section}));
+}
+
+template<typename Context>
+inline auto last_save(Context& c) -> result<std::time_t>
+{
+	auto n = detail::integer(c.try_command({"LASTSAVE"}));
+	if(!n)
+		return n.error();
+	return static_cast<std::time_t>(*n);
+}
+
+template<typename Context>
+inline auto save(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"SAVE"}));
+}
+
+namespace slowlog
+{
+template<typename Context>
+inline auto get(Context& c, long long count = 10) -> result<std::vector<commands::server::slowlog::entry>>
+{
+	auto r = c.try_command({"SLOWLOG", "GET", std::to_string(count)});
+	if(!r)
+		return r.error();
+	if((*r)->type != REDIS_REPLY_ARRAY)
+		return detail::type_error("array");
+	
+	std::vector<commands::server::slowlog::entry> entries;
+	for(std::size_t i = 0; i < (*r)->elements; ++i)
+	{
+		auto e = (*r)->element[i];
+		if(e->type != REDIS_REPLY_ARRAY || e->elements < 4)
+			return error_code{errc::type, "SLOWLOG entry has too few fields"};
+		auto args = e->element[3];
+		if(e->element[0]->type != REDIS_REPLY_INTEGER || e->element[1]->type != REDIS_REPLY_INTEGER || e->element[2]->type != REDIS_REPLY_INTEGER || args->type != REDIS_REPLY_ARRAY)
+			return error_code{errc::type, "SLOWLOG entry malformed"};
+		
+		commands::server::slowlog::entry res{e->element[0]->integer, static_cast<std::time_t>(e->element[1]->integer), std::chrono::microseconds{e->element[2]->integer}, {}};
+		for(std::size_t j = 0; j < args->elements; ++j)
+		{
+			if(args->element[j]->type != REDIS_REPLY_STRING)
+				return detail::type_error("string");
+			res.args.emplace_back(args->element[j]->str, args->element[j]->len);
+		}
+		entries.push_back(std::move(res));
+	}
+	return entries;
+}
+
+template<typename Context>
+inline auto len(Context& c) -> result<long long>
+{
+	return detail::integer(c.try_command({"SLOWLOG", "LEN"}));
+}
+
+template<typename Context>
+inline auto reset(Context& c) -> result<std::string>
+{
+	return detail::status(c.try_command({"SLOWLOG", "RESET"}));
+}
+}
+
+template<typename Context>
+inline auto time(Context& c) -> result<std::chrono::system_clock::time_point>
+{
+	auto t = detail::string_array(c.try_command({"TIME"}));
+	if(!t)
+		return t.error();
+	if(t->size() != 2)
+		return error_code{errc::type, "TIME result not 2 elements"};
+	auto seconds = std::strtoll((*t)[0].c_str(), nullptr, 10);
+	auto micros = std::strtoll((*t)[1].c_str(), nullptr, 10);
+	return std::chrono::system_clock::time_point{std::chrono::seconds{seconds} + std::chrono::microseconds{micros}};
+}
+}
+
+}
+}
+}
+
+#endif /* HIREDIS11_NOTHROW_H_ */
@@ -2,7 +2,12 @@
 #define HIREDIS11_PIPELINE_H_
 #include "context.hh"
 #include <vector>
+#include <deque>
+#include <string>
+#include <functional>
+#include <iterator>
 #include <algorithm>
+#include <exception>
 #include "reply.hh"
 
 namespace hiredis
@@ -24,6 +29,11 @@ public:
 		c.append_command(args);
 		++commands;
 	}
+	auto append_formatted(const char* cmd, std::size_t len) -> void
+	{
+		c.append_formatted(cmd, len);
+		++commands;
+	}
 	auto execute() -> std::vector<reply::reply_t>
 	{
 		std::vector<reply::reply_t> replies(commands);
@@ -31,6 +41,43 @@ public:
 		commands = 0;
 		return replies;
 	}
+	/*
+	 Read all pending replies into the arena.
+	 No per-reply or per-element reference counts; the replies are
+	 released together when the arena is reset or destroyed.
+	*/
+	auto execute(reply::arena& a) -> std::vector<reply::ref>
+	{
+		std::vector<reply::ref> replies(commands);
+		std::generate_n(begin(replies), commands, [this, &a]() -> reply::ref { return c.get_reply(a); });
+		commands = 0;
+		return replies;
+	}
+	/*
+	 Read all pending replies, or throw timeout_error if they have not all
+	 arrived by deadline. Replies not yet read are abandoned per the
+	 context's timeout policy.
+	*/
+	auto execute(context::clock::time_point deadline) -> std::vector<reply::reply_t>
+	{
+		std::vector<reply::reply_t> replies;
+		replies.reserve(commands);
+		while(commands)
+		{
+			--commands;
+			try
+			{
+				replies.push_back(c.get_reply(deadline));
+			}
+			catch(const timeout_error&)
+			{
+				c.abandon(commands);
+				commands = 0;
+				throw;
+			}
+		}
+		return replies;
+	}
 	
 	~pipeline()
 	{
@@ -44,6 +91,242 @@ public:
 	}
 };
 
+/*
+ Pipeline with bounded memory for very large batches.
+ Commands are flushed automatically once limits are reached, and each
+ reply is handed to its command's callback (or the default sink) as it
+ is read, so replies never accumulate. Error replies go to the error
+ handler with the command's sequence number; by default they are
+ collected and reported by finish().
+ e.g.
+ std::vector<std::string> values;
+ streaming_pipeline p(c, [&values](reply::reply_t r) { values.push_back(reply::string{r}); });
+ for(auto& k : keys)
+	 p.command({"GET", k});
+ p.finish();
+*/
+class streaming_pipeline
+{
+public:
+	typedef std::function<void(reply::reply_t)> callback;
+	typedef std::function<void(std::size_t, reply::reply_t)> error_handler;
+
+	struct limits
+	{
+		// Queued commands that trigger a flush.
+		std::size_t commands;
+		// Queued argument bytes that trigger a flush.
+		std::size_t bytes;
+		
+		limits(std::size_t commands = 1000, std::size_t bytes = 1 << 20)
+		 : commands(commands), bytes(bytes)
+		{
+		}
+	};
+
+	struct failure
+	{
+		std::size_t index;
+		std::string what;
+	};
+	
+	struct error : std::runtime_error
+	{
+		std::vector<failure> failures;
+		
+		error(std::vector<failure> failures)
+		 : std::runtime_error(std::to_string(failures.size()) + " pipelined commands failed, first: " + failures.front().what), failures(std::move(failures))
+		{
+		}
+	};
+private:
+	context& c;
+	callback sink;
+	error_handler on_error;
+	limits l;
+	std::deque<callback> pending;
+	std::size_t bytes;
+	std::size_t sequence;
+	std::vector<failure> failures;
+#ifdef __cpp_lib_uncaught_exceptions
+	int exceptions;
+
+	bool unwinding() const
+	{
+		return std::uncaught_exceptions() > exceptions;
+	}
+#else
+	bool unwinding() const
+	{
+		return std::uncaught_exception();
+	}
+#endif
+	
+	void dispatch(reply::reply_t r, const callback& fn)
+	{
+		auto index = sequence++;
+		if(r->type == REDIS_REPLY_ERROR)
+		{
+			if(on_error)
+				on_error(index, r);
+			else
+				failures.push_back({index, {r->str, static_cast<size_t>(r->len)}});
+			return;
+		}
+		if(fn)
+			fn(r);
+		else if(sink)
+			sink(r);
+	}
+public:
+	streaming_pipeline(context& c, callback sink = {}, limits l = limits())
+	 : c(c), sink(std::move(sink)), l(l), bytes(0), sequence(0)
+#ifdef __cpp_lib_uncaught_exceptions
+	 , exceptions(std::uncaught_exceptions())
+#endif
+	{
+	}
+	// Write every successful reply to out.
+	template <typename OutputIterator>
+	streaming_pipeline(context& c, OutputIterator out, limits l = limits(), typename std::iterator_traits<OutputIterator>::iterator_category* = nullptr)
+	 : streaming_pipeline(c, [out](reply::reply_t r) mutable { *out++ = r; }, l)
+	{
+	}
+	
+	streaming_pipeline(const streaming_pipeline&) = delete;
+	streaming_pipeline& operator=(const streaming_pipeline&) = delete;
+	
+	// Handle error replies instead of collecting them.
+	void errors(error_handler fn)
+	{
+		on_error = std::move(fn);
+	}
+	
+	/*
+	 Queue a command; fn (or the default sink) gets its reply.
+	 May flush, running callbacks of earlier commands.
+	*/
+	void command(const std::vector<std::string>& args, callback fn = {})
+	{
+		c.append_command(args);
+		pending.push_back(std::move(fn));
+		for(auto& a : args)
+			bytes += a.size();
+		if(pending.size() >= l.commands || bytes >= l.bytes)
+			flush();
+	}
+	
+	// Queue a command already encoded as RESP, e.g. by prepared_command.
+	void append_formatted(const char* cmd, std::size_t len, callback fn = {})
+	{
+		c.append_formatted(cmd, len);
+		pending.push_back(std::move(fn));
+		bytes += len;
+		if(pending.size() >= l.commands || bytes >= l.bytes)
+			flush();
+	}
+	
+	/*
+	 Read every queued reply.
+	 If reading or a callback throws, the replies not yet read are
+	 abandoned per the context's timeout policy and their callbacks dropped.
+	*/
+	void flush()
+	{
+		bytes = 0;
+		try
+		{
+			while(!pending.empty())
+			{
+				auto r = c.get_reply();
+				auto fn = std::move(pending.front());
+				pending.pop_front();
+				dispatch(r, fn);
+			}
+		}
+		catch(...)
+		{
+			c.abandon(pending.size());
+			sequence += pending.size();
+			pending.clear();
+			throw;
+		}
+	}
+	
+	/*
+	 Read every queued reply, or throw timeout_error if they have not all
+	 arrived by deadline. Callbacks of the replies not yet read are dropped
+	 and the replies abandoned per the context's timeout policy.
+	*/
+	void flush(context::clock::time_point deadline)
+	{
+		bytes = 0;
+		while(!pending.empty())
+		{
+			reply::reply_t r;
+			try
+			{
+				r = c.get_reply(deadline);
+			}
+			catch(const timeout_error&)
+			{
+				c.abandon(pending.size() - 1);
+				sequence += pending.size();
+				pending.clear();
+				throw;
+			}
+			auto fn = std::move(pending.front());
+			pending.pop_front();
+			dispatch(r, fn);
+		}
+	}
+	
+	/*
+	 Flush and throw error if any collected command failed.
+	 The collected failures are cleared.
+	*/
+	void finish()
+	{
+		flush();
+		if(!failures.empty())
+		{
+			std::vector<failure> f;
+			f.swap(failures);
+			throw error(std::move(f));
+		}
+	}
+	
+	// Commands sent so far whose replies have been read.
+	auto completed() const -> std::size_t
+	{
+		return sequence;
+	}
+	
+	/*
+	 Finishes, so failures not yet reported by finish() are thrown as
+	 error. When destroyed by another exception it only flushes, if the
+	 connection is still usable, and throws nothing.
+	*/
+	~streaming_pipeline() noexcept(false)
+	{
+		if(unwinding())
+		{
+			try
+			{
+				if(c.connected())
+					flush();
+			}
+			catch(...)
+			{
+			}
+			return;
+		}
+		if(!c.connected())
+			pending.clear();
+		finish();
+	}
+};
+
 }
 
 #endif /* HIREDIS11_PIPELINE_H_ */
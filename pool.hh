@@ -0,0 +1,226 @@
+#ifndef HIREDIS11_POOL_H_
+#define HIREDIS11_POOL_H_
+#include <memory>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <algorithm>
+#include <chrono>
+#include "context.hh"
+#include "reply.hh"
+#include "error.hh"
+
+namespace hiredis
+{
+
+/*
+ Thread safe pool of contexts to one server.
+ Connections are opened on demand up to max and reused; a connection
+ that failed is dropped instead of returned.
+ e.g.
+ context_pool pool("localhost", 6379, 16);
+ commands::string::get(pool, "foo"); // any thread
+ {
+	 auto c = pool.acquire();
+	 pipeline p(*c);
+	 ...
+ }
+*/
+class context_pool
+{
+private:
+	std::string host;
+	int port;
+	std::size_t max;
+	std::size_t open;
+	std::vector<std::unique_ptr<context>> idle;
+	std::mutex m;
+	std::condition_variable available;
+	context::timeout_policy policy;
+	unsigned long long timeouts;
+
+	void forget()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m);
+			--open;
+		}
+		available.notify_one();
+	}
+	void release(std::unique_ptr<context> c)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m);
+			if(c->connected())
+				idle.push_back(std::move(c));
+			else
+				--open;
+		}
+		available.notify_one();
+	}
+public:
+	// Exclusive use of one pooled context; returned on destruction.
+	class lease
+	{
+	private:
+		friend class context_pool;
+		context_pool* p;
+		std::unique_ptr<context> c;
+
+		lease(context_pool* p, std::unique_ptr<context> c)
+		 : p(p), c(std::move(c))
+		{
+		}
+	public:
+		lease(lease&& o)
+		 : p(o.p), c(std::move(o.c))
+		{
+		}
+		lease(const lease&) = delete;
+		lease& operator=(const lease&) = delete;
+		lease& operator=(lease&&) = delete;
+
+		~lease()
+		{
+			if(c)
+				p->release(std::move(c));
+		}
+
+		auto operator*() -> context&
+		{
+			return *c;
+		}
+		auto operator->() -> context*
+		{
+			return c.get();
+		}
+
+		/*
+		 Keep the context instead of returning it, e.g. after changing its
+		 connection state; it no longer counts towards the pool's max.
+		*/
+		auto detach() -> std::unique_ptr<context>
+		{
+			if(c)
+				p->forget();
+			return std::move(c);
+		}
+	};
+
+	context_pool(const std::string& host, int port, std::size_t max = std::max(2u, std::thread::hardware_concurrency() * 2))
+	 : host(host), port(port), max(std::max<std::size_t>(max, 1)), open(0), policy(context::timeout_policy::resync), timeouts(0)
+	{
+	}
+
+	context_pool(const context_pool&) = delete;
+	context_pool& operator=(const context_pool&) = delete;
+
+	// Take an idle context, open a new one, or wait for one to be returned.
+	auto acquire() -> lease
+	{
+		return acquire(context::clock::time_point::max());
+	}
+	// As acquire(), throwing timeout_error if none is free by deadline.
+	auto acquire(context::clock::time_point deadline) -> lease
+	{
+		std::unique_lock<std::mutex> lock(m);
+		auto free = [this]{ return !idle.empty() || open < max; };
+		if(deadline == context::clock::time_point::max())
+			available.wait(lock, free);
+		else if(!available.wait_until(lock, deadline, free))
+		{
+			++timeouts;
+			throw timeout_error("No pooled context free before deadline.");
+		}
+		if(!idle.empty())
+		{
+			auto c = std::move(idle.back());
+			idle.pop_back();
+			return {this, std::move(c)};
+		}
+
+		++open;
+		lock.unlock();
+		try
+		{
+			return {this, std::unique_ptr<context>(new context(host, port))};
+		}
+		catch(...)
+		{
+			lock.lock();
+			--open;
+			lock.unlock();
+			available.notify_one();
+			throw;
+		}
+	}
+
+	/*
+	 Send a command on any pooled context and get a reply.
+	 e.g.
+	 auto reply = pool.command({"GET", "foo"});
+	*/
+	auto command(const std::vector<std::string>& args) -> reply::reply_t
+	{
+		return acquire()->command(args);
+	}
+	/*
+	 As command(), throwing timeout_error if no context is free or no reply
+	 has arrived by deadline. A context that timed out goes back to the
+	 pool, per its timeout policy, and its next user skips the late reply.
+	*/
+	auto command(const std::vector<std::string>& args, context::clock::time_point deadline) -> reply::reply_t
+	{
+		auto c = acquire(deadline);
+		{
+			std::lock_guard<std::mutex> lock(m);
+			c->on_timeout(policy);
+		}
+		try
+		{
+			return c->command(args, deadline);
+		}
+		catch(const timeout_error&)
+		{
+			std::lock_guard<std::mutex> lock(m);
+			++timeouts;
+			throw;
+		}
+	}
+	template <typename Rep, typename Period>
+	auto command(const std::vector<std::string>& args, std::chrono::duration<Rep, Period> timeout) -> reply::reply_t
+	{
+		return command(args, context::clock::now() + timeout);
+	}
+
+	// Policy for pooled contexts whose command misses its deadline.
+	void on_timeout(context::timeout_policy p)
+	{
+		std::lock_guard<std::mutex> lock(m);
+		policy = p;
+	}
+	// Commands and acquires that missed their deadline.
+	auto timeout_count() -> unsigned long long
+	{
+		std::lock_guard<std::mutex> lock(m);
+		return timeouts;
+	}
+
+	// Open connections, idle or leased.
+	auto size() -> std::size_t
+	{
+		std::lock_guard<std::mutex> lock(m);
+		return open;
+	}
+	auto idle_count() -> std::size_t
+	{
+		std::lock_guard<std::mutex> lock(m);
+		return idle.size();
+	}
+};
+
+}
+
+#endif /* HIREDIS11_POOL_H_ */
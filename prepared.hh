@@ -0,0 +1,157 @@
+#ifndef HIREDIS11_PREPARED_H_
+#define HIREDIS11_PREPARED_H_
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <initializer_list>
+#include <utility>
+#include <iterator>
+#include <boost/utility/string_ref.hpp>
+#include "reply.hh"
+
+namespace hiredis
+{
+
+/*
+ A command shape whose fixed arguments are encoded once.
+ The RESP text between placeholders is built at construction; executing
+ only encodes the variable arguments, into a reused per-thread buffer
+ that is copied once into the connection's output buffer.
+ Works with anything providing append_formatted(), i.e. context,
+ pipeline, streaming_pipeline and async_context.
+ e.g.
+ static const prepared_command hget({"HGET", prepared_command::arg(), "profile"});
+ auto profile = reply::string{hget(c, {"user:42"})};
+ hget.append(p, {"user:43"});
+ hget.append(ac, {"user:44"}, [](reply::reply_t r, std::exception_ptr e) { ... });
+*/
+class prepared_command
+{
+public:
+	// Marks a variable argument.
+	struct arg
+	{
+	};
+
+	struct part
+	{
+		bool variable;
+		std::string value;
+
+		part(arg)
+		 : variable(true)
+		{
+		}
+		part(const char* value)
+		 : variable(false), value(value)
+		{
+		}
+		part(std::string value)
+		 : variable(false), value(std::move(value))
+		{
+		}
+	};
+private:
+	// fragments[i] precedes variable argument i; the last one ends the command.
+	std::vector<std::string> fragments;
+	std::size_t fixed;
+
+	static void bulk(std::string& out, boost::string_ref s)
+	{
+		out += '$';
+		out += std::to_string(s.size());
+		out += "\r\n";
+		out.append(s.data(), s.size());
+		out += "\r\n";
+	}
+
+	template <typename It>
+	auto encode(It first, It last) const -> const std::string&
+	{
+		if(static_cast<std::size_t>(std::distance(first, last)) != parameters())
+			throw std::invalid_argument("Prepared command expects " + std::to_string(parameters()) + " arguments");
+
+		static thread_local std::string buffer;
+		buffer.clear();
+		std::size_t size = fixed;
+		for(auto it = first; it != last; ++it)
+			size += boost::string_ref(*it).size() + 16;
+		buffer.reserve(size);
+
+		auto fragment = fragments.begin();
+		buffer += *fragment++;
+		for(; first != last; ++first)
+		{
+			bulk(buffer, *first);
+			buffer += *fragment++;
+		}
+		return buffer;
+	}
+public:
+	prepared_command(std::initializer_list<part> parts)
+	 : fragments(1, "*" + std::to_string(parts.size()) + "\r\n"), fixed(0)
+	{
+		if(!parts.size())
+			throw std::invalid_argument("Prepared command is empty");
+		for(auto& p : parts)
+		{
+			if(p.variable)
+				fragments.emplace_back();
+			else
+				bulk(fragments.back(), p.value);
+		}
+		for(auto& f : fragments)
+			fixed += f.size();
+	}
+
+	auto parameters() const -> std::size_t
+	{
+		return fragments.size() - 1;
+	}
+
+	// RESP encoding of the command with the given arguments.
+	auto format(std::initializer_list<boost::string_ref> args) const -> std::string
+	{
+		return encode(args.begin(), args.end());
+	}
+	auto format(const std::vector<std::string>& args) const -> std::string
+	{
+		return encode(args.begin(), args.end());
+	}
+
+	/*
+	 Queue the command on c.
+	 Extra arguments are passed through, e.g. the completion for an
+	 async_context or streaming_pipeline.
+	*/
+	template <typename Context, typename... Extra>
+	void append(Context& c, std::initializer_list<boost::string_ref> args, Extra&&... extra) const
+	{
+		auto& cmd = encode(args.begin(), args.end());
+		c.append_formatted(cmd.data(), cmd.size(), std::forward<Extra>(extra)...);
+	}
+	template <typename Context, typename... Extra>
+	void append(Context& c, const std::vector<std::string>& args, Extra&&... extra) const
+	{
+		auto& cmd = encode(args.begin(), args.end());
+		c.append_formatted(cmd.data(), cmd.size(), std::forward<Extra>(extra)...);
+	}
+
+	// Send the command and wait for its reply.
+	template <typename Context>
+	auto operator()(Context& c, std::initializer_list<boost::string_ref> args) const -> reply::reply_t
+	{
+		append(c, args);
+		return c.get_reply();
+	}
+	template <typename Context>
+	auto operator()(Context& c, const std::vector<std::string>& args) const -> reply::reply_t
+	{
+		append(c, args);
+		return c.get_reply();
+	}
+};
+
+}
+
+#endif /* HIREDIS11_PREPARED_H_ */
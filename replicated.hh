@@ -0,0 +1,295 @@
+#ifndef HIREDIS11_REPLICATED_H_
+#define HIREDIS11_REPLICATED_H_
+#include <hiredis/hiredis.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+#include "context.hh"
+#include "command_info.hh"
+#include "reply.hh"
+#include "error.hh"
+
+namespace hiredis
+{
+
+/*
+ Primary plus read replicas.
+ Read-only commands (per command_info) go to a replica, everything else
+ to the primary. After a write, reads stay on the primary for a while so
+ a caller always sees its own writes; MULTI/WATCH blocks stay on the
+ primary throughout. Replicas lagging more than max_lag, or failing, are
+ skipped until the next refresh.
+ e.g.
+ replicated_context db("10.0.0.1", 6379);
+ commands::string::get(db, "foo"); // served by a replica
+*/
+class replicated_context
+{
+public:
+	typedef std::chrono::steady_clock clock;
+
+	enum class selection
+	{
+		round_robin,
+		// Lowest exponentially weighted moving average latency.
+		latency
+	};
+
+	struct endpoint
+	{
+		std::string host;
+		int port;
+	};
+
+	struct options
+	{
+		selection select;
+		// Replicas reporting a larger lag (INFO replication, in seconds) are skipped.
+		std::chrono::seconds max_lag;
+		// Reads go to the primary for this long after a write.
+		std::chrono::milliseconds pin;
+		// Interval between INFO replication refreshes.
+		std::chrono::milliseconds refresh;
+		// Weight of the newest sample in the latency average.
+		double alpha;
+
+		options(selection select = selection::latency, std::chrono::seconds max_lag = std::chrono::seconds{10},
+			std::chrono::milliseconds pin = std::chrono::milliseconds{1000}, std::chrono::milliseconds refresh = std::chrono::milliseconds{5000}, double alpha = 0.2)
+		 : select(select), max_lag(max_lag), pin(pin), refresh(refresh), alpha(alpha)
+		{
+		}
+	};
+
+	struct replica
+	{
+		endpoint address;
+		std::shared_ptr<context> c;
+		// Seconds, as reported by the primary; -1 if unknown.
+		long long lag;
+		// Microseconds.
+		double latency;
+		bool online;
+	};
+private:
+	context p;
+	std::vector<replica> replicas;
+	options o;
+	bool discover;
+	std::size_t next;
+	clock::time_point pinned_until;
+	clock::time_point next_refresh;
+	bool in_transaction;
+
+	// key:value lines of an INFO section.
+	static auto info_field(const std::string& info, const std::string& name) -> std::string
+	{
+		auto pos = info.find(name + ":");
+		if(pos == std::string::npos || (pos > 0 && info[pos - 1] != '\n'))
+			return {};
+		pos += name.size() + 1;
+		return info.substr(pos, info.find_first_of("\r\n", pos) - pos);
+	}
+	// Value of name= in a comma separated slaveN line.
+	static auto attribute(const std::string& line, const std::string& name) -> std::string
+	{
+		auto pos = line.find(name + "=");
+		while(pos != std::string::npos && pos > 0 && line[pos - 1] != ',' && line[pos - 1] != ':')
+			pos = line.find(name + "=", pos + 1);
+		if(pos == std::string::npos)
+			return {};
+		pos += name.size() + 1;
+		return line.substr(pos, line.find(',', pos) - pos);
+	}
+
+	auto find(const std::string& host, int port) -> replica*
+	{
+		for(auto& r : replicas)
+		{
+			if(r.address.host == host && r.address.port == port)
+				return &r;
+		}
+		return nullptr;
+	}
+
+	void connect(replica& r)
+	{
+		try
+		{
+			r.c = std::make_shared<context>(r.address.host, r.address.port);
+		}
+		catch(const context::error&)
+		{
+			r.c.reset();
+		}
+	}
+
+	bool eligible(const replica& r) const
+	{
+		return r.c && r.online && (r.lag < 0 || r.lag <= o.max_lag.count());
+	}
+
+	auto choose() -> replica*
+	{
+		if(replicas.empty())
+			return nullptr;
+
+		if(o.select == selection::round_robin)
+		{
+			for(std::size_t i = 0; i < replicas.size(); ++i)
+			{
+				auto& r = replicas[next++ % replicas.size()];
+				if(eligible(r))
+					return &r;
+			}
+			return nullptr;
+		}
+
+		replica* best = nullptr;
+		for(auto& r : replicas)
+		{
+			if(eligible(r) && (!best || r.latency < best->latency))
+				best = &r;
+		}
+		return best;
+	}
+
+	auto read(replica& r, const std::vector<std::string>& args) -> reply::reply_t
+	{
+		auto start = clock::now();
+		auto res = r.c->command(args);
+		double sample = std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count();
+		r.latency = r.latency > 0 ? o.alpha * sample + (1 - o.alpha) * r.latency : sample;
+		return res;
+	}
+public:
+	/*
+	 Connect to the primary and discover its replicas with INFO replication.
+	 Replicas joining or leaving are picked up on refresh.
+	*/
+	replicated_context(const std::string& host, int port, const options& o = options())
+	 : p(host, port), o(o), discover(true), next(0), in_transaction(false)
+	{
+		refresh();
+	}
+	/*
+	 Connect to the primary and a fixed list of replicas.
+	 Lag is still taken from the primary's INFO replication where listed.
+	*/
+	replicated_context(const endpoint& primary, const std::vector<endpoint>& replicas, const options& o = options())
+	 : p(primary.host, primary.port), o(o), discover(false), next(0), in_transaction(false)
+	{
+		for(auto& address : replicas)
+			this->replicas.push_back({address, {}, -1, 0, true});
+		refresh();
+	}
+
+	replicated_context(const replicated_context&) = delete;
+	replicated_context& operator=(const replicated_context&) = delete;
+
+	replicated_context(replicated_context&&) = default;
+	replicated_context& operator=(replicated_context&&) = default;
+
+	auto primary() -> context&
+	{
+		return p;
+	}
+	auto replica_info() const -> const std::vector<replica>&
+	{
+		return replicas;
+	}
+
+	/*
+	 Re-read INFO replication from the primary: update lag and state,
+	 add newly discovered replicas and reconnect failed ones.
+	*/
+	void refresh()
+	{
+		auto info = reply::string{p.command({"INFO", "replication"})}.value;
+
+		for(auto& r : replicas)
+		{
+			if(discover)
+				r.online = false;
+		}
+
+		auto count = std::atoi(info_field(info, "connected_slaves").c_str());
+		for(int i = 0; i < count; ++i)
+		{
+			auto line = info_field(info, "slave" + std::to_string(i));
+			if(line.empty())
+				continue;
+
+			auto host = attribute(line, "ip");
+			auto port = std::atoi(attribute(line, "port").c_str());
+			auto r = find(host, port);
+			if(!r)
+			{
+				if(!discover)
+					continue;
+				replicas.push_back({{host, port}, {}, -1, 0, false});
+				r = &replicas.back();
+			}
+
+			auto lag = attribute(line, "lag");
+			r->lag = lag.empty() ? -1 : std::atoll(lag.c_str());
+			r->online = attribute(line, "state") == "online";
+		}
+
+		for(auto& r : replicas)
+		{
+			if(!r.c && r.online)
+				connect(r);
+		}
+		next_refresh = clock::now() + o.refresh;
+	}
+
+	/*
+	 Send a command and get a reply.
+	 Reads fall back to the primary when no replica is eligible or the
+	 chosen replica fails.
+	*/
+	auto command(const std::vector<std::string>& args) -> reply::reply_t
+	{
+		auto now = clock::now();
+		if(now >= next_refresh)
+			refresh();
+
+		if(!args.empty())
+		{
+			auto name = args[0];
+			std::transform(begin(name), end(name), begin(name), ::toupper);
+			if(name == "MULTI" || name == "WATCH")
+				in_transaction = true;
+			else if(name == "EXEC" || name == "DISCARD" || name == "UNWATCH")
+				in_transaction = false;
+		}
+
+		if(!in_transaction && now >= pinned_until && command_info::readonly(args))
+		{
+			if(auto r = choose())
+			{
+				try
+				{
+					return read(*r, args);
+				}
+				catch(const context::error&)
+				{
+					// Reconnected on the next refresh.
+					r->c.reset();
+				}
+			}
+		}
+		else if(!command_info::readonly(args))
+		{
+			pinned_until = now + o.pin;
+		}
+		return p.command(args);
+	}
+};
+
+}
+
+#endif /* HIREDIS11_REPLICATED_H_ */
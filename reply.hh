@@ -20,6 +20,10 @@ struct string
 	std::string value;
 	
 	string(reply_t reply)
+	 : string(reply.get())
+	{
+	}
+	string(const redisReply* reply)
 	{
 		if(reply->type == REDIS_REPLY_STRING)
 			value = {reply->str, static_cast<size_t>(reply->len)};
@@ -38,6 +42,10 @@ struct integer
 	long long value;
 	
 	integer(reply_t reply)
+	 : integer(reply.get())
+	{
+	}
+	integer(const redisReply* reply)
 	{
 		if(reply->type == REDIS_REPLY_INTEGER)
 			value = reply->integer;
@@ -57,6 +65,10 @@ struct status
 	std::string value;
 	
 	status(reply_t reply)
+	 : status(reply.get())
+	{
+	}
+	status(const redisReply* reply)
 	{
 		if(reply->type == REDIS_REPLY_STATUS || reply->type == REDIS_REPLY_ERROR)
 			value = {reply->str, static_cast<size_t>(reply->len)};
@@ -99,15 +111,16 @@ struct string_array
 	std::vector<std::string> value;
 	
 	string_array(reply_t reply)
+	 : string_array(reply.get())
+	{
+	}
+	string_array(const redisReply* reply)
 	{
 		if(reply->type == REDIS_REPLY_ARRAY)
 		{
-			std::vector<reply_t> elements;
-			elements.resize(reply->elements);
-			std::transform(reply->element, reply->element + reply->elements, begin(elements), [&reply](redisReply* r) -> reply_t { return {reply, r}; });
-			
-			for(auto& reply : elements)
-				value.push_back(string{reply});
+			value.reserve(reply->elements);
+			for(std::size_t i = 0; i < reply->elements; ++i)
+				value.push_back(string{reply->element[i]});
 		}
 		else
 			throw std::invalid_argument("reply type not array.");
@@ -123,6 +136,10 @@ bool is_nill(reply_t reply)
 {
 	return reply->type == REDIS_REPLY_NIL;
 }
+inline bool is_nill(const redisReply* reply)
+{
+	return reply->type == REDIS_REPLY_NIL;
+}
 
 }
 }
@@ -0,0 +1,342 @@
+#ifndef HIREDIS11_RESILIENT_H_
+#define HIREDIS11_RESILIENT_H_
+#include <hiredis/hiredis.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <cstdlib>
+#include <algorithm>
+#include "context.hh"
+#include "command_info.hh"
+#include "reply.hh"
+#include "error.hh"
+
+namespace hiredis
+{
+
+/*
+ Context that survives connection loss.
+ A failed connection is replaced with a new one, retrying with jittered
+ exponential backoff; the first attempt is immediate so a blip or a
+ failover costs one round of connects. The handshake issued through this
+ context (AUTH, SELECT, CLIENT SETNAME, SUBSCRIBE, PSUBSCRIBE) is replayed
+ on every new connection. Commands that are safe to repeat are retried
+ transparently; others rethrow the error as they may or may not have run.
+ With Sentinels the primary's address is resolved again on each reconnect.
+ e.g.
+ resilient_context db({{"10.0.0.1", 26379}, {"10.0.0.2", 26379}}, "mymaster");
+ commands::string::get(db, "foo");
+*/
+class resilient_context
+{
+public:
+	struct endpoint
+	{
+		std::string host;
+		int port;
+	};
+
+	struct options
+	{
+		std::chrono::milliseconds connect_timeout;
+		std::chrono::milliseconds initial_backoff;
+		std::chrono::milliseconds max_backoff;
+		// Connection attempts before an operation gives up.
+		unsigned max_attempts;
+		// Retry idempotent commands after a reconnect.
+		bool retry;
+
+		options(std::chrono::milliseconds connect_timeout = std::chrono::milliseconds{250}, std::chrono::milliseconds initial_backoff = std::chrono::milliseconds{5},
+			std::chrono::milliseconds max_backoff = std::chrono::milliseconds{1000}, unsigned max_attempts = 10, bool retry = true)
+		 : connect_timeout(connect_timeout), initial_backoff(initial_backoff), max_backoff(max_backoff), max_attempts(max_attempts), retry(retry)
+		{
+		}
+	};
+private:
+	std::unique_ptr<context> c;
+	endpoint address;
+	std::vector<endpoint> sentinels;
+	std::string master_name;
+	options o;
+	std::mt19937 rng;
+
+	// Handshake state, replayed in this order.
+	std::vector<std::string> auth;
+	std::vector<std::string> select;
+	std::vector<std::string> name;
+	std::vector<std::string> channels;
+	std::vector<std::string> patterns;
+
+	bool in_transaction;
+	std::size_t pending;
+	unsigned reconnects;
+
+	static auto upper(std::string s) -> std::string
+	{
+		std::transform(begin(s), end(s), begin(s), ::toupper);
+		return s;
+	}
+
+	// Repeating these has the same effect as running them once.
+	static bool idempotent(const std::vector<std::string>& args)
+	{
+		if(command_info::readonly(args))
+			return true;
+		static const char* const writes[] = {"DEL", "ECHO", "EXPIRE", "EXPIREAT", "HDEL", "HMSET", "HSET", "MSET", "PERSIST",
+			"PEXPIRE", "PEXPIREAT", "PING", "PSETEX", "SADD", "SETEX", "SREM", "UNLINK", "ZREM"};
+		auto n = upper(args[0]);
+		// A repeated SET NX / XX sees the first one's write, and SET GET its value.
+		if(n == "SET")
+		{
+			for(std::size_t i = 3; i < args.size(); ++i)
+			{
+				auto option = upper(args[i]);
+				if(option == "NX" || option == "XX" || option == "GET")
+					return false;
+			}
+			return true;
+		}
+		for(auto w : writes)
+		{
+			if(n == w)
+				return true;
+		}
+		return false;
+	}
+
+	auto resolve() -> endpoint
+	{
+		for(auto& s : sentinels)
+		{
+			try
+			{
+				context sentinel(s.host, s.port, o.connect_timeout);
+				auto r = sentinel.command({"SENTINEL", "get-master-addr-by-name", master_name});
+				if(r->type == REDIS_REPLY_ARRAY && r->elements == 2)
+					return {reply::string{r->element[0]}, std::atoi(reply::string{r->element[1]}.value.c_str())};
+			}
+			catch(const std::exception&)
+			{
+				// Try the next sentinel.
+			}
+		}
+		throw context::error("No sentinel knows the address of " + master_name);
+	}
+
+	void replay(context& n)
+	{
+		for(auto args : {&auth, &select, &name})
+		{
+			if(!args->empty())
+				reply::status{n.command(*args)};
+		}
+
+		auto resubscribe = [&n](const char* command, const std::vector<std::string>& names)
+		{
+			if(names.empty())
+				return;
+			std::vector<std::string> args{command};
+			args.insert(args.end(), names.begin(), names.end());
+			n.append_command(args);
+			for(std::size_t i = 0; i < names.size(); ++i)
+				n.get_reply();
+		};
+		resubscribe("SUBSCRIBE", channels);
+		resubscribe("PSUBSCRIBE", patterns);
+	}
+
+	// Full jitter: uniform in [0, min(max, initial * 2^attempt)].
+	auto backoff(unsigned attempt) -> std::chrono::milliseconds
+	{
+		auto limit = o.initial_backoff.count() << std::min(attempt, 20u);
+		limit = std::min<long long>(limit, o.max_backoff.count());
+		std::uniform_int_distribution<long long> d(0, limit);
+		return std::chrono::milliseconds{d(rng)};
+	}
+
+	void reconnect()
+	{
+		c.reset();
+		in_transaction = false;
+		pending = 0;
+
+		std::string last;
+		for(unsigned attempt = 0; attempt < o.max_attempts; ++attempt)
+		{
+			if(attempt)
+				std::this_thread::sleep_for(backoff(attempt - 1));
+			try
+			{
+				if(!sentinels.empty())
+					address = resolve();
+				std::unique_ptr<context> n(new context(address.host, address.port, o.connect_timeout));
+				replay(*n);
+				c = std::move(n);
+				++reconnects;
+				return;
+			}
+			catch(const std::exception& e)
+			{
+				last = e.what();
+			}
+		}
+		throw context::error("Unable to reconnect: " + last);
+	}
+
+	auto connection() -> context&
+	{
+		if(!c || !c->connected())
+			reconnect();
+		return *c;
+	}
+
+	// Remember handshake commands.
+	void track(const std::vector<std::string>& args)
+	{
+		auto n = upper(args[0]);
+		auto add = [&args](std::vector<std::string>& names)
+		{
+			for(std::size_t i = 1; i < args.size(); ++i)
+			{
+				if(std::find(begin(names), end(names), args[i]) == end(names))
+					names.push_back(args[i]);
+			}
+		};
+		auto remove = [&args](std::vector<std::string>& names)
+		{
+			if(args.size() == 1)
+				names.clear();
+			for(std::size_t i = 1; i < args.size(); ++i)
+				names.erase(std::remove(begin(names), end(names), args[i]), end(names));
+		};
+
+		if(n == "AUTH")
+			auth = args;
+		else if(n == "SELECT")
+			select = args;
+		else if(n == "CLIENT" && args.size() > 1 && upper(args[1]) == "SETNAME")
+			name = args;
+		else if(n == "SUBSCRIBE")
+			add(channels);
+		else if(n == "PSUBSCRIBE")
+			add(patterns);
+		else if(n == "UNSUBSCRIBE")
+			remove(channels);
+		else if(n == "PUNSUBSCRIBE")
+			remove(patterns);
+		else if(n == "MULTI")
+			in_transaction = true;
+		else if(n == "EXEC" || n == "DISCARD")
+			in_transaction = false;
+	}
+public:
+	resilient_context(const std::string& host, int port, const options& o = options())
+	 : address{host, port}, o(o), rng(std::random_device{}()), in_transaction(false), pending(0), reconnects(0)
+	{
+		reconnect();
+		reconnects = 0;
+	}
+	// Follow the primary named master_name as reported by the sentinels.
+	resilient_context(const std::vector<endpoint>& sentinels, const std::string& master_name, const options& o = options())
+	 : sentinels(sentinels), master_name(master_name), o(o), rng(std::random_device{}()), in_transaction(false), pending(0), reconnects(0)
+	{
+		reconnect();
+		reconnects = 0;
+	}
+
+	resilient_context(const resilient_context&) = delete;
+	resilient_context& operator=(const resilient_context&) = delete;
+
+	resilient_context(resilient_context&&) = default;
+	resilient_context& operator=(resilient_context&&) = default;
+
+	// Current primary address.
+	auto server() const -> const endpoint&
+	{
+		return address;
+	}
+	// Number of times the connection has been replaced.
+	auto reconnect_count() const -> unsigned
+	{
+		return reconnects;
+	}
+
+	/*
+	 Send a command and get a reply.
+	 On connection loss the context reconnects; the command is retried if
+	 it is idempotent and not part of a MULTI block, otherwise the error
+	 is rethrown.
+	*/
+	auto command(const std::vector<std::string>& args) -> reply::reply_t
+	{
+		bool retried = false;
+		while(true)
+		{
+			bool transaction = in_transaction;
+			try
+			{
+				auto r = connection().command(args);
+				if(r->type != REDIS_REPLY_ERROR)
+					track(args);
+				return r;
+			}
+			catch(const context::error&)
+			{
+				if(c && c->connected())
+					throw;
+				c.reset();
+				if(retried || transaction || !o.retry || !idempotent(args))
+					throw;
+				retried = true;
+			}
+		}
+	}
+
+	/*
+	 Pipelined use, and subscriptions; not retried, as the replies of a
+	 broken pipeline cannot be matched to commands. A connection error invalidates every
+	 appended command and the next call reconnects.
+	*/
+	void append_command(const std::vector<std::string>& args)
+	{
+		connection().append_command(args);
+		track(args);
+		++pending;
+	}
+	auto get_reply() -> reply::reply_t
+	{
+		if(!c || !c->connected())
+		{
+			// Subscribed connections carry on after a reconnect; pipelines do not.
+			if(pending || (channels.empty() && patterns.empty()))
+			{
+				pending = 0;
+				throw context::error("Connection lost with pending replies.");
+			}
+			reconnect();
+		}
+		try
+		{
+			auto r = c->get_reply();
+			if(pending)
+				--pending;
+			return r;
+		}
+		catch(const context::error&)
+		{
+			c.reset();
+			if(channels.empty() && patterns.empty())
+				throw;
+			pending = 0;
+			reconnect();
+			return c->get_reply();
+		}
+	}
+};
+
+}
+
+#endif /* HIREDIS11_RESILIENT_H_ */
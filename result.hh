@@ -0,0 +1,182 @@
+#ifndef HIREDIS11_RESULT_H_
+#define HIREDIS11_RESULT_H_
+#include <hiredis/hiredis.h>
+#include <string>
+#include <cstring>
+#include <utility>
+#include <boost/optional.hpp>
+#include "error.hh"
+
+namespace hiredis
+{
+
+/*
+ Failure categories.
+ Server errors are classified by the prefix of the error reply; anything
+ unrecognised (including plain ERR) is server.
+*/
+enum class errc
+{
+	// Connection failed; the context is no longer usable.
+	io,
+	// Server closed the connection.
+	eof,
+	protocol,
+	// Socket timeout expired.
+	timeout,
+	// Reply was not of the expected type.
+	type,
+	server,
+	wrong_type,
+	no_script,
+	busy,
+	loading,
+	read_only,
+	no_auth,
+	no_perm,
+	oom,
+	exec_abort,
+	moved,
+	ask,
+	try_again,
+	cross_slot,
+	cluster_down,
+	master_down,
+	no_replicas
+};
+
+struct error_code
+{
+	errc code;
+	std::string message;
+
+	error_code(errc code, std::string message)
+	 : code(code), message(std::move(message))
+	{
+	}
+
+	// Classify an error reply, e.g. "WRONGTYPE Operation against a key..."
+	static auto from_reply(const redisReply* r) -> error_code
+	{
+		static const struct
+		{
+			const char* prefix;
+			errc code;
+		} prefixes[] = {
+			{"WRONGTYPE", errc::wrong_type},
+			{"NOSCRIPT", errc::no_script},
+			{"BUSY", errc::busy},
+			{"LOADING", errc::loading},
+			{"READONLY", errc::read_only},
+			{"NOAUTH", errc::no_auth},
+			{"WRONGPASS", errc::no_auth},
+			{"NOPERM", errc::no_perm},
+			{"OOM", errc::oom},
+			{"EXECABORT", errc::exec_abort},
+			{"MOVED", errc::moved},
+			{"ASK", errc::ask},
+			{"TRYAGAIN", errc::try_again},
+			{"CROSSSLOT", errc::cross_slot},
+			{"CLUSTERDOWN", errc::cluster_down},
+			{"MASTERDOWN", errc::master_down},
+			{"NOREPLICAS", errc::no_replicas},
+		};
+		std::string message(r->str, r->len);
+		auto space = message.find(' ');
+		auto word = message.substr(0, space);
+		for(auto& p : prefixes)
+		{
+			if(word == p.prefix)
+				return {p.code, std::move(message)};
+		}
+		return {errc::server, std::move(message)};
+	}
+
+	auto what() const -> const std::string&
+	{
+		return message;
+	}
+	// Worth retrying as is, possibly after a pause.
+	bool transient() const
+	{
+		return code == errc::timeout || code == errc::busy || code == errc::loading || code == errc::try_again || code == errc::cluster_down || code == errc::master_down;
+	}
+};
+
+/*
+ A value or the reason there is none; returned by try_command and the
+ commands::nothrow wrappers so expected failures cost no exception.
+ e.g.
+ auto value = commands::nothrow::string::get(db, "foo");
+ if(!value && value.error().code == errc::wrong_type)
+	 ...
+*/
+template <typename T>
+class result
+{
+private:
+	boost::optional<T> v;
+	boost::optional<error_code> e;
+public:
+	result(T value)
+	 : v(std::move(value))
+	{
+	}
+	result(error_code error)
+	 : e(std::move(error))
+	{
+	}
+
+	explicit operator bool() const
+	{
+		return !e;
+	}
+	bool has_value() const
+	{
+		return !e;
+	}
+
+	// Throws error if there is no value.
+	auto value() -> T&
+	{
+		if(e)
+			throw hiredis::error(e->message);
+		return *v;
+	}
+	auto value() const -> const T&
+	{
+		if(e)
+			throw hiredis::error(e->message);
+		return *v;
+	}
+	auto value_or(T fallback) const -> T
+	{
+		return e ? std::move(fallback) : *v;
+	}
+	auto operator*() -> T&
+	{
+		return *v;
+	}
+	auto operator*() const -> const T&
+	{
+		return *v;
+	}
+	auto operator->() -> T*
+	{
+		return &*v;
+	}
+	auto operator->() const -> const T*
+	{
+		return &*v;
+	}
+
+	// Only valid if there is no value.
+	auto error() const -> const error_code&
+	{
+		return *e;
+	}
+};
+
+}
+
+#endif /* HIREDIS11_RESULT_H_ */
@@ -0,0 +1,486 @@
+#ifndef HIREDIS11_SCHEMA_H_
+#define HIREDIS11_SCHEMA_H_
+#include <hiredis/hiredis.h>
+#include <string>
+#include <vector>
+#include <tuple>
+#include <limits>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <initializer_list>
+#include <boost/optional.hpp>
+#include "reply.hh"
+#include "error.hh"
+
+namespace hiredis
+{
+namespace schema
+{
+
+/*
+ Text encoding of a hash field value.
+ Specialize for other member types; decode gets the NUL terminated
+ field value and throws std::invalid_argument if it does not parse.
+*/
+template <typename T, typename Enable = void>
+struct field_codec;
+
+template <>
+struct field_codec<std::string>
+{
+	static auto encode(const std::string& value) -> std::string
+	{
+		return value;
+	}
+	static void decode(const char* s, std::size_t len, std::string& value)
+	{
+		value.assign(s, len);
+	}
+};
+
+template <>
+struct field_codec<bool>
+{
+	static auto encode(bool value) -> std::string
+	{
+		return value ? "1" : "0";
+	}
+	static void decode(const char* s, std::size_t len, bool& value)
+	{
+		if(len != 1 || (*s != '0' && *s != '1'))
+			throw std::invalid_argument("Field value is not a bool");
+		value = *s == '1';
+	}
+};
+
+template <typename T>
+struct field_codec<T, typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type>
+{
+	static auto encode(T value) -> std::string
+	{
+		return std::to_string(value);
+	}
+	static void decode(const char* s, std::size_t len, T& value)
+	{
+		char* end;
+		errno = 0;
+		auto v = std::strtoll(s, &end, 10);
+		if(!len || end != s + len || errno || v < std::numeric_limits<T>::min() || v > std::numeric_limits<T>::max())
+			throw std::invalid_argument("Field value is not an integer");
+		value = static_cast<T>(v);
+	}
+};
+
+template <typename T>
+struct field_codec<T, typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value && !std::is_same<T, bool>::value>::type>
+{
+	static auto encode(T value) -> std::string
+	{
+		return std::to_string(value);
+	}
+	static void decode(const char* s, std::size_t len, T& value)
+	{
+		char* end;
+		errno = 0;
+		auto v = std::strtoull(s, &end, 10);
+		if(!len || *s == '-' || end != s + len || errno || v > std::numeric_limits<T>::max())
+			throw std::invalid_argument("Field value is not an unsigned integer");
+		value = static_cast<T>(v);
+	}
+};
+
+// Shortest text that round trips; also readable by HINCRBYFLOAT.
+template <typename T>
+struct field_codec<T, typename std::enable_if<std::is_floating_point<T>::value>::type>
+{
+	static auto encode(T value) -> std::string
+	{
+		char buf[32];
+		auto v = static_cast<double>(value);
+		auto n = std::snprintf(buf, sizeof(buf), "%.15g", v);
+		if(std::strtod(buf, nullptr) != v)
+			n = std::snprintf(buf, sizeof(buf), "%.17g", v);
+		return {buf, static_cast<std::size_t>(n)};
+	}
+	static void decode(const char* s, std::size_t len, T& value)
+	{
+		char* end;
+		errno = 0;
+		auto v = std::strtod(s, &end);
+		if(!len || end != s + len || errno)
+			throw std::invalid_argument("Field value is not a number");
+		value = static_cast<T>(v);
+	}
+};
+
+template <typename T, typename M>
+struct member_field
+{
+	const char* name;
+	M T::* member;
+};
+
+// Map member to the hash field name.
+template <typename T, typename M>
+inline auto field(const char* name, M T::* member) -> member_field<T, M>
+{
+	return {name, member};
+}
+
+// Bit i selects the i-th declared field.
+typedef std::uint64_t mask;
+
+namespace detail
+{
+template <std::size_t I, typename Tuple, typename Fn>
+inline auto each(const Tuple&, Fn&) -> typename std::enable_if<I == std::tuple_size<Tuple>::value>::type
+{
+}
+template <std::size_t I, typename Tuple, typename Fn>
+inline auto each(const Tuple& t, Fn& fn) -> typename std::enable_if<(I < std::tuple_size<Tuple>::value)>::type
+{
+	fn(I, std::get<I>(t));
+	each<I + 1>(t, fn);
+}
+}
+
+template <typename Hash, typename Context>
+class entity;
+
+/*
+ Compile-time mapping between a struct and a hash.
+ Members are encoded straight into HMSET arguments and decoded straight
+ from the HMGET reply, with no intermediate map; masks select a subset of
+ fields for partial loads and stores.
+ e.g.
+ struct user { std::string name; int age; double score; };
+ static const auto user_hash = schema::make_hash(
+	 schema::field("name", &user::name),
+	 schema::field("age", &user::age),
+	 schema::field("score", &user::score));
+ user_hash.store(c, "user:42", u);
+ auto u = user_hash.load(c, "user:42");
+ user_hash.load(c, "user:42", *u, user_hash.select(&user::score));
+*/
+template <typename T, typename... M>
+class hash
+{
+public:
+	typedef T value_type;
+	static_assert(sizeof...(M) > 0 && sizeof...(M) <= 64, "A hash schema has 1 to 64 fields");
+private:
+	std::tuple<member_field<T, M>...> fields;
+
+	static auto bit(std::size_t i) -> mask
+	{
+		return mask(1) << i;
+	}
+
+	struct append_values
+	{
+		const T& value;
+		mask selected;
+		std::vector<std::string>& args;
+
+		template <typename F>
+		void operator()(std::size_t i, const F& f)
+		{
+			if(!(selected & bit(i)))
+				return;
+			args.push_back(f.name);
+			args.push_back(field_codec<typename std::decay<decltype(value.*f.member)>::type>::encode(value.*f.member));
+		}
+	};
+	struct append_names
+	{
+		mask selected;
+		std::vector<std::string>& args;
+
+		template <typename F>
+		void operator()(std::size_t i, const F& f)
+		{
+			if(selected & bit(i))
+				args.push_back(f.name);
+		}
+	};
+	struct decode_values
+	{
+		T& value;
+		mask selected;
+		const redisReply* r;
+		std::size_t next;
+		std::size_t found;
+
+		template <typename F>
+		void operator()(std::size_t i, const F& f)
+		{
+			if(!(selected & bit(i)))
+				return;
+			auto e = r->element[next++];
+			if(e->type == REDIS_REPLY_NIL)
+				return;
+			if(e->type != REDIS_REPLY_STRING)
+				throw std::invalid_argument("reply type not string.");
+			auto& member = value.*f.member;
+			field_codec<typename std::decay<decltype(member)>::type>::decode(e->str, e->len, member);
+			++found;
+		}
+	};
+	struct compare
+	{
+		const T& a;
+		const T& b;
+		mask changed;
+
+		template <typename F>
+		void operator()(std::size_t i, const F& f)
+		{
+			if(!(a.*f.member == b.*f.member))
+				changed |= bit(i);
+		}
+	};
+	template <typename P>
+	struct find_member
+	{
+		P T::* member;
+		mask found;
+
+		void operator()(std::size_t i, const member_field<T, P>& f)
+		{
+			if(f.member == member)
+				found |= bit(i);
+		}
+		template <typename F>
+		void operator()(std::size_t, const F&)
+		{
+		}
+	};
+	struct find_name
+	{
+		const std::string& name;
+		mask found;
+
+		template <typename F>
+		void operator()(std::size_t i, const F& f)
+		{
+			if(name == f.name)
+				found |= bit(i);
+		}
+	};
+public:
+	hash(member_field<T, M>... fields)
+	 : fields(fields...)
+	{
+	}
+
+	static auto size() -> std::size_t
+	{
+		return sizeof...(M);
+	}
+	static auto all() -> mask
+	{
+		return sizeof...(M) == 64 ? ~mask(0) : bit(sizeof...(M)) - 1;
+	}
+
+	// Fields by member, e.g. select(&user::name, &user::age).
+	template <typename... P>
+	auto select(P T::*... members) const -> mask
+	{
+		mask m = 0;
+		for(auto b : {select_one(members)...})
+			m |= b;
+		return m;
+	}
+	// Fields by name; throws std::invalid_argument for a name not in the schema.
+	auto select(const std::vector<std::string>& names) const -> mask
+	{
+		mask m = 0;
+		for(auto& name : names)
+		{
+			find_name fn{name, 0};
+			detail::each<0>(fields, fn);
+			if(!fn.found)
+				throw std::invalid_argument("No field " + name + " in hash schema");
+			m |= fn.found;
+		}
+		return m;
+	}
+	template <typename P>
+	auto select_one(P T::* member) const -> mask
+	{
+		find_member<P> fn{member, 0};
+		detail::each<0>(fields, fn);
+		if(!fn.found)
+			throw std::invalid_argument("Member not in hash schema");
+		return fn.found;
+	}
+
+	// Fields whose values differ between a and b.
+	auto changed(const T& a, const T& b) const -> mask
+	{
+		compare fn{a, b, 0};
+		detail::each<0>(fields, fn);
+		return fn.changed;
+	}
+
+	/*
+	 Command arguments, for use with pipelines.
+	 e.g.
+	 p.command(user_hash.hmset("user:42", u));
+	*/
+	auto hmset(const std::string& key, const T& value, mask selected = all()) const -> std::vector<std::string>
+	{
+		std::vector<std::string> args{"HMSET", key};
+		args.reserve(2 + 2 * size());
+		append_values fn{value, selected, args};
+		detail::each<0>(fields, fn);
+		return args;
+	}
+	auto hmget(const std::string& key, mask selected = all()) const -> std::vector<std::string>
+	{
+		std::vector<std::string> args{"HMGET", key};
+		args.reserve(2 + size());
+		append_names fn{selected, args};
+		detail::each<0>(fields, fn);
+		return args;
+	}
+	/*
+	 Decode an HMGET reply for the selected fields into value.
+	 Missing fields are left as they are; returns the fields present.
+	*/
+	auto decode(const redisReply* r, T& value, mask selected = all()) const -> std::size_t
+	{
+		if(r->type == REDIS_REPLY_ERROR)
+			throw error({r->str, static_cast<std::size_t>(r->len)});
+		if(r->type != REDIS_REPLY_ARRAY)
+			throw std::invalid_argument("reply type not array.");
+		if(r->elements != static_cast<std::size_t>(__builtin_popcountll(selected & all())))
+			throw error("HMGET result not equal to field count");
+		decode_values fn{value, selected, r, 0, 0};
+		detail::each<0>(fields, fn);
+		return fn.found;
+	}
+
+	// Write the selected fields; an empty selection sends nothing.
+	template <typename Context>
+	void store(Context& c, const std::string& key, const T& value, mask selected = all()) const
+	{
+		if(!(selected & all()))
+			return;
+		reply::status{c.command(hmset(key, value, selected))};
+	}
+	// Read the selected fields into value; returns the fields present.
+	template <typename Context>
+	auto load(Context& c, const std::string& key, T& value, mask selected = all()) const -> std::size_t
+	{
+		if(!(selected & all()))
+			return 0;
+		return decode(c.command(hmget(key, selected)).get(), value, selected);
+	}
+	// Read the whole struct; none if the hash has none of the fields.
+	template <typename Context>
+	auto load(Context& c, const std::string& key) const -> boost::optional<T>
+	{
+		T value{};
+		if(!load(c, key, value))
+			return {};
+		return value;
+	}
+
+	// Load the selected fields into a proxy that stores back only what changes.
+	template <typename Context>
+	auto track(Context& c, const std::string& key, mask selected = all()) const -> entity<hash, Context>
+	{
+		return {*this, c, key, selected};
+	}
+};
+
+template <typename T, typename... M>
+inline auto make_hash(member_field<T, M>... fields) -> hash<T, M...>
+{
+	return {fields...};
+}
+
+/*
+ A struct loaded from a hash, with a snapshot of what was read.
+ store() writes only the fields that differ from the snapshot, as one
+ HMSET, then takes a new snapshot. Fields changed by others since the
+ load are overwritten only if they were also changed locally.
+ e.g.
+ auto u = user_hash.track(c, "user:42");
+ u->score += 1.5;
+ u.store();	// HMSET user:42 score ...
+*/
+template <typename Hash, typename Context>
+class entity
+{
+public:
+	typedef typename Hash::value_type value_type;
+private:
+	Hash schema;
+	Context* c;
+	std::string key;
+	value_type value;
+	value_type original;
+	std::size_t found;
+public:
+	entity(const Hash& schema, Context& c, std::string key, mask selected = Hash::all())
+	 : schema(schema), c(&c), key(std::move(key)), value(), found(schema.load(c, this->key, value, selected))
+	{
+		original = value;
+	}
+
+	// Whether any of the loaded fields were present.
+	bool exists() const
+	{
+		return found > 0;
+	}
+
+	auto operator->() -> value_type*
+	{
+		return &value;
+	}
+	auto operator->() const -> const value_type*
+	{
+		return &value;
+	}
+	auto operator*() -> value_type&
+	{
+		return value;
+	}
+	auto operator*() const -> const value_type&
+	{
+		return value;
+	}
+
+	// Fields changed since load or the last store.
+	auto dirty() const -> mask
+	{
+		return schema.changed(value, original);
+	}
+
+	// Write changed fields; returns how many were written.
+	auto store() -> std::size_t
+	{
+		auto changed = dirty();
+		if(!changed)
+			return 0;
+		schema.store(*c, key, value, changed);
+		original = value;
+		return __builtin_popcountll(changed);
+	}
+	// Discard local changes.
+	void revert()
+	{
+		value = original;
+	}
+};
+
+}
+}
+
+#endif /* HIREDIS11_SCHEMA_H_ */
@@ -0,0 +1,524 @@
+#ifndef HIREDIS11_SERIALIZE_H_
+#define HIREDIS11_SERIALIZE_H_
+#include <string>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+#include "schema.hh"
+
+namespace hiredis
+{
+namespace types
+{
+
+/*
+ Encodings of values stored by the types:: containers, chosen per
+ container.
+ text    decimal as written by std::to_string; scalars and strings only.
+ binary  compact: varint integers (zigzag for signed), raw little endian
+         IEEE floats, length prefixed strings and sequences.
+ ordered byte order matches value order, for lexicographic ranges over
+         sorted set members: fixed width big endian integers with the sign
+         bit flipped, floats mapped to ordered bits, strings escaped and
+         terminated, sequences with a marker byte per element.
+ binary and ordered also encode std::pair, std::tuple, std::vector and
+ types opted in with serializable. A string at the top level is always
+ stored as is.
+*/
+struct text {};
+struct binary {};
+struct ordered {};
+
+/*
+ Encoding of T.
+ write() appends a self-delimiting encoding, for use inside composites;
+ encode() returns the encoding of a whole stored value.
+*/
+template <typename T, typename Encoding = text, typename Enable = void>
+struct Serialize;
+
+/*
+ Decoding of T.
+ read() consumes one value written by Serialize::write() from [p, end);
+ decode() decodes a whole stored value. Both throw std::invalid_argument
+ on malformed input.
+*/
+template <typename T, typename Encoding = text, typename Enable = void>
+struct Deserialize;
+
+/*
+ Opt-in for user types in the binary and ordered encodings: map the type
+ to and from a tuple of encodable members. In the ordered encoding values
+ then sort by their members in tuple order.
+ e.g.
+ struct point { int x; int y; };
+ namespace hiredis { namespace types {
+ template <>
+ struct serializable<point>
+ {
+	 static auto to_tuple(const point& p) -> std::tuple<int, int> { return std::make_tuple(p.x, p.y); }
+	 static auto from_tuple(const std::tuple<int, int>& t) -> point { return {std::get<0>(t), std::get<1>(t)}; }
+ };
+ }}
+*/
+template <typename T, typename Enable = void>
+struct serializable
+{
+};
+
+namespace detail
+{
+inline void truncated()
+{
+	throw std::invalid_argument("Encoded value is truncated.");
+}
+
+// encode() in terms of write(), and decode() in terms of read().
+template <typename T, typename Encoding>
+struct encoder
+{
+	static auto encode(const T& value) -> std::string
+	{
+		std::string out;
+		Serialize<T, Encoding>::write(out, value);
+		return out;
+	}
+};
+template <typename T, typename Encoding>
+struct decoder
+{
+	static auto decode(const std::string& s) -> T
+	{
+		auto p = s.data();
+		auto end = p + s.size();
+		auto value = Deserialize<T, Encoding>::read(p, end);
+		if(p != end)
+			throw std::invalid_argument("Encoded value has trailing bytes.");
+		return value;
+	}
+};
+
+template <typename T>
+struct is_binary_encoding : std::integral_constant<bool, std::is_same<T, binary>::value || std::is_same<T, ordered>::value>
+{
+};
+
+template <typename T, typename Enable = void>
+struct has_serializable : std::false_type
+{
+};
+template <typename T>
+struct has_serializable<T, decltype(static_cast<void>(serializable<T>::to_tuple(std::declval<const T&>())))> : std::true_type
+{
+};
+
+inline void put_varint(std::string& out, std::uint64_t v)
+{
+	while(v >= 0x80)
+	{
+		out.push_back(static_cast<char>(v | 0x80));
+		v >>= 7;
+	}
+	out.push_back(static_cast<char>(v));
+}
+inline auto get_varint(const char*& p, const char* end) -> std::uint64_t
+{
+	std::uint64_t v = 0;
+	for(int shift = 0; shift < 64; shift += 7)
+	{
+		if(p == end)
+			truncated();
+		auto b = static_cast<unsigned char>(*p++);
+		v |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+		if(!(b & 0x80))
+			return v;
+	}
+	throw std::invalid_argument("Encoded varint is too long.");
+}
+
+inline void put_fixed(std::string& out, std::uint64_t v, std::size_t bytes, bool big_endian)
+{
+	for(std::size_t i = 0; i < bytes; ++i)
+		out.push_back(static_cast<char>(v >> (8 * (big_endian ? bytes - 1 - i : i))));
+}
+inline auto get_fixed(const char*& p, const char* end, std::size_t bytes, bool big_endian) -> std::uint64_t
+{
+	if(static_cast<std::size_t>(end - p) < bytes)
+		truncated();
+	std::uint64_t v = 0;
+	for(std::size_t i = 0; i < bytes; ++i)
+		v |= static_cast<std::uint64_t>(static_cast<unsigned char>(p[i])) << (8 * (big_endian ? bytes - 1 - i : i));
+	p += bytes;
+	return v;
+}
+
+// Unsigned integer with the bits of a float.
+template <typename T>
+struct float_bits
+{
+	typedef typename std::conditional<sizeof(T) == 4, std::uint32_t, std::uint64_t>::type type;
+	static_assert(std::numeric_limits<T>::is_iec559 && (sizeof(T) == 4 || sizeof(T) == 8), "IEEE single or double precision only");
+};
+
+template <typename Encoding, std::size_t I, typename Tuple>
+inline auto write_elements(std::string&, const Tuple&) -> typename std::enable_if<I == std::tuple_size<Tuple>::value>::type
+{
+}
+template <typename Encoding, std::size_t I, typename Tuple>
+inline auto write_elements(std::string& out, const Tuple& t) -> typename std::enable_if<(I < std::tuple_size<Tuple>::value)>::type
+{
+	Serialize<typename std::tuple_element<I, Tuple>::type, Encoding>::write(out, std::get<I>(t));
+	write_elements<Encoding, I + 1>(out, t);
+}
+}
+
+// Text, as stored by earlier versions.
+template <>
+struct Serialize<std::string, text>
+{
+	static void write(std::string& out, const std::string& value)
+	{
+		out += value;
+	}
+	static auto encode(const std::string& value) -> std::string
+	{
+		return value;
+	}
+};
+template <>
+struct Deserialize<std::string, text>
+{
+	static auto read(const char*& p, const char* end) -> std::string
+	{
+		std::string value(p, end);
+		p = end;
+		return value;
+	}
+	static auto decode(const std::string& s) -> std::string
+	{
+		return s;
+	}
+};
+
+template <typename T>
+struct Serialize<T, text, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>::type> : detail::encoder<T, text>
+{
+	static void write(std::string& out, T value)
+	{
+		out += std::to_string(value);
+	}
+};
+template <typename T>
+struct Deserialize<T, text, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>::type> : detail::decoder<T, text>
+{
+	static auto read(const char*& p, const char* end) -> T
+	{
+		T value;
+		schema::field_codec<T>::decode(p, end - p, value);
+		p = end;
+		return value;
+	}
+};
+
+// Binary and ordered.
+template <typename Encoding>
+struct Serialize<bool, Encoding, typename std::enable_if<detail::is_binary_encoding<Encoding>::value>::type> : detail::encoder<bool, Encoding>
+{
+	static void write(std::string& out, bool value)
+	{
+		out.push_back(value ? 1 : 0);
+	}
+};
+template <typename Encoding>
+struct Deserialize<bool, Encoding, typename std::enable_if<detail::is_binary_encoding<Encoding>::value>::type> : detail::decoder<bool, Encoding>
+{
+	static auto read(const char*& p, const char* end) -> bool
+	{
+		auto v = detail::get_fixed(p, end, 1, false);
+		if(v > 1)
+			throw std::invalid_argument("Encoded value is not a bool.");
+		return v != 0;
+	}
+};
+
+template <typename T>
+struct Serialize<T, binary, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> : detail::encoder<T, binary>
+{
+	static void write(std::string& out, T value)
+	{
+		auto v = static_cast<std::uint64_t>(value);
+		// Zigzag, so small negative numbers stay short.
+		if(std::is_signed<T>::value)
+		{
+			auto n = static_cast<std::int64_t>(value);
+			v = (static_cast<std::uint64_t>(n) << 1) ^ static_cast<std::uint64_t>(n >> 63);
+		}
+		detail::put_varint(out, v);
+	}
+};
+template <typename T>
+struct Deserialize<T, binary, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> : detail::decoder<T, binary>
+{
+	static auto read(const char*& p, const char* end) -> T
+	{
+		auto v = detail::get_varint(p, end);
+		if(std::is_signed<T>::value)
+			v = (v >> 1) ^ (~(v & 1) + 1);
+		auto value = static_cast<T>(v);
+		// Round trips only if in range for T.
+		auto back = std::is_signed<T>::value ? static_cast<std::uint64_t>(static_cast<std::int64_t>(value)) : static_cast<std::uint64_t>(value);
+		if(back != v)
+			throw std::invalid_argument("Encoded integer out of range.");
+		return value;
+	}
+};
+
+template <typename T>
+struct Serialize<T, ordered, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> : detail::encoder<T, ordered>
+{
+	static void write(std::string& out, T value)
+	{
+		auto v = static_cast<std::uint64_t>(static_cast<typename std::make_unsigned<T>::type>(value));
+		if(std::is_signed<T>::value)
+			v ^= std::uint64_t(1) << (8 * sizeof(T) - 1);
+		detail::put_fixed(out, v, sizeof(T), true);
+	}
+};
+template <typename T>
+struct Deserialize<T, ordered, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type> : detail::decoder<T, ordered>
+{
+	static auto read(const char*& p, const char* end) -> T
+	{
+		auto v = detail::get_fixed(p, end, sizeof(T), true);
+		if(std::is_signed<T>::value)
+			v ^= std::uint64_t(1) << (8 * sizeof(T) - 1);
+		return static_cast<T>(static_cast<typename std::make_unsigned<T>::type>(v));
+	}
+};
+
+template <typename T, typename Encoding>
+struct Serialize<T, Encoding, typename std::enable_if<std::is_floating_point<T>::value && detail::is_binary_encoding<Encoding>::value>::type> : detail::encoder<T, Encoding>
+{
+	static void write(std::string& out, T value)
+	{
+		typename detail::float_bits<T>::type bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		std::uint64_t v = bits;
+		if(std::is_same<Encoding, ordered>::value)
+		{
+			// Negative values reversed below positive ones.
+			auto sign = std::uint64_t(1) << (8 * sizeof(T) - 1);
+			v = (v & sign) ? (~v & (sign | (sign - 1))) : (v | sign);
+		}
+		detail::put_fixed(out, v, sizeof(T), std::is_same<Encoding, ordered>::value);
+	}
+};
+template <typename T, typename Encoding>
+struct Deserialize<T, Encoding, typename std::enable_if<std::is_floating_point<T>::value && detail::is_binary_encoding<Encoding>::value>::type> : detail::decoder<T, Encoding>
+{
+	static auto read(const char*& p, const char* end) -> T
+	{
+		auto v = detail::get_fixed(p, end, sizeof(T), std::is_same<Encoding, ordered>::value);
+		if(std::is_same<Encoding, ordered>::value)
+		{
+			auto sign = std::uint64_t(1) << (8 * sizeof(T) - 1);
+			v = (v & sign) ? (v & ~sign) : (~v & (sign | (sign - 1)));
+		}
+		auto bits = static_cast<typename detail::float_bits<T>::type>(v);
+		T value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+};
+
+template <>
+struct Serialize<std::string, binary>
+{
+	static void write(std::string& out, const std::string& value)
+	{
+		detail::put_varint(out, value.size());
+		out += value;
+	}
+	static auto encode(const std::string& value) -> std::string
+	{
+		return value;
+	}
+};
+template <>
+struct Deserialize<std::string, binary>
+{
+	static auto read(const char*& p, const char* end) -> std::string
+	{
+		auto n = detail::get_varint(p, end);
+		if(static_cast<std::uint64_t>(end - p) < n)
+			detail::truncated();
+		std::string value(p, n);
+		p += n;
+		return value;
+	}
+	static auto decode(const std::string& s) -> std::string
+	{
+		return s;
+	}
+};
+
+// 0x00 is escaped as 0x00 0xff and the string ends with 0x00 0x01.
+template <>
+struct Serialize<std::string, ordered>
+{
+	static void write(std::string& out, const std::string& value)
+	{
+		for(auto c : value)
+		{
+			out.push_back(c);
+			if(c == '\0')
+				out.push_back('\xff');
+		}
+		out.push_back('\0');
+		out.push_back('\x01');
+	}
+	static auto encode(const std::string& value) -> std::string
+	{
+		return value;
+	}
+};
+template <>
+struct Deserialize<std::string, ordered>
+{
+	static auto read(const char*& p, const char* end) -> std::string
+	{
+		std::string value;
+		while(true)
+		{
+			auto zero = static_cast<const char*>(std::memchr(p, '\0', end - p));
+			if(!zero || zero + 1 == end)
+				detail::truncated();
+			value.append(p, zero);
+			p = zero + 2;
+			if(zero[1] == '\x01')
+				return value;
+			if(zero[1] != '\xff')
+				throw std::invalid_argument("Encoded string has a bad escape.");
+			value.push_back('\0');
+		}
+	}
+	static auto decode(const std::string& s) -> std::string
+	{
+		return s;
+	}
+};
+
+// Count, then the elements; ordered marks each element instead so shorter sequences sort first.
+template <typename T, typename Encoding>
+struct Serialize<std::vector<T>, Encoding, typename std::enable_if<detail::is_binary_encoding<Encoding>::value>::type> : detail::encoder<std::vector<T>, Encoding>
+{
+	static void write(std::string& out, const std::vector<T>& values)
+	{
+		auto marked = std::is_same<Encoding, ordered>::value;
+		if(!marked)
+			detail::put_varint(out, values.size());
+		for(auto& v : values)
+		{
+			if(marked)
+				out.push_back('\x01');
+			Serialize<T, Encoding>::write(out, v);
+		}
+		if(marked)
+			out.push_back('\0');
+	}
+};
+template <typename T, typename Encoding>
+struct Deserialize<std::vector<T>, Encoding, typename std::enable_if<detail::is_binary_encoding<Encoding>::value>::type> : detail::decoder<std::vector<T>, Encoding>
+{
+	static auto read(const char*& p, const char* end) -> std::vector<T>
+	{
+		std::vector<T> values;
+		if(!std::is_same<Encoding, ordered>::value)
+		{
+			auto n = detail::get_varint(p, end);
+			// Every element takes at least a byte.
+			if(static_cast<std::uint64_t>(end - p) < n)
+				detail::truncated();
+			values.reserve(n);
+			while(n--)
+				values.push_back(Deserialize<T, Encoding>::read(p, end));
+			return values;
+		}
+		while(true)
+		{
+			if(p == end)
+				detail::truncated();
+			if(*p++ == '\0')
+				return values;
+			values.push_back(Deserialize<T, Encoding>::read(p, end));
+		}
+	}
+};
+
+template <typename A, typename B, typename Encoding>
+struct Serialize<std::pair<A, B>, Encoding, typename std::enable_if<detail::is_binary_encoding<Encoding>::value>::type> : detail::encoder<std::pair<A, B>, Encoding>
+{
+	static void write(std::string& out, const std::pair<A, B>& value)
+	{
+		Serialize<A, Encoding>::write(out, value.first);
+		Serialize<B, Encoding>::write(out, value.second);
+	}
+};
+template <typename A, typename B, typename Encoding>
+struct Deserialize<std::pair<A, B>, Encoding, typename std::enable_if<detail::is_binary_encoding<Encoding>::value>::type> : detail::decoder<std::pair<A, B>, Encoding>
+{
+	static auto read(const char*& p, const char* end) -> std::pair<A, B>
+	{
+		auto first = Deserialize<A, Encoding>::read(p, end);
+		return {std::move(first), Deserialize<B, Encoding>::read(p, end)};
+	}
+};
+
+template <typename... T, typename Encoding>
+struct Serialize<std::tuple<T...>, Encoding, typename std::enable_if<detail::is_binary_encoding<Encoding>::value>::type> : detail::encoder<std::tuple<T...>, Encoding>
+{
+	static void write(std::string& out, const std::tuple<T...>& value)
+	{
+		detail::write_elements<Encoding, 0>(out, value);
+	}
+};
+template <typename... T, typename Encoding>
+struct Deserialize<std::tuple<T...>, Encoding, typename std::enable_if<detail::is_binary_encoding<Encoding>::value>::type> : detail::decoder<std::tuple<T...>, Encoding>
+{
+	static auto read(const char*& p, const char* end) -> std::tuple<T...>
+	{
+		// Braced initialisers are evaluated in order.
+		return std::tuple<T...>{Deserialize<T, Encoding>::read(p, end)...};
+	}
+};
+
+template <typename T, typename Encoding>
+struct Serialize<T, Encoding, typename std::enable_if<detail::has_serializable<T>::value && detail::is_binary_encoding<Encoding>::value>::type> : detail::encoder<T, Encoding>
+{
+	typedef decltype(serializable<T>::to_tuple(std::declval<const T&>())) tuple_type;
+
+	static void write(std::string& out, const T& value)
+	{
+		Serialize<tuple_type, Encoding>::write(out, serializable<T>::to_tuple(value));
+	}
+};
+template <typename T, typename Encoding>
+struct Deserialize<T, Encoding, typename std::enable_if<detail::has_serializable<T>::value && detail::is_binary_encoding<Encoding>::value>::type> : detail::decoder<T, Encoding>
+{
+	typedef decltype(serializable<T>::to_tuple(std::declval<const T&>())) tuple_type;
+
+	static auto read(const char*& p, const char* end) -> T
+	{
+		return serializable<T>::from_tuple(Deserialize<tuple_type, Encoding>::read(p, end));
+	}
+};
+
+}
+}
+
+#endif /* HIREDIS11_SERIALIZE_H_ */
@@ -0,0 +1,513 @@
+#ifndef HIREDIS11_SHARDED_H_
+#define HIREDIS11_SHARDED_H_
+#include <hiredis/hiredis.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include "context.hh"
+#include "command_info.hh"
+#include "reply.hh"
+#include "error.hh"
+
+namespace hiredis
+{
+
+/*
+ Consistent hash ring.
+ Points are placed ketama style (160 MD5 derived points per node, scaled
+ by weight), matching libketama and twemproxy's ketama distribution.
+ Keys are hashed with MD5 (libketama) or twemproxy's fnv1a_64.
+*/
+class hash_ring
+{
+public:
+	enum class algorithm
+	{
+		md5,
+		fnv1a_64
+	};
+
+	struct node
+	{
+		std::string name;
+		unsigned weight;
+	};
+private:
+	static const unsigned points_per_server = 160;
+	static const unsigned points_per_hash = 4;
+
+	std::vector<std::pair<std::uint32_t, std::size_t>> points;
+	algorithm hash;
+
+	static auto point(const unsigned char* digest, unsigned alignment) -> std::uint32_t
+	{
+		return (static_cast<std::uint32_t>(digest[3 + alignment * 4]) << 24)
+			| (static_cast<std::uint32_t>(digest[2 + alignment * 4]) << 16)
+			| (static_cast<std::uint32_t>(digest[1 + alignment * 4]) << 8)
+			| digest[alignment * 4];
+	}
+public:
+	// RFC 1321
+	static void md5(const char* data, std::size_t len, unsigned char digest[16])
+	{
+		static const std::uint32_t k[64] = {
+			0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+			0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+			0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+			0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+			0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+			0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+			0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+			0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+		static const unsigned r[64] = {
+			7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+			5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+			4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+			6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+		std::uint32_t h[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+
+		std::size_t padded = ((len + 8) / 64 + 1) * 64;
+		std::vector<unsigned char> msg(padded, 0);
+		std::memcpy(msg.data(), data, len);
+		msg[len] = 0x80;
+		std::uint64_t bits = static_cast<std::uint64_t>(len) * 8;
+		for(int i = 0; i < 8; ++i)
+			msg[padded - 8 + i] = static_cast<unsigned char>(bits >> (8 * i));
+
+		for(std::size_t offset = 0; offset < padded; offset += 64)
+		{
+			std::uint32_t w[16];
+			for(int i = 0; i < 16; ++i)
+			{
+				auto p = &msg[offset + i * 4];
+				w[i] = p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+			}
+
+			std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+			for(unsigned i = 0; i < 64; ++i)
+			{
+				std::uint32_t f;
+				unsigned g;
+				if(i < 16)
+				{
+					f = (b & c) | (~b & d);
+					g = i;
+				}
+				else if(i < 32)
+				{
+					f = (d & b) | (~d & c);
+					g = (5 * i + 1) % 16;
+				}
+				else if(i < 48)
+				{
+					f = b ^ c ^ d;
+					g = (3 * i + 5) % 16;
+				}
+				else
+				{
+					f = c ^ (b | ~d);
+					g = (7 * i) % 16;
+				}
+				auto t = d;
+				d = c;
+				c = b;
+				auto x = a + f + k[i] + w[g];
+				b = b + ((x << r[i]) | (x >> (32 - r[i])));
+				a = t;
+			}
+			h[0] += a;
+			h[1] += b;
+			h[2] += c;
+			h[3] += d;
+		}
+
+		for(int i = 0; i < 4; ++i)
+			for(int j = 0; j < 4; ++j)
+				digest[i * 4 + j] = static_cast<unsigned char>(h[i] >> (8 * j));
+	}
+
+	// twemproxy's fnv1a_64, truncated to 32 bits.
+	static auto fnv1a_64(const char* data, std::size_t len) -> std::uint32_t
+	{
+		auto h = static_cast<std::uint32_t>(0xcbf29ce484222325ULL);
+		for(std::size_t i = 0; i < len; ++i)
+		{
+			h ^= static_cast<std::uint32_t>(static_cast<unsigned char>(data[i]));
+			h *= static_cast<std::uint32_t>(0x100000001b3ULL);
+		}
+		return h;
+	}
+
+	hash_ring(const std::vector<node>& nodes, algorithm hash = algorithm::md5)
+	 : hash(hash)
+	{
+		if(nodes.empty())
+			throw error("hash ring needs at least one node.");
+
+		double total = 0;
+		for(auto& n : nodes)
+			total += n.weight;
+
+		for(std::size_t i = 0; i < nodes.size(); ++i)
+		{
+			double pct = nodes[i].weight / total;
+			auto count = static_cast<unsigned>(std::floor(pct * points_per_server / points_per_hash * nodes.size() + 0.0000000001));
+			for(unsigned p = 0; p < count; ++p)
+			{
+				auto name = nodes[i].name + "-" + std::to_string(p);
+				unsigned char digest[16];
+				md5(name.data(), name.size(), digest);
+				for(unsigned a = 0; a < points_per_hash; ++a)
+					points.push_back({point(digest, a), i});
+			}
+		}
+		std::sort(begin(points), end(points));
+	}
+
+	auto hash_key(const char* key, std::size_t len) const -> std::uint32_t
+	{
+		if(hash == algorithm::fnv1a_64)
+			return fnv1a_64(key, len);
+
+		unsigned char digest[16];
+		md5(key, len, digest);
+		return point(digest, 0);
+	}
+
+	// Index of the node owning the key.
+	auto locate(const char* key, std::size_t len) const -> std::size_t
+	{
+		auto h = hash_key(key, len);
+		auto it = std::lower_bound(begin(points), end(points), std::make_pair(h, std::size_t(0)));
+		if(it == end(points))
+			it = begin(points);
+		return it->second;
+	}
+};
+
+/*
+ Routes commands across independent instances by key.
+ Commands with keys on several shards are split where the result can be
+ merged (DEL, UNLINK, EXISTS, TOUCH, MGET, MSET); the per-shard parts are
+ pipelined to every shard before any reply is read, and the results are
+ merged back in request order.
+ Usable anywhere a context is, e.g. with the wrapped commands:
+ sharded_context db({{"10.0.0.1", 6379}, {"10.0.0.2", 6379}});
+ commands::string::set(db, "foo", "bar");
+*/
+class sharded_context
+{
+public:
+	struct shard
+	{
+		std::string host;
+		int port;
+		unsigned weight;
+		// Ring identity; defaults to host:port.
+		std::string name;
+
+		shard(const std::string& host, int port, unsigned weight = 1, const std::string& name = {})
+		 : host(host), port(port), weight(weight), name(name)
+		{
+		}
+	};
+
+	struct options
+	{
+		hash_ring::algorithm hash;
+		// Only the part of a key between the two tag characters is hashed, if present.
+		std::string hash_tag;
+
+		options(hash_ring::algorithm hash = hash_ring::algorithm::md5, const std::string& hash_tag = "{}")
+		 : hash(hash), hash_tag(hash_tag)
+		{
+		}
+	};
+private:
+	std::vector<std::shared_ptr<context>> shards;
+	hash_ring ring;
+	std::string hash_tag;
+
+	static auto nodes(const std::vector<shard>& shards) -> std::vector<hash_ring::node>
+	{
+		std::vector<hash_ring::node> n;
+		for(auto& s : shards)
+			n.push_back({s.name.empty() ? s.host + ":" + std::to_string(s.port) : s.name, s.weight});
+		return n;
+	}
+
+	static auto make_integer(long long value) -> reply::reply_t
+	{
+		auto r = std::make_shared<redisReply>();
+		r->type = REDIS_REPLY_INTEGER;
+		r->integer = value;
+		return r;
+	}
+	// Array of nodes owned by other replies, which are kept alive with it.
+	static auto make_array(std::vector<redisReply*> elements, std::vector<reply::reply_t> owners) -> reply::reply_t
+	{
+		struct merged
+		{
+			redisReply top;
+			std::vector<redisReply*> elements;
+			std::vector<reply::reply_t> owners;
+		};
+		auto m = std::make_shared<merged>();
+		m->elements = std::move(elements);
+		m->owners = std::move(owners);
+		m->top = redisReply();
+		m->top.type = REDIS_REPLY_ARRAY;
+		m->top.elements = m->elements.size();
+		m->top.element = m->elements.data();
+		return reply::reply_t(m, &m->top);
+	}
+
+	/*
+	 Send one command per shard, writing them all before reading any reply,
+	 so the shards work in parallel and the batch costs one round trip.
+	 Returns the replies indexed like parts; empty parts are skipped.
+	 If a shard fails, the replies still owed by the others are abandoned,
+	 so their next command does not read a reply of this one.
+	*/
+	auto scatter(const std::vector<std::vector<std::string>>& parts) -> std::vector<reply::reply_t>
+	{
+		std::vector<reply::reply_t> replies(parts.size());
+		// Shards sent a command whose reply has not been read.
+		std::vector<bool> owed(parts.size());
+		try
+		{
+			for(std::size_t i = 0; i < parts.size(); ++i)
+			{
+				if(parts[i].empty())
+					continue;
+				shards[i]->append_command(parts[i]);
+				owed[i] = true;
+			}
+			for(std::size_t i = 0; i < parts.size(); ++i)
+			{
+				if(!parts[i].empty())
+					shards[i]->flush();
+			}
+			for(std::size_t i = 0; i < parts.size(); ++i)
+			{
+				if(parts[i].empty())
+					continue;
+				owed[i] = false;
+				replies[i] = shards[i]->get_reply();
+			}
+		}
+		catch(...)
+		{
+			for(std::size_t i = 0; i < parts.size(); ++i)
+			{
+				if(owed[i])
+					shards[i]->abandon(1);
+			}
+			throw;
+		}
+		return replies;
+	}
+
+	static auto first_error(const std::vector<reply::reply_t>& replies) -> reply::reply_t
+	{
+		for(auto& r : replies)
+		{
+			if(r && r->type == REDIS_REPLY_ERROR)
+				return r;
+		}
+		return {};
+	}
+
+	auto sum(const std::vector<std::string>& args, const std::vector<std::size_t>& owner) -> reply::reply_t
+	{
+		std::vector<std::vector<std::string>> parts(shards.size());
+		for(std::size_t i = 1; i < args.size(); ++i)
+		{
+			auto& part = parts[owner[i]];
+			if(part.empty())
+				part.push_back(args[0]);
+			part.push_back(args[i]);
+		}
+		auto replies = scatter(parts);
+		if(auto err = first_error(replies))
+			return err;
+
+		long long total = 0;
+		for(auto& r : replies)
+		{
+			if(r)
+				total += reply::integer{r}.value;
+		}
+		return make_integer(total);
+	}
+
+	auto mget(const std::vector<std::string>& args, const std::vector<std::size_t>& owner) -> reply::reply_t
+	{
+		std::vector<std::vector<std::string>> parts(shards.size());
+		for(std::size_t i = 1; i < args.size(); ++i)
+		{
+			auto& part = parts[owner[i]];
+			if(part.empty())
+				part.push_back(args[0]);
+			part.push_back(args[i]);
+		}
+		auto replies = scatter(parts);
+		if(auto err = first_error(replies))
+			return err;
+
+		std::vector<std::size_t> next(shards.size(), 0);
+		std::vector<redisReply*> elements;
+		elements.reserve(args.size() - 1);
+		for(std::size_t i = 1; i < args.size(); ++i)
+		{
+			auto s = owner[i];
+			elements.push_back(replies[s]->element[next[s]++]);
+		}
+		std::vector<reply::reply_t> owners;
+		for(auto& r : replies)
+		{
+			if(r)
+				owners.push_back(r);
+		}
+		return make_array(std::move(elements), std::move(owners));
+	}
+
+	auto mset(const std::vector<std::string>& args, const std::vector<std::size_t>& owner) -> reply::reply_t
+	{
+		std::vector<std::vector<std::string>> parts(shards.size());
+		for(std::size_t i = 1; i + 1 < args.size(); i += 2)
+		{
+			auto& part = parts[owner[i]];
+			if(part.empty())
+				part.push_back(args[0]);
+			part.push_back(args[i]);
+			part.push_back(args[i + 1]);
+		}
+		auto replies = scatter(parts);
+		if(auto err = first_error(replies))
+			return err;
+		for(auto& r : replies)
+		{
+			if(r)
+				return r;
+		}
+		throw error("MSET without keys.");
+	}
+
+	// Commands without keys that are sent to every shard.
+	auto broadcast(const std::vector<std::string>& args) -> reply::reply_t
+	{
+		auto name = args[0];
+		std::transform(begin(name), end(name), begin(name), ::toupper);
+		if(name != "KEYS" && name != "DBSIZE" && name != "FLUSHALL" && name != "FLUSHDB" && name != "SELECT" && name != "PING")
+			throw error("command has no key to route by: " + args[0]);
+
+		auto replies = scatter(std::vector<std::vector<std::string>>(shards.size(), args));
+		if(auto err = first_error(replies))
+			return err;
+
+		if(name == "DBSIZE")
+		{
+			long long total = 0;
+			for(auto& r : replies)
+				total += reply::integer{r}.value;
+			return make_integer(total);
+		}
+		if(name == "KEYS")
+		{
+			std::vector<redisReply*> elements;
+			for(auto& r : replies)
+				elements.insert(elements.end(), r->element, r->element + r->elements);
+			return make_array(std::move(elements), std::move(replies));
+		}
+		return replies.front();
+	}
+public:
+	sharded_context(const std::vector<shard>& shards, const options& o = options())
+	 : ring(nodes(shards), o.hash), hash_tag(o.hash_tag)
+	{
+		for(auto& s : shards)
+			this->shards.push_back(std::make_shared<context>(s.host, s.port));
+	}
+
+	sharded_context(const sharded_context&) = delete;
+	sharded_context& operator=(const sharded_context&) = delete;
+
+	sharded_context(sharded_context&&) = default;
+	sharded_context& operator=(sharded_context&&) = default;
+
+	auto size() const -> std::size_t
+	{
+		return shards.size();
+	}
+	auto operator[](std::size_t i) -> context&
+	{
+		return *shards[i];
+	}
+
+	// Shard index for a key, honouring hash tags.
+	auto locate(const std::string& key) const -> std::size_t
+	{
+		if(hash_tag.size() == 2)
+		{
+			auto open = key.find(hash_tag[0]);
+			if(open != std::string::npos)
+			{
+				auto close = key.find(hash_tag[1], open + 1);
+				if(close != std::string::npos && close > open + 1)
+					return ring.locate(key.data() + open + 1, close - open - 1);
+			}
+		}
+		return ring.locate(key.data(), key.size());
+	}
+	auto shard_for(const std::string& key) -> context&
+	{
+		return *shards[locate(key)];
+	}
+
+	/*
+	 Send a command to the shard(s) owning its keys and get the reply.
+	 Multi-key commands other than the splittable ones must have all their
+	 keys on one shard (use hash tags).
+	*/
+	auto command(const std::vector<std::string>& args) -> reply::reply_t
+	{
+		std::vector<std::size_t> owner(args.size(), 0);
+		std::size_t first = 0;
+		bool spread = false;
+		command_info::for_each_key(args, [&](std::size_t i)
+		{
+			owner[i] = locate(args[i]);
+			if(!first)
+				first = i;
+			else if(owner[i] != owner[first])
+				spread = true;
+		});
+
+		if(!first)
+			return broadcast(args);
+		if(!spread)
+			return shards[owner[first]]->command(args);
+
+		auto name = args[0];
+		std::transform(begin(name), end(name), begin(name), ::toupper);
+		if(name == "DEL" || name == "UNLINK" || name == "EXISTS" || name == "TOUCH")
+			return sum(args, owner);
+		if(name == "MGET")
+			return mget(args, owner);
+		if(name == "MSET")
+			return mset(args, owner);
+		throw error("Keys in request don't hash to the same shard: " + args[0]);
+	}
+};
+
+}
+
+#endif /* HIREDIS11_SHARDED_H_ */
@@ -0,0 +1,237 @@
+#ifndef HIREDIS11_SINGLE_FLIGHT_H_
+#define HIREDIS11_SINGLE_FLIGHT_H_
+#include <memory>
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <functional>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include "command_info.hh"
+#include "async.hh"
+#include "reply.hh"
+
+namespace hiredis
+{
+
+/*
+ Which commands may share a request. Defaults to the read-only commands
+ of command_info; a reply is shared by every caller, so only commands
+ whose result does not depend on who asks are eligible.
+*/
+typedef std::function<bool(const std::vector<std::string>&)> flight_filter;
+
+namespace detail
+{
+// Unambiguous map key for an argument vector.
+inline auto flight_key(const std::vector<std::string>& args) -> std::string
+{
+	std::string key;
+	for(auto& a : args)
+	{
+		key += std::to_string(a.size());
+		key += ':';
+		key += a;
+	}
+	return key;
+}
+}
+
+/*
+ Request coalescing over a thread safe context (e.g. context_pool).
+ Identical eligible commands issued while one is in flight wait for it
+ and share its reply instead of making their own round trip.
+ e.g.
+ context_pool pool("localhost", 6379);
+ single_flight<context_pool> db(pool);
+ commands::string::get(db, "hot"); // from many threads
+*/
+template <typename Context>
+class single_flight
+{
+private:
+	Context& c;
+	flight_filter eligible;
+	std::mutex m;
+	std::unordered_map<std::string, std::shared_future<reply::reply_t>> flights;
+	std::atomic<unsigned long long> executed;
+	std::atomic<unsigned long long> collapsed;
+public:
+	single_flight(Context& c, flight_filter eligible = command_info::readonly)
+	 : c(c), eligible(std::move(eligible)), executed(0), collapsed(0)
+	{
+	}
+
+	single_flight(const single_flight&) = delete;
+	single_flight& operator=(const single_flight&) = delete;
+
+	auto command(const std::vector<std::string>& args) -> reply::reply_t
+	{
+		if(!eligible(args))
+			return c.command(args);
+
+		auto key = detail::flight_key(args);
+		std::promise<reply::reply_t> result;
+		std::shared_future<reply::reply_t> shared;
+		bool leader = false;
+		{
+			std::lock_guard<std::mutex> lock(m);
+			auto it = flights.find(key);
+			if(it != flights.end())
+			{
+				shared = it->second;
+			}
+			else
+			{
+				shared = result.get_future().share();
+				flights.emplace(key, shared);
+				leader = true;
+			}
+		}
+		if(!leader)
+		{
+			++collapsed;
+			return shared.get();
+		}
+
+		++executed;
+		try
+		{
+			result.set_value(c.command(args));
+		}
+		catch(...)
+		{
+			result.set_exception(std::current_exception());
+		}
+		{
+			std::lock_guard<std::mutex> lock(m);
+			flights.erase(key);
+		}
+		return shared.get();
+	}
+
+	// Commands sent to the server.
+	auto executed_count() const -> unsigned long long
+	{
+		return executed;
+	}
+	// Commands answered by another caller's request.
+	auto collapsed_count() const -> unsigned long long
+	{
+		return collapsed;
+	}
+};
+
+/*
+ Request coalescing for an async_context.
+ Identical eligible commands queued while one is pending complete
+ together from its reply. Loop thread only, like async_context.
+*/
+class async_single_flight
+{
+public:
+	typedef async_context::handler handler;
+	typedef async_context::callback callback;
+private:
+	struct flight : handler
+	{
+		async_single_flight* owner;
+		std::string key;
+		std::vector<handler*> waiters;
+
+		void complete(reply::reply_t reply, std::exception_ptr error) override
+		{
+			std::unique_ptr<flight> self(this);
+			owner->flights.erase(key);
+			auto waiting = std::move(waiters);
+			for(auto h : waiting)
+				h->complete(reply, error);
+		}
+	};
+	struct callback_handler : handler
+	{
+		callback fn;
+
+		callback_handler(callback fn)
+		 : fn(std::move(fn))
+		{
+		}
+		void complete(reply::reply_t reply, std::exception_ptr error) override
+		{
+			std::unique_ptr<callback_handler> self(this);
+			fn(reply, error);
+		}
+	};
+
+	async_context& ac;
+	flight_filter eligible;
+	std::unordered_map<std::string, flight*> flights;
+	unsigned long long executed;
+	unsigned long long collapsed;
+public:
+	async_single_flight(async_context& ac, flight_filter eligible = command_info::readonly)
+	 : ac(ac), eligible(std::move(eligible)), executed(0), collapsed(0)
+	{
+	}
+
+	async_single_flight(const async_single_flight&) = delete;
+	async_single_flight& operator=(const async_single_flight&) = delete;
+
+	// As async_context::command.
+	void command(const std::vector<std::string>& args, handler& h)
+	{
+		if(!eligible(args))
+			return ac.command(args, h);
+
+		auto key = detail::flight_key(args);
+		auto it = flights.find(key);
+		if(it != flights.end())
+		{
+			it->second->waiters.push_back(&h);
+			++collapsed;
+			return;
+		}
+
+		std::unique_ptr<flight> f(new flight());
+		f->owner = this;
+		f->key = key;
+		f->waiters.push_back(&h);
+		ac.command(args, *f);
+		flights.emplace(key, f.get());
+		f.release();
+		++executed;
+	}
+	void command(const std::vector<std::string>& args, callback fn)
+	{
+		std::unique_ptr<callback_handler> h(new callback_handler(std::move(fn)));
+		command(args, *h);
+		h.release();
+	}
+
+	// Detach h; the shared request still completes for other waiters.
+	void cancel(handler& h)
+	{
+		for(auto& f : flights)
+		{
+			auto& w = f.second->waiters;
+			w.erase(std::remove(begin(w), end(w), &h), end(w));
+		}
+		ac.cancel(h);
+	}
+
+	auto executed_count() const -> unsigned long long
+	{
+		return executed;
+	}
+	auto collapsed_count() const -> unsigned long long
+	{
+		return collapsed;
+	}
+};
+
+}
+
+#endif /* HIREDIS11_SINGLE_FLIGHT_H_ */
@@ -0,0 +1,555 @@
+#ifndef HIREDIS11_SNAPSHOT_H_
+#define HIREDIS11_SNAPSHOT_H_
+#include <hiredis/hiredis.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <boost/utility/string_ref.hpp>
+#include "context.hh"
+#include "commands.hh"
+#include "reply.hh"
+#include "error.hh"
+
+namespace hiredis
+{
+namespace snapshot
+{
+
+/*
+ File layout, all integers little endian:
+ header  "H11SNAP1"
+ record* u32 key length, u32 payload length, i64 expiry (unix ms, 0 = none), key, DUMP payload
+ index   u64 record offset per record, sorted by key, one per key
+ footer  u64 index offset, u64 record count, "H11SIDX1"
+ Records are only appended; the index and footer are written by
+ finish(), so a file without a footer is incomplete, e.g. an export that
+ failed part-way. It is still readable record by record.
+*/
+namespace detail
+{
+const char header[] = "H11SNAP1";
+const char footer[] = "H11SIDX1";
+const std::size_t magic_size = 8;
+const std::size_t record_header = 16;
+const std::size_t footer_size = 24;
+
+inline void put(std::string& buf, std::uint64_t v, int bytes)
+{
+	for(int i = 0; i < bytes; ++i)
+		buf.push_back(static_cast<char>(v >> (8 * i)));
+}
+inline auto get(const char* p, int bytes) -> std::uint64_t
+{
+	std::uint64_t v = 0;
+	for(int i = 0; i < bytes; ++i)
+		v |= static_cast<std::uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+	return v;
+}
+inline auto now_ms() -> long long
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+// SCAN MATCH pattern for keys starting with prefix.
+inline auto prefix_pattern(const std::string& prefix) -> std::string
+{
+	std::string pattern;
+	for(auto c : prefix)
+	{
+		if(c && std::strchr("*?[]\\", c))
+			pattern.push_back('\\');
+		pattern.push_back(c);
+	}
+	return pattern + "*";
+}
+}
+
+/*
+ Appends records to a snapshot file. add() is thread safe.
+ A writer destroyed before finish() writes out the records added but no
+ footer, leaving the file marked incomplete.
+ e.g.
+ snapshot::writer w("dump.snap");
+ w.add("foo", 0, commands::key::dump(db, "foo"));
+ w.finish();
+*/
+class writer
+{
+private:
+	int fd;
+	std::string buffer;
+	std::uint64_t offset;
+	std::vector<std::pair<std::string, std::uint64_t>> index;
+	std::mutex m;
+	bool finished;
+
+	void flush()
+	{
+		std::size_t done = 0;
+		while(done < buffer.size())
+		{
+			auto n = ::write(fd, buffer.data() + done, buffer.size() - done);
+			if(n < 0)
+				throw error("Unable to write snapshot: " + std::string(std::strerror(errno)));
+			done += n;
+		}
+		buffer.clear();
+	}
+public:
+	explicit writer(const std::string& path)
+	 : fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)), offset(detail::magic_size), finished(false)
+	{
+		if(fd < 0)
+			throw error("Unable to create " + path + ": " + std::strerror(errno));
+		buffer.append(detail::header, detail::magic_size);
+	}
+	~writer()
+	{
+		try
+		{
+			if(!finished)
+				flush();
+		}
+		catch(...)
+		{
+		}
+		::close(fd);
+	}
+
+	writer(const writer&) = delete;
+	writer& operator=(const writer&) = delete;
+
+	void add(boost::string_ref key, long long expiry, boost::string_ref payload)
+	{
+		std::lock_guard<std::mutex> lock(m);
+		index.emplace_back(key.to_string(), offset);
+		detail::put(buffer, key.size(), 4);
+		detail::put(buffer, payload.size(), 4);
+		detail::put(buffer, static_cast<std::uint64_t>(expiry), 8);
+		buffer.append(key.data(), key.size());
+		buffer.append(payload.data(), payload.size());
+		offset += detail::record_header + key.size() + payload.size();
+		if(buffer.size() >= 1 << 20)
+			flush();
+	}
+
+	auto size() -> std::size_t
+	{
+		std::lock_guard<std::mutex> lock(m);
+		return index.size();
+	}
+
+	/*
+	 Write the index and footer.
+	 A key added more than once (SCAN may return a key twice) is indexed
+	 by its last record only.
+	*/
+	void finish()
+	{
+		std::lock_guard<std::mutex> lock(m);
+		if(finished)
+			return;
+		finished = true;
+
+		std::sort(begin(index), end(index));
+		auto last = std::unique(index.rbegin(), index.rend(), [](const std::pair<std::string, std::uint64_t>& a, const std::pair<std::string, std::uint64_t>& b) { return a.first == b.first; });
+		index.erase(begin(index), last.base());
+		auto index_offset = offset;
+		for(auto& e : index)
+		{
+			detail::put(buffer, e.second, 8);
+			if(buffer.size() >= 1 << 20)
+				flush();
+		}
+		detail::put(buffer, index_offset, 8);
+		detail::put(buffer, index.size(), 8);
+		buffer.append(detail::footer, detail::magic_size);
+		flush();
+		::fsync(fd);
+	}
+};
+
+struct record
+{
+	boost::string_ref key;
+	boost::string_ref payload;
+	// Unix time in ms, 0 if the key does not expire.
+	long long expiry;
+};
+
+/*
+ Read-only memory mapping of a snapshot file.
+ Records refer directly into the mapping.
+*/
+class reader
+{
+private:
+	int fd;
+	const char* data;
+	std::size_t size;
+	std::vector<std::uint64_t> scanned;
+	const char* index;
+	std::size_t count;
+
+	auto at(std::uint64_t offset) const -> record
+	{
+		if(offset + detail::record_header > size)
+			throw error("Corrupt snapshot record offset.");
+		auto p = data + offset;
+		auto key_len = detail::get(p, 4);
+		auto payload_len = detail::get(p + 4, 4);
+		if(offset + detail::record_header + key_len + payload_len > size)
+			throw error("Corrupt snapshot record.");
+		auto key = p + detail::record_header;
+		return {{key, key_len}, {key + key_len, payload_len}, static_cast<long long>(detail::get(p + 8, 8))};
+	}
+	auto offset(std::size_t i) const -> std::uint64_t
+	{
+		return index ? detail::get(index + i * 8, 8) : scanned[i];
+	}
+public:
+	explicit reader(const std::string& path)
+	 : fd(::open(path.c_str(), O_RDONLY)), data(nullptr), size(0), index(nullptr), count(0)
+	{
+		if(fd < 0)
+			throw error("Unable to open " + path + ": " + std::strerror(errno));
+		struct stat st;
+		if(::fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(detail::magic_size))
+		{
+			::close(fd);
+			throw error("Not a snapshot: " + path);
+		}
+		size = st.st_size;
+		auto m = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+		if(m == MAP_FAILED)
+		{
+			::close(fd);
+			throw error("Unable to map " + path);
+		}
+		data = static_cast<const char*>(m);
+		::madvise(m, size, MADV_SEQUENTIAL);
+		if(std::memcmp(data, detail::header, detail::magic_size) != 0)
+		{
+			::munmap(m, size);
+			::close(fd);
+			throw error("Not a snapshot: " + path);
+		}
+
+		auto f = data + size - detail::footer_size;
+		if(size >= detail::magic_size + detail::footer_size && std::memcmp(f + 16, detail::footer, detail::magic_size) == 0)
+		{
+			auto index_offset = detail::get(f, 8);
+			count = detail::get(f + 8, 8);
+			if(index_offset < detail::magic_size || index_offset + count * 8 > size - detail::footer_size)
+			{
+				::munmap(m, size);
+				::close(fd);
+				throw error("Corrupt snapshot index: " + path);
+			}
+			index = data + index_offset;
+			return;
+		}
+
+		// Unfinished file: walk the records and sort by key.
+		std::uint64_t pos = detail::magic_size;
+		while(pos + detail::record_header <= size)
+		{
+			auto len = detail::record_header + detail::get(data + pos, 4) + detail::get(data + pos + 4, 4);
+			if(pos + len > size)
+				break;
+			scanned.push_back(pos);
+			pos += len;
+		}
+		// As finish(), keep only the last record of a repeated key.
+		std::stable_sort(begin(scanned), end(scanned), [this](std::uint64_t a, std::uint64_t b) { return at(a).key < at(b).key; });
+		auto last = std::unique(scanned.rbegin(), scanned.rend(), [this](std::uint64_t a, std::uint64_t b) { return at(a).key == at(b).key; });
+		scanned.erase(begin(scanned), last.base());
+		count = scanned.size();
+	}
+	~reader()
+	{
+		::munmap(const_cast<char*>(data), size);
+		::close(fd);
+	}
+
+	reader(const reader&) = delete;
+	reader& operator=(const reader&) = delete;
+
+	auto records() const -> std::size_t
+	{
+		return count;
+	}
+	// False if the file has no footer, i.e. the writer never finished.
+	bool complete() const
+	{
+		return index != nullptr;
+	}
+	// Records in key order.
+	auto operator[](std::size_t i) const -> record
+	{
+		return at(offset(i));
+	}
+
+	// Index range [first, last) of keys starting with prefix.
+	auto range(boost::string_ref prefix) const -> std::pair<std::size_t, std::size_t>
+	{
+		std::size_t lo = 0, hi = count;
+		while(lo < hi)
+		{
+			auto mid = (lo + hi) / 2;
+			if((*this)[mid].key < prefix)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		auto first = lo;
+		hi = count;
+		while(lo < hi)
+		{
+			auto mid = (lo + hi) / 2;
+			if((*this)[mid].key.starts_with(prefix))
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return {first, lo};
+	}
+};
+
+struct options
+{
+	// Keys to export or restore; empty for all.
+	std::string prefix;
+	unsigned connections;
+	// Keys per pipelined batch.
+	std::size_t batch;
+	// RESTORE ... REPLACE existing keys.
+	bool replace;
+
+	options(const std::string& prefix = {}, unsigned connections = 4, std::size_t batch = 256, bool replace = false)
+	 : prefix(prefix), connections(connections), batch(batch), replace(replace)
+	{
+	}
+};
+
+/*
+ Export keys to a snapshot file.
+ One connection SCANs; the others pipeline DUMP + PTTL for each batch.
+ Returns the number of keys written.
+*/
+inline auto dump(const std::string& host, int port, const std::string& path, const options& o = options()) -> std::size_t
+{
+	writer w(path);
+	context scanner(host, port);
+
+	std::vector<std::vector<std::string>> batches;
+	std::mutex m;
+	std::atomic<bool> scanning(true);
+	std::string failure;
+
+	auto work = [&]
+	{
+		try
+		{
+			context c(host, port);
+			while(true)
+			{
+				std::vector<std::string> keys;
+				{
+					std::lock_guard<std::mutex> lock(m);
+					if(!batches.empty())
+					{
+						keys = std::move(batches.back());
+						batches.pop_back();
+					}
+				}
+				if(keys.empty())
+				{
+					if(!scanning)
+					{
+						std::lock_guard<std::mutex> lock(m);
+						if(batches.empty())
+							return;
+						continue;
+					}
+					std::this_thread::sleep_for(std::chrono::milliseconds(1));
+					continue;
+				}
+
+				for(auto& k : keys)
+				{
+					c.append_command({"DUMP", k});
+					c.append_command({"PTTL", k});
+				}
+				auto now = detail::now_ms();
+				for(auto& k : keys)
+				{
+					auto payload = c.get_reply();
+					auto ttl = c.get_reply();
+					// Deleted or expired since it was scanned.
+					if(payload->type != REDIS_REPLY_STRING || ttl->type != REDIS_REPLY_INTEGER || ttl->integer == -2)
+						continue;
+					w.add(k, ttl->integer >= 0 ? now + ttl->integer : 0, {payload->str, static_cast<std::size_t>(payload->len)});
+				}
+			}
+		}
+		catch(const std::exception& e)
+		{
+			std::lock_guard<std::mutex> lock(m);
+			failure = e.what();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for(unsigned i = 0; i < std::max(1u, o.connections); ++i)
+		workers.emplace_back(work);
+
+	try
+	{
+		std::string cursor = "0";
+		do
+		{
+			auto res = commands::key::scan(scanner, cursor, o.prefix.empty() ? std::string() : detail::prefix_pattern(o.prefix), o.batch);
+			cursor = res.first;
+			if(res.second.empty())
+				continue;
+
+			std::unique_lock<std::mutex> lock(m);
+			if(!failure.empty())
+				break;
+			batches.push_back(std::move(res.second));
+			// Bound memory; workers drain the queue.
+			while(batches.size() > 4 * workers.size() && failure.empty())
+			{
+				lock.unlock();
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+				lock.lock();
+			}
+		} while(cursor != "0");
+	}
+	catch(...)
+	{
+		scanning = false;
+		for(auto& t : workers)
+			t.join();
+		throw;
+	}
+
+	scanning = false;
+	for(auto& t : workers)
+		t.join();
+	if(!failure.empty())
+		throw error(failure);
+	w.finish();
+	return w.size();
+}
+
+/*
+ RESTORE records [first, last) over one connection, pipelined in batches.
+ Payloads are appended straight from the mapping. Keys that expired
+ since the dump are skipped. Returns the number of keys restored.
+*/
+inline auto restore(context& c, const reader& r, std::size_t first, std::size_t last, const options& o = options()) -> std::size_t
+{
+	std::size_t restored = 0;
+	std::size_t batch = std::max<std::size_t>(o.batch, 1);
+
+	while(first < last)
+	{
+		auto now = detail::now_ms();
+		auto end = std::min(last, first + batch);
+		std::size_t sent = 0;
+		for(auto i = first; i < end; ++i)
+		{
+			auto rec = r[i];
+			long long ttl = 0;
+			if(rec.expiry)
+			{
+				ttl = rec.expiry - now;
+				if(ttl <= 0)
+					continue;
+			}
+			auto ttl_arg = std::to_string(ttl);
+
+			const char* argv[] = {"RESTORE", rec.key.data(), ttl_arg.c_str(), rec.payload.data(), "REPLACE"};
+			size_t argvlen[] = {7, rec.key.size(), ttl_arg.size(), rec.payload.size(), 7};
+			c.append_command(o.replace ? 5 : 4, argv, argvlen);
+			++sent;
+		}
+
+		std::string failure;
+		for(std::size_t i = 0; i < sent; ++i)
+		{
+			auto reply = c.get_reply();
+			if(reply->type == REDIS_REPLY_ERROR)
+			{
+				if(failure.empty())
+					failure = reply->str;
+			}
+			else
+			{
+				++restored;
+			}
+		}
+		if(!failure.empty())
+			throw error("RESTORE failed: " + failure);
+		first = end;
+	}
+	return restored;
+}
+
+/*
+ Restore the records matching o.prefix, split across o.connections.
+ Returns the number of keys restored.
+*/
+inline auto restore(const std::string& host, int port, const reader& r, const options& o = options()) -> std::size_t
+{
+	auto span = r.range(o.prefix);
+	auto n = std::max(1u, o.connections);
+	auto per = (span.second - span.first + n - 1) / n;
+
+	std::atomic<std::size_t> restored(0);
+	std::mutex m;
+	std::string failure;
+	std::vector<std::thread> workers;
+	for(unsigned i = 0; i < n; ++i)
+	{
+		auto first = std::min(span.second, span.first + i * per);
+		auto last = std::min(span.second, first + per);
+		if(first == last)
+			break;
+		workers.emplace_back([&, first, last]
+		{
+			try
+			{
+				context c(host, port);
+				restored += restore(c, r, first, last, o);
+			}
+			catch(const std::exception& e)
+			{
+				std::lock_guard<std::mutex> lock(m);
+				failure = e.what();
+			}
+		});
+	}
+	for(auto& t : workers)
+		t.join();
+	if(!failure.empty())
+		throw error(failure);
+	return restored;
+}
+
+}
+}
+
+#endif /* HIREDIS11_SNAPSHOT_H_ */
@@ -0,0 +1,324 @@
+#ifndef HIREDIS11_TELEMETRY_H_
+#define HIREDIS11_TELEMETRY_H_
+#include <memory>
+#include <vector>
+#include <map>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <boost/utility/string_ref.hpp>
+#include "context.hh"
+#include "reply.hh"
+
+namespace hiredis
+{
+namespace telemetry
+{
+
+/*
+ Flat view of an INFO reply.
+ Holds one copy of the text and string_refs into it; no per-field
+ allocation.
+ e.g.
+ telemetry::info_view info(commands::server::info(db));
+ auto used = info.number("used_memory");
+*/
+class info_view
+{
+public:
+	struct field
+	{
+		boost::string_ref section;
+		boost::string_ref key;
+		boost::string_ref value;
+	};
+private:
+	std::string text;
+	std::vector<field> fields;
+public:
+	explicit info_view(std::string info)
+	 : text(std::move(info))
+	{
+		boost::string_ref rest(text);
+		boost::string_ref section;
+		while(!rest.empty())
+		{
+			auto eol = rest.find('\n');
+			auto line = rest.substr(0, eol);
+			rest = eol == boost::string_ref::npos ? boost::string_ref() : rest.substr(eol + 1);
+			if(!line.empty() && line.back() == '\r')
+				line.remove_suffix(1);
+			if(line.empty())
+				continue;
+
+			if(line.front() == '#')
+			{
+				line.remove_prefix(1);
+				while(!line.empty() && line.front() == ' ')
+					line.remove_prefix(1);
+				section = line;
+				continue;
+			}
+			auto colon = line.find(':');
+			if(colon == boost::string_ref::npos)
+				continue;
+			fields.push_back({section, line.substr(0, colon), line.substr(colon + 1)});
+		}
+	}
+
+	// Views refer into the owned text.
+	info_view(const info_view&) = delete;
+	info_view& operator=(const info_view&) = delete;
+
+	auto begin() const -> std::vector<field>::const_iterator
+	{
+		return fields.begin();
+	}
+	auto end() const -> std::vector<field>::const_iterator
+	{
+		return fields.end();
+	}
+
+	// Value of key, or an empty view if absent.
+	auto get(boost::string_ref key) const -> boost::string_ref
+	{
+		for(auto& f : fields)
+		{
+			if(f.key == key)
+				return f.value;
+		}
+		return {};
+	}
+	auto has(boost::string_ref key) const -> bool
+	{
+		return std::any_of(fields.begin(), fields.end(), [&key](const field& f) { return f.key == key; });
+	}
+	// Numeric value of key, or fallback if absent or not numeric.
+	auto number(boost::string_ref key, double fallback = 0) const -> double
+	{
+		auto v = get(key);
+		if(v.empty())
+			return fallback;
+		// Values are followed by \r or \n in the text, which stops strtod.
+		char* end;
+		auto d = std::strtod(v.data(), &end);
+		return end == v.data() ? fallback : d;
+	}
+	auto section(boost::string_ref name) const -> std::vector<field>
+	{
+		std::vector<field> res;
+		std::copy_if(fields.begin(), fields.end(), std::back_inserter(res), [&name](const field& f) { return f.section == name; });
+		return res;
+	}
+};
+
+// The INFO fields the sampler tracks.
+struct info
+{
+	std::string version;
+	std::string role;
+	long long uptime;
+	long long connected_clients;
+	long long blocked_clients;
+	long long used_memory;
+	long long used_memory_rss;
+	long long maxmemory;
+	double fragmentation;
+	long long total_commands;
+	long long ops_per_sec;
+	long long keyspace_hits;
+	long long keyspace_misses;
+	long long expired_keys;
+	long long evicted_keys;
+	long long connected_slaves;
+	// Keys per database, from the Keyspace section.
+	std::map<int, long long> keys;
+
+	info()
+	 : uptime(0), connected_clients(0), blocked_clients(0), used_memory(0), used_memory_rss(0), maxmemory(0), fragmentation(0),
+	 total_commands(0), ops_per_sec(0), keyspace_hits(0), keyspace_misses(0), expired_keys(0), evicted_keys(0), connected_slaves(0)
+	{
+	}
+	explicit info(const info_view& v)
+	 : version(v.get("redis_version").to_string()), role(v.get("role").to_string()),
+	 uptime(v.number("uptime_in_seconds")), connected_clients(v.number("connected_clients")), blocked_clients(v.number("blocked_clients")),
+	 used_memory(v.number("used_memory")), used_memory_rss(v.number("used_memory_rss")), maxmemory(v.number("maxmemory")),
+	 fragmentation(v.number("mem_fragmentation_ratio")), total_commands(v.number("total_commands_processed")),
+	 ops_per_sec(v.number("instantaneous_ops_per_sec")), keyspace_hits(v.number("keyspace_hits")), keyspace_misses(v.number("keyspace_misses")),
+	 expired_keys(v.number("expired_keys")), evicted_keys(v.number("evicted_keys")), connected_slaves(v.number("connected_slaves"))
+	{
+		for(auto& f : v.section("Keyspace"))
+		{
+			// db0:keys=1,expires=0,avg_ttl=0
+			if(f.key.substr(0, 2) != "db" || f.value.substr(0, 5) != "keys=")
+				continue;
+			keys[std::atoi(f.key.substr(2).to_string().c_str())] = std::atoll(f.value.data() + 5);
+		}
+	}
+};
+
+// Parse INFO output into the tracked fields.
+inline auto parse(const std::string& text) -> info
+{
+	return info(info_view(text));
+}
+
+/*
+ Polls INFO from a set of instances on a background thread, each over
+ its own dedicated connection, and derives rates between samples.
+ An instance that does not answer within timeout is marked down for the
+ round and its connection dropped, so one hung server cannot stall the
+ others; it is reconnected on the next round.
+ e.g.
+ telemetry::sampler s({{"10.0.0.1", 6379}, {"10.0.0.2", 6379}}, std::chrono::seconds{10});
+ for(auto& i : s.snapshot())
+	 std::cout << i.host << " " << i.ops_per_sec << "\n";
+*/
+class sampler
+{
+public:
+	typedef std::chrono::steady_clock clock;
+
+	struct endpoint
+	{
+		std::string host;
+		int port;
+	};
+
+	struct instance
+	{
+		std::string host;
+		int port;
+		// False if the last poll failed; error holds why.
+		bool up;
+		std::string error;
+		clock::time_point sampled;
+		info last;
+		// Derived from the last two samples.
+		double ops_per_sec;
+		double hit_ratio;
+		double fragmentation;
+		double evictions_per_sec;
+	};
+private:
+	struct target
+	{
+		instance state;
+		std::unique_ptr<context> c;
+		bool sampled;
+	};
+
+	std::vector<target> targets;
+	std::chrono::milliseconds interval;
+	std::chrono::milliseconds timeout;
+	std::mutex m;
+	std::condition_variable wake;
+	bool stopping;
+	std::thread worker;
+
+	static void update(instance& s, const info& now, clock::time_point when, bool have_previous)
+	{
+		if(have_previous)
+		{
+			double seconds = std::chrono::duration<double>(when - s.sampled).count();
+			auto& prev = s.last;
+			if(seconds > 0 && now.total_commands >= prev.total_commands)
+			{
+				s.ops_per_sec = (now.total_commands - prev.total_commands) / seconds;
+				s.evictions_per_sec = (now.evicted_keys - prev.evicted_keys) / seconds;
+			}
+			auto hits = now.keyspace_hits - prev.keyspace_hits;
+			auto misses = now.keyspace_misses - prev.keyspace_misses;
+			if(hits >= 0 && misses >= 0 && hits + misses > 0)
+				s.hit_ratio = static_cast<double>(hits) / (hits + misses);
+		}
+		else
+		{
+			s.ops_per_sec = now.ops_per_sec;
+			auto total = now.keyspace_hits + now.keyspace_misses;
+			s.hit_ratio = total ? static_cast<double>(now.keyspace_hits) / total : 0;
+		}
+		s.fragmentation = now.used_memory ? static_cast<double>(now.used_memory_rss) / now.used_memory : now.fragmentation;
+		s.last = now;
+		s.sampled = when;
+	}
+
+	void poll(target& t)
+	{
+		try
+		{
+			if(!t.c || !t.c->connected())
+			{
+				t.c.reset(new context(t.state.host, t.state.port, timeout));
+				t.c->on_timeout(context::timeout_policy::invalidate);
+			}
+			auto text = reply::string{t.c->command({"INFO"}, context::clock::now() + timeout)}.value;
+			auto when = clock::now();
+			info now = parse(text);
+
+			std::lock_guard<std::mutex> lock(m);
+			update(t.state, now, when, t.sampled && t.state.up);
+			t.state.up = true;
+			t.state.error.clear();
+			t.sampled = true;
+		}
+		catch(const std::exception& e)
+		{
+			std::lock_guard<std::mutex> lock(m);
+			t.state.up = false;
+			t.state.error = e.what();
+		}
+	}
+
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(m);
+		while(!stopping)
+		{
+			lock.unlock();
+			for(auto& t : targets)
+				poll(t);
+			lock.lock();
+			wake.wait_for(lock, interval, [this]{ return stopping; });
+		}
+	}
+public:
+	sampler(const std::vector<endpoint>& endpoints, std::chrono::milliseconds interval, std::chrono::milliseconds timeout = std::chrono::milliseconds{500})
+	 : interval(interval), timeout(timeout), stopping(false)
+	{
+		for(auto& e : endpoints)
+			targets.push_back({{e.host, e.port, false, "not sampled", {}, {}, 0, 0, 0, 0}, {}, false});
+		worker = std::thread([this]{ run(); });
+	}
+	~sampler()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m);
+			stopping = true;
+		}
+		wake.notify_all();
+		worker.join();
+	}
+
+	sampler(const sampler&) = delete;
+	sampler& operator=(const sampler&) = delete;
+
+	// Copy of the latest state of every instance.
+	auto snapshot() -> std::vector<instance>
+	{
+		std::lock_guard<std::mutex> lock(m);
+		std::vector<instance> res;
+		for(auto& t : targets)
+			res.push_back(t.state);
+		return res;
+	}
+};
+
+}
+}
+
+#endif /* HIREDIS11_TELEMETRY_H_ */
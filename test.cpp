@@ -1,5 +1,35 @@
 #include "hiredis.hh"
 #include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <limits>
+
+// Every value decodes back equal from both the binary and the ordered encoding.
+template <typename T>
+bool round_trips(const std::vector<T>& values)
+{
+	using namespace hiredis::types;
+	for(auto& v : values)
+	{
+		if(!(Deserialize<T, binary>::decode(Serialize<T, binary>::encode(v)) == v))
+			return false;
+		if(!(Deserialize<T, ordered>::decode(Serialize<T, ordered>::encode(v)) == v))
+			return false;
+	}
+	return true;
+}
+
+// Ascending values have strictly ascending ordered encodings.
+template <typename T>
+bool sorts(const std::vector<T>& values)
+{
+	using namespace hiredis::types;
+	for(std::size_t i = 0; i + 1 < values.size(); ++i)
+		if(!(Serialize<T, ordered>::encode(values[i]) < Serialize<T, ordered>::encode(values[i + 1])))
+			return false;
+	return true;
+}
 
 int main()
 {
@@ -29,6 +59,16 @@ int main()
 	auto replies = p.execute();
 	std::cout << "replies.size(): " << replies.size() << "\n";
 
+	// Replies allocated from an arena, released together.
+	reply::arena a;
+	p.command({"GET", "a"});
+	p.command({"KEYS", "*"});
+	auto arena_replies = p.execute(a);
+	std::cout << "a: " << reply::string{arena_replies[0]}.value << "\n";
+	for(reply::ref k : arena_replies[1])
+		std::cout << "arena keys: " << reply::string{k}.value << "\n";
+	a.reset();
+
 	// 2. One step higher - wrapped functions
 	
 	//connection::auth(db, "a password");
@@ -41,8 +81,8 @@ int main()
 	for(int i = 0; i < 10; ++i)
 		std::cout << connection::ping(db) << "\n";
 
-	std::cout << "get(foo)   : " << string::get(db, "foo") << "\n";
-	std::cout << "get(foofoo): " << string::get(db, "foofoo") << "\n"; // nil
+	std::cout << "get(foo)   : " << string::get(db, "foo").value_or("(nil)") << "\n";
+	std::cout << "get(foofoo): " << string::get(db, "foofoo").value_or("(nil)") << "\n"; // nil
 	
 	key::expire(db, "foo", std::chrono::seconds{1});
 
@@ -95,6 +135,12 @@ int main()
 	auto h3 = hash::get(db, "foo_hash", "hello", "non_existing");
 	std::cout << "h == h3: " << (h == h3) << "\n";
 	
+	std::vector<std::string> many_keys;
+	for(int i = 0; i < 10000; ++i)
+		many_keys.push_back("many_" + std::to_string(i));
+	auto many = string::get_many(db, many_keys);
+	std::cout << "get_many: " << std::count(begin(many), end(many), boost::none) << " missing\n";
+	
 	//connection::quit(db);
 	
 	// 3. Higher still - types.
@@ -109,5 +155,63 @@ int main()
 	std::cout << "type(testset1): " << key::type(db, "testset1") << "\n";
 	std::cout << set.size() << "\n";
 	
+	// 4. Snapshots - a key SCAN returned twice is indexed once, by its last record.
+	
+	for(bool finish : {true, false})
+	{
+		{
+			snapshot::writer w("test.snap");
+			w.add("k", 0, "first");
+			w.add("j", 0, "other");
+			w.add("k", 0, "second");
+			if(finish)
+				w.finish();
+		}
+		snapshot::reader r("test.snap");
+		auto k = r.range("k");
+		std::cout << "snapshot complete=" << r.complete() << " records: " << r.records() << " (2), k: " << (k.second - k.first) << " (1) " << r[k.first].payload << " (second)\n";
+	}
+	std::remove("test.snap");
+	
+	// 5. Serialization - round trips, and ordered encodings sort like their values.
+	
+	{
+		using namespace hiredis::types;
+		typedef std::tuple<std::string, int, double> row;
+		auto inf = std::numeric_limits<double>::infinity();
+		auto nan = std::numeric_limits<double>::quiet_NaN();
+		std::vector<long long> ints{std::numeric_limits<long long>::min(), -300, -1, 0, 1, 300, std::numeric_limits<long long>::max()};
+		std::vector<double> doubles{-inf, -1e300, -1.5, -1e-300, -0.0, 0.0, 1e-300, 0.1, 1.5, 1e300, inf};
+		std::vector<row> rows{row{"", -1, 0.0}, row{"a", -1, 0.0}, row{"a", 0, -1.0}, row{"a", 0, 1.0}, row{std::string("a\0", 2), 0, 0.0}, row{"ab", 0, 0.0}};
+		std::vector<std::vector<std::string>> lists{{}, {""}, {"", ""}, {"a"}, {"a", ""}, {std::string("a\0b", 3)}, {"b"}};
+		std::vector<std::pair<int, std::string>> pairs{{-2, "x"}, {-2, "y"}, {7, ""}};
+		
+		std::cout << "serialize round trip: " << (round_trips(ints) && round_trips(doubles) && round_trips(rows) && round_trips(lists) && round_trips(pairs)) << " (1)\n";
+		std::cout << "serialize ordered sort: " << (sorts(ints) && sorts(doubles) && sorts(rows) && sorts(lists) && sorts(pairs)) << " (1)\n";
+		
+		// -0.0 keeps its sign; NaN comes back NaN and sorts above +inf.
+		std::cout << "serialize -0.0: " << std::signbit(Deserialize<double, binary>::decode(Serialize<double, binary>::encode(-0.0)))
+			<< std::signbit(Deserialize<double, ordered>::decode(Serialize<double, ordered>::encode(-0.0))) << " (11)\n";
+		std::cout << "serialize NaN: " << std::isnan(Deserialize<double, binary>::decode(Serialize<double, binary>::encode(nan)))
+			<< std::isnan(Deserialize<double, ordered>::decode(Serialize<double, ordered>::encode(nan)))
+			<< (Serialize<double, ordered>::encode(inf) < Serialize<double, ordered>::encode(nan)) << " (111)\n";
+		
+		// Zigzag varints keep small magnitudes short; length prefixes count bytes.
+		std::cout << "serialize varint sizes: " << Serialize<long long, binary>::encode(-1).size() << Serialize<long long, binary>::encode(63).size()
+			<< Serialize<long long, binary>::encode(64).size() << Serialize<long long, binary>::encode(-300).size()
+			<< Serialize<std::vector<std::string>, binary>::encode({"abc"}).size() << " (11225)\n";
+		
+		try
+		{
+			auto e = Serialize<row, binary>::encode(rows.back());
+			Deserialize<row, binary>::decode(e.substr(0, e.size() - 1));
+			std::cout << "serialize truncated: decoded\n";
+		}
+		catch(const std::invalid_argument& e)
+		{
+			std::cout << "serialize truncated: " << e.what() << "\n";
+		}
+	}
+	
 	return 0;
 }
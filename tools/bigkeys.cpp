@@ -0,0 +1,440 @@
+/*
+ Keyspace memory analyzer.
+ Walks the keyspace with SCAN and, over several connections, pipelines
+ TYPE, MEMORY USAGE, OBJECT ENCODING and the per-type length for each
+ batch of keys. Reports the biggest keys, memory per key prefix and the
+ encoding distribution. Throttled by a keys per second budget so it can
+ run against production instances.
+
+ hiredis11-bigkeys [-h host] [-p port] [-c connections] [-b batch] [-n top]
+	[-m pattern] [-d delimiter] [-r keys/sec] [-s samples]
+*/
+#include "hiredis.hh"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <map>
+#include <unordered_map>
+#include <atomic>
+#include <chrono>
+
+namespace
+{
+
+struct options
+{
+	std::string host = "localhost";
+	int port = 6379;
+	unsigned connections = 4;
+	unsigned batch = 500;
+	std::size_t top = 20;
+	std::string pattern;
+	char delimiter = ':';
+	// Keys per second across all connections; 0 is unlimited.
+	double rate = 10000;
+	int samples = 5;
+};
+
+struct key_info
+{
+	std::string key;
+	std::string type;
+	std::string encoding;
+	long long memory;
+	long long length;
+};
+
+struct usage
+{
+	long long keys = 0;
+	long long memory = 0;
+};
+
+// Per-connection totals, merged when the scan is done.
+struct totals
+{
+	std::vector<key_info> biggest;
+	std::unordered_map<std::string, usage> prefixes;
+	std::map<std::string, usage> encodings;
+	std::map<std::string, usage> types;
+	long long keys = 0;
+	long long memory = 0;
+
+	static bool smaller(const key_info& a, const key_info& b)
+	{
+		return a.memory > b.memory;
+	}
+
+	void add(key_info k, char delimiter, std::size_t top)
+	{
+		++keys;
+		memory += k.memory;
+
+		auto pos = k.key.find(delimiter);
+		auto& p = prefixes[pos == std::string::npos ? k.key : k.key.substr(0, pos + 1) + "*"];
+		++p.keys;
+		p.memory += k.memory;
+
+		auto& e = encodings[k.type + " " + k.encoding];
+		++e.keys;
+		e.memory += k.memory;
+
+		auto& t = types[k.type];
+		++t.keys;
+		t.memory += k.memory;
+
+		// Min-heap on memory keeps the largest top keys.
+		if(biggest.size() < top)
+		{
+			biggest.push_back(std::move(k));
+			std::push_heap(begin(biggest), end(biggest), smaller);
+		}
+		else if(!biggest.empty() && k.memory > biggest.front().memory)
+		{
+			std::pop_heap(begin(biggest), end(biggest), smaller);
+			biggest.back() = std::move(k);
+			std::push_heap(begin(biggest), end(biggest), smaller);
+		}
+	}
+
+	void merge(totals& o, std::size_t top)
+	{
+		keys += o.keys;
+		memory += o.memory;
+		for(auto& p : o.prefixes)
+		{
+			prefixes[p.first].keys += p.second.keys;
+			prefixes[p.first].memory += p.second.memory;
+		}
+		for(auto& e : o.encodings)
+		{
+			encodings[e.first].keys += e.second.keys;
+			encodings[e.first].memory += e.second.memory;
+		}
+		for(auto& t : o.types)
+		{
+			types[t.first].keys += t.second.keys;
+			types[t.first].memory += t.second.memory;
+		}
+		for(auto& k : o.biggest)
+		{
+			if(biggest.size() < top)
+			{
+				biggest.push_back(k);
+				std::push_heap(begin(biggest), end(biggest), smaller);
+			}
+			else if(k.memory > biggest.front().memory)
+			{
+				std::pop_heap(begin(biggest), end(biggest), smaller);
+				biggest.back() = k;
+				std::push_heap(begin(biggest), end(biggest), smaller);
+			}
+		}
+	}
+};
+
+// Token bucket limiting the keys handed to the connections.
+class throttle
+{
+private:
+	typedef std::chrono::steady_clock clock;
+	double rate;
+	double tokens;
+	clock::time_point last;
+	std::mutex m;
+public:
+	explicit throttle(double rate)
+	 : rate(rate), tokens(0), last(clock::now())
+	{
+	}
+
+	void acquire(double n)
+	{
+		if(rate <= 0)
+			return;
+		std::unique_lock<std::mutex> lock(m);
+		auto now = clock::now();
+		tokens = std::min(rate, tokens + std::chrono::duration<double>(now - last).count() * rate);
+		last = now;
+		tokens -= n;
+		if(tokens < 0)
+		{
+			auto wait = std::chrono::duration<double>(-tokens / rate);
+			lock.unlock();
+			std::this_thread::sleep_for(wait);
+		}
+	}
+};
+
+// Batches of scanned keys waiting for a connection.
+class work_queue
+{
+private:
+	std::deque<std::vector<std::string>> batches;
+	std::size_t limit;
+	bool done;
+	std::mutex m;
+	std::condition_variable changed;
+public:
+	explicit work_queue(std::size_t limit)
+	 : limit(limit), done(false)
+	{
+	}
+
+	void push(std::vector<std::string> batch)
+	{
+		std::unique_lock<std::mutex> lock(m);
+		changed.wait(lock, [this]{ return batches.size() < limit; });
+		batches.push_back(std::move(batch));
+		changed.notify_all();
+	}
+	bool pop(std::vector<std::string>& batch)
+	{
+		std::unique_lock<std::mutex> lock(m);
+		changed.wait(lock, [this]{ return !batches.empty() || done; });
+		if(batches.empty())
+			return false;
+		batch = std::move(batches.front());
+		batches.pop_front();
+		changed.notify_all();
+		return true;
+	}
+	void finish()
+	{
+		std::lock_guard<std::mutex> lock(m);
+		done = true;
+		changed.notify_all();
+	}
+};
+
+auto length_command(const std::string& type) -> const char*
+{
+	if(type == "string")
+		return "STRLEN";
+	if(type == "list")
+		return "LLEN";
+	if(type == "hash")
+		return "HLEN";
+	if(type == "set")
+		return "SCARD";
+	if(type == "zset")
+		return "ZCARD";
+	if(type == "stream")
+		return "XLEN";
+	return nullptr;
+}
+
+void analyze(hiredis::context& c, const std::vector<std::string>& keys, const options& o, totals& t)
+{
+	using namespace hiredis;
+
+	// Round one: type, memory and encoding of every key.
+	pipeline p(c);
+	for(auto& k : keys)
+	{
+		p.command({"TYPE", k});
+		p.command({"MEMORY", "USAGE", k, "SAMPLES", std::to_string(o.samples)});
+		p.command({"OBJECT", "ENCODING", k});
+	}
+	auto replies = p.execute();
+
+	std::vector<key_info> infos;
+	for(std::size_t i = 0; i < keys.size(); ++i)
+	{
+		auto type = replies[i * 3];
+		auto memory = replies[i * 3 + 1];
+		auto encoding = replies[i * 3 + 2];
+		// Deleted since it was scanned.
+		if(type->type != REDIS_REPLY_STATUS || std::strcmp(type->str, "none") == 0)
+			continue;
+		infos.push_back({keys[i], type->str,
+			encoding->type == REDIS_REPLY_STRING ? encoding->str : "unknown",
+			memory->type == REDIS_REPLY_INTEGER ? memory->integer : 0, 0});
+	}
+
+	// Round two: length by type.
+	std::vector<std::size_t> measured;
+	for(std::size_t i = 0; i < infos.size(); ++i)
+	{
+		if(auto cmd = length_command(infos[i].type))
+		{
+			p.command({cmd, infos[i].key});
+			measured.push_back(i);
+		}
+	}
+	auto lengths = p.execute();
+	for(std::size_t i = 0; i < measured.size(); ++i)
+	{
+		if(lengths[i]->type == REDIS_REPLY_INTEGER)
+			infos[measured[i]].length = lengths[i]->integer;
+	}
+
+	for(auto& k : infos)
+		t.add(std::move(k), o.delimiter, o.top);
+}
+
+auto human(long long bytes) -> std::string
+{
+	static const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+	double v = bytes;
+	int u = 0;
+	for(; v >= 1024 && u < 4; ++u)
+		v /= 1024;
+	std::ostringstream s;
+	s << std::fixed << std::setprecision(u ? 1 : 0) << v << units[u];
+	return s.str();
+}
+
+void report(totals& t, std::size_t top)
+{
+	std::sort_heap(begin(t.biggest), end(t.biggest), totals::smaller);
+
+	std::cout << "Scanned " << t.keys << " keys, " << human(t.memory) << "\n\n";
+
+	std::cout << "Biggest keys\n";
+	for(auto& k : t.biggest)
+		std::cout << std::setw(10) << human(k.memory) << "  " << std::setw(6) << k.type << "  " << std::setw(10) << k.length << "  " << k.encoding << "  " << k.key << "\n";
+
+	std::vector<std::pair<std::string, usage>> prefixes(begin(t.prefixes), end(t.prefixes));
+	std::sort(begin(prefixes), end(prefixes), [](const std::pair<std::string, usage>& a, const std::pair<std::string, usage>& b) { return a.second.memory > b.second.memory; });
+	if(prefixes.size() > top)
+		prefixes.resize(top);
+	std::cout << "\nMemory by prefix\n";
+	for(auto& p : prefixes)
+		std::cout << std::setw(10) << human(p.second.memory) << "  " << std::setw(10) << p.second.keys << " keys  " << p.first << "\n";
+
+	std::cout << "\nMemory by type\n";
+	for(auto& e : t.types)
+		std::cout << std::setw(10) << human(e.second.memory) << "  " << std::setw(10) << e.second.keys << " keys  " << e.first << "\n";
+
+	std::cout << "\nEncodings\n";
+	for(auto& e : t.encodings)
+		std::cout << std::setw(10) << human(e.second.memory) << "  " << std::setw(10) << e.second.keys << " keys  " << e.first << "\n";
+}
+
+void usage_exit(const char* name)
+{
+	std::cerr << "usage: " << name << " [-h host] [-p port] [-c connections] [-b batch] [-n top] [-m pattern] [-d delimiter] [-r keys/sec] [-s samples]\n";
+	std::exit(1);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace hiredis;
+
+	options o;
+	for(int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if(i + 1 >= argc)
+			usage_exit(argv[0]);
+		std::string value = argv[++i];
+		if(arg == "-h")
+			o.host = value;
+		else if(arg == "-p")
+			o.port = std::atoi(value.c_str());
+		else if(arg == "-c")
+			o.connections = std::max(1, std::atoi(value.c_str()));
+		else if(arg == "-b")
+			o.batch = std::max(1, std::atoi(value.c_str()));
+		else if(arg == "-n")
+			o.top = std::atoi(value.c_str());
+		else if(arg == "-m")
+			o.pattern = value;
+		else if(arg == "-d")
+			o.delimiter = value.empty() ? ':' : value[0];
+		else if(arg == "-r")
+			o.rate = std::atof(value.c_str());
+		else if(arg == "-s")
+			o.samples = std::atoi(value.c_str());
+		else
+			usage_exit(argv[0]);
+	}
+
+	try
+	{
+		throttle limit(o.rate);
+		work_queue queue(o.connections * 2);
+		std::vector<totals> results(o.connections);
+		std::vector<std::thread> workers;
+		std::mutex error_mutex;
+		std::string failure;
+
+		for(unsigned i = 0; i < o.connections; ++i)
+		{
+			workers.emplace_back([&, i]
+			{
+				try
+				{
+					context c(o.host, o.port);
+					std::vector<std::string> batch;
+					while(queue.pop(batch))
+						analyze(c, batch, o, results[i]);
+				}
+				catch(const std::exception& e)
+				{
+					{
+						std::lock_guard<std::mutex> lock(error_mutex);
+						failure = e.what();
+					}
+					// Keep the scanner from blocking on a full queue.
+					std::vector<std::string> skipped;
+					while(queue.pop(skipped))
+					{
+					}
+				}
+			});
+		}
+
+		auto stop = [&]
+		{
+			queue.finish();
+			for(auto& w : workers)
+				w.join();
+		};
+		try
+		{
+			context scanner(o.host, o.port);
+			std::string cursor = "0";
+			do
+			{
+				auto res = commands::key::scan(scanner, cursor, o.pattern, o.batch);
+				cursor = res.first;
+				if(res.second.empty())
+					continue;
+				limit.acquire(res.second.size());
+				queue.push(std::move(res.second));
+			} while(cursor != "0");
+		}
+		catch(...)
+		{
+			// Joinable threads must not be destroyed.
+			stop();
+			throw;
+		}
+
+		stop();
+		if(!failure.empty())
+			throw std::runtime_error(failure);
+
+		totals all;
+		for(auto& r : results)
+			all.merge(r, o.top);
+		report(all, o.top);
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << "error: " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,89 @@
+#ifndef HIREDIS11_TOOLS_HISTOGRAM_H_
+#define HIREDIS11_TOOLS_HISTOGRAM_H_
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+namespace hiredis
+{
+namespace tools
+{
+
+/*
+ Log-linear latency histogram in nanoseconds.
+ 64 sub-buckets per power of two, i.e. under 1.6% error at any
+ magnitude, in a fixed 30KB.
+*/
+class histogram
+{
+private:
+	std::vector<std::uint64_t> counts;
+	std::uint64_t total;
+	std::uint64_t largest;
+
+	static auto index(std::uint64_t v) -> std::size_t
+	{
+		if(v < 128)
+			return v;
+		int shift = 63 - __builtin_clzll(v) - 6;
+		return 64 * shift + (v >> shift);
+	}
+	static auto value(std::size_t i) -> std::uint64_t
+	{
+		if(i < 128)
+			return i;
+		int shift = i / 64 - 1;
+		return ((i - 64 * shift) << shift) + (std::uint64_t(1) << shift) / 2;
+	}
+public:
+	histogram()
+	 : counts(64 * 58), total(0), largest(0)
+	{
+	}
+
+	void record(std::chrono::steady_clock::duration latency)
+	{
+		auto ns = static_cast<std::uint64_t>(std::max<std::chrono::steady_clock::rep>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count()));
+		++counts[index(ns)];
+		++total;
+		largest = std::max(largest, ns);
+	}
+	void merge(const histogram& h)
+	{
+		for(std::size_t i = 0; i < counts.size(); ++i)
+			counts[i] += h.counts[i];
+		total += h.total;
+		largest = std::max(largest, h.largest);
+	}
+
+	auto count() const -> std::uint64_t
+	{
+		return total;
+	}
+	// Nanoseconds at or below which p percent of samples fall.
+	auto percentile(double p) const -> std::uint64_t
+	{
+		if(!total)
+			return 0;
+		auto target = static_cast<std::uint64_t>(std::ceil(p / 100 * total));
+		std::uint64_t seen = 0;
+		for(std::size_t i = 0; i < counts.size(); ++i)
+		{
+			seen += counts[i];
+			if(seen >= std::max<std::uint64_t>(target, 1))
+				return std::min(value(i), largest);
+		}
+		return largest;
+	}
+	auto max() const -> std::uint64_t
+	{
+		return largest;
+	}
+};
+
+}
+}
+
+#endif /* HIREDIS11_TOOLS_HISTOGRAM_H_ */
@@ -0,0 +1,589 @@
+/*
+ Load generator.
+ Drives a weighted command mix through the library: uniform or zipfian
+ keys, fixed or ranged value sizes, several threads each owning some
+ connections, pipelining, and an optional open-loop target rate. With a
+ rate, latency is measured from when each command was due to be sent, so
+ commands delayed behind a stall are charged for it (coordinated omission
+ correction); without one the generator runs closed-loop and latency is
+ measured from the actual send.
+ With depth 1 every command goes through its commands.hh wrapper; with a
+ greater depth each connection gets that many commands pipelined.
+
+ hiredis11-loadgen [-h host] [-p port] [-T threads] [-c connections]
+	[-d depth] [-r ops/s] [-t seconds] [-n keys] [-D uniform|zipf[:theta]]
+	[-s size|min-max] [-R read ratio] [-m command=weight,...] [-P]
+
+ Commands for -m: get set incr exists del hget hset sadd sismember,
+ e.g. -m get=70,set=20,incr=10. -R 0.9 is short for -m get=90,set=10.
+*/
+#include "hiredis.hh"
+#include "histogram.hh"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <exception>
+
+namespace
+{
+
+using std::chrono::steady_clock;
+using hiredis::tools::histogram;
+
+enum class kind
+{
+	get,
+	set,
+	incr,
+	exists,
+	del,
+	hget,
+	hset,
+	sadd,
+	sismember
+};
+
+const struct
+{
+	const char* name;
+	kind k;
+} command_names[] = {
+	{"get", kind::get},
+	{"set", kind::set},
+	{"incr", kind::incr},
+	{"exists", kind::exists},
+	{"del", kind::del},
+	{"hget", kind::hget},
+	{"hset", kind::hset},
+	{"sadd", kind::sadd},
+	{"sismember", kind::sismember},
+};
+const std::size_t kinds = sizeof(command_names) / sizeof(command_names[0]);
+
+struct options
+{
+	std::string host = "localhost";
+	int port = 6379;
+	unsigned threads = 4;
+	// Total across all threads.
+	unsigned connections = 4;
+	unsigned depth = 1;
+	// Commands per second across all threads; 0 is closed-loop.
+	double rate = 0;
+	double seconds = 10;
+	std::uint64_t keys = 100000;
+	// 0 is uniform.
+	double theta = 0;
+	std::size_t min_size = 64;
+	std::size_t max_size = 64;
+	std::vector<std::pair<kind, unsigned>> mix = {{kind::get, 90}, {kind::set, 10}};
+	bool populate = false;
+};
+
+/*
+ Zipfian ranks in [0, n) with exponent theta in (0, 1); rank 0 is the
+ hottest. Gray et al., "Quickly generating billion-record synthetic
+ databases", as used by YCSB.
+*/
+class zipf
+{
+private:
+	std::uint64_t n;
+	double theta;
+	double alpha;
+	double zetan;
+	double eta;
+
+	static auto zeta(std::uint64_t n, double theta) -> double
+	{
+		double sum = 0;
+		for(std::uint64_t i = 1; i <= n; ++i)
+			sum += 1 / std::pow(static_cast<double>(i), theta);
+		return sum;
+	}
+public:
+	zipf(std::uint64_t n, double theta)
+	 : n(n), theta(theta), alpha(1 / (1 - theta)), zetan(zeta(n, theta))
+	{
+		eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta(2, theta) / zetan);
+	}
+
+	template <typename Generator>
+	auto operator()(Generator& g) const -> std::uint64_t
+	{
+		double u = std::uniform_real_distribution<double>(0, 1)(g);
+		double uz = u * zetan;
+		if(uz < 1)
+			return 0;
+		if(uz < 1 + std::pow(0.5, theta))
+			return 1;
+		return std::min<std::uint64_t>(n - 1, static_cast<std::uint64_t>(n * std::pow(eta * u - eta + 1, alpha)));
+	}
+};
+
+struct operation
+{
+	kind k;
+	std::string key;
+	std::size_t size;
+	std::string member;
+	steady_clock::time_point due;
+};
+
+// Generates operations; shared read-only by the workers.
+class workload
+{
+private:
+	const options& o;
+	std::unique_ptr<zipf> skew;
+	std::vector<unsigned> cumulative;
+	std::string payload;
+public:
+	workload(const options& o)
+	 : o(o), payload(o.max_size, 'x')
+	{
+		if(o.theta > 0)
+			skew.reset(new zipf(o.keys, o.theta));
+		unsigned sum = 0;
+		for(auto& m : o.mix)
+			cumulative.push_back(sum += m.second);
+	}
+
+	static auto prefix(kind k) -> const char*
+	{
+		switch(k)
+		{
+			case kind::incr:
+				return "loadgen:n:";
+			case kind::hget:
+			case kind::hset:
+				return "loadgen:h:";
+			case kind::sadd:
+			case kind::sismember:
+				return "loadgen:t:";
+			default:
+				return "loadgen:s:";
+		}
+	}
+
+	template <typename Generator>
+	void next(Generator& g, operation& op) const
+	{
+		auto pick = std::uniform_int_distribution<unsigned>(0, cumulative.back() - 1)(g);
+		op.k = o.mix[std::upper_bound(cumulative.begin(), cumulative.end(), pick) - cumulative.begin()].first;
+		auto index = skew ? (*skew)(g) : std::uniform_int_distribution<std::uint64_t>(0, o.keys - 1)(g);
+		op.key = prefix(op.k) + std::to_string(index);
+		op.size = std::uniform_int_distribution<std::size_t>(o.min_size, o.max_size)(g);
+		op.member = std::to_string(g() % 1024);
+	}
+
+	auto value(const operation& op) const -> std::string
+	{
+		return payload.substr(0, op.size);
+	}
+
+	auto args(const operation& op) const -> std::vector<std::string>
+	{
+		switch(op.k)
+		{
+			case kind::get:
+				return {"GET", op.key};
+			case kind::set:
+				return {"SET", op.key, value(op)};
+			case kind::incr:
+				return {"INCR", op.key};
+			case kind::exists:
+				return {"EXISTS", op.key};
+			case kind::del:
+				return {"DEL", op.key};
+			case kind::hget:
+				return {"HGET", op.key, "field"};
+			case kind::hset:
+				return {"HSET", op.key, "field", value(op)};
+			case kind::sadd:
+				return {"SADD", op.key, op.member};
+			case kind::sismember:
+				return {"SISMEMBER", op.key, op.member};
+		}
+		return {};
+	}
+
+	void call(hiredis::context& c, const operation& op) const
+	{
+		using namespace hiredis::commands;
+		switch(op.k)
+		{
+			case kind::get:
+				string::get(c, op.key);
+				break;
+			case kind::set:
+				string::set(c, op.key, value(op));
+				break;
+			case kind::incr:
+				string::incr(c, op.key);
+				break;
+			case kind::exists:
+				key::exists(c, op.key);
+				break;
+			case kind::del:
+				key::del(c, op.key);
+				break;
+			case kind::hget:
+				hash::get(c, op.key, std::string("field"));
+				break;
+			case kind::hset:
+				hash::set(c, op.key, std::string("field"), value(op));
+				break;
+			case kind::sadd:
+				set::add(c, op.key, op.member);
+				break;
+			case kind::sismember:
+				set::is_member(c, op.key, op.member);
+				break;
+		}
+	}
+};
+
+struct thread_stats
+{
+	std::vector<histogram> latency;
+	std::vector<std::uint64_t> errors;
+	std::uint64_t reconnects = 0;
+	// Ended the thread, e.g. the first connection failed; reported by main.
+	std::exception_ptr failure;
+
+	thread_stats()
+	 : latency(kinds), errors(kinds)
+	{
+	}
+};
+
+void worker(const options& o, const workload& w, unsigned id, unsigned connections, steady_clock::time_point start, steady_clock::time_point until, thread_stats& s)
+{
+	std::vector<std::unique_ptr<hiredis::context>> conns(connections);
+	auto connect = [&]
+	{
+		for(auto& c : conns)
+		{
+			if(!c || !c->connected())
+				c.reset(new hiredis::context(o.host, o.port));
+		}
+	};
+	connect();
+
+	std::mt19937_64 rng(0x9e3779b97f4a7c15ull * (id + 1));
+	// Seconds between this thread's commands when open-loop.
+	double interval = o.rate > 0 ? o.threads / o.rate : 0;
+	auto due = [&](std::uint64_t n)
+	{
+		return start + std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(n * interval));
+	};
+
+	std::uint64_t scheduled = 0;
+	std::size_t capacity = conns.size() * o.depth;
+	std::vector<operation> batch(capacity);
+	std::size_t next_conn = 0;
+	for(auto now = steady_clock::now(); now < until; now = steady_clock::now())
+	{
+		std::size_t n = capacity;
+		if(interval > 0)
+		{
+			auto ready = static_cast<std::uint64_t>(std::chrono::duration<double>(now - start).count() / interval) + 1;
+			n = std::min<std::uint64_t>(capacity, ready - scheduled);
+			if(!n)
+			{
+				std::this_thread::sleep_until(std::min(due(scheduled), until));
+				continue;
+			}
+		}
+		for(std::size_t i = 0; i < n; ++i)
+		{
+			w.next(rng, batch[i]);
+			batch[i].due = interval > 0 ? due(scheduled) : now;
+			++scheduled;
+		}
+
+		std::size_t done = 0;
+		try
+		{
+			if(o.depth == 1)
+			{
+				for(; done < n; ++done)
+				{
+					auto& op = batch[done];
+					auto& c = *conns[next_conn++ % conns.size()];
+					if(interval == 0)
+						op.due = steady_clock::now();
+					try
+					{
+						w.call(c, op);
+					}
+					catch(const hiredis::error&)
+					{
+						++s.errors[static_cast<std::size_t>(op.k)];
+					}
+					catch(const std::invalid_argument&)
+					{
+						++s.errors[static_cast<std::size_t>(op.k)];
+					}
+					s.latency[static_cast<std::size_t>(op.k)].record(steady_clock::now() - op.due);
+				}
+			}
+			else
+			{
+				// Command i goes to connection i % connections.
+				for(std::size_t i = 0; i < n; ++i)
+					conns[i % conns.size()]->append_command(w.args(batch[i]));
+				for(auto& c : conns)
+					c->flush();
+				for(; done < n; ++done)
+				{
+					auto& op = batch[done];
+					auto reply = conns[done % conns.size()]->get_reply();
+					if(reply->type == REDIS_REPLY_ERROR)
+						++s.errors[static_cast<std::size_t>(op.k)];
+					s.latency[static_cast<std::size_t>(op.k)].record(steady_clock::now() - op.due);
+				}
+			}
+		}
+		catch(const hiredis::context::error&)
+		{
+			// Unread replies are lost with their connections; start over.
+			for(; done < n; ++done)
+				++s.errors[static_cast<std::size_t>(batch[done].k)];
+			for(auto& c : conns)
+				c.reset();
+			++s.reconnects;
+			while(steady_clock::now() < until)
+			{
+				try
+				{
+					connect();
+					break;
+				}
+				catch(const hiredis::context::error&)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				}
+			}
+		}
+	}
+}
+
+void populate(const options& o, const workload& w)
+{
+	bool hashes = false;
+	for(auto& m : o.mix)
+		hashes |= m.first == kind::hget || m.first == kind::hset;
+
+	hiredis::context c(o.host, o.port);
+	hiredis::streaming_pipeline p(c);
+	operation op;
+	op.size = o.max_size;
+	for(std::uint64_t i = 0; i < o.keys; ++i)
+	{
+		auto n = std::to_string(i);
+		p.command({"SET", workload::prefix(kind::set) + n, w.value(op)});
+		if(hashes)
+			p.command({"HSET", workload::prefix(kind::hset) + n, "field", w.value(op)});
+	}
+	p.finish();
+}
+
+auto parse_mix(const std::string& spec) -> std::vector<std::pair<kind, unsigned>>
+{
+	std::vector<std::pair<kind, unsigned>> mix;
+	std::istringstream in(spec);
+	std::string item;
+	while(std::getline(in, item, ','))
+	{
+		auto eq = item.find('=');
+		auto name = item.substr(0, eq);
+		unsigned weight = eq == std::string::npos ? 1 : std::atoi(item.c_str() + eq + 1);
+		auto it = std::find_if(std::begin(command_names), std::end(command_names), [&](decltype(command_names[0]) c) { return name == c.name; });
+		if(it == std::end(command_names))
+			throw std::invalid_argument("unknown command in mix: " + name);
+		if(weight)
+			mix.emplace_back(it->k, weight);
+	}
+	if(mix.empty())
+		throw std::invalid_argument("empty command mix");
+	return mix;
+}
+
+void usage_exit(const char* name)
+{
+	std::cerr << "usage: " << name << " [-h host] [-p port] [-T threads] [-c connections] [-d depth] [-r ops/s] [-t seconds]\n"
+		"\t[-n keys] [-D uniform|zipf[:theta]] [-s size|min-max] [-R read ratio] [-m command=weight,...] [-P]\n";
+	std::exit(1);
+}
+
+void print_latency(std::ostream& os, const histogram& h)
+{
+	const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+	for(auto p : percentiles)
+		os << std::setw(10) << h.percentile(p) / 1000.0;
+	os << std::setw(10) << h.max() / 1000.0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace hiredis;
+
+	options o;
+	try
+	{
+		for(int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			if(arg == "-P")
+			{
+				o.populate = true;
+				continue;
+			}
+			if(i + 1 >= argc)
+				usage_exit(argv[0]);
+			std::string value = argv[++i];
+			if(arg == "-h")
+				o.host = value;
+			else if(arg == "-p")
+				o.port = std::atoi(value.c_str());
+			else if(arg == "-T")
+				o.threads = std::max(1, std::atoi(value.c_str()));
+			else if(arg == "-c")
+				o.connections = std::max(1, std::atoi(value.c_str()));
+			else if(arg == "-d")
+				o.depth = std::max(1, std::atoi(value.c_str()));
+			else if(arg == "-r")
+				o.rate = std::atof(value.c_str());
+			else if(arg == "-t")
+				o.seconds = std::atof(value.c_str());
+			else if(arg == "-n")
+				o.keys = std::max(1ll, std::atoll(value.c_str()));
+			else if(arg == "-D")
+			{
+				if(value == "uniform")
+					o.theta = 0;
+				else if(value.compare(0, 4, "zipf") == 0)
+				{
+					o.theta = value.size() > 5 ? std::atof(value.c_str() + 5) : 0.99;
+					if(o.theta <= 0 || o.theta >= 1)
+						usage_exit(argv[0]);
+				}
+				else
+					usage_exit(argv[0]);
+			}
+			else if(arg == "-s")
+			{
+				auto dash = value.find('-');
+				o.min_size = std::atoi(value.c_str());
+				o.max_size = dash == std::string::npos ? o.min_size : std::atoi(value.c_str() + dash + 1);
+				if(o.max_size < o.min_size)
+					usage_exit(argv[0]);
+			}
+			else if(arg == "-R")
+			{
+				auto reads = static_cast<unsigned>(std::atof(value.c_str()) * 100 + 0.5);
+				o.mix = parse_mix("get=" + std::to_string(reads) + ",set=" + std::to_string(100 - std::min(100u, reads)));
+			}
+			else if(arg == "-m")
+				o.mix = parse_mix(value);
+			else
+				usage_exit(argv[0]);
+		}
+		o.threads = std::min(o.threads, o.connections);
+
+		workload w(o);
+		if(o.populate)
+			populate(o, w);
+
+		std::vector<thread_stats> stats(o.threads);
+		std::vector<std::thread> threads;
+		auto start = steady_clock::now() + std::chrono::milliseconds(100);
+		auto until = start + std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(o.seconds));
+		for(unsigned t = 0; t < o.threads; ++t)
+		{
+			unsigned connections = o.connections / o.threads + (t < o.connections % o.threads ? 1 : 0);
+			threads.emplace_back([&, t, connections]
+			{
+				std::this_thread::sleep_until(start);
+				try
+				{
+					worker(o, w, t, connections, start, until, stats[t]);
+				}
+				catch(...)
+				{
+					stats[t].failure = std::current_exception();
+				}
+			});
+		}
+		for(auto& t : threads)
+			t.join();
+		for(auto& s : stats)
+		{
+			if(s.failure)
+				std::rethrow_exception(s.failure);
+		}
+		auto elapsed = std::chrono::duration<double>(steady_clock::now() - start).count();
+
+		histogram total;
+		std::uint64_t errors = 0;
+		std::uint64_t reconnects = 0;
+		std::vector<histogram> per_command(kinds);
+		std::vector<std::uint64_t> per_command_errors(kinds);
+		for(auto& s : stats)
+		{
+			for(std::size_t k = 0; k < kinds; ++k)
+			{
+				per_command[k].merge(s.latency[k]);
+				per_command_errors[k] += s.errors[k];
+				total.merge(s.latency[k]);
+				errors += s.errors[k];
+			}
+			reconnects += s.reconnects;
+		}
+
+		std::cout << std::fixed << std::setprecision(0)
+			<< "threads      " << o.threads << ", " << o.connections << " connections, depth " << o.depth << "\n"
+			<< "keys         " << o.keys << (o.theta > 0 ? " zipfian" : " uniform");
+		if(o.theta > 0)
+			std::cout << std::setprecision(2) << " (theta " << o.theta << ")" << std::setprecision(0);
+		std::cout << "\n";
+		if(o.rate > 0)
+			std::cout << "target       " << o.rate << " ops/s open-loop, latency from intended send time\n";
+		else
+			std::cout << "target       closed-loop, latency from actual send time\n";
+		std::cout << "commands     " << total.count() << " in " << std::setprecision(2) << elapsed << "s\n"
+			<< "throughput   " << std::setprecision(0) << total.count() / elapsed << " ops/s\n"
+			<< "errors       " << errors << "\n"
+			<< "reconnects   " << reconnects << "\n\n"
+			<< std::setprecision(1)
+			<< std::left << std::setw(12) << "latency us" << std::right << std::setw(12) << "commands" << std::setw(10) << "errors"
+			<< std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(10) << "p99.99" << std::setw(10) << "max" << "\n";
+		for(std::size_t k = 0; k < kinds; ++k)
+		{
+			if(!per_command[k].count())
+				continue;
+			std::cout << std::left << std::setw(12) << command_names[k].name << std::right << std::setw(12) << per_command[k].count() << std::setw(10) << per_command_errors[k];
+			print_latency(std::cout, per_command[k]);
+			std::cout << "\n";
+		}
+		std::cout << std::left << std::setw(12) << "all" << std::right << std::setw(12) << total.count() << std::setw(10) << errors;
+		print_latency(std::cout, total);
+		std::cout << "\n";
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << "error: " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
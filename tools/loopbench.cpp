@@ -0,0 +1,269 @@
+/*
+ Event loop transport benchmark.
+ Drives GET (or SET) over many async_contexts from one event_loop, each
+ keeping a fixed number of commands in flight, and reports throughput
+ for the selected transport. Compare e.g. -b poll against -b io_uring on
+ loopback; epoll and io_uring need a build with HIREDIS11_IO_URING.
+ With -k it drives blocking contexts instead, one thread per connection,
+ each sending depth commands per round trip; -b poll keeps hiredis' own
+ I/O and any other backend uses the thread's io_uring transport.
+
+ hiredis11-loopbench [-h host] [-p port] [-b auto|poll|epoll|io_uring]
+	[-c connections] [-d depth] [-s value size] [-t seconds] [-w] [-k]
+*/
+#include "hiredis.hh"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+
+namespace
+{
+
+struct options
+{
+	std::string host = "localhost";
+	int port = 6379;
+	hiredis::event_loop::backend backend = hiredis::event_loop::backend::automatic;
+	unsigned connections = 64;
+	unsigned depth = 16;
+	std::size_t size = 64;
+	double seconds = 10;
+	bool writes = false;
+	bool blocking = false;
+};
+
+// Keeps depth commands in flight on one connection.
+struct client
+{
+	hiredis::async_context ac;
+	std::vector<std::string> args;
+	unsigned long long completed = 0;
+	unsigned long long errors = 0;
+	bool running = true;
+	unsigned outstanding = 0;
+
+	client(hiredis::event_loop& ev, const options& o, unsigned id)
+	 : ac(ev, o.host, o.port)
+	{
+		auto key = "loopbench:" + std::to_string(id);
+		if(o.writes)
+			args = {"SET", key, std::string(o.size, 'x')};
+		else
+			args = {"GET", key};
+	}
+
+	void issue()
+	{
+		++outstanding;
+		ac.command(args, [this](hiredis::reply::reply_t reply, std::exception_ptr error)
+		{
+			--outstanding;
+			if(error || reply->type == REDIS_REPLY_ERROR)
+				++errors;
+			else
+				++completed;
+			if(running && ac.connected())
+				issue();
+		});
+	}
+};
+
+// Keeps depth commands per round trip on one blocking connection.
+void blocking_client(const options& o, unsigned id, std::chrono::steady_clock::time_point until, std::atomic<unsigned long long>& completed, std::atomic<unsigned long long>& errors)
+{
+	using namespace hiredis;
+
+	context c(o.host, o.port);
+	c.use_transport(o.backend != event_loop::backend::poll);
+	auto key = "loopbench:" + std::to_string(id);
+	std::vector<std::string> args;
+	if(o.writes)
+		args = {"SET", key, std::string(o.size, 'x')};
+	else
+	{
+		args = {"GET", key};
+		c.command({"SET", key, std::string(o.size, 'x')});
+	}
+
+	unsigned long long done = 0;
+	unsigned long long failed = 0;
+	while(std::chrono::steady_clock::now() < until)
+	{
+		for(unsigned d = 0; d < o.depth; ++d)
+			c.append_command(args);
+		for(unsigned d = 0; d < o.depth; ++d)
+		{
+			if(c.get_reply()->type == REDIS_REPLY_ERROR)
+				++failed;
+			else
+				++done;
+		}
+	}
+	completed += done;
+	errors += failed;
+}
+
+void usage_exit(const char* name)
+{
+	std::cerr << "usage: " << name << " [-h host] [-p port] [-b auto|poll|epoll|io_uring] [-c connections] [-d depth] [-s value size] [-t seconds] [-w] [-k]\n";
+	std::exit(1);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace hiredis;
+
+	options o;
+	for(int i = 1; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if(arg == "-w")
+		{
+			o.writes = true;
+			continue;
+		}
+		if(arg == "-k")
+		{
+			o.blocking = true;
+			continue;
+		}
+		if(i + 1 >= argc)
+			usage_exit(argv[0]);
+		std::string value = argv[++i];
+		if(arg == "-h")
+			o.host = value;
+		else if(arg == "-p")
+			o.port = std::atoi(value.c_str());
+		else if(arg == "-b")
+		{
+			if(value == "auto")
+				o.backend = event_loop::backend::automatic;
+			else if(value == "poll")
+				o.backend = event_loop::backend::poll;
+			else if(value == "epoll")
+				o.backend = event_loop::backend::epoll;
+			else if(value == "io_uring")
+				o.backend = event_loop::backend::io_uring;
+			else
+				usage_exit(argv[0]);
+		}
+		else if(arg == "-c")
+			o.connections = std::max(1, std::atoi(value.c_str()));
+		else if(arg == "-d")
+			o.depth = std::max(1, std::atoi(value.c_str()));
+		else if(arg == "-s")
+			o.size = std::atoi(value.c_str());
+		else if(arg == "-t")
+			o.seconds = std::atof(value.c_str());
+		else
+			usage_exit(argv[0]);
+	}
+
+	try
+	{
+		if(o.blocking)
+		{
+			typedef std::chrono::steady_clock clock;
+			std::atomic<unsigned long long> completed(0);
+			std::atomic<unsigned long long> errors(0);
+			std::vector<std::thread> threads;
+			std::exception_ptr failure;
+			std::mutex m;
+			auto start = clock::now();
+			auto until = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(o.seconds));
+			for(unsigned i = 0; i < o.connections; ++i)
+			{
+				threads.emplace_back([&, i]
+				{
+					try
+					{
+						blocking_client(o, i, until, completed, errors);
+					}
+					catch(...)
+					{
+						std::lock_guard<std::mutex> lock(m);
+						failure = std::current_exception();
+					}
+				});
+			}
+			for(auto& t : threads)
+				t.join();
+			if(failure)
+				std::rethrow_exception(failure);
+			auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+			auto io = o.backend != event_loop::backend::poll ? context::thread_transport() : nullptr;
+			std::cout << "transport    blocking, " << (io ? io->name() : "hiredis") << "\n"
+				<< "connections  " << o.connections << " x depth " << o.depth << "\n"
+				<< "commands     " << completed << " in " << std::fixed << std::setprecision(2) << elapsed << "s\n"
+				<< "throughput   " << std::setprecision(0) << completed / elapsed << " ops/s\n"
+				<< "errors       " << errors << "\n";
+			return 0;
+		}
+
+		event_loop ev(o.backend);
+		std::vector<std::unique_ptr<client>> clients;
+		for(unsigned i = 0; i < o.connections; ++i)
+			clients.emplace_back(new client(ev, o, i));
+
+		// Populate the keys read by GET.
+		if(!o.writes)
+		{
+			unsigned done = 0;
+			for(unsigned i = 0; i < o.connections; ++i)
+				clients[i]->ac.command({"SET", "loopbench:" + std::to_string(i), std::string(o.size, 'x')}, [&done](reply::reply_t, std::exception_ptr) { ++done; });
+			ev.run_until([&]{ return done == o.connections; });
+		}
+
+		typedef std::chrono::steady_clock clock;
+		auto start = clock::now();
+		auto until = start + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(o.seconds));
+		for(auto& c : clients)
+		{
+			for(unsigned d = 0; d < o.depth; ++d)
+				c->issue();
+		}
+		ev.run_until([&]{ return clock::now() >= until; });
+		auto elapsed = std::chrono::duration<double>(clock::now() - start).count();
+
+		// Drain what is in flight before the contexts go away.
+		for(auto& c : clients)
+			c->running = false;
+		ev.run_until([&]
+		{
+			for(auto& c : clients)
+			{
+				if(c->outstanding && c->ac.connected())
+					return false;
+			}
+			return true;
+		});
+
+		unsigned long long completed = 0;
+		unsigned long long errors = 0;
+		for(auto& c : clients)
+		{
+			completed += c->completed;
+			errors += c->errors;
+		}
+		std::cout << "transport    " << ev.transport_name() << "\n"
+			<< "connections  " << o.connections << " x depth " << o.depth << "\n"
+			<< "commands     " << completed << " in " << std::fixed << std::setprecision(2) << elapsed << "s\n"
+			<< "throughput   " << std::setprecision(0) << completed / elapsed << " ops/s\n"
+			<< "errors       " << errors << "\n";
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << "error: " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,250 @@
+/*
+ Capture replay.
+ Re-issues a log written by capture::writer against a server, at the
+ original pace, scaled (-x 2 is twice as fast) or as fast as possible
+ (-x 0). Streams, i.e. the capturing threads, are spread over the
+ connections, each on its own thread, and every stream keeps its order.
+ When paced, latency is measured from when each command was due, so a
+ stall is charged to the commands queued behind it; at full speed it is
+ measured from the actual send. Subscriptions and MONITOR are skipped.
+
+ hiredis11-replay [-h host] [-p port] [-c connections] [-x speed] [-l limit] file
+*/
+#include "hiredis.hh"
+#include "capture.hh"
+#include "histogram.hh"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cctype>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <map>
+#include <unordered_map>
+
+namespace
+{
+
+using std::chrono::steady_clock;
+using hiredis::tools::histogram;
+
+struct options
+{
+	std::string host = "localhost";
+	int port = 6379;
+	unsigned connections = 4;
+	// Multiple of the captured pace; 0 is as fast as possible.
+	double speed = 1;
+	// Records replayed; 0 is all.
+	std::uint64_t limit = 0;
+	std::string file;
+};
+
+struct command
+{
+	std::chrono::nanoseconds offset;
+	std::vector<std::string> args;
+	std::size_t name;
+};
+
+struct worker_stats
+{
+	// Indexed by command name.
+	std::vector<histogram> latency;
+	std::vector<std::uint64_t> errors;
+	std::uint64_t reconnects = 0;
+};
+
+bool skipped(const std::string& name)
+{
+	static const char* const names[] = {"MONITOR", "PSUBSCRIBE", "SSUBSCRIBE", "SUBSCRIBE"};
+	for(auto n : names)
+		if(hiredis::command_info::compare(name.c_str(), n) == 0)
+			return true;
+	return false;
+}
+
+void worker(const options& o, const std::vector<command>& commands, std::size_t names, steady_clock::time_point start, worker_stats& s)
+{
+	using namespace hiredis;
+
+	s.latency.resize(names);
+	s.errors.resize(names);
+	std::unique_ptr<context> c;
+	for(auto& cmd : commands)
+	{
+		auto due = steady_clock::now();
+		if(o.speed > 0)
+		{
+			due = start + std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(std::chrono::duration<double>(cmd.offset).count() / o.speed));
+			std::this_thread::sleep_until(due);
+		}
+		try
+		{
+			if(!c)
+				c.reset(new context(o.host, o.port));
+			auto reply = c->command(cmd.args);
+			s.latency[cmd.name].record(steady_clock::now() - due);
+			if(reply->type == REDIS_REPLY_ERROR)
+				++s.errors[cmd.name];
+		}
+		catch(const context::error&)
+		{
+			++s.errors[cmd.name];
+			if(c && !c->connected())
+			{
+				c.reset();
+				++s.reconnects;
+			}
+		}
+	}
+}
+
+void usage_exit(const char* name)
+{
+	std::cerr << "usage: " << name << " [-h host] [-p port] [-c connections] [-x speed] [-l limit] file\n";
+	std::exit(1);
+}
+
+void print_latency(std::ostream& os, const histogram& h)
+{
+	const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+	for(auto p : percentiles)
+		os << std::setw(10) << h.percentile(p) / 1000.0;
+	os << std::setw(10) << h.max() / 1000.0;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace hiredis;
+
+	options o;
+	try
+	{
+		for(int i = 1; i < argc; ++i)
+		{
+			std::string arg = argv[i];
+			if(arg[0] != '-')
+			{
+				if(!o.file.empty())
+					usage_exit(argv[0]);
+				o.file = arg;
+				continue;
+			}
+			if(i + 1 >= argc)
+				usage_exit(argv[0]);
+			std::string value = argv[++i];
+			if(arg == "-h")
+				o.host = value;
+			else if(arg == "-p")
+				o.port = std::atoi(value.c_str());
+			else if(arg == "-c")
+				o.connections = std::max(1, std::atoi(value.c_str()));
+			else if(arg == "-x")
+				o.speed = std::max(0.0, std::atof(value.c_str()));
+			else if(arg == "-l")
+				o.limit = std::atoll(value.c_str());
+			else
+				usage_exit(argv[0]);
+		}
+		if(o.file.empty())
+			usage_exit(argv[0]);
+
+		// Streams are dealt to connections in order of first appearance.
+		std::vector<std::vector<command>> work(o.connections);
+		std::unordered_map<std::uint64_t, std::size_t> streams;
+		std::map<std::string, std::size_t> name_index;
+		std::vector<std::string> names;
+		std::uint64_t records = 0;
+		std::uint64_t skips = 0;
+		std::chrono::nanoseconds span(0);
+		{
+			capture::reader log(o.file);
+			capture::record r;
+			while((!o.limit || records < o.limit) && log.next(r))
+			{
+				++records;
+				span = r.offset;
+				if(r.args.empty() || skipped(r.args[0]))
+				{
+					++skips;
+					continue;
+				}
+				std::string name;
+				for(auto ch : r.args[0])
+					name.push_back(std::tolower(static_cast<unsigned char>(ch)));
+				auto n = name_index.emplace(name, names.size());
+				if(n.second)
+					names.push_back(name);
+				auto s = streams.emplace(r.stream, streams.size()).first->second;
+				work[s % o.connections].push_back({r.offset, std::move(r.args), n.first->second});
+			}
+		}
+
+		std::vector<worker_stats> stats(o.connections);
+		std::vector<std::thread> threads;
+		auto start = steady_clock::now() + std::chrono::milliseconds(100);
+		for(unsigned t = 0; t < o.connections; ++t)
+		{
+			threads.emplace_back([&, t]
+			{
+				std::this_thread::sleep_until(start);
+				worker(o, work[t], names.size(), start, stats[t]);
+			});
+		}
+		for(auto& t : threads)
+			t.join();
+		auto elapsed = std::chrono::duration<double>(steady_clock::now() - start).count();
+
+		histogram total;
+		std::uint64_t errors = 0;
+		std::uint64_t reconnects = 0;
+		std::vector<histogram> per_command(names.size());
+		std::vector<std::uint64_t> per_command_errors(names.size());
+		for(auto& s : stats)
+		{
+			for(std::size_t k = 0; k < names.size(); ++k)
+			{
+				per_command[k].merge(s.latency[k]);
+				per_command_errors[k] += s.errors[k];
+				total.merge(s.latency[k]);
+				errors += s.errors[k];
+			}
+			reconnects += s.reconnects;
+		}
+
+		std::cout << std::fixed << std::setprecision(2)
+			<< "capture      " << records << " commands over " << std::chrono::duration<double>(span).count() << "s, " << streams.size() << " streams, " << skips << " skipped\n"
+			<< "replay       " << o.connections << " connections, ";
+		if(o.speed > 0)
+			std::cout << o.speed << "x captured pace, latency from intended send time\n";
+		else
+			std::cout << "full speed, latency from actual send time\n";
+		std::cout << "commands     " << total.count() << " in " << elapsed << "s\n"
+			<< "throughput   " << std::setprecision(0) << total.count() / elapsed << " ops/s\n"
+			<< "errors       " << errors << "\n"
+			<< "reconnects   " << reconnects << "\n\n"
+			<< std::setprecision(1)
+			<< std::left << std::setw(12) << "latency us" << std::right << std::setw(12) << "commands" << std::setw(10) << "errors"
+			<< std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "p99.9" << std::setw(10) << "p99.99" << std::setw(10) << "max" << "\n";
+		for(auto& n : name_index)
+		{
+			auto k = n.second;
+			std::cout << std::left << std::setw(12) << n.first << std::right << std::setw(12) << per_command[k].count() << std::setw(10) << per_command_errors[k];
+			print_latency(std::cout, per_command[k]);
+			std::cout << "\n";
+		}
+		std::cout << std::left << std::setw(12) << "all" << std::right << std::setw(12) << total.count() << std::setw(10) << errors;
+		print_latency(std::cout, total);
+		std::cout << "\n";
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << "error: " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ Keyspace snapshot export and restore.
+ dump:    SCAN + pipelined DUMP/PTTL over several connections into an
+          indexed snapshot file.
+ restore: pipelined RESTOREs straight from the memory mapped file,
+          optionally only the keys under a prefix.
+ list:    print the keys in a snapshot.
+
+ hiredis11-snapshot dump|restore|list -f file [-h host] [-p port]
+	[-m prefix] [-c connections] [-b batch] [-r]
+*/
+#include "hiredis.hh"
+#include "snapshot.hh"
+#include <iostream>
+#include <cstdlib>
+#include <chrono>
+
+namespace
+{
+
+void usage_exit(const char* name)
+{
+	std::cerr << "usage: " << name << " dump|restore|list -f file [-h host] [-p port] [-m prefix] [-c connections] [-b batch] [-r]\n"
+		<< "  -r  replace existing keys on restore\n";
+	std::exit(1);
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+	using namespace hiredis;
+
+	if(argc < 2)
+		usage_exit(argv[0]);
+	std::string mode = argv[1];
+	std::string host = "localhost";
+	int port = 6379;
+	std::string file;
+	snapshot::options o;
+
+	for(int i = 2; i < argc; ++i)
+	{
+		std::string arg = argv[i];
+		if(arg == "-r")
+		{
+			o.replace = true;
+			continue;
+		}
+		if(i + 1 >= argc)
+			usage_exit(argv[0]);
+		std::string value = argv[++i];
+		if(arg == "-f")
+			file = value;
+		else if(arg == "-h")
+			host = value;
+		else if(arg == "-p")
+			port = std::atoi(value.c_str());
+		else if(arg == "-m")
+			o.prefix = value;
+		else if(arg == "-c")
+			o.connections = std::max(1, std::atoi(value.c_str()));
+		else if(arg == "-b")
+			o.batch = std::max(1, std::atoi(value.c_str()));
+		else
+			usage_exit(argv[0]);
+	}
+	if(file.empty())
+		usage_exit(argv[0]);
+
+	try
+	{
+		auto start = std::chrono::steady_clock::now();
+		std::size_t keys = 0;
+		if(mode == "dump")
+		{
+			keys = snapshot::dump(host, port, file, o);
+		}
+		else if(mode == "restore")
+		{
+			snapshot::reader r(file);
+			if(!r.complete())
+				std::cerr << "warning: " << file << " was not finished and may be partial\n";
+			keys = snapshot::restore(host, port, r, o);
+		}
+		else if(mode == "list")
+		{
+			snapshot::reader r(file);
+			auto span = r.range(o.prefix);
+			for(auto i = span.first; i < span.second; ++i)
+			{
+				auto rec = r[i];
+				std::cout << rec.key << "\t" << rec.payload.size() << "\t" << rec.expiry << "\n";
+			}
+			return 0;
+		}
+		else
+		{
+			usage_exit(argv[0]);
+		}
+
+		auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::cerr << mode << ": " << keys << " keys in " << seconds << "s\n";
+	}
+	catch(const std::exception& e)
+	{
+		std::cerr << "error: " << e.what() << "\n";
+		return 1;
+	}
+	return 0;
+}
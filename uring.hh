@@ -0,0 +1,490 @@
+#ifndef HIREDIS11_URING_H_
+#define HIREDIS11_URING_H_
+#ifndef HIREDIS11_IO_URING
+#error "uring.hh is included by async.hh when built with HIREDIS11_IO_URING."
+#endif
+#include "async.hh"
+#include "io_ring.hh"
+#include <linux/io_uring.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+namespace hiredis
+{
+
+/*
+ epoll transport for event_loop.
+ Each connection is registered once and only modified when it starts or
+ stops having output, instead of passing every descriptor to the kernel
+ on every iteration as poll() does.
+*/
+class epoll_transport : public event_loop::transport
+{
+private:
+	struct connection
+	{
+		async_context* ac;
+		int fd;
+		std::uint32_t events;
+	};
+
+	int ep;
+	bool wake_added;
+	// Removed while a batch may still refer to them; freed after it.
+	std::vector<connection*> closed;
+
+	static auto state(async_context& ac) -> connection*
+	{
+		return static_cast<connection*>(ac.io);
+	}
+	void control(int op, int fd, std::uint32_t events, void* ptr)
+	{
+		epoll_event e;
+		e.events = events;
+		e.data.ptr = ptr;
+		if(epoll_ctl(ep, op, fd, &e) != 0)
+			throw std::runtime_error(std::string("epoll_ctl: ") + std::strerror(errno));
+	}
+public:
+	epoll_transport()
+	 : ep(epoll_create1(EPOLL_CLOEXEC)), wake_added(false)
+	{
+		if(ep < 0)
+			throw std::runtime_error(std::string("epoll_create1: ") + std::strerror(errno));
+	}
+	~epoll_transport()
+	{
+		close(ep);
+		for(auto c : closed)
+			delete c;
+	}
+
+	auto name() const -> const char* override
+	{
+		return "epoll";
+	}
+	void remove(async_context& ac) override
+	{
+		auto conn = state(ac);
+		if(!conn)
+			return;
+		if(ac.c)
+			epoll_ctl(ep, EPOLL_CTL_DEL, conn->fd, nullptr);
+		conn->ac = nullptr;
+		closed.push_back(conn);
+		ac.io = nullptr;
+	}
+	void wait(event_loop& ev, int timeout) override
+	{
+		if(!wake_added)
+		{
+			control(EPOLL_CTL_ADD, ev.wake[0], EPOLLIN, nullptr);
+			wake_added = true;
+		}
+		for(auto ac : ev.contexts)
+		{
+			if(!ac || !ac->c)
+				continue;
+			auto conn = state(*ac);
+			std::uint32_t events = ac->wants_write() ? EPOLLIN | EPOLLOUT : EPOLLIN;
+			if(!conn)
+			{
+				conn = new connection{ac, ac->c->fd, events};
+				ac->io = conn;
+				control(EPOLL_CTL_ADD, conn->fd, events, conn);
+			}
+			else if(conn->events != events)
+			{
+				conn->events = events;
+				control(EPOLL_CTL_MOD, conn->fd, events, conn);
+			}
+		}
+
+		epoll_event events[256];
+		auto n = epoll_wait(ep, events, 256, timeout);
+		for(int i = 0; i < n; ++i)
+		{
+			auto conn = static_cast<connection*>(events[i].data.ptr);
+			if(!conn)
+			{
+				ev.drain_wake();
+				continue;
+			}
+			// Contexts may be destroyed while dispatching.
+			auto ac = conn->ac;
+			if(!ac)
+				continue;
+			auto revents = events[i].events;
+			if((revents & EPOLLOUT) && ac->wants_write())
+				ac->on_writable();
+			if((revents & (EPOLLIN | EPOLLERR | EPOLLHUP)) && conn->ac && ac->c)
+				ac->on_readable();
+		}
+		for(auto c : closed)
+			delete c;
+		closed.clear();
+	}
+};
+
+/*
+ io_uring transport for event_loop.
+ Every connection keeps a multishot receive armed that lands in buffers
+ provided to the kernel up front, and output is sent straight from the
+ context's buffer. Submissions for all connections, including handing
+ consumed buffers back, are made together with the wait, so an iteration
+ costs one system call however many connections are busy.
+ Needs Linux 6.0 (multishot receive, IOSQE_CQE_SKIP_SUCCESS); the
+ constructor checks for both and throws on older kernels or where
+ io_uring is disabled, so backend::automatic falls back to epoll.
+*/
+class uring_transport : public event_loop::transport
+{
+public:
+	struct options
+	{
+		// Submission queue entries.
+		unsigned entries;
+		// Receive buffers shared by all connections; a power of two.
+		unsigned buffers;
+		std::size_t buffer_size;
+
+		options(unsigned entries = 1024, unsigned buffers = 256, std::size_t buffer_size = 16384)
+		 : entries(entries), buffers(buffers), buffer_size(buffer_size)
+		{
+		}
+	};
+private:
+	enum op : std::uint64_t
+	{
+		op_wake,
+		op_recv,
+		op_send,
+		// Completion is not interesting.
+		op_ignore
+	};
+
+	struct connection
+	{
+		async_context* ac;
+		int fd;
+		// Output in flight; the context keeps buffering into its own.
+		std::string sending;
+		bool receiving;
+		bool writing;
+		bool cancelled;
+	};
+
+	static const std::uint16_t group = 0;
+
+	options o;
+	io_ring ring;
+	// Provided receive buffers.
+	char* buffers;
+
+	bool wake_armed;
+	std::vector<connection*> closed;
+
+	static auto state(async_context& ac) -> connection*
+	{
+		return static_cast<connection*>(ac.io);
+	}
+	static auto tag(connection* conn, op o) -> std::uint64_t
+	{
+		return reinterpret_cast<std::uintptr_t>(conn) | o;
+	}
+
+	// Hand count buffers from id on to the kernel.
+	auto provide(std::uint16_t id, unsigned count) -> io_uring_sqe*
+	{
+		auto sqe = ring.next();
+		sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+		sqe->fd = count;
+		sqe->addr = reinterpret_cast<std::uint64_t>(buffers + id * o.buffer_size);
+		sqe->len = o.buffer_size;
+		sqe->off = id;
+		sqe->buf_group = group;
+		sqe->user_data = op_ignore;
+		return sqe;
+	}
+
+	void receive(int fd, std::uint64_t user_data)
+	{
+		auto sqe = ring.next();
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = fd;
+		sqe->ioprio = IORING_RECV_MULTISHOT;
+		sqe->flags = IOSQE_BUFFER_SELECT;
+		sqe->buf_group = group;
+		sqe->user_data = user_data;
+	}
+	void receive(connection* conn)
+	{
+		receive(conn->fd, tag(conn, op_recv));
+		conn->receiving = true;
+	}
+	// Send whatever the context has buffered, if nothing is in flight.
+	void send(connection* conn)
+	{
+		if(conn->writing)
+			return;
+		if(conn->sending.empty())
+		{
+			if(!conn->ac || conn->ac->out.empty())
+				return;
+			conn->sending.swap(conn->ac->out);
+		}
+		auto sqe = ring.next();
+		sqe->opcode = IORING_OP_SEND;
+		sqe->fd = conn->fd;
+		sqe->addr = reinterpret_cast<std::uint64_t>(conn->sending.data());
+		sqe->len = conn->sending.size();
+		sqe->msg_flags = MSG_NOSIGNAL;
+		sqe->user_data = tag(conn, op_send);
+		conn->writing = true;
+	}
+	void cancel(connection* conn)
+	{
+		if(conn->cancelled)
+			return;
+		conn->cancelled = true;
+		for(auto kind : {op_recv, op_send})
+		{
+			auto sqe = ring.next();
+			sqe->opcode = IORING_OP_ASYNC_CANCEL;
+			sqe->fd = -1;
+			sqe->addr = tag(conn, kind);
+			sqe->user_data = op_ignore;
+		}
+	}
+
+	/*
+	 Multishot receive has no feature flag; kernels before 6.0 reject it
+	 only once a receive is submitted. Try one on a socket pair: it must
+	 deliver a byte and stay armed, then end when the peer closes.
+	*/
+	bool multishot()
+	{
+		int sv[2];
+		if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) != 0)
+			return false;
+		bool ok = false;
+		if(::write(sv[1], "", 1) == 1)
+		{
+			receive(sv[0], op_recv);
+			bool more = true;
+			while(more)
+			{
+				auto cqe = ring.wait();
+				if(cqe.user_data != op_recv)
+					continue;
+				more = cqe.flags & IORING_CQE_F_MORE;
+				if(cqe.flags & IORING_CQE_F_BUFFER)
+				{
+					ok = ok || (cqe.res > 0 && more);
+					provide(static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT), 1)->flags = IOSQE_CQE_SKIP_SUCCESS;
+				}
+				if(more && sv[1] >= 0)
+				{
+					close(sv[1]);
+					sv[1] = -1;
+				}
+			}
+		}
+		close(sv[0]);
+		if(sv[1] >= 0)
+			close(sv[1]);
+		return ok;
+	}
+
+	void complete(const io_uring_cqe& cqe, event_loop& ev)
+	{
+		auto kind = static_cast<op>(cqe.user_data & 7);
+		auto conn = reinterpret_cast<connection*>(cqe.user_data & ~std::uint64_t(7));
+		bool more = cqe.flags & IORING_CQE_F_MORE;
+		switch(kind)
+		{
+			case op_wake:
+				ev.drain_wake();
+				wake_armed = more;
+				return;
+			case op_ignore:
+				return;
+			case op_recv:
+			{
+				conn->receiving = more;
+				auto ac = conn->ac;
+				bool live = ac && ac->c && !conn->cancelled;
+				if(cqe.flags & IORING_CQE_F_BUFFER)
+				{
+					auto id = static_cast<std::uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+					if(live && cqe.res > 0)
+						ac->on_data(buffers + id * o.buffer_size, cqe.res);
+					provide(id, 1)->flags = IOSQE_CQE_SKIP_SUCCESS;
+				}
+				else if(live && cqe.res == 0)
+					ac->fail("Server closed the connection.");
+				// Out of buffers; rearmed on the next iteration.
+				else if(live && cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED)
+					ac->fail(std::strerror(-cqe.res));
+				break;
+			}
+			case op_send:
+			{
+				conn->writing = false;
+				auto ac = conn->ac;
+				if(cqe.res < 0)
+				{
+					conn->sending.clear();
+					if(ac && ac->c && cqe.res != -ECANCELED)
+						ac->fail(std::strerror(-cqe.res));
+				}
+				else
+				{
+					conn->sending.erase(0, cqe.res);
+					if(ac && ac->c)
+						send(conn);
+				}
+				break;
+			}
+		}
+		// Failed contexts close their socket; stop the operations on it.
+		if(conn->ac && !conn->ac->c)
+			cancel(conn);
+	}
+
+	void fail(const char* what, int err)
+	{
+		if(buffers)
+			munmap(buffers, o.buffers * o.buffer_size);
+		throw std::runtime_error(std::string(what) + ": " + std::strerror(err));
+	}
+public:
+	explicit uring_transport(const options& o = options())
+	 : o(o), ring(o.entries), buffers(nullptr), wake_armed(false)
+	{
+		if(!o.buffers || o.buffers > 32768)
+			throw std::invalid_argument("Receive buffer count must be between 1 and 32768");
+		if(!(ring.features() & IORING_FEAT_CQE_SKIP))
+			fail("io_uring features", ENOSYS);
+
+		auto data = mmap(nullptr, o.buffers * o.buffer_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(data == MAP_FAILED)
+			fail("mmap", errno);
+		buffers = static_cast<char*>(data);
+
+		provide(0, o.buffers);
+		auto cqe = ring.wait();
+		if(cqe.res < 0)
+			fail("io_uring provide buffers", -cqe.res);
+		if(!multishot())
+			fail("io_uring multishot receive", EINVAL);
+	}
+	~uring_transport()
+	{
+		if(buffers)
+			munmap(buffers, o.buffers * o.buffer_size);
+		for(auto c : closed)
+			delete c;
+	}
+
+	uring_transport(const uring_transport&) = delete;
+	uring_transport& operator=(const uring_transport&) = delete;
+
+	auto name() const -> const char* override
+	{
+		return "io_uring";
+	}
+	void remove(async_context& ac) override
+	{
+		auto conn = state(ac);
+		if(!conn)
+			return;
+		cancel(conn);
+		conn->ac = nullptr;
+		closed.push_back(conn);
+		ac.io = nullptr;
+	}
+	void wait(event_loop& ev, int timeout) override
+	{
+		if(!wake_armed)
+		{
+			auto sqe = ring.next();
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->fd = ev.wake[0];
+			sqe->poll32_events = POLLIN;
+			sqe->len = IORING_POLL_ADD_MULTI;
+			sqe->user_data = tag(nullptr, op_wake);
+			wake_armed = true;
+		}
+		for(auto ac : ev.contexts)
+		{
+			if(!ac || !ac->c)
+				continue;
+			auto conn = state(*ac);
+			if(!conn)
+			{
+				conn = new connection{ac, ac->c->fd, {}, false, false, false};
+				ac->io = conn;
+			}
+			if(!conn->receiving)
+				receive(conn);
+			send(conn);
+		}
+
+		auto ready = ring.ready();
+		if(ring.pending() || !ready)
+			ring.submit(!ready, timeout);
+
+		io_uring_cqe cqe;
+		while(ring.pop(cqe))
+			complete(cqe, ev);
+
+		// Freed once the kernel is done with them.
+		closed.erase(std::remove_if(begin(closed), end(closed), [](connection* c)
+		{
+			if(c->receiving || c->writing)
+				return false;
+			delete c;
+			return true;
+		}), end(closed));
+	}
+};
+
+inline auto event_loop::make_transport(backend b) -> std::unique_ptr<transport>
+{
+	switch(b)
+	{
+		case backend::poll:
+			return {};
+		case backend::epoll:
+			return std::unique_ptr<transport>(new epoll_transport());
+		case backend::io_uring:
+			return std::unique_ptr<transport>(new uring_transport());
+		case backend::automatic:
+			break;
+	}
+	try
+	{
+		return std::unique_ptr<transport>(new uring_transport());
+	}
+	catch(const std::exception&)
+	{
+		return std::unique_ptr<transport>(new epoll_transport());
+	}
+}
+
+}
+
+#endif /* HIREDIS11_URING_H_ */